@@ -0,0 +1,661 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+// Benchmark is a console program that runs the whole Demo (the same
+// renderer that vkcube.exe runs) for a fixed number of frames, and
+// measures every frame. It can try many settings in one run (a sweep),
+// for example:
+//
+//   Benchmark.exe --sprites 1000,20000,100000 --resolution 640x360,1920x1080
+//                 --frames-in-flight 1,2,3 --mode bindless,classic
+//                 --warmup 60 --frames 600 --out results.csv
+//
+// makes one Demo for every combination of those settings, one after
+// another. For each one, we throw away the warm-up frames (the first
+// frames are slow, because drivers compile shaders and fill caches),
+// and then we record three numbers for each measured frame:
+//   cpu_ms      how long Demo::draw worked, without waiting for fences
+//               or for the swapchain
+//   gpu_ms      how long the GPU took, from GpuTimer
+//   present_ms  time between presents, which is what the user sees
+//   overdraw    fragment shaders per pixel, if the GPU has pipeline
+//               statistics (see Demo::overdraw)
+// Then we write the mean, standard deviation, median (p50), p95, p99
+// and maximum of each one, as CSV or JSON.
+//
+// Two result files (CSV or JSON, or one of each) can be compared:
+//
+//   Benchmark.exe --compare base.csv new.csv --threshold 0.05
+//
+// which prints every row where the new result is worse than the old
+// one, and returns 1 if there are any, so that a script can stop.
+// It still needs a window (a real swapchain), because present times
+// can't be measured without one
+
+#include "Demo.h"
+#include "Helper.h"
+#include "Main.h"
+#include "Profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+// Demo.cpp creates the window with this WndProc,
+// vkcube.exe has its own in Main.cpp. The benchmark
+// does not need keys, and the window is never resized
+LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+	return (DefWindowProc(hWnd, uMsg, wParam, lParam));
+}
+
+// A case gives up if no frame could be counted for this long:
+// a texture that never stops loading, or a window that was
+// minimized (nothing is drawn then) would otherwise spin forever
+#define BENCHMARK_STALL_SECONDS 30.0
+
+// same as ERR_EXIT, but for a console program
+#define BENCHMARK_FAIL(msg)   \
+	do {                      \
+		printf("%s\n", msg);  \
+		fflush(stdout);       \
+		exit(2);              \
+	} while (0)
+
+// One combination of settings that we run
+struct BenchmarkCase
+{
+	uint32_t sprites;
+	int width;
+	int height;
+	uint32_t frames_in_flight;
+	bool bindless;
+};
+
+// The numbers we write for one measured value
+// (like cpu_ms) of one BenchmarkCase
+struct BenchmarkStats
+{
+	uint32_t n;
+	double mean;
+	double stddev;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+};
+
+// One row of a result file
+struct BenchmarkRow
+{
+	BenchmarkCase c;
+	std::string metric;
+	BenchmarkStats s;
+};
+
+// p is between 0 and 1, "sorted" must be sorted. This picks the
+// nearest sample (no interpolation), which is how most frame
+// time tools report percentiles
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+
+	size_t index = (size_t)ceil(p * sorted.size());
+	if (index > 0) index--;
+	if (index >= sorted.size()) index = sorted.size() - 1;
+	return sorted[index];
+}
+
+static BenchmarkStats Summarize(std::vector<double> samples)
+{
+	BenchmarkStats s = {};
+	s.n = (uint32_t)samples.size();
+	if (samples.empty())
+		return s;
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (double v : samples)
+		sum += v;
+	s.mean = sum / samples.size();
+
+	// sample standard deviation (n - 1), compare mode needs it
+	double squares = 0.0;
+	for (double v : samples)
+		squares += (v - s.mean) * (v - s.mean);
+	s.stddev = samples.size() > 1 ? sqrt(squares / (samples.size() - 1)) : 0.0;
+
+	s.p50 = Percentile(samples, 0.50);
+	s.p95 = Percentile(samples, 0.95);
+	s.p99 = Percentile(samples, 0.99);
+	s.max = samples.back();
+	return s;
+}
+
+// Turns "1,2,3" into {"1", "2", "3"}
+static std::vector<std::string> SplitList(const char* text)
+{
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* c = text; ; c++)
+	{
+		if (*c == ',' || *c == '\0')
+		{
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (*c == '\0')
+				break;
+		}
+		else
+			item += *c;
+	}
+	return items;
+}
+
+// Run one BenchmarkCase, and add three rows to "rows"
+static void RunCase(const BenchmarkCase& c, uint32_t warmupFrames, uint32_t measuredFrames,
+	VkPresentModeKHR presentMode, bool validate, std::vector<BenchmarkRow>& rows)
+{
+	printf("%u sprites, %dx%d, %u frames in flight, %s: ",
+		c.sprites, c.width, c.height, c.frames_in_flight, c.bindless ? "bindless" : "classic");
+	fflush(stdout);
+
+	DemoSettings settings;
+	settings.width = c.width;
+	settings.height = c.height;
+	settings.frame_lag = c.frames_in_flight;
+	settings.sprite_count = c.sprites;
+	settings.allow_bindless = c.bindless;
+	settings.present_mode = presentMode;
+	settings.make_console = false;
+	settings.validate = validate;
+
+	Demo* demo = new Demo(settings);
+
+	// If the GPU can't do bindless, Demo quietly uses classic,
+	// which would make the results lie, so we skip the case
+	if (c.bindless && !demo->bindless)
+	{
+		printf("skipped, bindless is not supported\n");
+		fflush(stdout);
+		delete demo;
+		return;
+	}
+
+	std::vector<double> cpu;
+	std::vector<double> gpu;
+	std::vector<double> present;
+	std::vector<double> overdraw;
+	cpu.reserve(measuredFrames);
+	gpu.reserve(measuredFrames);
+	present.reserve(measuredFrames);
+
+	// Textures load on other threads, and the first frames would be
+	// measured while they are still uploading, so we draw (without
+	// measuring) until every texture is ready, before the warm-up
+	uint32_t frame = 0;
+	auto lastCounted = std::chrono::steady_clock::now();
+
+	while (frame < warmupFrames + measuredFrames)
+	{
+		MSG msg = {};
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+			DispatchMessage(&msg);
+
+		demo->run();
+
+		// A minimized window draws nothing, and a frame drawn
+		// while textures are loading does not count either
+		bool loading = demo->texture_loader != nullptr && demo->texture_loader->Pending() > 0;
+
+		if (loading || !demo->prepared || demo->is_minimized)
+		{
+			double stalled = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCounted).count();
+			if (stalled > BENCHMARK_STALL_SECONDS)
+			{
+				printf("skipped, no frame for %.0f seconds (%s)\n", BENCHMARK_STALL_SECONDS,
+					loading ? "textures are still loading" : "the window is minimized");
+				fflush(stdout);
+				delete demo;
+				return;
+			}
+			continue;
+		}
+
+		lastCounted = std::chrono::steady_clock::now();
+
+		if (frame >= warmupFrames)
+		{
+			cpu.push_back(demo->cpu_frame_ms);
+
+			// the first present interval after the warm-up
+			// is fine, because the warm-up frames were presented
+			present.push_back(demo->present_interval_ms);
+
+			// GPU times arrive a few frames late, and
+			// only if timestamps are supported
+			if (demo->gpu_timer != nullptr && demo->gpu_timer->updated)
+			{
+				gpu.push_back(demo->gpu_timer->frameMs);
+
+				// fragments per pixel, if the device
+				// has pipeline statistics
+				if (demo->gpu_timer->statisticsEnabled)
+					overdraw.push_back(demo->overdraw());
+			}
+		}
+
+		frame++;
+	}
+
+	delete demo;
+
+	BenchmarkRow row;
+	row.c = c;
+
+	row.metric = "cpu_ms";
+	row.s = Summarize(cpu);
+	rows.push_back(row);
+
+	row.metric = "gpu_ms";
+	row.s = Summarize(gpu);
+	rows.push_back(row);
+
+	row.metric = "present_ms";
+	row.s = Summarize(present);
+	rows.push_back(row);
+
+	printf("cpu p99 %.3f ms, gpu p99 %.3f ms, present p99 %.3f ms\n",
+		rows[rows.size() - 3].s.p99, rows[rows.size() - 2].s.p99, rows[rows.size() - 1].s.p99);
+	fflush(stdout);
+
+	// not a time, but more overdraw is worse too,
+	// so --compare treats it the same way
+	if (!overdraw.empty())
+	{
+		row.metric = "overdraw";
+		row.s = Summarize(overdraw);
+		rows.push_back(row);
+	}
+}
+
+// "Long" CSV, one row for each case and metric. This is easy
+// to open in a spreadsheet, and easy for compare mode to read
+static void WriteCsv(FILE* f, const std::vector<BenchmarkRow>& rows)
+{
+	fprintf(f, "sprites,width,height,frames_in_flight,mode,metric,n,mean,stddev,p50,p95,p99,max\n");
+	for (const BenchmarkRow& r : rows)
+	{
+		fprintf(f, "%u,%d,%d,%u,%s,%s,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+			r.c.sprites, r.c.width, r.c.height, r.c.frames_in_flight,
+			r.c.bindless ? "bindless" : "classic", r.metric.c_str(),
+			r.s.n, r.s.mean, r.s.stddev, r.s.p50, r.s.p95, r.s.p99, r.s.max);
+	}
+}
+
+static void WriteJson(FILE* f, const std::vector<BenchmarkRow>& rows)
+{
+	fprintf(f, "[\n");
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		const BenchmarkRow& r = rows[i];
+		fprintf(f, "  {\"sprites\": %u, \"width\": %d, \"height\": %d, \"frames_in_flight\": %u, "
+			"\"mode\": \"%s\", \"metric\": \"%s\", \"n\": %u, \"mean\": %.6f, \"stddev\": %.6f, "
+			"\"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f}%s\n",
+			r.c.sprites, r.c.width, r.c.height, r.c.frames_in_flight,
+			r.c.bindless ? "bindless" : "classic", r.metric.c_str(),
+			r.s.n, r.s.mean, r.s.stddev, r.s.p50, r.s.p95, r.s.p99, r.s.max,
+			i + 1 < rows.size() ? "," : "");
+	}
+	fprintf(f, "]\n");
+}
+
+// Reads a file that WriteCsv wrote, after its header line
+static std::vector<BenchmarkRow> ReadCsv(FILE* f)
+{
+	std::vector<BenchmarkRow> rows;
+	char line[512];
+
+	while (fgets(line, sizeof(line), f))
+	{
+		BenchmarkRow r;
+		char mode[32];
+		char metric[32];
+
+		int read = sscanf(line, "%u,%d,%d,%u,%31[^,],%31[^,],%u,%lf,%lf,%lf,%lf,%lf,%lf",
+			&r.c.sprites, &r.c.width, &r.c.height, &r.c.frames_in_flight, mode, metric,
+			&r.s.n, &r.s.mean, &r.s.stddev, &r.s.p50, &r.s.p95, &r.s.p99, &r.s.max);
+
+		if (read != 13)
+			continue;
+
+		r.c.bindless = strcmp(mode, "bindless") == 0;
+		r.metric = metric;
+		rows.push_back(r);
+	}
+
+	return rows;
+}
+
+// Reads a file that WriteJson wrote, after its "[" line.
+// WriteJson puts every row on its own line, with the keys
+// always in the same order, so each line is read like a
+// CSV line, with the keys as part of the format
+static std::vector<BenchmarkRow> ReadJson(FILE* f)
+{
+	std::vector<BenchmarkRow> rows;
+	char line[512];
+
+	while (fgets(line, sizeof(line), f))
+	{
+		BenchmarkRow r;
+		char mode[32];
+		char metric[32];
+
+		int read = sscanf(line, " {\"sprites\": %u, \"width\": %d, \"height\": %d, \"frames_in_flight\": %u, "
+			"\"mode\": \"%31[^\"]\", \"metric\": \"%31[^\"]\", \"n\": %u, \"mean\": %lf, \"stddev\": %lf, "
+			"\"p50\": %lf, \"p95\": %lf, \"p99\": %lf, \"max\": %lf",
+			&r.c.sprites, &r.c.width, &r.c.height, &r.c.frames_in_flight, mode, metric,
+			&r.s.n, &r.s.mean, &r.s.stddev, &r.s.p50, &r.s.p95, &r.s.p99, &r.s.max);
+
+		if (read != 13)
+			continue;
+
+		r.c.bindless = strcmp(mode, "bindless") == 0;
+		r.metric = metric;
+		rows.push_back(r);
+	}
+
+	return rows;
+}
+
+// Reads a result file, CSV or JSON. The first line tells us
+// which one it is: JSON starts with "[", CSV with its header
+static std::vector<BenchmarkRow> ReadResults(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (f == nullptr)
+	{
+		printf("Could not open %s\n", path);
+		fflush(stdout);
+		exit(2);
+	}
+
+	std::vector<BenchmarkRow> rows;
+	char line[512];
+
+	if (fgets(line, sizeof(line), f) == nullptr)
+	{
+		// empty file, nothing to read
+	}
+	else if (line[0] == '[')
+	{
+		rows = ReadJson(f);
+	}
+	else if (strncmp(line, "sprites,", 8) == 0)
+	{
+		rows = ReadCsv(f);
+	}
+
+	fclose(f);
+
+	if (rows.empty())
+	{
+		printf("%s has no results, it is not a CSV or JSON file that Benchmark wrote\n", path);
+		fflush(stdout);
+		exit(2);
+	}
+
+	return rows;
+}
+
+// Compare every row of "newPath" with the same row of "basePath".
+// A row is a regression when both of these are true:
+//  - the mean got worse by more than "threshold" (0.05 is 5%), so
+//    that tiny changes don't count, even if they are real
+//  - Welch's t-test says the change is bigger than noise: t is the
+//    difference of the means divided by how much the means wobble,
+//    and |t| > 1.96 means there is less than a 5% chance that two
+//    runs of the same program would be this different
+// For a metric where there are no samples (no GPU timer), we skip
+static int Compare(const char* basePath, const char* newPath, double threshold)
+{
+	std::vector<BenchmarkRow> base = ReadResults(basePath);
+	std::vector<BenchmarkRow> next = ReadResults(newPath);
+
+	int regressions = 0;
+	int compared = 0;
+
+	for (const BenchmarkRow& n : next)
+	{
+		for (const BenchmarkRow& b : base)
+		{
+			if (b.c.sprites != n.c.sprites || b.c.width != n.c.width || b.c.height != n.c.height ||
+				b.c.frames_in_flight != n.c.frames_in_flight || b.c.bindless != n.c.bindless ||
+				b.metric != n.metric)
+				continue;
+
+			if (b.s.n < 2 || n.s.n < 2 || b.s.mean <= 0.0)
+				break;
+
+			compared++;
+
+			double change = (n.s.mean - b.s.mean) / b.s.mean;
+			double error = sqrt(b.s.stddev * b.s.stddev / b.s.n + n.s.stddev * n.s.stddev / n.s.n);
+			double t = error > 0.0 ? (n.s.mean - b.s.mean) / error : 0.0;
+
+			bool significant = fabs(t) > 1.96;
+			bool regressed = significant && change > threshold;
+			bool improved = significant && change < -threshold;
+
+			if (regressed || improved)
+			{
+				// every metric is in ms, except overdraw
+				const char* unit = n.metric == "overdraw" ? "" : " ms";
+
+				printf("%s %u sprites, %dx%d, %u frames in flight, %s, %s: %.3f -> %.3f%s (%+.1f%%, t = %.2f)\n",
+					regressed ? "REGRESSION" : "improved  ",
+					n.c.sprites, n.c.width, n.c.height, n.c.frames_in_flight,
+					n.c.bindless ? "bindless" : "classic", n.metric.c_str(),
+					b.s.mean, n.s.mean, unit, change * 100.0, t);
+			}
+
+			if (regressed)
+				regressions++;
+			break;
+		}
+	}
+
+	printf("%d results compared, %d regressions\n", compared, regressions);
+	fflush(stdout);
+
+	return regressions > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t warmupFrames = 60;
+	uint32_t measuredFrames = 600;
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+	const char* outPath = "benchmark.csv";
+	bool json = false;
+
+	// Validation makes every Vulkan call slower, so it is off,
+	// unless VKCUBE_VALIDATION=1 or --validation on
+	bool validate = Helper::env_flag("VKCUBE_VALIDATION", false);
+
+	std::vector<uint32_t> sprites = { SPRITE_COUNT };
+	std::vector<std::pair<int, int>> resolutions = { { 640, 360 } };
+	std::vector<uint32_t> framesInFlight = { FRAME_LAG };
+	std::vector<bool> modes = { true };
+
+	// every option has one value after it,
+	// except --compare, which has two
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+
+		if (strcmp(arg, "--compare") == 0)
+		{
+			if (i + 2 >= argc)
+				BENCHMARK_FAIL("--compare needs two files");
+
+			double threshold = 0.05;
+			for (int j = i + 3; j + 1 < argc; j++)
+			{
+				if (strcmp(argv[j], "--threshold") == 0)
+					threshold = atof(argv[j + 1]);
+			}
+
+			return Compare(argv[i + 1], argv[i + 2], threshold);
+		}
+
+		if (i + 1 >= argc)
+		{
+			printf("%s needs a value\n", arg);
+			fflush(stdout);
+			return 2;
+		}
+
+		const char* value = argv[++i];
+
+		if (strcmp(arg, "--warmup") == 0)
+			warmupFrames = (uint32_t)atoi(value);
+
+		else if (strcmp(arg, "--frames") == 0)
+			measuredFrames = (uint32_t)atoi(value);
+
+		else if (strcmp(arg, "--sprites") == 0)
+		{
+			sprites.clear();
+			for (const std::string& s : SplitList(value))
+				sprites.push_back((uint32_t)atoi(s.c_str()));
+		}
+
+		else if (strcmp(arg, "--resolution") == 0)
+		{
+			resolutions.clear();
+			for (const std::string& s : SplitList(value))
+			{
+				int w = 0;
+				int h = 0;
+				if (sscanf(s.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+					BENCHMARK_FAIL("--resolution looks like 1920x1080");
+				resolutions.push_back(std::make_pair(w, h));
+			}
+		}
+
+		else if (strcmp(arg, "--frames-in-flight") == 0)
+		{
+			framesInFlight.clear();
+			for (const std::string& s : SplitList(value))
+			{
+				uint32_t count = (uint32_t)atoi(s.c_str());
+				if (count < 1 || count > MAX_FRAME_LAG)
+					BENCHMARK_FAIL("--frames-in-flight must be between 1 and MAX_FRAME_LAG");
+				framesInFlight.push_back(count);
+			}
+		}
+
+		else if (strcmp(arg, "--mode") == 0)
+		{
+			modes.clear();
+			for (const std::string& s : SplitList(value))
+			{
+				if (s == "bindless") modes.push_back(true);
+				else if (s == "classic") modes.push_back(false);
+				else BENCHMARK_FAIL("--mode is bindless or classic");
+			}
+		}
+
+		// immediate is the default, because FIFO would
+		// make every present_ms the refresh rate of the monitor
+		else if (strcmp(arg, "--present") == 0)
+		{
+			if (strcmp(value, "fifo") == 0) presentMode = VK_PRESENT_MODE_FIFO_KHR;
+			else if (strcmp(value, "mailbox") == 0) presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+			else if (strcmp(value, "immediate") == 0) presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			else BENCHMARK_FAIL("--present is fifo, mailbox or immediate");
+		}
+
+		else if (strcmp(arg, "--validation") == 0)
+			validate = strcmp(value, "on") == 0;
+
+		else if (strcmp(arg, "--out") == 0)
+			outPath = value;
+
+		else if (strcmp(arg, "--format") == 0)
+			json = strcmp(value, "json") == 0;
+
+		else
+		{
+			printf("Unknown option %s\n", arg);
+			fflush(stdout);
+			return 2;
+		}
+	}
+
+	PROFILE_THREAD_NAME("Main");
+
+	// Every combination of every setting
+	std::vector<BenchmarkRow> rows;
+	for (uint32_t s : sprites)
+		for (const std::pair<int, int>& r : resolutions)
+			for (uint32_t f : framesInFlight)
+				for (bool b : modes)
+				{
+					BenchmarkCase c;
+					c.sprites = s;
+					c.width = r.first;
+					c.height = r.second;
+					c.frames_in_flight = f;
+					c.bindless = b;
+					RunCase(c, warmupFrames, measuredFrames, presentMode, validate, rows);
+				}
+
+	FILE* f = fopen(outPath, "w");
+	if (f == nullptr)
+		BENCHMARK_FAIL("Could not open the output file");
+
+	if (json)
+		WriteJson(f, rows);
+	else
+		WriteCsv(f, rows);
+
+	fclose(f);
+
+	printf("Wrote %u results to %s\n", (uint32_t)rows.size(), outPath);
+	fflush(stdout);
+
+	return 0;
+}
@@ -0,0 +1,912 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "BlockCompression.h"
+#include <string.h>
+
+#define ASTC(w, h) \
+	{ VK_FORMAT_ASTC_##w##x##h##_UNORM_BLOCK, BLOCK_FAMILY_ASTC, w, h, 16, true, false }, \
+	{ VK_FORMAT_ASTC_##w##x##h##_SRGB_BLOCK, BLOCK_FAMILY_ASTC, w, h, 16, true, true }
+
+static const BlockFormat block_formats[] =
+{
+	{ VK_FORMAT_BC1_RGB_UNORM_BLOCK, BLOCK_FAMILY_BC1, 4, 4, 8, false, false },
+	{ VK_FORMAT_BC1_RGB_SRGB_BLOCK, BLOCK_FAMILY_BC1, 4, 4, 8, false, true },
+	{ VK_FORMAT_BC1_RGBA_UNORM_BLOCK, BLOCK_FAMILY_BC1, 4, 4, 8, true, false },
+	{ VK_FORMAT_BC1_RGBA_SRGB_BLOCK, BLOCK_FAMILY_BC1, 4, 4, 8, true, true },
+	{ VK_FORMAT_BC3_UNORM_BLOCK, BLOCK_FAMILY_BC3, 4, 4, 16, true, false },
+	{ VK_FORMAT_BC3_SRGB_BLOCK, BLOCK_FAMILY_BC3, 4, 4, 16, true, true },
+	{ VK_FORMAT_BC7_UNORM_BLOCK, BLOCK_FAMILY_BC7, 4, 4, 16, true, false },
+	{ VK_FORMAT_BC7_SRGB_BLOCK, BLOCK_FAMILY_BC7, 4, 4, 16, true, true },
+	{ VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, BLOCK_FAMILY_ETC2_RGB, 4, 4, 8, false, false },
+	{ VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, BLOCK_FAMILY_ETC2_RGB, 4, 4, 8, false, true },
+	{ VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, BLOCK_FAMILY_ETC2_RGBA, 4, 4, 16, true, false },
+	{ VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, BLOCK_FAMILY_ETC2_RGBA, 4, 4, 16, true, true },
+	ASTC(4, 4), ASTC(5, 4), ASTC(5, 5), ASTC(6, 5), ASTC(6, 6),
+	ASTC(8, 5), ASTC(8, 6), ASTC(8, 8),
+	ASTC(10, 5), ASTC(10, 6), ASTC(10, 8), ASTC(10, 10),
+	ASTC(12, 10), ASTC(12, 12)
+};
+
+#undef ASTC
+
+const BlockFormat* BlockCompression::Find(VkFormat format)
+{
+	for (size_t i = 0; i < sizeof(block_formats) / sizeof(block_formats[0]); i++)
+		if (block_formats[i].format == format)
+			return &block_formats[i];
+
+	return nullptr;
+}
+
+uint64_t BlockCompression::LevelSize(const BlockFormat* block, uint32_t width, uint32_t height)
+{
+	// a level that is not a multiple of the block size
+	// still needs a whole block for the pixels at the edge
+	uint64_t blocksX = (width + block->blockWidth - 1) / block->blockWidth;
+	uint64_t blocksY = (height + block->blockHeight - 1) / block->blockHeight;
+	return blocksX * blocksY * block->bytesPerBlock;
+}
+
+static uint8_t clamp_byte(int value)
+{
+	return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// BC1, BC3
+// =======================================
+
+// 5 bits of red, 6 of green, 5 of blue, to 8 bits each.
+// The top bits are copied into the bottom bits, so
+// that 31 becomes 255, not 248
+static void unpack_565(uint16_t c, uint8_t* rgb)
+{
+	uint8_t r = (c >> 11) & 31;
+	uint8_t g = (c >> 5) & 63;
+	uint8_t b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The color part of BC1 and BC3: two colors, two more colors
+// in between them, and a 2-bit index for every pixel.
+// In BC1, if color0 <= color1, there is only one color in
+// between, and index 3 is transparent black. BC3 always
+// uses the four color mode
+static void decode_bc1_colors(const uint8_t* block, bool fourColorsOnly, uint8_t out[16][4])
+{
+	uint16_t c0 = block[0] | (block[1] << 8);
+	uint16_t c1 = block[2] | (block[3] << 8);
+	uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+	uint8_t palette[4][4];
+	unpack_565(c0, palette[0]);
+	unpack_565(c1, palette[1]);
+	palette[0][3] = 255;
+	palette[1][3] = 255;
+
+	for (int c = 0; c < 3; c++)
+	{
+		if (c0 > c1 || fourColorsOnly)
+		{
+			palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		else
+		{
+			palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+			palette[3][c] = 0;
+		}
+	}
+
+	palette[2][3] = 255;
+	palette[3][3] = (c0 > c1 || fourColorsOnly) ? 255 : 0;
+
+	for (int i = 0; i < 16; i++)
+		memcpy(out[i], palette[(indices >> (2 * i)) & 3], 4);
+}
+
+// The alpha part of BC3: two alphas, six more in between (or
+// four in between, plus 0 and 255), and a 3-bit index per pixel
+static void decode_bc3_alpha(const uint8_t* block, uint8_t out[16][4])
+{
+	int a0 = block[0];
+	int a1 = block[1];
+
+	uint8_t palette[8];
+	palette[0] = (uint8_t)a0;
+	palette[1] = (uint8_t)a1;
+
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1) / 7);
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+			palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	// 48 bits of indices, 3 bits per pixel
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (uint64_t)block[2 + i] << (8 * i);
+
+	for (int i = 0; i < 16; i++)
+		out[i][3] = palette[(indices >> (3 * i)) & 7];
+}
+
+// BC7
+// =======================================
+
+// Reads bits from the block, starting at bit 0 of byte 0
+struct BitReader
+{
+	const uint8_t* data;
+	uint32_t position;
+
+	uint32_t Read(uint32_t count)
+	{
+		uint32_t value = 0;
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t bit = (data[position >> 3] >> (position & 7)) & 1;
+			value |= bit << i;
+			position++;
+		}
+
+		return value;
+	}
+};
+
+struct Bc7Mode
+{
+	uint32_t subsets;
+	uint32_t partitionBits;
+	uint32_t rotationBits;
+	uint32_t indexSelectionBits;
+	uint32_t colorBits;
+	uint32_t alphaBits;
+	uint32_t endpointPBits;
+	uint32_t sharedPBits;
+	uint32_t indexBits;
+	uint32_t secondaryIndexBits;
+};
+
+static const Bc7Mode bc7_modes[8] =
+{
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+};
+
+// Which subset every pixel is in, for the 64 two-subset
+// shapes. Bit i is the subset of pixel i
+static const uint16_t bc7_partitions2[64] =
+{
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+
+// The same for the 64 three-subset shapes,
+// bits 2i and 2i+1 are the subset of pixel i
+static const uint32_t bc7_partitions3[64] =
+{
+	0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+	0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+	0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+	0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+	0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+	0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+	0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+	0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+};
+
+// The first pixel of every subset (the "anchor") has one less
+// index bit, because the encoder always makes its top bit 0.
+// Subset 0 always starts at pixel 0, these are the others
+static const uint8_t bc7_anchor2[64] =
+{
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static const uint8_t bc7_anchor3_second[64] =
+{
+	 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+	 3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+	 8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+	 3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+};
+
+static const uint8_t bc7_anchor3_third[64] =
+{
+	15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+	15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+	15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+	15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+};
+
+// how far from endpoint 0 to endpoint 1, out of 64
+static const uint8_t bc7_weights2[4] = { 0, 21, 43, 64 };
+static const uint8_t bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static const uint8_t* bc7_weights(uint32_t bits)
+{
+	if (bits == 2) return bc7_weights2;
+	if (bits == 3) return bc7_weights3;
+	return bc7_weights4;
+}
+
+static uint32_t bc7_subset(uint32_t subsets, uint32_t partition, uint32_t pixel)
+{
+	if (subsets == 2) return (bc7_partitions2[partition] >> pixel) & 1;
+	if (subsets == 3) return (bc7_partitions3[partition] >> (2 * pixel)) & 3;
+	return 0;
+}
+
+static bool bc7_is_anchor(uint32_t subsets, uint32_t partition, uint32_t pixel)
+{
+	if (pixel == 0) return true;
+	if (subsets == 2) return pixel == bc7_anchor2[partition];
+	if (subsets == 3) return pixel == bc7_anchor3_second[partition] || pixel == bc7_anchor3_third[partition];
+	return false;
+}
+
+static void decode_bc7(const uint8_t* block, uint8_t out[16][4])
+{
+	BitReader bits = { block, 0 };
+
+	// The mode is the number of 0 bits before the first 1 bit
+	uint32_t mode = 0;
+	while (mode < 8 && bits.Read(1) == 0)
+		mode++;
+
+	// a block with no 1 in the first byte is not valid,
+	// the format says to make it transparent black
+	if (mode == 8)
+	{
+		memset(out, 0, 16 * 4);
+		return;
+	}
+
+	const Bc7Mode& m = bc7_modes[mode];
+
+	uint32_t partition = bits.Read(m.partitionBits);
+	uint32_t rotation = bits.Read(m.rotationBits);
+	uint32_t indexSelection = bits.Read(m.indexSelectionBits);
+
+	// All of the reds come first (two per subset),
+	// then all of the greens, blues, and alphas
+	uint32_t endpoints[6][4] = {};
+	uint32_t endpointCount = m.subsets * 2;
+
+	for (uint32_t c = 0; c < 3; c++)
+		for (uint32_t e = 0; e < endpointCount; e++)
+			endpoints[e][c] = bits.Read(m.colorBits);
+
+	for (uint32_t e = 0; e < endpointCount; e++)
+		endpoints[e][3] = m.alphaBits ? bits.Read(m.alphaBits) : 255;
+
+	// P-bits are one more low bit for every channel, either
+	// one per endpoint, or one shared by both endpoints of a subset
+	uint32_t colorPrecision = m.colorBits;
+	uint32_t alphaPrecision = m.alphaBits;
+
+	if (m.endpointPBits || m.sharedPBits)
+	{
+		uint32_t pbits[6];
+
+		if (m.endpointPBits)
+		{
+			for (uint32_t e = 0; e < endpointCount; e++)
+				pbits[e] = bits.Read(1);
+		}
+		else
+		{
+			for (uint32_t s = 0; s < m.subsets; s++)
+				pbits[2 * s] = pbits[2 * s + 1] = bits.Read(1);
+		}
+
+		for (uint32_t e = 0; e < endpointCount; e++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+				endpoints[e][c] = (endpoints[e][c] << 1) | pbits[e];
+
+			if (m.alphaBits)
+				endpoints[e][3] = (endpoints[e][3] << 1) | pbits[e];
+		}
+
+		colorPrecision++;
+		if (m.alphaBits)
+			alphaPrecision++;
+	}
+
+	// Make every endpoint 8 bits, by copying the top bits into the bottom
+	for (uint32_t e = 0; e < endpointCount; e++)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			uint32_t v = endpoints[e][c] << (8 - colorPrecision);
+			endpoints[e][c] = v | (v >> colorPrecision);
+		}
+
+		if (m.alphaBits)
+		{
+			uint32_t v = endpoints[e][3] << (8 - alphaPrecision);
+			endpoints[e][3] = v | (v >> alphaPrecision);
+		}
+	}
+
+	// Indices, one per pixel, one bit shorter for the anchors.
+	// Modes 4 and 5 have a second set of indices for alpha
+	uint32_t indices[16];
+	uint32_t secondary[16] = {};
+
+	for (uint32_t i = 0; i < 16; i++)
+		indices[i] = bits.Read(m.indexBits - (bc7_is_anchor(m.subsets, partition, i) ? 1 : 0));
+
+	if (m.secondaryIndexBits)
+	{
+		for (uint32_t i = 0; i < 16; i++)
+			secondary[i] = bits.Read(m.secondaryIndexBits - (i == 0 ? 1 : 0));
+	}
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint32_t subset = bc7_subset(m.subsets, partition, i);
+		const uint32_t* e0 = endpoints[2 * subset];
+		const uint32_t* e1 = endpoints[2 * subset + 1];
+
+		uint32_t colorWeight;
+		uint32_t alphaWeight;
+
+		if (m.secondaryIndexBits == 0)
+		{
+			colorWeight = bc7_weights(m.indexBits)[indices[i]];
+			alphaWeight = colorWeight;
+		}
+		else if (indexSelection == 0)
+		{
+			colorWeight = bc7_weights(m.indexBits)[indices[i]];
+			alphaWeight = bc7_weights(m.secondaryIndexBits)[secondary[i]];
+		}
+		else
+		{
+			colorWeight = bc7_weights(m.secondaryIndexBits)[secondary[i]];
+			alphaWeight = bc7_weights(m.indexBits)[indices[i]];
+		}
+
+		for (uint32_t c = 0; c < 3; c++)
+			out[i][c] = (uint8_t)(((64 - colorWeight) * e0[c] + colorWeight * e1[c] + 32) >> 6);
+
+		out[i][3] = (uint8_t)(((64 - alphaWeight) * e0[3] + alphaWeight * e1[3] + 32) >> 6);
+
+		// the rotation swaps alpha with one of the colors
+		if (rotation != 0)
+		{
+			uint8_t temp = out[i][3];
+			out[i][3] = out[i][rotation - 1];
+			out[i][rotation - 1] = temp;
+		}
+	}
+}
+
+// ETC2
+// =======================================
+
+// ETC blocks are stored big-endian, and the pixels
+// are numbered down each column: pixel k is at
+// x = k / 4, y = k % 4
+
+static const int etc_modifiers[8][2] =
+{
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+	{ 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+static const int etc_distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+static const int eac_modifiers[16][8] =
+{
+	{ -3, -6, -9, -15, 2, 5, 8, 14 },
+	{ -3, -7, -10, -13, 2, 6, 9, 12 },
+	{ -2, -5, -8, -13, 1, 4, 7, 12 },
+	{ -2, -4, -6, -13, 1, 3, 5, 12 },
+	{ -3, -6, -8, -12, 2, 5, 7, 11 },
+	{ -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 },
+	{ -3, -5, -8, -11, 2, 4, 7, 10 },
+	{ -2, -6, -8, -10, 1, 5, 7, 9 },
+	{ -2, -5, -8, -10, 1, 4, 7, 9 },
+	{ -2, -4, -8, -10, 1, 3, 7, 9 },
+	{ -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },
+	{ -1, -2, -3, -10, 0, 1, 2, 9 },
+	{ -4, -6, -8, -9, 3, 5, 7, 8 },
+	{ -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+static uint8_t extend_4(int v) { return (uint8_t)((v << 4) | v); }
+static uint8_t extend_5(int v) { return (uint8_t)((v << 3) | (v >> 2)); }
+static uint8_t extend_6(int v) { return (uint8_t)((v << 2) | (v >> 4)); }
+static uint8_t extend_7(int v) { return (uint8_t)((v << 1) | (v >> 6)); }
+
+// 3-bit two's complement, -4 to 3
+static int signed_3(int v) { return v >= 4 ? v - 8 : v; }
+
+// the 2-bit index of pixel k, from the low 32 bits of the block
+static int etc_index(uint32_t low, int k)
+{
+	return (((low >> (k + 16)) & 1) << 1) | ((low >> k) & 1);
+}
+
+static void decode_etc2_rgb(const uint8_t* block, uint8_t out[16][4])
+{
+	uint32_t low = ((uint32_t)block[4] << 24) | (block[5] << 16) | (block[6] << 8) | block[7];
+	bool diff = (block[3] & 2) != 0;
+	bool flip = (block[3] & 1) != 0;
+
+	int base[2][3];
+
+	if (!diff)
+	{
+		// individual mode, two 4-bit colors
+		for (int c = 0; c < 3; c++)
+		{
+			base[0][c] = extend_4(block[c] >> 4);
+			base[1][c] = extend_4(block[c] & 15);
+		}
+	}
+	else
+	{
+		// differential mode, a 5-bit color and a 3-bit difference.
+		// If the second color goes past 0 or 31, the block is in
+		// one of the three ETC2 modes instead (T, H, or planar)
+		int c1[3], c2[3];
+		for (int c = 0; c < 3; c++)
+		{
+			c1[c] = block[c] >> 3;
+			c2[c] = c1[c] + signed_3(block[c] & 7);
+		}
+
+		if (c2[0] < 0 || c2[0] > 31)
+		{
+			// T mode: one color, and three colors around a second one
+			int r1 = (((block[0] >> 3) & 3) << 2) | (block[0] & 3);
+			int g1 = block[1] >> 4;
+			int b1 = block[1] & 15;
+			int r2 = block[2] >> 4;
+			int g2 = block[2] & 15;
+			int b2 = block[3] >> 4;
+			int d = etc_distances[(((block[3] >> 2) & 3) << 1) | (block[3] & 1)];
+
+			int paint[4][3] =
+			{
+				{ extend_4(r1), extend_4(g1), extend_4(b1) },
+				{ extend_4(r2) + d, extend_4(g2) + d, extend_4(b2) + d },
+				{ extend_4(r2), extend_4(g2), extend_4(b2) },
+				{ extend_4(r2) - d, extend_4(g2) - d, extend_4(b2) - d }
+			};
+
+			for (int k = 0; k < 16; k++)
+			{
+				int* p = paint[etc_index(low, k)];
+				uint8_t* px = out[(k % 4) * 4 + k / 4];
+				px[0] = clamp_byte(p[0]);
+				px[1] = clamp_byte(p[1]);
+				px[2] = clamp_byte(p[2]);
+				px[3] = 255;
+			}
+			return;
+		}
+
+		if (c2[1] < 0 || c2[1] > 31)
+		{
+			// H mode: two pairs of colors, around two base colors
+			int r1 = (block[0] >> 3) & 15;
+			int g1 = ((block[0] & 7) << 1) | ((block[1] >> 4) & 1);
+			int b1 = (block[1] & 8) | ((block[1] & 3) << 1) | (block[2] >> 7);
+			int r2 = (block[2] >> 3) & 15;
+			int g2 = ((block[2] & 7) << 1) | (block[3] >> 7);
+			int b2 = (block[3] >> 3) & 15;
+
+			// the lowest bit of the distance is which base color is bigger
+			int bigger = ((r1 << 8) | (g1 << 4) | b1) >= ((r2 << 8) | (g2 << 4) | b2) ? 1 : 0;
+			int d = etc_distances[(block[3] & 4) | ((block[3] & 1) << 1) | bigger];
+
+			int paint[4][3] =
+			{
+				{ extend_4(r1) + d, extend_4(g1) + d, extend_4(b1) + d },
+				{ extend_4(r1) - d, extend_4(g1) - d, extend_4(b1) - d },
+				{ extend_4(r2) + d, extend_4(g2) + d, extend_4(b2) + d },
+				{ extend_4(r2) - d, extend_4(g2) - d, extend_4(b2) - d }
+			};
+
+			for (int k = 0; k < 16; k++)
+			{
+				int* p = paint[etc_index(low, k)];
+				uint8_t* px = out[(k % 4) * 4 + k / 4];
+				px[0] = clamp_byte(p[0]);
+				px[1] = clamp_byte(p[1]);
+				px[2] = clamp_byte(p[2]);
+				px[3] = 255;
+			}
+			return;
+		}
+
+		if (c2[2] < 0 || c2[2] > 31)
+		{
+			// Planar mode: three colors, at the origin (O), at the
+			// right edge (H) and at the bottom edge (V), and the
+			// pixels are a smooth gradient between them
+			int ro = (block[0] >> 1) & 63;
+			int go = ((block[0] & 1) << 6) | ((block[1] >> 1) & 63);
+			int bo = ((block[1] & 1) << 5) | (((block[2] >> 3) & 3) << 3) | ((block[2] & 3) << 1) | (block[3] >> 7);
+			int rh = (((block[3] >> 2) & 31) << 1) | (block[3] & 1);
+			int gh = (low >> 25) & 127;
+			int bh = (low >> 19) & 63;
+			int rv = (low >> 13) & 63;
+			int gv = (low >> 6) & 127;
+			int bv = low & 63;
+
+			int o[3] = { extend_6(ro), extend_7(go), extend_6(bo) };
+			int h[3] = { extend_6(rh), extend_7(gh), extend_6(bh) };
+			int v[3] = { extend_6(rv), extend_7(gv), extend_6(bv) };
+
+			for (int y = 0; y < 4; y++)
+			{
+				for (int x = 0; x < 4; x++)
+				{
+					uint8_t* px = out[y * 4 + x];
+					for (int c = 0; c < 3; c++)
+						px[c] = clamp_byte((x * (h[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2);
+					px[3] = 255;
+				}
+			}
+			return;
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			base[0][c] = extend_5(c1[c]);
+			base[1][c] = extend_5(c2[c]);
+		}
+	}
+
+	// Individual and differential modes: the block is split
+	// into two halves (side by side, or top and bottom if
+	// "flip" is set), each with its own base color and table
+	int table[2] = { (block[3] >> 5) & 7, (block[3] >> 2) & 7 };
+
+	for (int k = 0; k < 16; k++)
+	{
+		int x = k / 4;
+		int y = k % 4;
+		int half = flip ? (y >= 2) : (x >= 2);
+
+		int index = etc_index(low, k);
+		int modifier = etc_modifiers[table[half]][index & 1];
+		if (index & 2)
+			modifier = -modifier;
+
+		uint8_t* px = out[y * 4 + x];
+		for (int c = 0; c < 3; c++)
+			px[c] = clamp_byte(base[half][c] + modifier);
+		px[3] = 255;
+	}
+}
+
+// The alpha part of ETC2_R8G8B8A8 (called EAC): a base alpha,
+// a multiplier, a table, and a 3-bit index per pixel
+static void decode_eac_alpha(const uint8_t* block, uint8_t out[16][4])
+{
+	int base = block[0];
+	int multiplier = block[1] >> 4;
+	const int* modifiers = eac_modifiers[block[1] & 15];
+
+	uint64_t indices = 0;
+	for (int i = 2; i < 8; i++)
+		indices = (indices << 8) | block[i];
+
+	// the first pixel is in the top bits
+	for (int k = 0; k < 16; k++)
+	{
+		int index = (int)((indices >> (45 - 3 * k)) & 7);
+		out[(k % 4) * 4 + k / 4][3] = clamp_byte(base + modifiers[index] * multiplier);
+	}
+}
+
+bool BlockCompression::Decode(
+	const BlockFormat* block,
+	const uint8_t* blocks,
+	uint32_t width,
+	uint32_t height,
+	uint8_t* rgba)
+{
+	if (block->family == BLOCK_FAMILY_ASTC)
+		return false;
+
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			const uint8_t* src = blocks + ((uint64_t)by * blocksX + bx) * block->bytesPerBlock;
+
+			// 16 pixels, in rows, top to bottom
+			uint8_t pixels[16][4];
+
+			switch (block->family)
+			{
+			case BLOCK_FAMILY_BC1:
+				decode_bc1_colors(src, false, pixels);
+				if (!block->hasAlpha)
+					for (int i = 0; i < 16; i++)
+						pixels[i][3] = 255;
+				break;
+			case BLOCK_FAMILY_BC3:
+				decode_bc1_colors(src + 8, true, pixels);
+				decode_bc3_alpha(src, pixels);
+				break;
+			case BLOCK_FAMILY_BC7:
+				decode_bc7(src, pixels);
+				break;
+			case BLOCK_FAMILY_ETC2_RGB:
+				decode_etc2_rgb(src, pixels);
+				break;
+			case BLOCK_FAMILY_ETC2_RGBA:
+				decode_etc2_rgb(src + 8, pixels);
+				decode_eac_alpha(src, pixels);
+				break;
+			default:
+				return false;
+			}
+
+			// blocks at the right and bottom edges can
+			// hang over the edge of the image
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+			{
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+				{
+					uint8_t* dst = rgba + (((uint64_t)(by * 4 + y) * width) + bx * 4 + x) * 4;
+					memcpy(dst, pixels[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// Encoders
+// =======================================
+
+// copies one 4x4 block out of the image, repeating the last
+// row and column for blocks that hang over the edge
+static void fetch_block(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t out[16][4])
+{
+	for (uint32_t y = 0; y < 4; y++)
+	{
+		uint32_t sy = by * 4 + y < height ? by * 4 + y : height - 1;
+
+		for (uint32_t x = 0; x < 4; x++)
+		{
+			uint32_t sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+			memcpy(out[y * 4 + x], rgba + ((uint64_t)sy * width + sx) * 4, 4);
+		}
+	}
+}
+
+static uint16_t pack_565(const int* rgb)
+{
+	return (uint16_t)(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+}
+
+// The two colors are the corners of the box around every
+// color in the block, and each pixel picks the closest of
+// the four colors on the line between them
+static void encode_bc1_colors(uint8_t pixels[16][4], uint8_t* dst)
+{
+	int lo[3] = { 255, 255, 255 };
+	int hi[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			if (pixels[i][c] < lo[c]) lo[c] = pixels[i][c];
+			if (pixels[i][c] > hi[c]) hi[c] = pixels[i][c];
+		}
+	}
+
+	uint16_t c0 = pack_565(hi);
+	uint16_t c1 = pack_565(lo);
+
+	// c0 must be bigger than c1, otherwise the
+	// decoder would use the three color mode
+	if (c0 < c1)
+	{
+		uint16_t temp = c0;
+		c0 = c1;
+		c1 = temp;
+	}
+
+	uint32_t indices = 0;
+
+	if (c0 != c1)
+	{
+		// the same four colors that the decoder will make
+		uint8_t palette[4][4];
+		unpack_565(c0, palette[0]);
+		unpack_565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestError = 0x7FFFFFFF;
+
+			for (int p = 0; p < 4; p++)
+			{
+				int error = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = pixels[i][c] - palette[p][c];
+					error += d * d;
+				}
+
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+
+			indices |= (uint32_t)best << (2 * i);
+		}
+	}
+
+	dst[0] = (uint8_t)c0;
+	dst[1] = (uint8_t)(c0 >> 8);
+	dst[2] = (uint8_t)c1;
+	dst[3] = (uint8_t)(c1 >> 8);
+	dst[4] = (uint8_t)indices;
+	dst[5] = (uint8_t)(indices >> 8);
+	dst[6] = (uint8_t)(indices >> 16);
+	dst[7] = (uint8_t)(indices >> 24);
+}
+
+static void encode_bc3_alpha(uint8_t pixels[16][4], uint8_t* dst)
+{
+	int a0 = 0;
+	int a1 = 255;
+
+	for (int i = 0; i < 16; i++)
+	{
+		if (pixels[i][3] > a0) a0 = pixels[i][3];
+		if (pixels[i][3] < a1) a1 = pixels[i][3];
+	}
+
+	memset(dst, 0, 8);
+	dst[0] = (uint8_t)a0;
+	dst[1] = (uint8_t)a1;
+
+	// every pixel has the same alpha, index 0 is all we need
+	if (a0 == a1)
+		return;
+
+	// a0 > a1, so this is the mode with 6 alphas in between
+	int palette[8];
+	palette[0] = a0;
+	palette[1] = a1;
+	for (int i = 1; i < 7; i++)
+		palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+
+	uint64_t indices = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+		int bestError = 256;
+
+		for (int p = 0; p < 8; p++)
+		{
+			int error = pixels[i][3] - palette[p];
+			if (error < 0) error = -error;
+
+			if (error < bestError)
+			{
+				bestError = error;
+				best = p;
+			}
+		}
+
+		indices |= (uint64_t)best << (3 * i);
+	}
+
+	for (int i = 0; i < 6; i++)
+		dst[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+void BlockCompression::EncodeBC1(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			uint8_t pixels[16][4];
+			fetch_block(rgba, width, height, bx, by, pixels);
+			encode_bc1_colors(pixels, blocks + ((uint64_t)by * blocksX + bx) * 8);
+		}
+	}
+}
+
+void BlockCompression::EncodeBC3(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			uint8_t pixels[16][4];
+			fetch_block(rgba, width, height, bx, by, pixels);
+
+			uint8_t* dst = blocks + ((uint64_t)by * blocksX + bx) * 16;
+			encode_bc3_alpha(pixels, dst);
+			encode_bc1_colors(pixels, dst + 8);
+		}
+	}
+}
@@ -0,0 +1,91 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+
+// Block-compressed formats store every 4x4 block of pixels
+// (or bigger, for ASTC) in a fixed number of bytes, 8 or 16.
+// The GPU decompresses a block when it samples it, so the
+// texture stays small in VRAM, and sampling it reads less
+// memory. Desktop GPUs usually support the BC formats, and
+// phones usually support ETC2 and ASTC, so a texture file can
+// have a format that this GPU can not sample. This class can
+// turn those blocks back into RGBA8 pixels on the CPU, and it
+// can turn RGBA8 pixels into BC1 or BC3 blocks
+
+enum BlockFamily
+{
+	BLOCK_FAMILY_BC1,
+	BLOCK_FAMILY_BC3,
+	BLOCK_FAMILY_BC7,
+	BLOCK_FAMILY_ETC2_RGB,
+	BLOCK_FAMILY_ETC2_RGBA,
+
+	// ASTC can only be uploaded to GPUs that support it,
+	// there is no CPU decoder for it
+	BLOCK_FAMILY_ASTC
+};
+
+struct BlockFormat
+{
+	VkFormat format;
+	BlockFamily family;
+	uint32_t blockWidth;
+	uint32_t blockHeight;
+	uint32_t bytesPerBlock;
+
+	// BC1_RGB has no alpha, every pixel is opaque
+	bool hasAlpha;
+	bool srgb;
+};
+
+class BlockCompression
+{
+public:
+	// nullptr if the format is not block-compressed,
+	// or if it is one that we do not know about
+	static const BlockFormat* Find(VkFormat format);
+
+	// bytes in one mip level that is width x height pixels
+	static uint64_t LevelSize(const BlockFormat* block, uint32_t width, uint32_t height);
+
+	// Writes width x height RGBA8 pixels into "rgba".
+	// Returns false for formats without a CPU decoder
+	static bool Decode(
+		const BlockFormat* block,
+		const uint8_t* blocks,
+		uint32_t width,
+		uint32_t height,
+		uint8_t* rgba);
+
+	// Makes BC1 blocks (no alpha), or BC3 blocks (with alpha), out
+	// of RGBA8 pixels. These are quick encoders, they are meant for
+	// loading a texture, not for making the best looking blocks
+	static void EncodeBC1(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks);
+	static void EncodeBC3(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks);
+};
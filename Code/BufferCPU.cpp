@@ -24,6 +24,8 @@ that utilizes Vulkan, see more at http://cemu.info
 
 #include "BufferCPU.h"
 #include "Helper.h"
+#include "FrameCapture.h"
+#include <string.h>
 
 // When we create a CPU buffer, we need the Device (lets us give commands to GPU),
 // Even though this is a CPU buffer, we still need information from the GPU
@@ -35,6 +37,9 @@ BufferCPU::BufferCPU(VkDevice d, VkPhysicalDeviceMemoryProperties memory_propert
 	// we can use it to store
 	// data, and delete data
 	device = d;
+	size = info.size;
+	mapped = nullptr;
+	mapCount = 0;
 
 	// create buffer with the device,
 	// and the VkBufferCreateInfo
@@ -86,6 +91,10 @@ BufferCPU::BufferCPU(VkDevice d, VkPhysicalDeviceMemoryProperties memory_propert
 	// to bind the buffer to the memory, so that
 	// we can use the memory
 	vkBindBufferMemory(device, buffer, memory, 0);
+
+	// if frames are being captured, remember
+	// this buffer, so its contents can be saved
+	FrameCapture::TrackBuffer(buffer, info, this);
 }
 
 BufferCPU::~BufferCPU()
@@ -93,6 +102,7 @@ BufferCPU::~BufferCPU()
 	// when we want to delete this CPU memory
 	// we delete the buffer, which is what we
 	// used to access the memory
+	FrameCapture::ForgetBuffer(buffer);
 	vkDestroyBuffer(device, buffer, NULL);
 
 	// after deleting the buffer, there is no
@@ -101,22 +111,38 @@ BufferCPU::~BufferCPU()
 	vkFreeMemory(device, memory, NULL);
 }
 
-void BufferCPU::Store(void* d, int size)
+void BufferCPU::Store(const void* d, VkDeviceSize dataSize)
 {
-	// create a pointer that does not go anywhere
-	uint8_t *pData = nullptr;
-
 	// Basically, this gives us a pointer to where
 	// the buffer's memory is stored in RAM. 
-	vkMapMemory(device, memory, 0, size, 0, (void **)&pData);
+	uint8_t *pData = (uint8_t*)Map();
 
 	// pData now points to the location in RAM
 	// where the buffer's memory is,
 	// so we use memcpy to transfer data into
 	// the buffer's memory
-	memcpy(pData, d, size);
+	memcpy(pData, d, (size_t)dataSize);
 	
 	// we unmap the memory, because we don't need
 	// to write to it, so we leave it alone
-	vkUnmapMemory(device, memory);
+	Unmap();
+}
+
+void* BufferCPU::Map()
+{
+	// only the first Map really maps the memory,
+	// the others get the same pointer
+	if (mapCount++ == 0)
+		vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+
+	return mapped;
+}
+
+void BufferCPU::Unmap()
+{
+	if (mapCount > 0 && --mapCount == 0)
+	{
+		vkUnmapMemory(device, memory);
+		mapped = nullptr;
+	}
 }
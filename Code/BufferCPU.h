@@ -32,8 +32,15 @@ private:
 	VkDeviceMemory memory;
 	VkDevice device;
 
+	// Map() can be called again while the buffer is mapped
+	// (FrameCapture reads buffers that are already mapped),
+	// the memory is unmapped when every Map has its Unmap
+	void* mapped;
+	uint32_t mapCount;
+
 public:
 	VkBuffer buffer;
+	VkDeviceSize size;
 
 	BufferCPU(
 		VkDevice d, 
@@ -42,5 +49,12 @@ public:
 
 	~BufferCPU();
 
-	void Store(void* d, int size);
+	void Store(const void* d, VkDeviceSize dataSize);
+
+	// Map gives a pointer to the whole buffer, which stays
+	// valid until Unmap. Use this instead of Store when the
+	// data is written by something else (a decoder, a loop
+	// that writes one element at a time, etc)
+	void* Map();
+	void Unmap();
 };
@@ -30,6 +30,8 @@ that utilizes Vulkan, see more at http://cemu.info
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
 #include <assert.h>
 #include <signal.h>
 #include <vector>
@@ -38,17 +40,12 @@ that utilizes Vulkan, see more at http://cemu.info
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "FrameCapture.h"
 #include "Helper.h"
 #include "Main.h"
+#include "Profiler.h"
 #include "SquareDataArrays.h"
 
-// This boolean keeps track of how many times we have executed the
-// "prepare()" function. If we have never used the function before
-// then we know we are initializing the program for the first time,
-// if the boolean is false, then we know the program has already
-// been initialized
-bool firstInit = true;
-
 // The structure of data
 // that is given to the
 // uniform buffer
@@ -74,6 +71,8 @@ struct VertexStructure
 
 void Demo::prepare_console()
 {
+	PROFILE_FUNCTION();
+
 	// This line is commented out,
 	// if you uncomment this "freopen" line,
 	// it will redirect all text from the console
@@ -121,6 +120,8 @@ void Demo::prepare_console()
 
 void Demo::prepare_window()
 {
+	PROFILE_FUNCTION();
+
 	// Make the title of the screen "Loading"
 	// while the program loads
 	strncpy(name, "Loading...", APP_NAME_STR_LEN);
@@ -207,6 +208,8 @@ void Demo::prepare_window()
 
 void Demo::prepare_instance()
 {
+	PROFILE_FUNCTION();
+
 	// The first thing we need to do, is choose the 
 	// "layers" and "extensions" that we want to use in Vulkan
 	// "Extensions" give us additional features, like ray tracing.
@@ -241,12 +244,16 @@ void Demo::prepare_instance()
 	// we create a boolean to see if we found the layer
 	VkBool32 validation_found = 0;
 
+	// no layers, unless we find the validation layer below
+	enabled_layer_count = 0;
+
 	// only enable validation if the validate bool
-	// is true. This boolean was set to true in init().
-	// This is set to true or false by the programmer, it
-	// does not depend on anything. It should be set to true
-	// during development, and set to false when it is time 
-	// to release the software
+	// is true. This boolean was set in prepare(), from
+	// settings.validate. It should be true during development,
+	// and false when it is time to release the software.
+	// When it is false, we do not even ask Vulkan for the list
+	// of layers, because loading that list opens the manifest
+	// of every layer that is installed, which is slow
 	if (validate)
 	{
 		// set the number of instance layers to zero
@@ -337,16 +344,15 @@ void Demo::prepare_instance()
 		}
 
 		// if we did not find a validation layer,
-		// or, if we did not find any layers at all
+		// or, if we did not find any layers at all,
+		// then we keep going without it. Validation is
+		// turned on by default, and a computer without
+		// the Vulkan SDK will not have the layer
 		if (!validation_found || total_instance_layers <= 0)
 		{
-			// Give the user an error that we failed to find the validation layer.
-			// If this error is found, you can fix it by disabling validate
-			// in init()
-			ERR_EXIT(
-				"vkEnumerateInstanceLayerProperties failed to find required validation layer.\n\n"
-				"Please look at the Getting Started guide for additional information.\n",
-				"vkCreateInstance Failure");
+			printf("VK_LAYER_KHRONOS_validation was not found, running without validation\n");
+			fflush(stdout);
+			validate = false;
 		}
 	}
 
@@ -473,14 +479,36 @@ void Demo::prepare_instance()
 			"vkCreateInstance Failure");
 	}
 
-	// some tutorials will have VkApplicationInfo,
-	// and then that will be put inside the 
-	// structure of VkInstanceCreateInfo. However,
-	// I personally believe that it is a waste of time.
-	// All it does is hold the name of the app, the version,
-	// the name of the engine, and the version, it literally
-	// does not do or change anything in the program, so I 
-	// just ignore it
+	// VkApplicationInfo holds the name of the app, the name of
+	// the engine, and their versions, which do not change anything
+	// in the program. However, it also holds "apiVersion", which is
+	// the version of Vulkan that we want to use. Without it, we only
+	// get Vulkan 1.0. We want 1.1, so we can use functions like
+	// vkGetPhysicalDeviceFeatures2, which TextureTable needs to find
+	// out if the GPU can do bindless textures.
+
+	// A Vulkan 1.0 loader does not have vkEnumerateInstanceVersion,
+	// and it would refuse to make a 1.1 instance, so we only ask
+	// for 1.1 if the loader says that it has it
+	api_version = VK_API_VERSION_1_0;
+
+	PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+		(PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+
+	if (enumerateInstanceVersion != NULL)
+	{
+		uint32_t loader_version = VK_API_VERSION_1_0;
+		enumerateInstanceVersion(&loader_version);
+
+		if (loader_version >= VK_API_VERSION_1_1)
+			api_version = VK_API_VERSION_1_1;
+	}
+
+	VkApplicationInfo app_info = {};
+	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app_info.pApplicationName = "vkcube";
+	app_info.pEngineName = "vkcube";
+	app_info.apiVersion = api_version;
 
 	// It is time to talk about another pattern that 
 	// will be used in all over the Vulkan program.
@@ -534,6 +562,7 @@ void Demo::prepare_instance()
 	// and the array of extensions that we want to enable.
 	VkInstanceCreateInfo inst_info = {};
 	inst_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	inst_info.pApplicationInfo = &app_info;
 	inst_info.enabledLayerCount = enabled_layer_count;
 	inst_info.ppEnabledLayerNames = (const char *const *)enabled_layers;
 	inst_info.enabledExtensionCount = enabled_extension_count;
@@ -581,6 +610,8 @@ void Demo::prepare_instance()
 
 void Demo::prepare_physical_device()
 {
+	PROFILE_FUNCTION();
+
 	// Now that we have an instance of Vulkan, we need
 	// to determine how many GPUs are available that
 	// can use Vulkan. We will be following the same
@@ -739,6 +770,8 @@ void Demo::prepare_physical_device()
 
 void Demo::prepare_instance_functionPointers()
 {
+	PROFILE_FUNCTION();
+
 	// Almost all functions in Vulkan are built-in to the SDK.
 	// We can access Vulkan functions through a static link (.lib),
 	// or a dynamic link (.dll). However, some Vulkan functions are
@@ -781,6 +814,8 @@ void Demo::prepare_instance_functionPointers()
 
 void Demo::prepare_surface()
 {
+	PROFILE_FUNCTION();
+
 	// Create a Surface:
 	// The "surface" is an abstraction layer that sends
 	// a finished image from Vulkan to the screen
@@ -870,8 +905,53 @@ void Demo::prepare_surface()
 	free(surfFormats);
 }
 
+// Imageless framebuffers (VK_KHR_imageless_framebuffer) need
+// VK_KHR_image_format_list, and VK_KHR_maintenance2, which is part
+// of Vulkan 1.1, like vkGetPhysicalDeviceFeatures2, so the instance
+// and the GPU both need 1.1. The GPU can have the extension without
+// the feature, so we ask for the feature too
+static bool imageless_supported(VkPhysicalDevice gpu, uint32_t apiVersion)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu, &properties);
+
+	if (apiVersion < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1)
+		return false;
+
+	uint32_t count = 0;
+	vkEnumerateDeviceExtensionProperties(gpu, NULL, &count, NULL);
+
+	std::vector<VkExtensionProperties> extensions(count);
+	vkEnumerateDeviceExtensionProperties(gpu, NULL, &count, extensions.data());
+
+	bool imageless = false;
+	bool format_list = false;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!strcmp(extensions[i].extensionName, VK_KHR_IMAGELESS_FRAMEBUFFER_EXTENSION_NAME))
+			imageless = true;
+		if (!strcmp(extensions[i].extensionName, VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME))
+			format_list = true;
+	}
+
+	if (!imageless || !format_list)
+		return false;
+
+	VkPhysicalDeviceImagelessFramebufferFeaturesKHR imageless_features = {};
+	imageless_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGELESS_FRAMEBUFFER_FEATURES_KHR;
+
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &imageless_features;
+	vkGetPhysicalDeviceFeatures2(gpu, &features);
+
+	return imageless_features.imagelessFramebuffer == VK_TRUE;
+}
+
 void Demo::prepare_device_queue()
 {
+	PROFILE_FUNCTION();
+
 	//		Here is an explaination of how we will handle queues
 
 	// In Vulkan, we have something called VkQueue. This queue allows us
@@ -930,8 +1010,9 @@ void Demo::prepare_device_queue()
 	}
 
 	// Search for a graphics and a present queue in the array of queue
-	// families, try to find one that supports both
-	uint32_t queue_family_index = UINT32_MAX;
+	// families, try to find one that supports both. We keep the index
+	// in the Demo class, because command pools need it too
+	queue_family_index = UINT32_MAX;
 
 	// check the properties of all queues on the device
 	for (uint32_t i = 0; i < queue_family_count; i++)
@@ -975,6 +1056,73 @@ void Demo::prepare_device_queue()
 	queueInfo.queueCount = 1;
 	queueInfo.pQueuePriorities = queue_priorities;
 
+	// Some parts of Vulkan are "features" that have to be turned
+	// on when the device is made. We turn on the compressed texture
+	// formats that this GPU supports, so the texture loader can
+	// upload them without decompressing them first.
+	// Every other feature stays off
+	VkPhysicalDeviceFeatures supported_features;
+	vkGetPhysicalDeviceFeatures(gpu, &supported_features);
+
+	memset(&enabled_features, 0, sizeof(enabled_features));
+	enabled_features.textureCompressionBC = supported_features.textureCompressionBC;
+	enabled_features.textureCompressionETC2 = supported_features.textureCompressionETC2;
+	enabled_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+
+	// This lets GpuTimer count vertices and fragments
+	// with pipeline statistics queries
+	enabled_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+
+	// Bindless textures need VK_EXT_descriptor_indexing, and
+	// a few of its features, which are not in VkPhysicalDeviceFeatures,
+	// they have their own structure that goes in the pNext chain.
+	// Both the instance and the GPU need Vulkan 1.1 for this.
+	// If the GPU can not do it, TextureTable uses one descriptor
+	// set per texture instead
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+	bindless = false;
+
+	if (settings.allow_bindless && api_version >= VK_API_VERSION_1_1 && TextureTable::Supported(gpu, &indexing_features))
+	{
+		bindless = true;
+		extension_names[enabled_extension_count++] = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+	}
+
+	// Descriptors that change every frame are written from a
+	// struct with an update template (Vulkan 1.1), or pushed
+	// into the command buffer if VK_KHR_push_descriptor is
+	// here, which is cheaper than vkUpdateDescriptorSets
+	descriptor_path = DescriptorTemplate::BestPath(gpu, api_version);
+
+	if (descriptor_path == DESCRIPTOR_PATH_PUSH)
+		extension_names[enabled_extension_count++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+
+	printf("Per-frame descriptors are %s\n",
+		descriptor_path == DESCRIPTOR_PATH_PUSH ? "pushed" :
+		descriptor_path == DESCRIPTOR_PATH_TEMPLATE ? "written with update templates" :
+		"written with vkUpdateDescriptorSets");
+	fflush(stdout);
+
+	// With imageless framebuffers, a framebuffer does not hold
+	// the swapchain image, so one framebuffer works for all of
+	// them, and it lives through a swapchain that is made again,
+	// see prepare_framebuffers
+	VkPhysicalDeviceImagelessFramebufferFeaturesKHR imageless_features = {};
+	imageless_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGELESS_FRAMEBUFFER_FEATURES_KHR;
+	imageless_features.imagelessFramebuffer = VK_TRUE;
+	imageless = false;
+
+	if (settings.allow_imageless && imageless_supported(gpu, api_version))
+	{
+		imageless = true;
+		extension_names[enabled_extension_count++] = VK_KHR_IMAGELESS_FRAMEBUFFER_EXTENSION_NAME;
+		extension_names[enabled_extension_count++] = VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME;
+	}
+
+	printf("Framebuffers are %s\n", imageless ?
+		"imageless, one shared by every swapchain image" : "one per swapchain image");
+	fflush(stdout);
+
 	// create the device info
 	// this tells us how a device will be made,
 	// with the extensions that we can enable,
@@ -985,6 +1133,17 @@ void Demo::prepare_device_queue()
 	deviceInfo.pQueueCreateInfos = &queueInfo;
 	deviceInfo.enabledExtensionCount = enabled_extension_count;
 	deviceInfo.ppEnabledExtensionNames = (const char *const *)extension_names;
+	deviceInfo.pEnabledFeatures = &enabled_features;
+
+	// each feature structure points at the next one
+	if (bindless)
+		deviceInfo.pNext = &indexing_features;
+
+	if (imageless)
+	{
+		imageless_features.pNext = (void*)deviceInfo.pNext;
+		deviceInfo.pNext = &imageless_features;
+	}
 
 	// This function is called vkCreateDevice, but it actually
 	// creates the device, and the queues, at the same time.
@@ -999,6 +1158,8 @@ void Demo::prepare_device_queue()
 
 void Demo::prepare_device_functionPointers()
 {
+	PROFILE_FUNCTION();
+
 	// When we ran the function prepare_instance_functionPointers() earlier in the code,
 	// it allowed us to use the VkInstance to get functions that are not found in the SDK's .lib or .dll files,
 	// but are instead in the Vulkan driver. Now, rather than using the VkInstance to get functions,
@@ -1034,6 +1195,8 @@ void Demo::prepare_device_functionPointers()
 
 void Demo::prepare_synchronization()
 {
+	PROFILE_FUNCTION();
+
 	// Create semaphores to synchronize acquiring presentable buffers before
 	// rendering and waiting for drawing to be complete before presenting
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
@@ -1045,7 +1208,7 @@ void Demo::prepare_synchronization()
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	for (uint32_t i = 0; i < FRAME_LAG; i++)
+	for (uint32_t i = 0; i < frame_lag; i++)
 	{
 		vkCreateFence(device, &fenceInfo, NULL, &drawFences[i]);
 
@@ -1061,6 +1224,8 @@ void Demo::prepare_synchronization()
 
 void Demo::prepare_swapchain()
 {
+	PROFILE_FUNCTION();
+
 	// This function will create a swapchain,
 	// and all of the images in the swapchain
 
@@ -1258,7 +1423,23 @@ void Demo::prepare_swapchain()
 
 	// The mode we want is FIFO, becuase it locks our frame-rate to 
 	// 60fps (or the limit of the monitor) and prevents tearing of images.
-	VkPresentModeKHR desiredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	// The benchmark can ask for another mode, which falls back to FIFO,
+	// because every GPU has to support FIFO
+	VkPresentModeKHR desiredPresentMode = settings.present_mode;
+
+	bool desiredSupported = false;
+	for (size_t i = 0; i < presentModeCount; ++i)
+	{
+		if (presentModes[i] == desiredPresentMode)
+			desiredSupported = true;
+	}
+
+	if (!desiredSupported)
+	{
+		printf("Present mode %d is not supported, using FIFO\n", (int)desiredPresentMode);
+		fflush(stdout);
+		desiredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	}
 
 	// If the current present mode is not equal to the 
 	// present mode that we want to use. This will probably
@@ -1417,6 +1598,31 @@ void Demo::prepare_swapchain()
 	swapchain_ci.imageExtent.width = swapchainExtent.width;
 	swapchain_ci.imageExtent.height = swapchainExtent.height;
 	swapchain_ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+	// FrameReadback copies the swapchain images, if the
+	// surface lets us. Most do, but it is not required
+	swapchain_readable = (surfCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+	if (swapchain_readable)
+		swapchain_ci.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+	// and FrameExporter converts them to YUV with a compute
+	// shader, which samples them. This is only needed for that
+	swapchain_sampleable = (surfCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_SAMPLED_BIT) != 0 &&
+		settings.export_path != nullptr;
+	if (swapchain_sampleable)
+		swapchain_ci.imageUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	// With dynamic resolution, the scene is drawn into a smaller
+	// image, which is then blitted (copied and stretched) into
+	// the swapchain image, so the swapchain image is a transfer
+	// destination. Only asked for when it is needed
+	swapchain_blittable = (surfCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0 &&
+		settings.dynamic_resolution;
+	if (swapchain_blittable)
+		swapchain_ci.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	// an imageless framebuffer is made for images with this usage
+	swapchain_usage = swapchain_ci.imageUsage;
 	swapchain_ci.preTransform = (VkSurfaceTransformFlagBitsKHR)preTransform;
 	swapchain_ci.compositeAlpha = desiredAlphaFlag;
 	swapchain_ci.imageArrayLayers = 1;
@@ -1474,9 +1680,9 @@ void Demo::prepare_swapchain()
 
 	// The swapchain_image_resources array, basically makes it so each
 	// swapchain iamge has its own image (itself), its own imageView
-	// (which makes the image usable), its own frameBuffer (which allows
-	// the imageView to be used in drawing), and its own command buffer,
-	// which will be explained later
+	// (which makes the image usable), and its own frameBuffer (which
+	// allows the imageView to be used in drawing). Command buffers are
+	// not per swapchain image, they are per frame, see draw()
 
 	// loop through all the swapchain images
 	for (uint32_t i = 0; i < swapchainImageCount; i++)
@@ -1558,6 +1764,8 @@ void Demo::prepare_swapchain()
 
 void Demo::prepare_uniform_buffer()
 {
+	PROFILE_FUNCTION();
+
 	// make temporary data where
 	// we can store data that will be
 	// in our buffer
@@ -1608,6 +1816,7 @@ void Demo::prepare_uniform_buffer()
 
 	// create the model view and projection matrices
 	glm::mat4x4	model = projection_matrix * view_matrix * model_matrix;
+	clip_matrix = model;
 	
 	// put our model into the temporary data buffer
 	temporaryData.model = model;
@@ -1633,6 +1842,8 @@ void Demo::prepare_uniform_buffer()
 
 void Demo::prepare_descriptor_layout()
 {
+	PROFILE_FUNCTION();
+
 	// Each descriptorSetLayoutBinding will describe what type
 	// of descriptor we will have at each binding in the shaders.
 	// In this case, there is one descriptor, the uniform buffer
@@ -1665,62 +1876,40 @@ void Demo::prepare_descriptor_layout()
 
 	// create the descriptor layout with the information we provided
 	vkCreateDescriptorSetLayout(device, &descriptor_layout, NULL, &desc_layout);
+	FrameCapture::TrackSetLayout(desc_layout, descriptor_layout);
 }
 
 void Demo::prepare_descriptor_pool()
 {
-	// There is one type of descriptors in the pool
-	// Uniform Buffer Descriptors
-	// We have an array of VkDescriptorPoolSize, each PoolSize
-	// is for each type of descriptor. We have on type of descriptor,
-	// so we only have one element in this array. This will change
-	// in future tutorials
-	VkDescriptorPoolSize type_counts[1];
-
-	// descriptor count is the number of buffers (of each type)
-	// that will be used in all pipelines for the entire program.
-	// In this case, its one uniform buffer and one texture.
-
-	// we will have one uniform buffer in the entire program
-	type_counts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	type_counts[0].descriptorCount = 1;
-
-	// poolSizeCount is 1 
-	// that is the number of elements in the type_counts array.
-	// If we increase the number of descriptors, this number should
-	// still be two. We would increase that number of we wanted
-	// other types of descriptors, like Storage Buffers (compute),
-	// or Texture buffers (which comes later).
-	
-	// Max Sets will store the number of dsecriptor sets that
-	// we will have in the pool, which will be just one,
-	// we will talk more about sets right after this function is done
-
-	VkDescriptorPoolCreateInfo descriptor_pool = {};
-	descriptor_pool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptor_pool.maxSets = 1;
-	descriptor_pool.poolSizeCount = 1;
-	descriptor_pool.pPoolSizes = type_counts;
-
-	// create descriptor pool, based on the information provided
-	vkCreateDescriptorPool(device, &descriptor_pool, NULL, &desc_pool);
+	PROFILE_FUNCTION();
+
+	// A descriptor pool is where descriptor sets come from, and
+	// it has to be made with the number of sets, and the number
+	// of descriptors of each type, that will ever come from it.
+	// Instead of counting those by hand (one uniform buffer, one
+	// texture per Square, ...) and getting it wrong every time
+	// something is added, the DescriptorAllocator makes pools as
+	// they are needed, each one twice as big as the last.
+
+	// It also has one set of pools per frame in flight, for sets
+	// that are only used by one frame. Those are all freed at once
+	// when the frame's fence opens (see draw), so a frame that makes
+	// the same sets as the frame before it never makes a new pool.
+	// See DescriptorAllocator.h
+	descriptor_allocator = new DescriptorAllocator(device, frame_lag);
 }
 
 void Demo::prepare_descriptor_set()
 {
+	PROFILE_FUNCTION();
+
 	// we need to allocate a space in memory for
 	// our descriptor set. In this case, we will
 	// only have one descriptor set. This set will
-	// be stored in the descriptor pool that we made,
+	// come from the descriptor allocator that we made,
 	// and this descriptor set will use the layout that
 	// we made earlier (desc_layout) which is given to
 	// the pipeline (explained later)
-	VkDescriptorSetAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	alloc_info.descriptorPool = desc_pool;
-	alloc_info.descriptorSetCount = 1;
-	alloc_info.pSetLayouts = &desc_layout;
-	vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set);
 
 	// The first descriptor will be the uniform buffer
 	// because this descriptor is at binding #0 of the shader
@@ -1728,62 +1917,41 @@ void Demo::prepare_descriptor_set()
 	buffer_info.range = sizeof(uniform_struct);
 	buffer_info.buffer = matrixBufferCPU->buffer;
 
-	// VkWriteDescriptorSet does not a structure that allows
-	// us to write to an entire set of descriptors,
-	// it is a structure that allows us to write to one descriptor
-	// that is part of a set
-
-	// There is one descriptor in the set, so we need one
-	// VkWriteDescriptorSet to allow us to write to the
-	// Descriptor Set. This will change later in future
-	// tutorials
-	VkWriteDescriptorSet writes[1];
-	
-	// this initializes the bytes in the array to all be zero
-	memset(&writes, 0, sizeof(writes));
-
-	// sType is required
-	// we are writing one descriptor per structure, so the 
-	// descriptorCount per structure will be 1
-	// dstSet is the destination set that we want to write to,
-	// we only have one descriptor set (called "descriptor_set")
-	// so that is the one we are using
-	
-	// The binding we are writing to is 0
-	// The type of descriptor in this structure is a UNIFORM_BUFFER
-	// and buffer_info is the VkDescriptorBufferInfo that we made
-	// just a minute ago in this function
-	writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writes[0].descriptorCount = 1;
-	writes[0].dstSet = descriptor_set;
-	writes[0].dstBinding = 0;
-	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	writes[0].pBufferInfo = &buffer_info;
-
-	// update the descriptors, we give it the device (GPU),
-	// we give it 1, because there is one elements in the
-	// "writes" array, and we give it the "writes" array
-	vkUpdateDescriptorSets(device, 1, writes, 0, NULL);
+	// The allocator also writes the set for us: it finds a set
+	// with this layout and these bindings in its cache, or makes
+	// one. A new set is written with one VkWriteDescriptorSet per
+	// binding, which says which binding of which set to write
+	// (binding 0, a UNIFORM_BUFFER) and points at buffer_info.
+	// Asking again with the same buffer gives back the same set,
+	// without allocating or writing anything
+	DescriptorBinding binding = DescriptorBinding::Buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		buffer_info.buffer, buffer_info.offset, buffer_info.range);
+	descriptor_set = descriptor_allocator->Cached(desc_layout, &binding, 1);
+
+	// no set means the allocator could not make a pool, or
+	// allocate from one, and the set is bound every frame
+	if (descriptor_set == VK_NULL_HANDLE)
+		ERR_EXIT("Could not allocate the descriptor set of the uniform buffer\n", "Descriptor Failure");
 }
 
-void Demo::prepare_vb_ib()
-{
-	// Create empty creationInfo
-	// we will be re-using this several times
-	// Leave it empty for now
-	VkBufferCreateInfo info = {};
-
-	// Vertex Buffer
-	//=====================================
+// The mesh file is created in the working directory
+// the first time the program runs, see write_square_mesh
+#define SQUARE_MESH_PATH "Square.mesh"
 
+// This converts the arrays in SquareDataArrays.h into a
+// mesh file. This only happens when the file does not exist yet,
+// every launch after that will skip this, and load the file
+static bool write_square_mesh(const char* path)
+{
 	// We make an array of 4 vertices
 	VertexStructure vertexArray[4];
 
 	// We will copy data into the vertex array from 
 	// arrays called g_vertex_buffer_data, and 
 	// g_color_buffer_data. These arrays can be found
-	// in the SquareDataArrays.h file, when we load
-	// 3D Obj files in the future, we won't need to do this
+	// in the SquareDataArrays.h file. This is the only
+	// place where we interleave vertices by hand, the
+	// file that we write already has them interleaved
 	for (unsigned int i = 0; i < 4; i++)
 	{
 		vertexArray[i].position[0] = g_vertex_buffer_data[i * 3];
@@ -1793,80 +1961,604 @@ void Demo::prepare_vb_ib()
 		vertexArray[i].color[1] = g_color_buffer_data[2 * i + 1];
 	}
 
-	// The size of our Vertex Array, will be the amount of 
-	// elements (4) multiplied by the size of one vertex
-	uint32_t vertexArraySize = 4 * sizeof(VertexStructure);
+	// These indices will determine which vertices
+	// to connect for each triangle. It will connect
+	// the first three indices into a triangle, and 
+	// then the next three. We make two triangles
+	// from four points, with six indices
+	uint32_t indexArray[6] = 
+	{
+		0, 1, 2,	// first triangle
+		2, 1, 3		// second triangle
+	};
+
+	// The file also describes what each piece of the vertex is,
+	// so that prepare_pipeline does not need to guess. Position is
+	// at location 0 with 3 floats, color is at location 1 with 2 floats
+	MeshFileAttribute attributes[2];
+	attributes[0].location = 0;
+	attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[0].offset = offsetof(VertexStructure, position);
+	attributes[1].location = 1;
+	attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[1].offset = offsetof(VertexStructure, color);
+
+	return MeshFile::Write(path,
+		vertexArray, sizeof(VertexStructure), 4,
+		attributes, 2,
+		indexArray, VK_INDEX_TYPE_UINT32, 6);
+}
+
+void Demo::prepare_vb_ib()
+{
+	PROFILE_FUNCTION();
+
+	// Open the mesh file. This does not read the file,
+	// it "maps" the file, so that the file looks like an
+	// array in memory. See MeshFile.cpp for how this works
+	MeshFile mesh;
+
+	if (!mesh.Open(SQUARE_MESH_PATH))
+	{
+		// If the file does not exist (or if it is from an older
+		// version of the program), make it, and then try again
+		if (!write_square_mesh(SQUARE_MESH_PATH) || !mesh.Open(SQUARE_MESH_PATH))
+		{
+			ERR_EXIT("Could not create " SQUARE_MESH_PATH "\n", "Mesh Failure");
+		}
+	}
+
+	// Vertex Layout
+	//=====================================
+
+	// Save the layout of each vertex, prepare_pipeline
+	// will give this to the pipeline's vertex input state
+	vertex_stride = mesh.header->vertexStride;
+	vertex_attribute_count = mesh.header->attributeCount;
+
+	for (uint32_t i = 0; i < vertex_attribute_count; i++)
+	{
+		vertex_attributes[i].location = mesh.header->attributes[i].location;
+		vertex_attributes[i].binding = 0;
+		vertex_attributes[i].format = (VkFormat)mesh.header->attributes[i].format;
+		vertex_attributes[i].offset = mesh.header->attributes[i].offset;
+	}
+
+	// Vertex and Index Buffer
+	//=====================================
 
-	// Lets make a buffer that is designed to be
-	// a VERTEX_BUFFER, that is large enough
-	// to hold all of our vertices. If we do not 
-	// include VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	// the program will still run the same, but we 
-	// will get validation errors. This is the same
-	// concept as sType, Vulkan looks for it to help
-	// us confirm that we are using the right buffers
-	// for the right purpose, to help us catch mistakes
+	// The vertices and the indices are right next to each other
+	// in the file, so we make one buffer that can be used as both
+	// a VERTEX_BUFFER and an INDEX_BUFFER, that is large enough
+	// to hold everything. If we do not include the usage bits,
+	// the program will still run the same, but we will get
+	// validation errors
+	VkBufferCreateInfo info = {};
 	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	info.size = vertexArraySize;
+	info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	info.size = mesh.payloadSize;
 
-	// make the buffer, and store the data into the buffer
+	// make the buffer, and store the data into the buffer.
+	// This is one memcpy, straight from the mapped file
+	// into the buffer, no matter how large the mesh is.
 	// For more information on how this works, look at BufferCPU.cpp
-	// Learning about BufferCPU is optional
-	vertexDataCPU = new BufferCPU(device, memory_properties, info);
-	vertexDataCPU->Store(vertexArray, vertexArraySize);
+	meshDataCPU = new BufferCPU(device, memory_properties, info);
+	meshDataCPU->Store(mesh.payload, mesh.payloadSize);
 
-	// Index Buffer
+	// Bounds
 	//=====================================
 
-	// We make an array of indices
-	// These indices will determine which vertices
-	// to connect for each triangle. It will connect
-	// the first three indices into a triangle, and 
-	// then the next three, and so on.
-	std::vector<uint32_t> indexArray;
+	// The culler treats each Square as a sphere, so we find how
+	// far the mesh goes from (0, 0, 0). Position is the attribute
+	// at location 0, with at least 2 floats. This reads the mapped
+	// file once, which is nothing next to the copy above
+	mesh_radius_xy = 0.0f;
+	mesh_radius_z = 0.0f;
 
-	// For this simple tutorial, we make
-	// two triangles from four points, with
-	// six indices
-	
-	// first triangle
-	indexArray.push_back(0);
-	indexArray.push_back(1);
-	indexArray.push_back(2);
-
-	// second triangle
-	indexArray.push_back(2);
-	indexArray.push_back(1);
-	indexArray.push_back(3);
-
-	// For more complicated 3D models (covered in later
-	// tutorials), we will be using index buffers to 
-	// lower the amount of vertices in the Vertex Buffer
-	// by removing repeating vertices. We also have an
-	// OpenGL tutorial on ATLAS that teaches this concept
-
-	// The size of this index array will be the number
-	// of elements, multiplied by the size of one element
-	uint32_t indexArraySize = 6 * sizeof(uint32_t);
-
-	// This is the Index CPU buffer, so we useTRANSFER_SRC 
-	// because we will copy the buffer to GPU
+	for (uint32_t i = 0; i < vertex_attribute_count; i++)
+	{
+		VkFormat format = vertex_attributes[i].format;
+
+		if (vertex_attributes[i].location != 0 ||
+			(format != VK_FORMAT_R32G32_SFLOAT && format != VK_FORMAT_R32G32B32_SFLOAT))
+			continue;
+
+		for (uint32_t v = 0; v < mesh.header->vertexCount; v++)
+		{
+			float position[3] = {};
+			memcpy(position,
+				mesh.payload + (size_t)v * vertex_stride + vertex_attributes[i].offset,
+				format == VK_FORMAT_R32G32B32_SFLOAT ? 12 : 8);
+
+			float xy = sqrtf(position[0] * position[0] + position[1] * position[1]);
+			float z = fabsf(position[2]);
+
+			if (xy > mesh_radius_xy) mesh_radius_xy = xy;
+			if (z > mesh_radius_z) mesh_radius_z = z;
+		}
+	}
+
+	// Save what we need to bind the
+	// index buffer, and draw the mesh
+	index_offset = mesh.indexOffsetInPayload;
+	index_count = mesh.header->indexCount;
+	index_type = (VkIndexType)mesh.header->indexType;
+
+	// "mesh" closes the file when it goes out of
+	// scope, which is fine, because the buffer has
+	// its own copy of the data now
+}
+
+// Textures are in the Assets folder at the top of the repository,
+// and the program runs from Code/x64/Debug or Code/x64/Release
+#define ASSET_PATH "../../../Assets/"
+
+// decoded textures are kept here, next to Square.mesh
+#define TEXTURE_CACHE_PATH "TextureCache"
+
+void Demo::prepare_textures()
+{
+	PROFILE_FUNCTION();
+
+	// The texture loader decodes PNG files on other threads,
+	// so that loading textures never stops the window from
+	// drawing. See TextureLoader.cpp for how this works
+	// Every texture gets a full chain of mip levels, which
+	// are made on the GPU in the same command buffer as
+	// the copy. The compute shader is only used for formats
+	// that the GPU can not blit with a linear filter
+	mip_generator = new MipGenerator(device, gpu, queue_family_index, ASSET_PATH "Shaders/Downsample.comp.spv");
+
+	texture_loader = new TextureLoader(device, gpu, memory_properties, queue, queue_family_index, mip_generator);
+
+	// The first time a PNG is loaded, it is decoded and its mip
+	// levels are made, and then the result is saved next to the
+	// program. Every time after that, the saved texture is
+	// uploaded as it is, which is much faster than decoding.
+	// If the folder can not be made, textures still load,
+	// they are just decoded every time
+	texture_loader->EnableCache(TEXTURE_CACHE_PATH);
+
+	// Textures do not make their own samplers, they all ask
+	// the sampler cache, which only makes one VkSampler for
+	// each set of settings. This is the sampler that most
+	// textures will use: linear filtering between pixels
+	// and between mip levels, repeating past the edges
+	sampler_cache = new SamplerCache(device);
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+	texture_sampler = sampler_cache->Get(samplerInfo);
+
+	// The shaders find textures in the texture table, which is
+	// descriptor set 1. In bindless mode, it is one set for every
+	// texture, so it is bound once per frame. See TextureTable.h
+	texture_table = new TextureTable(device, gpu, descriptor_allocator, bindless);
+
+	printf("Textures are %s, up to %u of them\n",
+		bindless ? "bindless" : "bound one at a time", texture_table->capacity);
+	fflush(stdout);
+
+	// Each texture is drawn on its own Square. The instance buffer
+	// has room for one SquareInstance per texture in the table,
+	// it is read by the vertex shader with VK_VERTEX_INPUT_RATE_INSTANCE.
+	// It is also a STORAGE_BUFFER, because Cull.comp reads it
+	VkBufferCreateInfo info = {};
 	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-	info.size = indexArraySize;
+	info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	info.size = texture_table->capacity * sizeof(SquareInstance);
+
+	instanceBufferCPU = new BufferCPU(device, memory_properties, info);
+	instance_count = 0;
+	instances_changed = false;
+
+	// Load() returns right away. A few frames later,
+	// when the texture is on the GPU and ready to use,
+	// the function we give it here will be called
+	texture_loader->Load(ASSET_PATH "logo.png", [this](const char* path, Texture* texture)
+	{
+		if (texture == nullptr)
+		{
+			printf("Could not load %s\n", path);
+			fflush(stdout);
+			return;
+		}
+
+		// the index in the table is the same as the
+		// index in "textures", because both only grow
+		if (texture_table->Add(texture, texture_sampler) == UINT32_MAX)
+		{
+			printf("No room for %s in the texture table\n", path);
+			fflush(stdout);
+			delete texture;
+			return;
+		}
+
+		textures.push_back(texture);
+
+		// draw() writes the instance buffer again,
+		// so that it has one more Square
+		instances_changed = true;
+	});
+}
+
+void Demo::update_instance_buffer()
+{
+	PROFILE_FUNCTION();
+
+	// The Squares are put on a grid that is "columns" wide,
+	// and shrunk so that the grid is the size of one Square.
+	// With one texture, this is the same Square as always
+	instance_count = (uint32_t)textures.size();
+
+	uint32_t columns = 1;
+	while (columns * columns < instance_count)
+		columns++;
+
+	float scale = 1.0f / columns;
+	SquareInstance* instances = (SquareInstance*)instanceBufferCPU->Map();
 
-	// Just like before, we make the buffer and we store data into it
-	indexDataCPU = new BufferCPU(device, memory_properties, info);
-	indexDataCPU->Store(indexArray.data(), indexArraySize);
+	for (uint32_t i = 0; i < instance_count; i++)
+	{
+		uint32_t x = i % columns;
+		uint32_t y = i / columns;
+
+		instances[i].offset[0] = (x + 0.5f) * scale - 0.5f;
+		instances[i].offset[1] = (y + 0.5f) * scale - 0.5f;
+		instances[i].scale = scale;
+		instances[i].texture = i;
+	}
+
+	instanceBufferCPU->Unmap();
+}
+
+void Demo::prepare_culling()
+{
+	PROFILE_FUNCTION();
+
+	// Every Square is tested against the view on the GPU, every
+	// frame, and then drawn with vkCmdDrawIndexedIndirect. In
+	// bindless mode, the visible Squares are packed into one
+	// list, and drawn with one command. Otherwise, each Square
+	// keeps its own draw (it needs its own descriptor set), and
+	// hidden Squares get an instanceCount of 0
+	instance_culler = new InstanceCuller(
+		device, gpu, memory_properties, queue_family_index,
+		ASSET_PATH "Shaders/Cull.comp.spv",
+		instanceBufferCPU->buffer, texture_table->capacity,
+		frame_lag, bindless);
+
+	// Without compute (or without the shader), we still
+	// draw, we just draw every Square
+	printf("GPU culling is %s\n", instance_culler->enabled ? "on" : "off");
+	fflush(stdout);
+}
+
+void Demo::prepare_gpu_timing()
+{
+	PROFILE_FUNCTION();
+
+	// One slot more than frame_lag, because draw() only waits for
+	// the fence of the frame frame_lag frames ago. By the time a slot
+	// is used again, the frame that used it last is finished, so its
+	// timestamps can be read without waiting
+	// Pipeline statistics only work if the feature was turned on
+	// in prepare_device_queue, otherwise we only get the times
+	gpu_timer = new GpuTimer(device, gpu, queue_family_index, frame_lag + 1,
+		enabled_features.pipelineStatisticsQuery == VK_TRUE);
+	frame_count = 0;
+	gpu_log = nullptr;
+	gpu_log_needs_header = false;
+
+	if (!gpu_timer->enabled)
+	{
+		printf("This queue can not write timestamps, GPU timing is off\n");
+		fflush(stdout);
+	}
+}
+
+// print the GPU times about twice per second
+#define GPU_TIMING_REPORT_FRAMES 120
+
+// the file that toggle_gpu_log() writes to
+#define GPU_LOG_PATH "gpu_frames.csv"
+
+void Demo::report_gpu_timing()
+{
+	// Every frame that has new results gets one line in the log.
+	// The header is written with the first line, because it uses
+	// the names of the passes, which come with the results
+	if (gpu_log != nullptr && gpu_timer->updated)
+	{
+		if (gpu_log_needs_header)
+		{
+			gpu_timer->WriteCsvHeader(gpu_log);
+			gpu_log_needs_header = false;
+		}
+
+		gpu_timer->WriteCsvRow(gpu_log);
+	}
+
+	if (!gpu_timer->enabled || frame_count % GPU_TIMING_REPORT_FRAMES != 0 || gpu_timer->passes.empty())
+		return;
+
+	printf("GPU frame %llu:", (unsigned long long)gpu_timer->frame);
+	for (size_t i = 0; i < gpu_timer->passes.size(); i++)
+		printf(" %s %.3f ms,", gpu_timer->passes[i].name, gpu_timer->passes[i].ms);
+	printf(" total %.3f ms\n", gpu_timer->frameMs);
+
+	if (gpu_timer->statisticsEnabled)
+	{
+		const GpuStatistics& stats = gpu_timer->statistics;
+		printf("    %llu vertices in, %llu vertex shaders, %llu triangles, %llu fragment shaders\n",
+			(unsigned long long)stats.inputVertices,
+			(unsigned long long)stats.vertexInvocations,
+			(unsigned long long)stats.clippingPrimitives,
+			(unsigned long long)stats.fragmentInvocations);
+
+		// Overdraw is how many times the fragment shader ran for
+		// each pixel of the main window. 1.0 would mean that every
+		// pixel was shaded once. Fragments that early-Z skipped
+		// never run the shader, so they are not counted
+		printf("    overdraw %.2f fragments per pixel\n", overdraw());
+	}
+
+	fflush(stdout);
+}
+
+// Fragment shaders per pixel of the main window, in the last
+// frame that GpuTimer has statistics for, 0 without statistics.
+// With dynamic resolution, per pixel that was drawn
+double Demo::overdraw()
+{
+	if (!gpu_timer->statisticsEnabled || width <= 0 || height <= 0)
+		return 0.0;
+
+	double pixels = (double)width * height;
+	if (resolution != nullptr)
+		pixels *= (double)resolution->scale * resolution->scale;
+
+	return (double)gpu_timer->statistics.fragmentInvocations / pixels;
+}
+
+void Demo::toggle_gpu_log()
+{
+	if (gpu_log != nullptr)
+	{
+		fclose(gpu_log);
+		gpu_log = nullptr;
+		printf("Stopped writing " GPU_LOG_PATH "\n");
+		fflush(stdout);
+		return;
+	}
+
+	// a new file every time, so that one run can be
+	// compared against another run in a spreadsheet
+	gpu_log = fopen(GPU_LOG_PATH, "w");
+	gpu_log_needs_header = true;
+
+	printf(gpu_log ? "Writing GPU times to " GPU_LOG_PATH "\n" : "Could not open " GPU_LOG_PATH "\n");
+	fflush(stdout);
+}
+
+// how many sprites the sprite batch has room for,
+// unless settings.sprite_count is more than this
+#define SPRITE_BATCH_CAPACITY 65536
+
+void Demo::prepare_readback()
+{
+	PROFILE_FUNCTION();
+
+	// One slot per frame in flight, the same as draw_cmds,
+	// a slot is collected right after draw() waits for the
+	// fence of the command buffer that filled it
+	readback = new FrameReadback(device, memory_properties, frame_lag);
+
+	if (!swapchain_readable)
+	{
+		printf("The swapchain images can not be copied, frame readback is off\n");
+		fflush(stdout);
+	}
+	else if (FrameReadback::BytesPerPixel(format) == 0)
+	{
+		printf("Frame readback does not support the swapchain's format\n");
+		fflush(stdout);
+	}
+
+	exporter = nullptr;
+	if (settings.export_path == nullptr || !swapchain_readable)
+		return;
+
+	// FrameExporter packs 8-bit RGBA or BGRA, so a swapchain
+	// with 10-bit or 16-bit float colors can't be exported
+	if (!FrameExporter::SupportsFormat(format))
+	{
+		printf("Exporting needs a swapchain with 8 bits per channel, %s is not written\n", settings.export_path);
+		fflush(stdout);
+		return;
+	}
+
+	// The exporter takes every frame (or export_frames frames),
+	// at the size that the window has now
+	ExportFormat exportFormat = FrameExporter::FormatForPath(settings.export_path);
+	exporter = new FrameExporter(settings.export_path, exportFormat, width, height, settings.export_fps);
+	if (!exporter->ok)
+	{
+		printf("Could not open %s for writing\n", settings.export_path);
+		fflush(stdout);
+		delete exporter;
+		exporter = nullptr;
+		return;
+	}
+
+	// Y4M is YUV, which the GPU makes from the frame before it
+	// is copied back, so the copy is 1.5 bytes per pixel instead
+	// of 4. If the shader can't read the swapchain images, the
+	// frame comes back as RGBA, and FrameExporter converts it
+	if (exportFormat == EXPORT_FORMAT_Y4M && swapchain_sampleable)
+		readback->PrepareYuv(ASSET_PATH "Shaders/RgbToYuv.comp.spv", descriptor_path);
+
+	readback->requested = settings.export_frames > 0 ? settings.export_frames : READBACK_EVERY_FRAME;
+	readback->callback = [this](const ReadbackImage& image)
+	{
+		exporter->Push(image);
+	};
+
+	printf("Writing frames to %s (%s)\n", settings.export_path,
+		readback->layout == READBACK_LAYOUT_I420 ? "YUV made on the GPU" :
+		exportFormat == EXPORT_FORMAT_Y4M ? "YUV made on the CPU" : "RGBA");
+	fflush(stdout);
+}
+
+void Demo::prepare_sprites()
+{
+	PROFILE_FUNCTION();
+
+	// The sprite batch has a vertex buffer for each frame in
+	// flight (frame_lag), so we can write sprites for the next
+	// frame while the GPU is still drawing the last one
+	uint32_t capacity = settings.sprite_count > SPRITE_BATCH_CAPACITY ? settings.sprite_count : SPRITE_BATCH_CAPACITY;
+	sprite_batch = new SpriteBatch(device, memory_properties, bindless, capacity, frame_lag);
+	sprite_time = 0.0f;
+}
+
+void Demo::update_sprites()
+{
+	PROFILE_FUNCTION();
+
+	sprite_batch->Begin(frame_index);
+
+	// Nothing to draw until a texture has loaded
+	if (!textures.empty())
+	{
+		// A field of small spinning sprites that drift across the
+		// window, using every texture that is loaded. Half of them
+		// are on layer 1, so they are always drawn over layer 0,
+		// even though they are submitted in between.
+		// With depth, the sprites on layer 1 are opaque, so the
+		// see-through sprites under them are skipped by early-Z
+		sprite_time += 1.0f / 60.0f;
+
+		uint32_t columns = 200;
+		float spacing = 12.0f;
+
+		for (uint32_t i = 0; i < settings.sprite_count; i++)
+		{
+			uint8_t layer = (uint8_t)(i & 1);
+			bool opaque = layer == 1 && opaque_sprite_pipeline != VK_NULL_HANDLE;
+
+			float x = (i % columns) * spacing;
+			float y = (i / columns) * spacing;
+
+			glm::vec2 position;
+			position.x = fmodf(x + sprite_time * 20.0f, columns * spacing);
+			position.y = fmodf(y + sprite_time * (10.0f + (i % 7)), (settings.sprite_count / columns + 1) * spacing);
+
+			sprite_batch->Submit(
+				position,
+				sprite_time + i * 0.1f,
+				glm::vec2(10.0f, 10.0f),
+				glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+				opaque ? 0xFFFFFFFF : 0xC0FFFFFF,
+				i % (uint32_t)textures.size(),
+				layer,
+				opaque ? opaque_sprite_pipeline_id : sprite_pipeline_id);
+		}
+	}
+
+	// sort, and write the indices
+	sprite_batch->End();
+}
+
+void Demo::prepare_resolution()
+{
+	PROFILE_FUNCTION();
+
+	resolution = nullptr;
+	if (!settings.dynamic_resolution)
+		return;
+
+	// The controller needs GPU times, the swapchain has to
+	// take a blit, and the format has to be blitted with
+	// LINEAR filtering. Most GPUs can do all of that
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(gpu, format, &format_properties);
+
+	VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	const char* problem = nullptr;
+	if (!gpu_timer->enabled)
+		problem = "this queue can not write timestamps";
+	else if (!swapchain_blittable)
+		problem = "the swapchain can not be blitted into";
+	else if ((format_properties.optimalTilingFeatures & needed) != needed)
+		problem = "the swapchain format can not be blitted with filtering";
+
+	if (problem != nullptr)
+	{
+		printf("Dynamic resolution is off, %s\n", problem);
+		fflush(stdout);
+		return;
+	}
+
+	resolution = new ResolutionController(settings.frame_budget_ms, settings.min_resolution_scale);
 }
 
 void Demo::prepare_render_pass()
 {
+	PROFILE_FUNCTION();
+
 	// The Render Pass describes what the GPU is outputting.
 	// Every time we draw a scene on the graphics card, we want the 
 	// graphics card to give us an image (which goes on the screen)
 
+	// First we pick how many samples each pixel gets (MSAA).
+	// settings.msaa_samples is what was asked for, but the GPU
+	// might not support that many, so we go down until we find
+	// a count that it supports. 1 is always supported
+	VkPhysicalDeviceProperties gpu_properties;
+	vkGetPhysicalDeviceProperties(gpu, &gpu_properties);
+	VkSampleCountFlags supported_samples = gpu_properties.limits.framebufferColorSampleCounts;
+
+	// With depth (settings.depth_sprites), the depth attachment
+	// needs the same number of samples as the color attachment.
+	// 16 bits of depth is plenty for 256 sprite layers, and
+	// D16_UNORM is the one depth format that every GPU supports
+	depth_format = VK_FORMAT_UNDEFINED;
+	if (settings.depth_sprites)
+	{
+		depth_format = VK_FORMAT_D16_UNORM;
+		supported_samples &= gpu_properties.limits.framebufferDepthSampleCounts;
+	}
+
+	samples = VK_SAMPLE_COUNT_1_BIT;
+	for (uint32_t count = settings.msaa_samples; count > 1; count /= 2)
+	{
+		if (count <= 8 && (supported_samples & count))
+		{
+			samples = (VkSampleCountFlagBits)count;
+			break;
+		}
+	}
+
+	if (settings.msaa_samples > 1)
+	{
+		printf("MSAA: %ux was asked for, using %ux\n", settings.msaa_samples, (uint32_t)samples);
+		fflush(stdout);
+	}
+
 	// The initial layout for the color will be LAYOUT_UNDEFINED
 	// because at the start of the renderpass, we don't care about their contents.
 	// At the start of the subpass, the color attachment's layout will be transitioned
@@ -1874,7 +2566,7 @@ void Demo::prepare_render_pass()
 	// the renderpass, the color attachment's layout will be transitioned to
 	// LAYOUT_PRESENT_SRC_KHR to be ready to present.  This is all done as part of
 	// the renderpass, no barriers are necessary.
-	VkAttachmentDescription attachments[1];
+	VkAttachmentDescription attachments[3];
 
 	// The first attachment is our color
 	attachments[0].format = format;
@@ -1887,6 +2579,48 @@ void Demo::prepare_render_pass()
 	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+	// With MSAA, we draw into a multisampled image instead (the
+	// first attachment), and at the end of the subpass, the GPU
+	// averages the samples of each pixel into the swapchain image
+	// (the second attachment), which is called a "resolve".
+	// The multisampled image is never needed after the render
+	// pass, so storeOp is DONT_CARE. On a tile-based GPU, that
+	// means the samples never leave the chip, only the resolved
+	// pixels are written to memory, see RenderTarget.h
+	if (samples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		attachments[1] = attachments[0];
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+		attachments[0].samples = samples;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	uint32_t attachment_count = samples != VK_SAMPLE_COUNT_1_BIT ? 2 : 1;
+
+	// The depth attachment goes last. It is cleared to 1 (the
+	// farthest depth) at the start, and like the multisampled
+	// image, it is not needed after the render pass, so it is
+	// never written to memory (DONT_CARE)
+	VkAttachmentReference depth_reference;
+	depth_reference.attachment = attachment_count;
+	depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	if (depth_format != VK_FORMAT_UNDEFINED)
+	{
+		VkAttachmentDescription& depth = attachments[attachment_count++];
+		depth.format = depth_format;
+		depth.flags = 0;
+		depth.samples = samples;
+		depth.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depth.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depth.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	}
+
 	// For now, the attatchments array is finished, we 
 	// will use the array at the bottom of the function, don't
 	// worry about it for now
@@ -1908,6 +2642,18 @@ void Demo::prepare_render_pass()
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &color_reference;
 
+	// With MSAA, the color reference is the multisampled
+	// image, and the resolve reference is the swapchain image
+	VkAttachmentReference resolve_reference;
+	resolve_reference.attachment = 1;
+	resolve_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	if (samples != VK_SAMPLE_COUNT_1_BIT)
+		subpass.pResolveAttachments = &resolve_reference;
+
+	if (depth_format != VK_FORMAT_UNDEFINED)
+		subpass.pDepthStencilAttachment = &depth_reference;
+
 	// Now we have our subpass description, 
 	// we will use this at the bottom of the function
 
@@ -1931,8 +2677,22 @@ void Demo::prepare_render_pass()
 	attachmentDependencies[0].srcAccessMask = 0;
 	attachmentDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 
-	// create information that describes what
-	// we want in our renderpass
+	// The multisampled image and the depth image are not part of
+	// the swapchain, every frame in flight uses the same ones. So
+	// this frame has to wait until the last frame is done writing
+	// them, before it clears them again
+	if (attachment_count > 1)
+	{
+		attachmentDependencies[0].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		attachmentDependencies[0].dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		attachmentDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		attachmentDependencies[0].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	}
+
+	// create information that describes what
+	// we want in our renderpass
 	VkRenderPassCreateInfo rp_info = {};
 
 	// sType for all VkRenderPassCreateInfo structures
@@ -1940,8 +2700,8 @@ void Demo::prepare_render_pass()
 
 	// the array of pAttatchments will be the "attatchments"
 	// array that we just made, and there are 1 elements
-	// in the array
-	rp_info.attachmentCount = 1;
+	// in the array, one more with MSAA, and one more with depth
+	rp_info.attachmentCount = attachment_count;
 	rp_info.pAttachments = attachments;
 
 	// The "array" of pSubpasses won't really be an array
@@ -1958,21 +2718,56 @@ void Demo::prepare_render_pass()
 
 	// create a renderpass based on the information we provided
 	vkCreateRenderPass(device, &rp_info, NULL, &render_pass);
+
+	// With dynamic resolution, the main window's scene is drawn
+	// into an offscreen image, not the swapchain image. The render
+	// pass is the same, except that the image is left ready to be
+	// blitted (TRANSFER_SRC). The last frame's blit has to be done
+	// reading it before we draw into it again, but that is a barrier
+	// between two passes of the frame graph, which the graph makes
+	// before the render pass (see prepare_frame_graph). Everything
+	// that pipelines care about is the same (formats and samples),
+	// so the same pipelines work in both render passes
+	offscreen_render_pass = VK_NULL_HANDLE;
+	if (resolution != nullptr)
+	{
+		uint32_t output = samples != VK_SAMPLE_COUNT_1_BIT ? 1 : 0;
+		attachments[output].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		vkCreateRenderPass(device, &rp_info, NULL, &offscreen_render_pass);
+	}
 }
 
 void Demo::prepare_pipeline()
 {
+	PROFILE_FUNCTION();
+
 	// Now we create a pipeline layout, which will have
-	// one descriptor set in it. Super simple, just use 
-	// the required sType, give it the layout we just made,
-	// and let it know that there is one descriptor layout
+	// two descriptor sets in it. Set 0 is the uniform buffer,
+	// with the layout we just made, and set 1 is the texture
+	// table, which made its own layout
+	VkDescriptorSetLayout set_layouts[2] = { desc_layout, texture_table->layout };
+
+	// The sprite pipeline uses the same layout, so that the
+	// descriptor sets stay bound when we switch to it. It also
+	// has 16 bytes of push constants, which are small values that
+	// go straight into the command buffer, without any buffer.
+	// Sprite.vert uses them to turn pixels into -1 to 1
+	VkPushConstantRange push_range = {};
+	push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_range.offset = 0;
+	push_range.size = 4 * sizeof(float);
+
 	VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
 	pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pPipelineLayoutCreateInfo.setLayoutCount = 1;
-	pPipelineLayoutCreateInfo.pSetLayouts = &desc_layout;
+	pPipelineLayoutCreateInfo.setLayoutCount = 2;
+	pPipelineLayoutCreateInfo.pSetLayouts = set_layouts;
+	pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pPipelineLayoutCreateInfo.pPushConstantRanges = &push_range;
 
 	// Make the layout, we will use this when we build the pipeline later on
 	vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, NULL, &pipeline_layout);
+	FrameCapture::TrackPipelineLayout(pipeline_layout, pPipelineLayoutCreateInfo);
 	
 	// This is the CreateInfo for full pipeline
 	// This will be the largest CreateInfo structure of the
@@ -1992,52 +2787,59 @@ void Demo::prepare_pipeline()
 	// and we tell it how large each Vertex is. If the GPU has a Vertex Buffer that is 100kb large,
 	// the GPU needs to know where each vertex starts and ends, and it knows that by knowing
 	// how large each vertex is, which we tell it here
-	VkVertexInputBindingDescription vertexInputBinding = {};
-	vertexInputBinding.binding = 0;
-	vertexInputBinding.stride = sizeof(VertexStructure);
-	vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	VkVertexInputBindingDescription vertexInputBindings[2] = {};
+	vertexInputBindings[0].binding = 0;
+	vertexInputBindings[0].stride = vertex_stride;
+	vertexInputBindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	// The second binding is the instance buffer. INPUT_RATE_INSTANCE
+	// means the GPU moves to the next SquareInstance once per instance
+	// (once per Square), instead of once per vertex
+	vertexInputBindings[1].binding = 1;
+	vertexInputBindings[1].stride = sizeof(SquareInstance);
+	vertexInputBindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
 	// Input attribute bindings describe shader attribute locations and memory layouts
 	// This is very similar to how vertex attributes work in any other. Basically,
-	// in the last structure, we say how large each vertex is, but in this structure,
-	// we say how large each piece of the vertex is
-	VkVertexInputAttributeDescription vertexInputAttributs[2];
-	memset(vertexInputAttributs, 0, sizeof(VkVertexInputAttributeDescription) * 2);
-
-	// location = 0, because this is the first element of the vertex
-	vertexInputAttributs[0].location = 0;
-
-	// offsetof returns 0, because position starts 0 bytes after the start of the vertex
-	vertexInputAttributs[0].offset = offsetof(VertexStructure, position);
-
-	// format is R32-G32-B32, because there are three 32-bit floats in the position data,
-	// one float for X, one float for Y, and one float for Z, of each position, of each vertex
-	vertexInputAttributs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-
-	// location = 1, because this is the second element of the vertex
-	vertexInputAttributs[1].location = 1;
-
-	// offsetof returns 12, because color starts 12 bytes after the start of the vertex,
-	// because there are 12 bits in position (3 floats that are 4 bytes large)
-	vertexInputAttributs[1].offset = offsetof(VertexStructure, color);	
-
-	// format is R32-B32, because there are two floats in every color.
-	vertexInputAttributs[1].format = VK_FORMAT_R32G32_SFLOAT;
+	// in the last structure, we say how large each vertex is, and the attributes
+	// say how large each piece of the vertex is. We do not need to build the
+	// attributes here, because the mesh file already described them, and 
+	// prepare_vb_ib saved them in vertex_attributes. For the Square, there
+	// are two: position (location 0, three floats, 0 bytes into the vertex),
+	// and color (location 1, two floats, 12 bytes into the vertex).
+	// After those, we add the two attributes of each instance:
+	// offset and scale (location 2, three floats), and the index
+	// of the texture in the texture table (location 3, one uint)
+	VkVertexInputAttributeDescription attributes[MESH_FILE_MAX_ATTRIBUTES + 2];
+	uint32_t attribute_count = vertex_attribute_count;
+	memcpy(attributes, vertex_attributes, sizeof(VkVertexInputAttributeDescription) * vertex_attribute_count);
+
+	attributes[attribute_count].location = 2;
+	attributes[attribute_count].binding = 1;
+	attributes[attribute_count].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[attribute_count].offset = offsetof(SquareInstance, offset);
+	attribute_count++;
+
+	attributes[attribute_count].location = 3;
+	attributes[attribute_count].binding = 1;
+	attributes[attribute_count].format = VK_FORMAT_R32_UINT;
+	attributes[attribute_count].offset = offsetof(SquareInstance, texture);
+	attribute_count++;
 
 	// Vertex Input State
 	// This combines the last two structures we made
 	// We give it the requires sType, we give it the number of 
-	// binding descriptions, which is one, and we give it the 
-	// pointer to the bindingInput, because it is not an array.
-	// We tell it how many attributes there are (two) (pos and color),
-	// then we give it the array of two attributes (which is already
-	// a pointer)
+	// binding descriptions, which is two (vertices and instances),
+	// and we give it the array of bindings.
+	// We tell it how many attributes there are (four) (pos, color,
+	// offset and scale, and texture), then we give it the array of
+	// attributes (which is already a pointer)
 	VkPipelineVertexInputStateCreateInfo vi = {};
 	vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vi.vertexBindingDescriptionCount = 1;
-	vi.pVertexBindingDescriptions = &vertexInputBinding;
-	vi.vertexAttributeDescriptionCount = 2;
-	vi.pVertexAttributeDescriptions = vertexInputAttributs;
+	vi.vertexBindingDescriptionCount = 2;
+	vi.pVertexBindingDescriptions = vertexInputBindings;
+	vi.vertexAttributeDescriptionCount = attribute_count;
+	vi.pVertexAttributeDescriptions = attributes;
 	
 	// we put the InputStateCrateInfo into the PipelineCreateInfo
 	pipeInfo.pVertexInputState = &vi;
@@ -2149,9 +2951,9 @@ void Demo::prepare_pipeline()
 	// give the blendState to the PipelineCreateInfo
 	pipeInfo.pColorBlendState = &cb;
 
-	// In this tutorial, we don't have a depth buffer,
-	// we have a 2D square, so we give the required sTYpe,
-	// and we move on
+	// The Squares do not use the depth buffer, even if
+	// there is one, they are a 2D background, so we give
+	// the required sTYpe, and we move on
 	VkPipelineDepthStencilStateCreateInfo ds = {};
 	ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 
@@ -2160,14 +2962,15 @@ void Demo::prepare_pipeline()
 
 	// multisample state
 	// this allows for multisample anti-aliasing (MSAA).
-	// In this tutorial, we won't be using MSAA, so we set
-	// the number of samples to 1, and we give the necessary sType.
-	// If someone wants MSAA, it takes a little more effort than
-	// changing COUNT-1-BIT to COUNT-8-BIT, but this is definetely
-	// where it starts, there may be a tutorial on MSAA later
+	// The number of samples has to be the same as the
+	// color attachment's in the render pass, which
+	// prepare_render_pass picked. It takes a little more
+	// effort than changing COUNT-1-BIT to COUNT-8-BIT,
+	// the render pass and the framebuffers need a
+	// multisampled image too, but this is where it starts
 	VkPipelineMultisampleStateCreateInfo ms = {};
 	ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	ms.rasterizationSamples = samples;
 
 	// give multisample state to the PipelineCreateInfo
 	pipeInfo.pMultisampleState = &ms;
@@ -2192,89 +2995,32 @@ void Demo::prepare_pipeline()
 	// EXE file. This way, the shaders are compiled AND inside the
 	// program, so the end-user won't have any shader files.
 
-	// Right now, I have written a program called "compileShaders.cmd"
-	// First, it compiles the GLSL files Square.vert and Square.frag into
-	// compiled shader files:
-	//		..\Bin\glslangValidator.exe -V Square.vert -o Square.vert.spv
-	// Next, it optimizes the compiled shader by removing the 
-	// debug features of the shader. This can be disabled if you want
-	//		..\Bin\spirv-opt --strip-debug Square.vert.spv -o Square2.vert.spv
-
-	// If you want to load precompiled shaders from files at runtime,
-	// you can use Square2.vert.spv and Square2.frag.spv. However,
-	// you will not find these files anywhere, and I will explain why 
-	// in a second.
-
-	// What we do next is, take the optimized compiled shader files,
-	// and turn them into an array of bytes
-	//		bin2hex --i Square2.vert.spv --o Square.vert.inc
-	// Then, after it is converted to an array of bytes,
-	// the original compiled shader files are deleted
-	//		del Square.vert.spv
-	//		del Square2.vert.spv
-
-	// Finally, the array of bytes are included here.
-	// If you open the inc files in notepad, you will
-	// see the bytes of the compiled shader, looks like
-	// this:
-	//	0x03, 0x02, 0x23, 0x07, 0x00, 0x00, 0x01, ...
-
-	// By using #include, we can put those 
-	// arrays into the C++ program, and then
-	// we can compile the arrays into the EXE
-
-	// Vertex Shader compiled to header
-	const unsigned char vs_code[] = {
-		#include "Square.vert.inc"
-	};
-
-	// Fragment Shader compiled to header
-	const unsigned char fs_code[] = {
-		#include "Square.frag.inc"
-	};
-
-	// If you do not want to do this ^^^
-	// if you would prefer to take the compiled shader files
-	// and load them at runtime, you can make an empty array
-	// of bytes: char* vs_code = nullptr, char* fs_code = nullptr,
-	// Then you can use Helper::ReadFile to laod data from the 
-	// comopiled shader file into the byte arrays when the program
-	// launches, it works exactly the same as reading the PNG texture
-	// file, like we did before. If you want to use compiled shader
-	// files, then delete the lines in the compileShaders.cmd file
-	// that say:
-	//		del Square.vert.spv
-	//		del Square2.vert.spv
-
-	// Now, we need CreateInfo for each Shader Module.
-	// A Shader Module is a piece of a total Shader Program.
-	// One Shader Program is a combination of a vertex shader,
-	// a pixel shader, and sometimes more. So an individual
-	// vertex shader is a shader module, and a fragment shader
-	// is a shader module. We make a CreateInfo with the required sType
-	VkShaderModuleCreateInfo shaderInfo = {};
-	shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-
-	// We give a pointer to the bytes of the compiled vertex shader,
-	// and the number of bytes that are in the compiled vertex shader
-	shaderInfo.pCode = (uint32_t*)vs_code;
-	shaderInfo.codeSize = sizeof(vs_code);
-
-	// Then we use the createInfo to make the shader module
-	vkCreateShaderModule(device, &shaderInfo, NULL, &vert_shader_module);
-
-	// We are going to re-use the createInfo that we used for the
-	// vertex shader, to make the createInfo for the fragment shader.
-	// All we have to do is replace the vertex shader data with
-	// the fragment shader data
-
-	// we give the pointer to compiled fragment shader bytes
-	// and the number of bytes in the compiled fragment shader
-	shaderInfo.pCode = (uint32_t*)fs_code;
-	shaderInfo.codeSize = sizeof(fs_code);
-
-	// Then we use the createInfo to make the shader module
-	vkCreateShaderModule(device, &shaderInfo, NULL, &frag_shader_module);
+	// We used to do option 2, but now there are two versions of
+	// Square.frag: one for bindless textures, and one for GPUs
+	// that can not do bindless (see TextureTable.h), and we
+	// pick one when the program runs. So we do option 1.
+	// "compileShaders.cmd" compiles the GLSL files into the
+	// Assets/Shaders folder, and it compiles Square.frag twice,
+	// once with BINDLESS defined:
+	//		..\Bin\glslangValidator.exe -V Square.vert -o ..\Assets\Shaders\Square.vert.spv
+	//		..\Bin\glslangValidator.exe -V -DBINDLESS Square.frag -o ..\Assets\Shaders\SquareBindless.frag.spv
+
+	// Helper::create_shader_module_from_file maps the compiled
+	// shader file with FileView and gives the bytes to the driver,
+	// and it makes the VkShaderModule. A Shader Module is a piece of
+	// a total Shader Program. One Shader Program is a combination of
+	// a vertex shader, a pixel shader, and sometimes more. So an
+	// individual vertex shader is a shader module, and a fragment
+	// shader is a shader module
+	const char* frag_path = bindless ?
+		ASSET_PATH "Shaders/SquareBindless.frag.spv" :
+		ASSET_PATH "Shaders/Square.frag.spv";
+
+	if (!Helper::create_shader_module_from_file(device, ASSET_PATH "Shaders/Square.vert.spv", &vert_shader_module) ||
+		!Helper::create_shader_module_from_file(device, frag_path, &frag_shader_module))
+	{
+		ERR_EXIT("Could not load the Square shaders, build vkcube or run compileShaders.cmd\n", "Shader Failure");
+	}
 
 	// We create a list of pipeline stages
 	// In this case, there are two stages, a vertex shader
@@ -2336,16 +3082,163 @@ void Demo::prepare_pipeline()
 	// create the pipeline, with our pipeInfo structure
 	// and then our pipeline is stored into the cache
 	vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipeInfo, NULL, &pipeline);
+	FrameCapture::TrackGraphicsPipeline(pipeline, pipeInfo);
 
 	// Now that our shaders are now copied into the pipeline,
 	// we do not need the individual modules anymore.
 	// destroy shader modules, now that they aren't needed
 	vkDestroyShaderModule(device, frag_shader_module, NULL);
 	vkDestroyShaderModule(device, vert_shader_module, NULL);
+
+	// Sprite Pipeline
+	//=====================================
+
+	// The sprite pipeline is almost the same as the Square's,
+	// so we reuse pipeInfo, and only change what is different:
+	// the shaders, the vertex layout (SpriteVertex), no culling,
+	// because sprites can be flipped with a negative scale, and
+	// alpha blending, so the see-through parts of a sprite
+	// show what is behind it
+	const char* sprite_frag_path = bindless ?
+		ASSET_PATH "Shaders/SpriteBindless.frag.spv" :
+		ASSET_PATH "Shaders/Sprite.frag.spv";
+
+	if (!Helper::create_shader_module_from_file(device, ASSET_PATH "Shaders/Sprite.vert.spv", &vert_shader_module) ||
+		!Helper::create_shader_module_from_file(device, sprite_frag_path, &frag_shader_module))
+	{
+		ERR_EXIT("Could not load the Sprite shaders, run compileShaders.cmd\n", "Shader Failure");
+	}
+
+	shaderStages[0].module = vert_shader_module;
+	shaderStages[1].module = frag_shader_module;
+
+	VkVertexInputBindingDescription spriteBinding;
+	VkVertexInputAttributeDescription spriteAttributes[4];
+	SpriteBatch::VertexInput(&spriteBinding, spriteAttributes);
+
+	vi.vertexBindingDescriptionCount = 1;
+	vi.pVertexBindingDescriptions = &spriteBinding;
+	vi.vertexAttributeDescriptionCount = 4;
+	vi.pVertexAttributeDescriptions = spriteAttributes;
+
+	rs.cullMode = VK_CULL_MODE_NONE;
+
+	// color = source * alpha + destination * (1 - alpha)
+	att_state[0].blendEnable = VK_TRUE;
+	att_state[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	att_state[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	att_state[0].colorBlendOp = VK_BLEND_OP_ADD;
+	att_state[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	att_state[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	att_state[0].alphaBlendOp = VK_BLEND_OP_ADD;
+
+	// With a depth buffer, see-through sprites still test depth,
+	// so they are not drawn behind opaque sprites, but they do
+	// not write it, because what is behind them still shows
+	if (depth_format != VK_FORMAT_UNDEFINED)
+	{
+		ds.depthTestEnable = VK_TRUE;
+		ds.depthWriteEnable = VK_FALSE;
+		ds.depthCompareOp = VK_COMPARE_OP_LESS;
+	}
+
+	vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipeInfo, NULL, &sprite_pipeline);
+	FrameCapture::TrackGraphicsPipeline(sprite_pipeline, pipeInfo);
+
+	// the sprite batch sorts sprites by this number
+	sprite_pipeline_id = sprite_batch->AddPipeline(sprite_pipeline);
+
+	// The opaque sprite pipeline does not blend, and writes
+	// depth, so that anything drawn after it, behind it, is
+	// skipped before its fragment shader runs. SpriteBatch
+	// draws these sprites first, front to back
+	opaque_sprite_pipeline = VK_NULL_HANDLE;
+	opaque_sprite_pipeline_id = sprite_pipeline_id;
+
+	if (depth_format != VK_FORMAT_UNDEFINED)
+	{
+		att_state[0].blendEnable = VK_FALSE;
+		ds.depthWriteEnable = VK_TRUE;
+
+		vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipeInfo, NULL, &opaque_sprite_pipeline);
+		FrameCapture::TrackGraphicsPipeline(opaque_sprite_pipeline, pipeInfo);
+
+		opaque_sprite_pipeline_id = sprite_batch->AddPipeline(opaque_sprite_pipeline, true);
+	}
+
+	vkDestroyShaderModule(device, frag_shader_module, NULL);
+	vkDestroyShaderModule(device, vert_shader_module, NULL);
+}
+
+// the usage of the frame graph's offscreen image, the render
+// pass draws into it, and record_upscale blits from it
+#define OFFSCREEN_USAGE (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+
+// An imageless framebuffer for the render pass, with the same
+// attachments as the ones that prepare_framebuffers makes, where
+// the attachment that would be the swapchain image is any image
+// with the window's size and format, and "targetUsage"
+VkFramebuffer Demo::create_imageless_framebuffer(VkRenderPass pass, VkImageUsageFlags targetUsage)
+{
+	// Instead of image views, the framebuffer gets what the views
+	// passed to vkCmdBeginRenderPass will look like: the usage
+	// and size of their images, and the formats of the views
+	VkFramebufferAttachmentImageInfoKHR images[3] = {};
+	VkFormat formats[3];
+	uint32_t count = 0;
+
+	if (msaa_target != nullptr)
+	{
+		formats[count] = format;
+		images[count].usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		count++;
+	}
+
+	formats[count] = format;
+	images[count].usage = targetUsage;
+	count++;
+
+	if (depth_target != nullptr)
+	{
+		formats[count] = depth_format;
+		images[count].usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		count++;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		images[i].sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO_KHR;
+		images[i].width = width;
+		images[i].height = height;
+		images[i].layerCount = 1;
+		images[i].viewFormatCount = 1;
+		images[i].pViewFormats = &formats[i];
+	}
+
+	VkFramebufferAttachmentsCreateInfoKHR attachments_info = {};
+	attachments_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENTS_CREATE_INFO_KHR;
+	attachments_info.attachmentImageInfoCount = count;
+	attachments_info.pAttachmentImageInfos = images;
+
+	VkFramebufferCreateInfo fb_info = {};
+	fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	fb_info.pNext = &attachments_info;
+	fb_info.flags = VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT_KHR;
+	fb_info.renderPass = pass;
+	fb_info.attachmentCount = count;
+	fb_info.width = width;
+	fb_info.height = height;
+	fb_info.layers = 1;
+
+	VkFramebuffer framebuffer;
+	vkCreateFramebuffer(device, &fb_info, NULL, &framebuffer);
+	return framebuffer;
 }
 
 void Demo::prepare_framebuffers()
 {
+	PROFILE_FUNCTION();
+
 	// Remember when we had VkImage for the swapchain 
 	// images? Remember how we created a VkImageView 
 	// to hold each VkImage? Here is where that is important
@@ -2366,11 +3259,69 @@ void Demo::prepare_framebuffers()
 
 	// Therefore, we need one framebuffer for each swapchain image.
 
-	// We create an array of one attachment,
+	// With MSAA, every framebuffer shares one multisampled
+	// image, because only one frame draws at a time. It
+	// is TRANSIENT, so that it can use lazy memory, see
+	// RenderTarget.h. It has the size of the window, so it
+	// is made again when the window changes size
+	if (samples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		msaa_target = new RenderTarget(device, memory_properties, width, height, format, samples,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+			VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	// The depth image is shared the same way, and is
+	// TRANSIENT too, because only the render pass uses it
+	if (depth_format != VK_FORMAT_UNDEFINED)
+	{
+		depth_target = new RenderTarget(device, memory_properties, width, height, depth_format, samples,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+			VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
+	// With VK_KHR_imageless_framebuffer, a framebuffer does not
+	// hold image views, it only knows the size, format and usage
+	// of the images that it will be given in vkCmdBeginRenderPass
+	// (see record_scene). So the main window needs one framebuffer,
+	// not one for each swapchain image, and nothing that is made
+	// again here (the swapchain, its views, the multisampled and
+	// depth images, the offscreen image) makes it stale. It is only
+	// made again when the size changes, so a swapchain that was out
+	// of date, or a window that was minimized and restored, costs
+	// no framebuffers at all
+	if (imageless)
+	{
+		for (uint32_t i = 0; i < swapchainImageCount; i++)
+			swapchain_image_resources[i].framebuffer = VK_NULL_HANDLE;
+
+		if (imageless_framebuffer != VK_NULL_HANDLE &&
+			imageless_width == (uint32_t)width && imageless_height == (uint32_t)height)
+			return;
+
+		// the GPU is done with them, resize() waited for it,
+		// and destroying VK_NULL_HANDLE does nothing
+		vkDestroyFramebuffer(device, imageless_framebuffer, NULL);
+		vkDestroyFramebuffer(device, offscreen_framebuffer, NULL);
+		offscreen_framebuffer = VK_NULL_HANDLE;
+
+		imageless_framebuffer = create_imageless_framebuffer(render_pass, swapchain_usage);
+
+		if (resolution != nullptr)
+			offscreen_framebuffer = create_imageless_framebuffer(offscreen_render_pass, OFFSCREEN_USAGE);
+
+		imageless_width = width;
+		imageless_height = height;
+		return;
+	}
+
+	// We create an array of attachments,
 	// as described in the render pass, one will
 	// be used to export color of the image.
-	// We will add more in future tutorials
-	VkImageView attachments[1];
+	// With MSAA, the first one is the multisampled
+	// image, and the second one is the swapchain image.
+	// With depth, the depth image is the last one
+	VkImageView attachments[3];
 
 	// we create a structure of information that will be used
 	// to create each framebuffer. sType will be the same
@@ -2390,6 +3341,19 @@ void Demo::prepare_framebuffers()
 	fb_info.attachmentCount = 1;
 	fb_info.pAttachments = attachments;
 
+	// the swapchain image is written in the loop below
+	uint32_t swapchain_attachment = 0;
+
+	if (msaa_target != nullptr)
+	{
+		attachments[0] = msaa_target->view;
+		swapchain_attachment = 1;
+		fb_info.attachmentCount = 2;
+	}
+
+	if (depth_target != nullptr)
+		attachments[fb_info.attachmentCount++] = depth_target->view;
+
 	// We give the width and height of the frameBuffer
 	// which is the same as the screen dimensions
 	fb_info.width = width;
@@ -2400,13 +3364,27 @@ void Demo::prepare_framebuffers()
 	// that is for advacned topics
 	fb_info.layers = 1;
 
+	// With dynamic resolution, there is one more framebuffer, with
+	// the frame graph's offscreen image where the swapchain image
+	// would be. It has the size of the window, even though the
+	// scene is only drawn into part of it (ResolutionController::
+	// scale), so that it is only made again when the window
+	// changes size, not when the scale changes
+	if (resolution != nullptr)
+	{
+		attachments[swapchain_attachment] = frame_graph->View(graph_offscreen);
+		fb_info.renderPass = offscreen_render_pass;
+		vkCreateFramebuffer(device, &fb_info, NULL, &offscreen_framebuffer);
+		fb_info.renderPass = render_pass;
+	}
+
 	// loop through every swapchain image we have
 	for (uint32_t i = 0; i < swapchainImageCount; i++)
 	{
 		// set the first member of the attachment array (index 0)
 		// to the swapchain image that we want to render to, for each
 		// framebuffer
-		attachments[0] = swapchain_image_resources[i].view;
+		attachments[swapchain_attachment] = swapchain_image_resources[i].view;
 
 		// create a framebuffer for each swapchain image
 		// based on the information provided.
@@ -2417,155 +3395,558 @@ void Demo::prepare_framebuffers()
 	}
 }
 
-void Demo::build_swapchain_cmds()
+// Every frame is the same passes: culling, the main window's render
+// pass, the upscale, the other windows, and the readback. Instead of
+// writing the barriers between them by hand, each pass says what it
+// reads and writes, and RenderGraph works out the order and the
+// barriers, and leaves out passes that nothing needs. Any pass that
+// is added later (post-processing, more compute) only has to say what
+// it uses, and the barriers around it come for free.
+//
+// The graph is made again when the window changes size, because
+// the offscreen image has the size of the window. Everything that
+// changes every frame (the swapchain image, the culling buffers of
+// this frame) is given to it in record_draw_cmd
+void Demo::prepare_frame_graph()
 {
-	// Create the information needed to start the command buffer,
-	// we give it the required sType to get started
-	VkCommandBufferBeginInfo cmd_buf_info = {};
-	cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	PROFILE_FUNCTION();
+
+	frame_graph = new RenderGraph(device, memory_properties);
+
+	// The swapchain image is UNDEFINED when it is acquired, and the
+	// submit waits for the acquire at COLOR_ATTACHMENT_OUTPUT. It is
+	// an output of the frame, which must end up ready to present
+	graph_swapchain = frame_graph->ImportImage("Swapchain image", VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	// Made by the graph, only alive between the render pass
+	// and the upscale, so any other transient image that is not
+	// alive at the same time can share its memory
+	graph_offscreen = RENDER_GRAPH_NONE;
+	if (resolution != nullptr)
+	{
+		graph_offscreen = frame_graph->CreateImage("Offscreen image", width, height, format,
+			OFFSCREEN_USAGE, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	// Each frame in flight has its own culling buffers, and the
+	// fence of this frame was waited for, so nothing from an
+	// older frame uses them when this frame starts
+	bool culling = instance_culler->enabled;
+
+	graph_visible = RENDER_GRAPH_NONE;
+	graph_indirect = RENDER_GRAPH_NONE;
+	if (culling)
+	{
+		graph_visible = frame_graph->ImportBuffer("Visible instances");
+		graph_indirect = frame_graph->ImportBuffer("Indirect draws");
+	}
+
+	// Culling is a compute shader, and compute shaders can not
+	// run inside of a render pass, so it is its own pass. It
+	// resets the draw command with a transfer, then writes it
+	// (and the visible instances) from the compute shader
+	if (culling)
+	{
+		uint32_t pass = frame_graph->AddPass("Culling", [this](VkCommandBuffer cmd)
+		{
+			uint32_t time = gpu_timer->BeginPass(cmd, "Culling");
+
+			instance_culler->Record(cmd, frame_index, instance_count, index_count,
+				clip_matrix, mesh_radius_xy, mesh_radius_z);
+
+			gpu_timer->EndPass(cmd, time);
+		});
+
+		VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		frame_graph->Write(pass, graph_visible, stages, VK_ACCESS_SHADER_WRITE_BIT);
+		frame_graph->Write(pass, graph_indirect, stages, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	}
+
+	// The main window, straight into the swapchain image, or
+	// into the offscreen image, at a smaller size. The render pass
+	// starts with initialLayout UNDEFINED, so the image does not
+	// need a layout before it, and it ends in the render pass's
+	// finalLayout. The multisampled and depth images are only used
+	// inside of the render pass, so its subpass dependency is
+	// all they need, and they are not part of the graph
+	{
+		uint32_t pass = frame_graph->AddPass("Render pass", [this](VkCommandBuffer cmd)
+		{
+			// the timestamps go outside of the render pass,
+			// so that they include clearing and storing the image
+			uint32_t time = gpu_timer->BeginPass(cmd, "Render pass");
+
+			// count the vertices and fragments of the render pass
+			gpu_timer->BeginStatistics(cmd);
+
+			// an imageless framebuffer is given its image here
+			if (resolution != nullptr && imageless)
+			{
+				record_scene(cmd, offscreen_render_pass, offscreen_framebuffer, width, height, resolution->scale,
+					frame_graph->View(graph_offscreen));
+			}
+			else if (resolution != nullptr)
+			{
+				record_scene(cmd, offscreen_render_pass, offscreen_framebuffer, width, height, resolution->scale);
+			}
+			else if (imageless)
+			{
+				record_scene(cmd, render_pass, imageless_framebuffer, width, height, 1.0f,
+					swapchain_image_resources[current_buffer].view);
+			}
+			else
+			{
+				record_scene(cmd, render_pass, swapchain_image_resources[current_buffer].framebuffer,
+					width, height, 1.0f);
+			}
+
+			gpu_timer->EndStatistics(cmd);
+			gpu_timer->EndPass(cmd, time);
+		});
+
+		if (culling)
+		{
+			frame_graph->Read(pass, graph_indirect, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+				VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+			frame_graph->Read(pass, graph_visible, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		}
+
+		if (resolution != nullptr)
+		{
+			frame_graph->Write(pass, graph_offscreen, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		}
+		else
+		{
+			frame_graph->Write(pass, graph_swapchain, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		}
+	}
+
+	// Stretches the offscreen image over the swapchain image. The
+	// graph puts the swapchain image in TRANSFER_DST before it,
+	// and back in PRESENT_SRC after the last pass that uses it
+	if (resolution != nullptr)
+	{
+		uint32_t pass = frame_graph->AddPass("Upscale", [this](VkCommandBuffer cmd)
+		{
+			uint32_t time = gpu_timer->BeginPass(cmd, "Upscale");
+			record_upscale(cmd);
+			gpu_timer->EndPass(cmd, time);
+		});
+
+		frame_graph->Read(pass, graph_offscreen, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		frame_graph->Write(pass, graph_swapchain, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	}
+
+	// Every other window that got an image this frame. They use
+	// the same culling results, buffers and descriptor sets, only
+	// the framebuffer and the size are different. Their swapchain
+	// images are not in the graph (their render pass and their
+	// acquire semaphores take care of them), and nothing in the
+	// frame reads what they draw, so this is a side effect pass,
+	// which is never culled. prepare_outputs runs after this, and
+	// windows can close, so the pass is always there, and only
+	// draws into the windows that have an image
+	{
+		uint32_t pass = frame_graph->AddPass("Other windows", [this](VkCommandBuffer cmd)
+		{
+			uint32_t time = UINT32_MAX;
+			for (OutputWindow* output : outputs)
+			{
+				if (!output->acquired)
+					continue;
+
+				if (time == UINT32_MAX)
+					time = gpu_timer->BeginPass(cmd, "Other windows");
+
+				record_scene(cmd, render_pass, output->framebuffers[output->current_buffer],
+					output->width, output->height, 1.0f);
+			}
+
+			if (time != UINT32_MAX)
+				gpu_timer->EndPass(cmd, time);
+		}, true);
+
+		if (culling)
+		{
+			frame_graph->Read(pass, graph_indirect, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+				VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+			frame_graph->Read(pass, graph_visible, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		}
+	}
+
+	// If someone asked for this frame's pixels, copy the swapchain
+	// image into this frame's readback buffer, after everything
+	// else that draws into it. FrameReadback makes its own
+	// barriers, which wait at COLOR_ATTACHMENT_OUTPUT, and expects
+	// the image in PRESENT_SRC, so the read has no access
+	if (swapchain_readable)
+	{
+		uint32_t pass = frame_graph->AddPass("Readback", [this](VkCommandBuffer cmd)
+		{
+			readback->Record(cmd, frame_index, swapchain_image_resources[current_buffer].image,
+				swapchain_image_resources[current_buffer].view, width, height, format, frame_count);
+		}, true);
+
+		frame_graph->Read(pass, graph_swapchain, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	}
+
+	if (!frame_graph->Compile())
+	{
+		ERR_EXIT("The render graph could not allocate its images.\n",
+			"RenderGraph Failure");
+	}
+
+	if (firstInit)
+		frame_graph->Print();
+}
+
+// Draws the whole scene into one framebuffer, which is w by h
+// pixels, in one render pass. The main window and every
+// OutputWindow use this, with the same pipelines and buffers
+void Demo::prepare_outputs()
+{
+	PROFILE_FUNCTION();
+
+	// Each window is a little to the right of, and below, the
+	// one before it, with the same size as the main window
+	uint32_t count = settings.extra_windows;
+	if (count > MAX_OUTPUT_WINDOWS) count = MAX_OUTPUT_WINDOWS;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		char title[APP_NAME_STR_LEN];
+		snprintf(title, sizeof(title), "Window %u", i + 2);
+
+		int offset = 40 * (i + 1);
+		OutputWindow* output = new OutputWindow(title, 640 + offset, offset, width, height,
+			inst, gpu, device, memory_properties, queue_family_index, format, color_space,
+			samples, depth_format, render_pass, frame_lag);
+
+		if (!output->ok)
+		{
+			delete output;
+			continue;
+		}
+
+		outputs.push_back(output);
+	}
+}
+
+void Demo::record_scene(VkCommandBuffer cmd, VkRenderPass pass, VkFramebuffer framebuffer,
+	uint32_t w, uint32_t h, float scale, VkImageView target)
+{
+	// With dynamic resolution, the scene is only drawn into the
+	// top-left part of the framebuffer. Everything still thinks
+	// the window is w by h, only the viewport is smaller, so the
+	// picture is the same, with fewer pixels
+	uint32_t draw_w = (uint32_t)(w * scale + 0.5f);
+	uint32_t draw_h = (uint32_t)(h * scale + 0.5f);
+	if (draw_w < 1) draw_w = 1;
+	if (draw_h < 1) draw_h = 1;
 
 	// Set our clear colors. This sets the background 
 	// color to "cornflower blue", which was the default
 	// clear color for XNA and MonoGame, it looks nice,
 	// but literally this can be anything
-	VkClearValue clear_values[1];
+	VkClearValue clear_values[3];
 	clear_values[0].color.float32[0] = 100.0f / 255.0f;
 	clear_values[0].color.float32[1] = 149.0f / 255.0f;
 	clear_values[0].color.float32[2] = 237.0f / 255.0f;
 	clear_values[0].color.float32[3] = 0.0f;
 
+	// With MSAA, the second attachment is the swapchain image,
+	// which is not cleared, its value is ignored. With depth,
+	// the last attachment is cleared to the farthest depth
+	uint32_t clear_count = 1;
+	if (samples != VK_SAMPLE_COUNT_1_BIT)
+		clear_values[clear_count++] = clear_values[0];
+
+	if (depth_format != VK_FORMAT_UNDEFINED)
+	{
+		clear_values[clear_count].depthStencil.depth = 1.0f;
+		clear_values[clear_count].depthStencil.stencil = 0;
+		clear_count++;
+	}
+
 	// setup everything we need to begin using a render pass,
 	// give it the render pass we made, give it the dimensions
-	// of the window, give it the 1 clear values (color)
+	// of the window we are drawing to, give it the 1 clear
+	// values (color)
 	VkRenderPassBeginInfo rp_begin = {};
 	rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	rp_begin.renderPass = render_pass;
-	rp_begin.renderArea.extent.width = width;
-	rp_begin.renderArea.extent.height = height;
-	rp_begin.clearValueCount = 1;
+	rp_begin.renderPass = pass;
+	rp_begin.renderArea.extent.width = draw_w;
+	rp_begin.renderArea.extent.height = draw_h;
+	rp_begin.clearValueCount = clear_count;
 	rp_begin.pClearValues = clear_values;
 
-	// Get ready to begin a command buffer, the level will
-	// be primary, because this is the command buffer that
-	// is submitted to the queue. We are creating
-	// one command buffer at a time, which is why Count is 1,
-	// even though we will use this information to make 3 buffers,
-	// because they are being made one-at-a-time
-	VkCommandBufferAllocateInfo cmdInfo = {};
-	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmdInfo.commandPool = cmd_pool;
-	cmdInfo.commandBufferCount = 1;
-
-	// create a new command buffer for each swapchain image.
-	// Each command buffer has its own framebuffer, and each framebuffer
-	// has its own swapchain image. This allows us to swap command buffers
-	// when drawing, which allows us to swap the image we are rendering to,
-	// which allows us to utilize the swapchain
-	for (uint32_t i = 0; i < swapchainImageCount; i++)
+	// The RenderPassBeginInfo needs a framebuffer to know which
+	// image to render to, so give the framebuffer of the
+	// swapchain image that fpAcquireNextImageKHR gave us
+	rp_begin.framebuffer = framebuffer;
+
+	// If the framebuffer is imageless, "target" is the image that
+	// it draws into (the swapchain image, or the offscreen image),
+	// and it gets every view now, in the order that
+	// prepare_framebuffers would have put them in
+	VkImageView views[3];
+	VkRenderPassAttachmentBeginInfoKHR attachment_begin = {};
+
+	if (target != VK_NULL_HANDLE)
 	{
-		// create a command buffer
-		VkCommandBuffer cmd;
-
-		// allocate new memory for this command buffer.
-		// If this is the first time we are here, then of course it has not been allocated yet.
-		// If we are calling prepare() again after resizing the screen, then the command buffer
-		// was deleted when we resized the window (because swapchain image was deleted, which
-		// deletes the frame buffer and command buffer that correspond) so now we have to 
-		// reallocate it
-		vkAllocateCommandBuffers(device, &cmdInfo, &cmd);
-
-		// The RenderPassBeginInfo needs a framebuffer to know which
-		// image to render to, so give the framebuffer
-		// that is in the array of swapchain_image_resources
-		rp_begin.framebuffer = swapchain_image_resources[i].framebuffer;
-
-		// begin our command buffer
-		// we can now put commands into this command buffer
-		vkBeginCommandBuffer(cmd, &cmd_buf_info);
-
-		// the contents are INLINE, because we are calling each command in this 
-		// command buffer, one at a time. Sounds obvious, but this
-		// will change in advanced tutorials
-		vkCmdBeginRenderPass(cmd, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
-
-		// Bind our pipeline, let Vulkan know that it is a GRAPHICS pipeline.
-		// There are other types of pipelines, so we need to specify GRAPHICS.
-		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-		// Bind our descriptor set to the GRAPHICS pipeline
-		// Multiple pipelines of different types can be bound
-		// to a command buffer at the same time
-		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1,
-			&descriptor_set, 0, NULL);
-
-		// This sets the scale of the viewport.
-		// It takes the fully-rendered image, and scales it down to a portion of the
-		// screen provided by the dimensions specified in viewport. If you don't want to scale the
-		// image down, leave the viewport as it is. If you want to see what it does, change
-		// "width" and "height" to "width/2" and "height/2". That will draw the final image at 25% size in 
-		// the top-left corner of the window. This can be used for splitscreen multiplayer. If you want to
-		// utilize this feature, the image might look squished or stretched. We fix this in later
-		// tutorials
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)width;
-		viewport.height = (float)height;
-		vkCmdSetViewport(cmd, 0, 1, &viewport);
-
-		// Scissor tests clip to a rectangle inside that viewport.
-		// If you do not want to clip the image, then leave the 
-		// Scissor the way it is. If you want to see what it does, change
-		// "width" and "height" to "width/2" and "height/2".
-		// That will draw the final image at 100% size, but it will only
-		// draw the top-left quadrant of the window. This can be used
-		// for black cinematic bars on the screen during cutscenes.
-
-		VkRect2D rect = {};
-		rect.offset.x = 0;
-		rect.offset.y = 0;
-		rect.extent.width = width;
-		rect.extent.height = height;
-		vkCmdSetScissor(cmd, 0, 1, &rect);
-
-		// Bind triangle vertex buffer
-		// The offset is zero, which means we are starting with
-		// the first vertex in the buffer. We are binding 1 buffer,
-		// which is the GPU buffer, but this can be used to bind 
-		// arrays of vertex buffers
-		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(cmd, 0, 1, &vertexDataCPU->buffer, offsets);
-
-		// Bind triangle index buffer
-		// This is a 32-bit index buffer, because the data in the buffer
-		// is an array of integers, which each have 32 bits. If you want 16-bit
-		// index buffer, the buffer has to be an array of 'short', and the type 
-		// has to be changed to VK_INDEX_TYPE_UINT16, but for now, leave it as
-		// VK_INDEX_TYPE_UINT32
-		vkCmdBindIndexBuffer(cmd, indexDataCPU->buffer, 0, VK_INDEX_TYPE_UINT32);
-
-		// Draw the indexed triangle
-		// We have 6 indices in the index buffer
-		// We are drawing these 6 indices one time
-		vkCmdDrawIndexed(cmd, 6, 1, 0, 0, 1);
-
-		// Note that ending the renderpass changes the image's layout from
-		// COLOR_ATTACHMENT_OPTIMAL to PRESENT_SRC_KHR.
-		vkCmdEndRenderPass(cmd);
-
-		// end our command buffer
-		vkEndCommandBuffer(cmd);
-
-		// set the swapchain command buffer equal to the
-		// cmd that we just created here, and then move on
-		// to the next command buffer in the array
-		swapchain_image_resources[i].cmd = cmd;
+		uint32_t view_count = 0;
+		if (msaa_target != nullptr)
+			views[view_count++] = msaa_target->view;
+
+		views[view_count++] = target;
+
+		if (depth_target != nullptr)
+			views[view_count++] = depth_target->view;
+
+		attachment_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO_KHR;
+		attachment_begin.attachmentCount = view_count;
+		attachment_begin.pAttachments = views;
+		rp_begin.pNext = &attachment_begin;
 	}
+
+	// the contents are INLINE, because we are calling each command in this 
+	// command buffer, one at a time. Sounds obvious, but this
+	// will change in advanced tutorials
+	FrameCapture::CmdBeginRenderPass(cmd, rp_begin);
+
+	// Bind our pipeline, let Vulkan know that it is a GRAPHICS pipeline.
+	// There are other types of pipelines, so we need to specify GRAPHICS.
+	FrameCapture::CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+	// Bind our descriptor set to the GRAPHICS pipeline
+	// Multiple pipelines of different types can be bound
+	// to a command buffer at the same time
+	FrameCapture::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1,
+		&descriptor_set);
+
+	// In bindless mode, every texture is in set 1,
+	// so we bind it once, here, for every Square
+	if (bindless)
+	{
+		VkDescriptorSet textures_set = texture_table->SetFor(0);
+		FrameCapture::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1,
+			&textures_set);
+	}
+
+	// This sets the scale of the viewport.
+	// It takes the fully-rendered image, and scales it down to a portion of the
+	// screen provided by the dimensions specified in viewport. If you don't want to scale the
+	// image down, leave the viewport as it is. If you want to see what it does, change
+	// "width" and "height" to "width/2" and "height/2". That will draw the final image at 25% size in 
+	// the top-left corner of the window. This can be used for splitscreen multiplayer. If you want to
+	// utilize this feature, the image might look squished or stretched. We fix this in later
+	// tutorials
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)draw_w;
+	viewport.height = (float)draw_h;
+	FrameCapture::CmdSetViewport(cmd, viewport);
+
+	// Scissor tests clip to a rectangle inside that viewport.
+	// If you do not want to clip the image, then leave the 
+	// Scissor the way it is. If you want to see what it does, change
+	// "width" and "height" to "width/2" and "height/2".
+	// That will draw the final image at 100% size, but it will only
+	// draw the top-left quadrant of the window. This can be used
+	// for black cinematic bars on the screen during cutscenes.
+
+	VkRect2D rect = {};
+	rect.offset.x = 0;
+	rect.offset.y = 0;
+	rect.extent.width = draw_w;
+	rect.extent.height = draw_h;
+	FrameCapture::CmdSetScissor(cmd, rect);
+
+	// Bind triangle vertex buffer
+	// The offset is zero, which means we are starting with
+	// the first vertex in the buffer. We are binding 1 buffer,
+	// but this can be used to bind arrays of vertex buffers
+	VkDeviceSize offsets[1] = { 0 };
+	FrameCapture::CmdBindVertexBuffers(cmd, 0, 1, &meshDataCPU->buffer, offsets);
+
+	// Bind the instance buffer at binding 1. With culling
+	// in bindless mode, that is the list of visible Squares
+	// that Cull.comp wrote, instead of every Square
+	bool culled = instance_culler->enabled && instance_count > 0;
+
+	if (culled && bindless)
+	{
+		VkBuffer visible = instance_culler->VisibleBuffer(frame_index);
+		FrameCapture::CmdBindVertexBuffers(cmd, 1, 1, &visible, offsets);
+	}
+	else
+	{
+		FrameCapture::CmdBindVertexBuffers(cmd, 1, 1, &instanceBufferCPU->buffer, offsets);
+	}
+
+	// Bind triangle index buffer
+	// This is the same buffer as the vertex buffer, but the
+	// indices start at index_offset. The type of index (16-bit
+	// or 32-bit) comes from the mesh file. A 16-bit index buffer
+	// is an array of 'short', and uses VK_INDEX_TYPE_UINT16
+	FrameCapture::CmdBindIndexBuffer(cmd, meshDataCPU->buffer, index_offset, index_type);
+
+	// Draw the indexed triangles
+	// We have index_count indices in the index buffer
+	// (6 for the Square), we are drawing them once per
+	// texture. In bindless mode, that is one draw, with
+	// one instance per Square. Otherwise, each Square is
+	// its own draw, because its texture is in its own set.
+	// firstInstance picks the SquareInstance.
+	// With culling, the GPU wrote the instance counts, and the
+	// indirect draws read them from IndirectBuffer(), which is
+	// an array of VkDrawIndexedIndirectCommand
+	VkBuffer indirect = instance_culler->IndirectBuffer(frame_index);
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (bindless)
+	{
+		if (culled)
+			FrameCapture::CmdDrawIndexedIndirect(cmd, indirect, 0, 1, stride);
+		else
+			FrameCapture::CmdDrawIndexed(cmd, index_count, instance_count, 0, 0, 0);
+	}
+	else
+	{
+		for (uint32_t j = 0; j < instance_count; j++)
+		{
+			VkDescriptorSet textures_set = texture_table->SetFor(j);
+			FrameCapture::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1,
+				&textures_set);
+
+			if (culled)
+				FrameCapture::CmdDrawIndexedIndirect(cmd, indirect, (VkDeviceSize)j * stride, 1, stride);
+			else
+				FrameCapture::CmdDrawIndexed(cmd, index_count, 1, 0, 0, j);
+		}
+	}
+
+	// The sprites are drawn on top of the Squares. The sprite
+	// pipeline uses the same pipeline layout, so set 0 and set 1
+	// stay bound. The push constants turn pixels into -1 to 1
+	float screen[4] = { 2.0f / w, 2.0f / h, -1.0f, -1.0f };
+	FrameCapture::CmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(screen), screen);
+
+	// one draw per batch, see SpriteBatch.h
+	sprite_batch->Record(cmd, pipeline_layout, texture_table);
+
+	// Note that ending the renderpass changes the image's layout from
+	// COLOR_ATTACHMENT_OPTIMAL to PRESENT_SRC_KHR.
+	FrameCapture::CmdEndRenderPass(cmd);
+}
+
+// Stretches the part of the offscreen image that the scene was
+// drawn into over the whole swapchain image
+void Demo::record_upscale(VkCommandBuffer cmd)
+{
+	uint32_t draw_w = (uint32_t)(width * resolution->scale + 0.5f);
+	uint32_t draw_h = (uint32_t)(height * resolution->scale + 0.5f);
+	if (draw_w < 1) draw_w = 1;
+	if (draw_h < 1) draw_h = 1;
+
+	// The frame graph made the barriers before this: the render
+	// pass is done writing the offscreen image, and the swapchain
+	// image is a transfer destination. Every pixel of it is
+	// written by the blit, so what was in it before does not matter
+
+	// LINEAR filtering blends the four nearest pixels, which is
+	// a plain bilinear upscale. prepare_resolution checked that
+	// the format can be filtered
+	VkImageBlit blit = {};
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount = 1;
+	blit.srcOffsets[1].x = (int32_t)draw_w;
+	blit.srcOffsets[1].y = (int32_t)draw_h;
+	blit.srcOffsets[1].z = 1;
+	blit.dstSubresource = blit.srcSubresource;
+	blit.dstOffsets[1].x = width;
+	blit.dstOffsets[1].y = height;
+	blit.dstOffsets[1].z = 1;
+
+	vkCmdBlitImage(cmd,
+		frame_graph->Image(graph_offscreen), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		swapchain_image_resources[current_buffer].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, VK_FILTER_LINEAR);
 }
 
+void Demo::record_draw_cmd(VkCommandBuffer cmd)
+{
+	PROFILE_FUNCTION();
+
+	// The sprites change every frame, so we can not build the
+	// command buffers once, and submit them again and again.
+	// Instead, every frame, we record a new command buffer, for
+	// the swapchain image that we are about to draw to.
+	// ONE_TIME_SUBMIT tells the driver that this command buffer
+	// will only be submitted once, before it is recorded again
+	VkCommandBufferBeginInfo cmd_buf_info = {};
+	cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	// begin our command buffer
+	// we can now put commands into this command buffer
+	vkBeginCommandBuffer(cmd, &cmd_buf_info);
+
+	// This reads the GPU times of an older frame, and
+	// gets this frame's timestamps ready to be written
+	gpu_timer->BeginFrame(cmd, frame_count);
+
+	// This frame's handles for the resources that the graph did
+	// not make, then every pass, with the barriers between them,
+	// see prepare_frame_graph
+	frame_graph->SetImage(graph_swapchain, swapchain_image_resources[current_buffer].image);
+
+	if (graph_visible != RENDER_GRAPH_NONE)
+	{
+		frame_graph->SetBuffer(graph_visible, instance_culler->VisibleBuffer(frame_index));
+		frame_graph->SetBuffer(graph_indirect, instance_culler->IndirectBuffer(frame_index));
+	}
+
+	frame_graph->Execute(cmd);
+
+	// end our command buffer
+	vkEndCommandBuffer(cmd);
+}
+
+// TIME_STARTUP calls one prepare_* function, and the first
+// time that prepare() runs, it remembers how long the function
+// took, so that report_startup_times() can print it. This does
+// not need the profiler, so it works in every build
+#define TIME_STARTUP(stage)                                                \
+	do {                                                                   \
+		auto stage_start = std::chrono::steady_clock::now();               \
+		stage();                                                           \
+		if (firstInit)                                                     \
+		{                                                                  \
+			StartupStage entry;                                            \
+			entry.name = #stage;                                           \
+			entry.ms = std::chrono::duration<double, std::milli>(          \
+				std::chrono::steady_clock::now() - stage_start).count();   \
+			startup_stages.push_back(entry);                               \
+		}                                                                  \
+	} while (0)
+
 void Demo::prepare()
 {
+	PROFILE_FUNCTION();
+
 	// We will be calling prepare() multiple times.
 	// Some Vulkan assets only need to be created once, like
 	// the instance, the device, and the queue (i'll explain those soon),
@@ -2574,11 +3955,17 @@ void Demo::prepare()
 
 	// We keep track of a variable called firstInit, to determine
 	// if we have run the prepare() function before. "firstInit"
-	// is initialized as true at the top of Demo.cpp, and it is
+	// is initialized as true in the Demo constructor, and it is
 	// set to false after the first initialization is done
 
+	// how long all of the first prepare() takes,
+	// see report_startup_times()
+	auto prepare_start = std::chrono::steady_clock::now();
+
 	if (firstInit)
 	{
+		startup_stages.clear();
+
 		// Validation will tell us if our Vulkan code is correct.
 		// Sometimes, our code will execute the way we want it to,
 		// but just becasue the code runs, does not mean the code
@@ -2593,46 +3980,54 @@ void Demo::prepare()
 		// time to release a software or game, you don't want this running
 		// in the background because it will continue constantly checking for errors
 		// even if there are no errors. So, when you want to release a software or
-		// game, simply set this to false.
-		validate = true;
+		// game, set VKCUBE_VALIDATION=0 or run with --no-validate,
+		// see Main.cpp, which puts it in settings.validate
+		validate = settings.validate;
 
 		// During development, it is good to have a console window.
 		// You can read errors, and write printf statements.
 		// However, if you want to release a software or game, you may
 		// not want a console window. Simply comment out this line to 
 		// disable the console window.
-		prepare_console();
+		if (settings.make_console)
+			TIME_STARTUP(prepare_console);
 
-		// set the width and height of the window
-		// literally set this to whatever you want
-		width = 640;
-		height = 360;
+		// set the width and height of the window,
+		// this comes from DemoSettings, which is
+		// 640x360, unless Benchmark.cpp changes it
+		width = settings.width;
+		height = settings.height;
+
+		// how many frames can be in flight
+		frame_lag = settings.frame_lag;
+		if (frame_lag < 1) frame_lag = 1;
+		if (frame_lag > MAX_FRAME_LAG) frame_lag = MAX_FRAME_LAG;
 
 		// build the window with the Win32 API. This will look similar to how
 		// a window is created in a DirectX 11/12 engine, and we will use the
 		// WndProc from main.cpp to create the window
-		prepare_window();
+		TIME_STARTUP(prepare_window);
 
 		// We create an instance of Vulkan, this allows us to use VUlkan
 		// commands on the CPU, but we will not yet be able to talk to 
 		// the graphics device, that comes later
-		prepare_instance();
+		TIME_STARTUP(prepare_instance);
 
 		// Soem Vulkan functions are not available in the SDK's
 		// .lib or .dll files, but instead are inside the driver,
 		// this is how you get some of them from the instance
-		prepare_instance_functionPointers();
+		TIME_STARTUP(prepare_instance_functionPointers);
 
 		// The physical device gives us all the properties of the GPU
 		// that we want to use to render, such as the name of the GPU,
 		// how much memory it has, what features it supports, etc.
 		// We cannot send commands to the GPU through the PhysicalDevice,
 		// but we can use it to determine what our GPU can do.
-		prepare_physical_device();
+		TIME_STARTUP(prepare_physical_device);
 
 		// we create the surface of Vulkan, which helps Vulkan move a
 		// fully-rendered image from the graphics card to the screen
-		prepare_surface();
+		TIME_STARTUP(prepare_surface);
 
 		// The PhysicalDevice and the Device both refer to the same
 		// GPU. The difference is that PhysicalDevice tells us the 
@@ -2650,12 +4045,12 @@ void Demo::prepare()
 		// at the same time
 
 		// Create the Device and the Queue
-		prepare_device_queue();
+		TIME_STARTUP(prepare_device_queue);
 
 		// Soem Vulkan functions are not available in the SDK's
 		// .lib or .dll files, but instead are inside the driver,
 		// this is how you get some of them from the device
-		prepare_device_functionPointers();
+		TIME_STARTUP(prepare_device_functionPointers);
 
 		// The Swapchain and currentPresentMode
 		// variables will be thoroughly explained
@@ -2673,7 +4068,7 @@ void Demo::prepare()
 	// build the swapchain, and also
 	// prepare the images that are
 	// in the swapchain
-	prepare_swapchain();
+	TIME_STARTUP(prepare_swapchain);
 
 	// If the screen is minimized, do not contineu the function.
 	// Exit the prepaer() function, stop drawing to the screen,
@@ -2711,7 +4106,38 @@ void Demo::prepare()
 		// prepare the vertex buffer and
 		// the index buffer that the Square
 		// will use to draw
-		prepare_vb_ib();
+		TIME_STARTUP(prepare_vb_ib);
+
+		// this is the descriptor pool, which will tell 
+		// the GPU how many different descriptors there will 
+		// be throughout the duration of the entire program.
+	
+		// If you have 100 different models, in the scene
+		// if each one uses one uniform buffer and one texture,
+		// then there should be 200 descriptors in the pool.
+		// Our pools grow by themselves, and the texture
+		// table takes its sets from them, so this goes first
+		TIME_STARTUP(prepare_descriptor_pool);
+
+		// start loading textures in the background,
+		// they will be ready a few frames from now
+		TIME_STARTUP(prepare_textures);
+
+		// the sprite batch, which draws 2D sprites
+		// that are submitted again every frame
+		TIME_STARTUP(prepare_sprites);
+
+		// GPU culling reads the instance buffer
+		// from prepare_textures, and the bounds of
+		// the mesh from prepare_vb_ib
+		TIME_STARTUP(prepare_culling);
+
+		// timestamp queries, to see how long the GPU
+		// spends on each part of the frame
+		TIME_STARTUP(prepare_gpu_timing);
+
+		// copies frames back to the CPU, when asked
+		TIME_STARTUP(prepare_readback);
 
 		// Before continuing, please look at
 		// the shader files.
@@ -2722,13 +4148,14 @@ void Demo::prepare()
 		// inside of it
 
 		// The uniform buffer has a binding of 0
-		// the texture has a binding of 1
+		// in set 0, the textures are in set 1,
+		// which the texture table takes care of.
 		// Keep this in mind while moving through
 		// the next few functions
 
 		// prepare the uniform buffer with the 
 		// model matrix that gets sent to the shader
-		prepare_uniform_buffer();
+		TIME_STARTUP(prepare_uniform_buffer);
 
 		// This is the layout, which will be given to 
 		// the pipeline, and it will tell the pipeline to 
@@ -2736,16 +4163,7 @@ void Demo::prepare()
 		// for each draw call. If you have 100 different models,
 		// if each one uses one uniform buffer and one texture,
 		// then there should only be two descriptors here
-		prepare_descriptor_layout();
-
-		// this is the descriptor pool, which will tell 
-		// the GPU how many different descriptors there will 
-		// be throughout the duration of the entire program.
-	
-		// If you have 100 different models, in the scene
-		// if each one uses one uniform buffer and one texture,
-		// then there should be 200 descriptors in the pool
-		prepare_descriptor_pool();
+		TIME_STARTUP(prepare_descriptor_layout);
 
 		// this creates the descriptor set. Right now there
 		// is only one descriptor set. A descriptor set is 
@@ -2768,7 +4186,7 @@ void Demo::prepare()
 		// option uses more processing, pick your poison.
 		// personally I have one descriptor set, which
 		// gets wiped and refilled between draw calls.
-		prepare_descriptor_set();
+		TIME_STARTUP(prepare_descriptor_set);
 
 		// The renderpass describes what type of
 		// data will be outputted by the GPU when
@@ -2777,15 +4195,21 @@ void Demo::prepare()
 		// to the swapchain). We do not provide
 		// any buffers for the GPU to write to, we just say
 		// what type of data we want to be written
-		prepare_render_pass();
+		TIME_STARTUP(prepare_resolution);
+		TIME_STARTUP(prepare_render_pass);
 	}
 
+	// The passes of every frame, and the barriers between
+	// them. This makes the offscreen image of dynamic
+	// resolution, which prepare_framebuffers uses
+	TIME_STARTUP(prepare_frame_graph);
+
 	// we prepare the framebuffes, which say 
 	// specifically what buffers should be written
 	// to by the GPU. This is where we specifically
 	// say to write to the swapchain images, 
 	// by giving the VkImageViews of those images.
-	prepare_framebuffers();
+	TIME_STARTUP(prepare_framebuffers);
 
 	// We only prepare the pipeline once
 	// This includes loading shaders
@@ -2796,7 +4220,11 @@ void Demo::prepare()
 		// through while the scene is being rendered:
 		// InputState, Vertex Shader, Fragment Shader,
 		// Blending, etc.
-		prepare_pipeline();
+		TIME_STARTUP(prepare_pipeline);
+
+		// the other windows use the render pass
+		// and the pipelines that we just made
+		TIME_STARTUP(prepare_outputs);
 
 		// A command pool is needed to create command buffers,
 		// command buffers will handle every command that we want
@@ -2804,21 +4232,32 @@ void Demo::prepare()
 		// of command buffers only takes 4 lines of code.
 		// Later on, we will put command buffers in the command pool
 
+		// RESET_COMMAND_BUFFER lets us record the same command
+		// buffer again, every frame, without freeing it
 		VkCommandPoolCreateInfo cmd_pool_info = {};
 		cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		cmd_pool_info.queueFamilyIndex = queue_family_index;
 
 		// create the command pool, based on the information
 		vkCreateCommandPool(device, &cmd_pool_info, NULL, &cmd_pool);
 	}
 
-	// We bulid three command buffers, one for each swapchain image.
-	// When we build the command buffer, we give it a framebuffer,
-	// which has all the image buffers that the GPU will draw to,
-	// but after we create a command buffer, we cannot change the framebuffer.
-	// So we build one command buffer per swapchain image, then when it
-	// is time to execute the command buffers, we swap command buffers,
-	// to swap between swapchain images that we are drawing to
-	build_swapchain_cmds();
+	// We make one command buffer for each frame that can be in
+	// flight (frame_lag), they are recorded again every frame in
+	// draw(), for whichever swapchain image we are drawing to.
+	// They do not depend on the size of the window, so they are
+	// only made once
+	if (firstInit)
+	{
+		VkCommandBufferAllocateInfo cmdInfo = {};
+		cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cmdInfo.commandPool = cmd_pool;
+		cmdInfo.commandBufferCount = frame_lag;
+
+		vkAllocateCommandBuffers(device, &cmdInfo, draw_cmds);
+	}
 
 	// We only need to do this the first time
 	// the program loads, after that, we can 
@@ -2835,7 +4274,7 @@ void Demo::prepare()
 		// only draw when they are ready to be drawn,
 		// and also let us know when each command buffer 
 		// is finished drawing
-		prepare_synchronization();
+		TIME_STARTUP(prepare_synchronization);
 	}
 
 	// Our "repare" functions above may generate pipeline commands
@@ -2856,10 +4295,40 @@ void Demo::prepare()
 	// first initialization, we only want to redo things that depend
 	// on window size (which will be changing):
 	// swapchain images, renderpass (which has window dimensions),
-	// primary command buffers (which need the new swapchain images), etc.
+	// framebuffers (which need the new swapchain images), etc.
+	if (firstInit)
+	{
+		startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepare_start).count();
+		report_startup_times();
+	}
+
 	firstInit = false;
 }
 
+void Demo::report_startup_times()
+{
+	// Every stage, with how much of the startup it was.
+	// Whatever is not in a stage (the command pool, memory
+	// properties, etc) is "other". Textures keep loading on
+	// other threads after this, so they are not counted here
+	double stages_ms = 0.0;
+
+	printf("Startup took %.2f ms, validation is %s\n", startup_ms, validate ? "on" : "off");
+
+	for (const StartupStage& stage : startup_stages)
+	{
+		printf("  %-36s %9.2f ms %5.1f%%\n", stage.name, stage.ms,
+			startup_ms > 0.0 ? 100.0 * stage.ms / startup_ms : 0.0);
+		stages_ms += stage.ms;
+	}
+
+	double other_ms = startup_ms - stages_ms;
+	printf("  %-36s %9.2f ms %5.1f%%\n", "other", other_ms,
+		startup_ms > 0.0 ? 100.0 * other_ms / startup_ms : 0.0);
+
+	fflush(stdout);
+}
+
 void Demo::delete_resolution_dependencies()
 {
 	// Loop through each swapchain image
@@ -2870,19 +4339,35 @@ void Demo::delete_resolution_dependencies()
 
 		// delete the framebuffer that is associated with this swapchain image
 		vkDestroyFramebuffer(device, swapchain_image_resources[i].framebuffer, NULL);
-
-		// delee the primary command buffer that is associated with this framebuffer
-		vkFreeCommandBuffers(device, cmd_pool, 1, &swapchain_image_resources[i].cmd);
 	}
 
 	// delete the array of swapchain_image_resources,
 	// which holds all the data that we deleted above ^^
 	// so that we can reallocate new images later
 	free(swapchain_image_resources);
+
+	// the multisampled and depth images have the old size too
+	delete msaa_target;
+	msaa_target = nullptr;
+	delete depth_target;
+	depth_target = nullptr;
+
+	// The offscreen image belongs to the graph. An imageless
+	// framebuffer does not have it, so it is kept
+	if (offscreen_framebuffer != VK_NULL_HANDLE && !imageless)
+	{
+		vkDestroyFramebuffer(device, offscreen_framebuffer, NULL);
+		offscreen_framebuffer = VK_NULL_HANDLE;
+	}
+
+	delete frame_graph;
+	frame_graph = nullptr;
 }
 
 void Demo::resize()
 {
+	PROFILE_FUNCTION();
+
 	// Do not try to resize the window
 	// if we haven't initialized the program yet,
 	// that would just be a waste
@@ -2941,6 +4426,8 @@ void Demo::resize()
 
 void Demo::update_uniform_buffer()
 {
+	PROFILE_FUNCTION();
+
 	// This is our model matrix
 	// Just like OpenGL, it handles the position, rotation, and scale of our 
 	// object, which is the Square in this case. We make our model matrix equal 
@@ -2961,6 +4448,11 @@ void Demo::update_uniform_buffer()
 	// put our model into the temporary data buffer
 	temporaryData.model = model;
 
+	// the culler has to use the same matrix as
+	// the vertex shader, or it would hide Squares
+	// that are on the screen
+	clip_matrix = model;
+
 	// We store data into the buffer, just like
 	// we did when we first made the buffer. We
 	// do not need to destroy and rebuild the buffer,
@@ -2970,6 +4462,28 @@ void Demo::update_uniform_buffer()
 
 void Demo::draw()
 {
+	PROFILE_FUNCTION();
+
+	auto frame_start = std::chrono::steady_clock::now();
+
+	// upload textures that finished decoding, and hand
+	// over textures that finished uploading. This never
+	// waits, if nothing is ready, it does nothing
+	texture_loader->Update();
+
+	// If a texture was added to the table, there is one more
+	// Square. This only happens when a texture finishes loading,
+	// so it is fine to wait for the GPU here. The instance buffer
+	// can not change while the GPU reads it, so it is written
+	// after the wait
+	if (instances_changed)
+	{
+		PROFILE_SCOPE("instances_changed");
+		vkDeviceWaitIdle(device);
+		update_instance_buffer();
+		instances_changed = false;
+	}
+
 	// update the data in the uniform buffer
 	// this recalculates the model matrix (for rotation)
 	// and the projection matrix (for the window dimensions),
@@ -2987,18 +4501,94 @@ void Demo::draw()
 
 	// Waiting for this fence will confirm that we can draw a frame to this 
 	// to this frame index at this time (out of two possible slots).
-	vkWaitForFences(device, 1, &drawFences[frame_index], VK_TRUE, UINT64_MAX);
+	// The time spent waiting is not counted in cpu_frame_ms
+	auto wait_start = std::chrono::steady_clock::now();
+	{
+		PROFILE_SCOPE("vkWaitForFences");
+		vkWaitForFences(device, 1, &drawFences[frame_index], VK_TRUE, UINT64_MAX);
+	}
 
 	// If we got past the last line, it means that the fence is open,
 	// and we are ready to continue. Picture this in your mind, the 
 	// fence is open, so we walk through, and close the fence behind us
 	vkResetFences(device, 1, &drawFences[frame_index]);
 
+	// The GPU is done with the last frame that had this index, so
+	// the descriptor sets that it used for one frame all go back
+	// to their pools at once
+	descriptor_allocator->BeginFrame(frame_index);
+
 	// Get the index of the next available swapchain image.
 	// When the next image is available, it will trigger the
 	// image_aquired_semaphore as complete
-	fpAcquireNextImageKHR(device, swapchain, UINT64_MAX,
-		image_acquired_semaphores[frame_index], VK_NULL_HANDLE, &current_buffer);
+	{
+		PROFILE_SCOPE("vkAcquireNextImageKHR");
+		fpAcquireNextImageKHR(device, swapchain, UINT64_MAX,
+			image_acquired_semaphores[frame_index], VK_NULL_HANDLE, &current_buffer);
+	}
+	auto wait_end = std::chrono::steady_clock::now();
+
+	// The other windows. A window that changed size needs a new
+	// swapchain, which can only be made when the GPU is not using
+	// the old one. That only happens when a window is resized, so
+	// waiting here is fine. Acquire does not wait, a window that
+	// has no free image is not drawn this frame
+	{
+		PROFILE_SCOPE("acquire other windows");
+		for (OutputWindow* output : outputs)
+		{
+			if (output->needs_rebuild && !output->closed)
+			{
+				vkDeviceWaitIdle(device);
+				output->Rebuild();
+			}
+
+			output->Acquire(frame_index);
+		}
+	}
+
+	// The frame that last used this frame_index is done,
+	// so if it copied its pixels, they are ready now
+	{
+		PROFILE_SCOPE("readback");
+		readback->Collect(frame_index);
+	}
+
+	// The fence is open, so the GPU is done with the last command
+	// buffer that used this frame_index, and with this frame's part
+	// of the sprite batch. Now we can write the sprites, and record
+	// the command buffer that draws this frame
+	update_sprites();
+
+	// The capture starts when every texture is ready, so
+	// that the captured frames look like every other frame,
+	// it saves the commands that record_draw_cmd makes
+	if (frame_capture != nullptr && !frame_capture->capturing && texture_loader->Pending() == 0)
+	{
+		if (!frame_capture->Start(settings.capture_path, settings.capture_frames, width, height, format))
+		{
+			delete frame_capture;
+			frame_capture = nullptr;
+		}
+	}
+
+	if (frame_capture != nullptr)
+		frame_capture->BeginFrame();
+
+	record_draw_cmd(draw_cmds[frame_index]);
+
+	if (frame_capture != nullptr)
+	{
+		frame_capture->EndFrame();
+
+		// after the last frame, there is nothing more
+		// to track, so the capture goes away
+		if (!frame_capture->capturing && frame_capture->framesCaptured > 0)
+		{
+			delete frame_capture;
+			frame_capture = nullptr;
+		}
+	}
 
 	// Wait for the image acquired semaphore to be signaled to ensure
 	// that the image won't be rendered to until the presentation
@@ -3018,23 +4608,45 @@ void Demo::draw()
 	// After the submission is finished executing, it will trigger the draw_complete
 	// semaphore as finished
 
-	// Here we cycle between the command buffers for each swapchain image
-	// We submit the command buffer that corresponds to the swapchain image
-	// that is ready to be drawn to, which we determine with fpAcquireNextImageKHR
+	// Here we cycle between the command buffers for each frame_index.
+	// The command buffer that we just recorded draws to the swapchain
+	// image that is ready to be drawn to, which we determined with
+	// fpAcquireNextImageKHR
+
+	// With more windows, the command buffer also waits for the
+	// image of every other window that it draws into
+	VkSemaphore wait_semaphores[1 + MAX_OUTPUT_WINDOWS];
+	VkPipelineStageFlags wait_stages[1 + MAX_OUTPUT_WINDOWS];
+	uint32_t wait_count = 0;
+
+	wait_semaphores[wait_count] = image_acquired_semaphores[frame_index];
+	wait_stages[wait_count++] = pipe_stage_flags;
+
+	for (OutputWindow* output : outputs)
+	{
+		if (!output->acquired)
+			continue;
+
+		wait_semaphores[wait_count] = output->image_acquired_semaphores[frame_index];
+		wait_stages[wait_count++] = pipe_stage_flags;
+	}
 
 	VkSubmitInfo submit_info = {};
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pWaitDstStageMask = &pipe_stage_flags;
-	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores = &image_acquired_semaphores[frame_index];
+	submit_info.pWaitDstStageMask = wait_stages;
+	submit_info.waitSemaphoreCount = wait_count;
+	submit_info.pWaitSemaphores = wait_semaphores;
 	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &swapchain_image_resources[current_buffer].cmd;
+	submit_info.pCommandBuffers = &draw_cmds[frame_index];
 	submit_info.signalSemaphoreCount = 1;
 	submit_info.pSignalSemaphores = &draw_complete_semaphores[frame_index];
 
 	// Thish fence is currently closed, it will open when
 	// the queue's submission is complete
-	vkQueueSubmit(queue, 1, &submit_info, drawFences[frame_index]);
+	{
+		PROFILE_SCOPE("vkQueueSubmit");
+		vkQueueSubmit(queue, 1, &submit_info, drawFences[frame_index]);
+	}
 
 	// We are now submitting the command buffer that will draw
 	// an image to the screen. Here is how it will work.
@@ -3050,23 +4662,79 @@ void Demo::draw()
 	// shouldn't send an image to the screen if the image is not finished
 	// rendering
 
+	// Every window is presented with this one call, they all wait
+	// for the same semaphore, because one command buffer drew
+	// all of them. pResults tells us about each swapchain
+	VkSwapchainKHR present_swapchains[1 + MAX_OUTPUT_WINDOWS];
+	uint32_t present_indices[1 + MAX_OUTPUT_WINDOWS];
+	VkResult present_results[1 + MAX_OUTPUT_WINDOWS];
+	OutputWindow* presented_outputs[1 + MAX_OUTPUT_WINDOWS];
+	uint32_t present_count = 0;
+
+	present_swapchains[present_count] = swapchain;
+	present_indices[present_count] = current_buffer;
+	presented_outputs[present_count++] = nullptr;
+
+	for (OutputWindow* output : outputs)
+	{
+		if (!output->acquired)
+			continue;
+
+		present_swapchains[present_count] = output->swapchain;
+		present_indices[present_count] = output->current_buffer;
+		presented_outputs[present_count++] = output;
+	}
+
 	VkPresentInfoKHR present = {};
 	present.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	present.waitSemaphoreCount = 1;
 	present.pWaitSemaphores = &draw_complete_semaphores[frame_index];
-	present.swapchainCount = 1;
-	present.pSwapchains = &swapchain;
-	present.pImageIndices = &current_buffer;
+	present.swapchainCount = present_count;
+	present.pSwapchains = present_swapchains;
+	present.pImageIndices = present_indices;
+	present.pResults = present_results;
 
 	// submit the presentInfo to the queue.
 	// The queue will execute our request to present
 	// an image as soon as it is done rendering the
 	// image that we want rendered in the command buffer
-	fpQueuePresentKHR(queue, &present);
+	{
+		PROFILE_SCOPE("vkQueuePresentKHR");
+		fpQueuePresentKHR(queue, &present);
+	}
+
+	// a window that is out of date gets a new
+	// swapchain before its next frame
+	for (uint32_t i = 1; i < present_count; i++)
+		presented_outputs[i]->Presented(present_results[i]);
 
 	// increment our frame counter
 	frame_index += 1;
-	frame_index %= FRAME_LAG;
+	frame_index %= frame_lag;
+	frame_count++;
+
+	// present_interval_ms is how often frames reach the screen,
+	// cpu_frame_ms is how long this function worked, both are
+	// read by the benchmark
+	auto frame_end = std::chrono::steady_clock::now();
+
+	cpu_frame_ms = std::chrono::duration<double, std::milli>((frame_end - frame_start) - (wait_end - wait_start)).count();
+	present_interval_ms = std::chrono::duration<double, std::milli>(frame_end - last_present_time).count();
+	last_present_time = frame_end;
+
+	report_gpu_timing();
+
+	// The next frame that is recorded uses the new scale.
+	// Only the commands change, nothing has to be made again
+	if (resolution != nullptr && gpu_timer->updated &&
+		resolution->Update(gpu_timer->frameMs))
+	{
+		printf("Resolution scale %.3f (%ux%u), GPU %.2f ms, budget %.2f ms\n",
+			resolution->scale,
+			(uint32_t)(width * resolution->scale + 0.5f), (uint32_t)(height * resolution->scale + 0.5f),
+			gpu_timer->frameMs, resolution->budgetMs);
+		fflush(stdout);
+	}
 }
 
 void Demo::run()
@@ -3079,7 +4747,7 @@ void Demo::run()
 }
 
 
-Demo::Demo()
+Demo::Demo(DemoSettings demoSettings)
 {
 	// Welcome to the Demo constructor
 	// The Demo class will handle the majority
@@ -3091,12 +4759,46 @@ Demo::Demo()
 	// in this class will be fully explained while
 	// we move through the code
 
+	settings = demoSettings;
+
+	// nothing has been prepared yet, see prepare()
+	firstInit = true;
+
+	cpu_frame_ms = 0.0;
+	present_interval_ms = 0.0;
+	last_present_time = std::chrono::steady_clock::now();
+
+	// made by prepare_framebuffers, if MSAA or depth is on
+	msaa_target = nullptr;
+	depth_target = nullptr;
+	offscreen_framebuffer = VK_NULL_HANDLE;
+
+	// made by prepare_framebuffers, if imageless is true
+	imageless_framebuffer = VK_NULL_HANDLE;
+	imageless_width = 0;
+	imageless_height = 0;
+
+	// made by prepare_frame_graph
+	frame_graph = nullptr;
+
+	// made by prepare_resolution, if it is on
+	resolution = nullptr;
+
+	// The capture has to exist before any Vulkan object
+	// is made, so that it can track all of them
+	frame_capture = nullptr;
+	if (settings.capture_frames > 0)
+		frame_capture = new FrameCapture();
+
 	// The first thing we do is initalize the scene
 	prepare();
 }
 
 Demo::~Demo()
 {
+	// finishes the file, if a capture is not done yet
+	delete frame_capture;
+
 	// vkDeviceWaitIdle actually does not wait until the device is idle, which is stupid.
 	// What vkDeviceWaitIdle does, is wait until every queue on the device is idle. The 
 	// queue sends command buffers to the GPU with VkSubmitInfo. There is one problem though,
@@ -3108,7 +4810,7 @@ Demo::~Demo()
 	// To absolutely confirm that all of the GPU's tasks are finished, we need to wait for 
 	// the fences to be completed too. 
 
-	for (uint32_t i = 0; i < FRAME_LAG; i++)
+	for (uint32_t i = 0; i < frame_lag; i++)
 	{
 		// we wait for draw fences prior to rendering each image,
 		// but we do not check fences after, which means that the fences
@@ -3126,16 +4828,72 @@ Demo::~Demo()
 		vkDestroySemaphore(device, draw_complete_semaphores[i], NULL);
 	}
 
+	// the GPU is idle, so the other windows' swapchains
+	// can go, before the device and the instance do
+	for (OutputWindow* output : outputs)
+		delete output;
+	outputs.clear();
+
+	// the GPU is idle, so the last frames
+	// that were copied can be handed over
+	readback->Flush();
+
+	// this waits for the writer thread to
+	// write every frame that is still queued
+	if (exporter != nullptr)
+	{
+		exporter->Finish();
+
+		uint64_t pushed = exporter->framesPushed;
+		uint64_t skipped = exporter->framesSkipped;
+		double stall = exporter->stallMs;
+		bool failed = exporter->writeFailed;
+		delete exporter;
+
+		printf("Exported %llu frames, skipped %llu (window size changed), the render loop waited %.1f ms for the disk\n",
+			(unsigned long long)pushed, (unsigned long long)skipped, stall);
+
+		if (failed)
+			printf("Writing %s failed, the file is not complete\n", settings.export_path);
+		fflush(stdout);
+	}
+
+	delete readback;
+
+	// The texture loader waits for its own uploads
+	// to finish, and then stops its threads
+	delete texture_loader;
+
+	for (size_t i = 0; i < textures.size(); i++)
+		delete textures[i];
+
+	delete texture_table;
+	delete instance_culler;
+	delete gpu_timer;
+
+	if (gpu_log != nullptr)
+		fclose(gpu_log);
+	delete instanceBufferCPU;
+
+	// this destroys texture_sampler too
+	delete sampler_cache;
+	delete mip_generator;
+
 	// We delete all of our CPU buffers
 	delete matrixBufferCPU;
-	delete vertexDataCPU;
-	delete indexDataCPU;
+	delete meshDataCPU;
 
 	// Delete the renderpass
 	vkDestroyRenderPass(device, render_pass, NULL);
+	vkDestroyRenderPass(device, offscreen_render_pass, NULL);
+	delete resolution;
+
+	delete sprite_batch;
 
 	// We destroy the pipeline data
 	vkDestroyPipeline(device, pipeline, NULL);
+	vkDestroyPipeline(device, sprite_pipeline, NULL);
+	vkDestroyPipeline(device, opaque_sprite_pipeline, NULL);
 	vkDestroyPipelineCache(device, pipelineCache, NULL);
 	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
 
@@ -3154,14 +4912,22 @@ Demo::~Demo()
 		delete_resolution_dependencies();
 	}
 
+	// imageless framebuffers live through resizes, so
+	// delete_resolution_dependencies leaves them
+	if (imageless)
+	{
+		vkDestroyFramebuffer(device, imageless_framebuffer, NULL);
+		vkDestroyFramebuffer(device, offscreen_framebuffer, NULL);
+	}
+
 	// destroy the swapchain
 	fpDestroySwapchainKHR(device, swapchain, NULL);
 
-	// destroy the descriptor pool, which holds
+	// destroy the descriptor pools, which hold
 	// all of our uniforms. This will also destroy
-	// all Descriptor Sets that were in the pool, so we
+	// all Descriptor Sets that were in the pools, so we
 	// don't need to destroy the descriptor set by ourselves
-	vkDestroyDescriptorPool(device, desc_pool, NULL);
+	delete descriptor_allocator;
 
 	// destroy the layout of the descriptor sets
 	vkDestroyDescriptorSetLayout(device, desc_layout, NULL);
@@ -3181,4 +4947,9 @@ Demo::~Demo()
 
 	// Destroy Vulkan Instance
 	vkDestroyInstance(inst, NULL);
+
+	// Close the window, and give back the window class, so
+	// that another Demo can register it again
+	DestroyWindow(window);
+	UnregisterClass(name, NULL);
 }
@@ -28,6 +28,26 @@ that utilizes Vulkan, see more at http://cemu.info
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_sdk_platform.h>
 #include "BufferCPU.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorTemplate.h"
+#include "FrameCapture.h"
+#include "FrameExporter.h"
+#include "FrameReadback.h"
+#include "GpuTimer.h"
+#include "InstanceCuller.h"
+#include "MeshFile.h"
+#include "MipGenerator.h"
+#include "OutputWindow.h"
+#include "RenderGraph.h"
+#include "RenderTarget.h"
+#include "ResolutionController.h"
+#include "SamplerCache.h"
+#include "SpriteBatch.h"
+#include "TextureLoader.h"
+#include "TextureTable.h"
+#include <stdio.h>
+#include <chrono>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -37,19 +57,137 @@ that utilizes Vulkan, see more at http://cemu.info
 #include <glm/gtc/matrix_transform.hpp>
 
 // Allow a maximum of two outstanding presentation operations.
+// This is the default, DemoSettings can pick anything from
+// 1 to MAX_FRAME_LAG
 #define FRAME_LAG 2
+#define MAX_FRAME_LAG 3
+
+// the most windows that settings.extra_windows can ask for
+#define MAX_OUTPUT_WINDOWS 8
+
+// how many sprites update_sprites() draws each frame
+#define SPRITE_COUNT 20000
+
+// Everything about a Demo that can change without rebuilding
+// the program. The defaults are what the interactive demo uses,
+// Benchmark.cpp makes Demos with other settings
+struct DemoSettings
+{
+	int width;
+	int height;
+
+	// frames that the CPU can be ahead of the GPU
+	uint32_t frame_lag;
+
+	uint32_t sprite_count;
+
+	// false forces one descriptor set per
+	// texture, even if bindless is supported
+	bool allow_bindless;
+
+	// false makes one framebuffer per swapchain image, even if
+	// VK_KHR_imageless_framebuffer is supported, see
+	// prepare_framebuffers
+	bool allow_imageless;
+
+	// FIFO is always supported, anything else
+	// falls back to FIFO if it is not
+	VkPresentModeKHR present_mode;
+
+	// false if the program already has a console
+	bool make_console;
+
+	// enable VK_LAYER_KHRONOS_validation, which checks every
+	// Vulkan call, and makes every Vulkan call slower
+	bool validate;
+
+	// if more than zero, this many frames are written to
+	// capture_path (a .vkcap file for Replay.exe), starting
+	// with the first frame after every texture has loaded
+	uint32_t capture_frames;
+	const char* capture_path;
+
+	// if not null, every frame is written to this file, Y4M if
+	// it ends with .y4m, raw RGBA if not (see FrameExporter.h).
+	// export_frames is how many, 0 means until the Demo is deleted
+	const char* export_path;
+	uint32_t export_frames;
+	uint32_t export_fps;
+
+	// windows to draw the same scene into, next to the
+	// main one, up to MAX_OUTPUT_WINDOWS. They share every
+	// resource but the swapchain (see OutputWindow.h)
+	uint32_t extra_windows;
+
+	// samples per pixel, 1 (no MSAA), 2, 4 or 8. If the GPU
+	// can not do that many, the next lower count is used
+	uint32_t msaa_samples;
+
+	// adds a depth buffer, and draws half of the sprites
+	// as opaque, front to back, see SpriteBatch.h
+	bool depth_sprites;
+
+	// draws the main window's scene at a size that keeps
+	// the GPU time under frame_budget_ms, never smaller
+	// than min_resolution_scale of the window, and then
+	// stretches it over the window, see ResolutionController.h
+	bool dynamic_resolution;
+	float frame_budget_ms;
+	float min_resolution_scale;
+
+	DemoSettings()
+	{
+		width = 640;
+		height = 360;
+		frame_lag = FRAME_LAG;
+		sprite_count = SPRITE_COUNT;
+		allow_bindless = true;
+		allow_imageless = true;
+		present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		make_console = true;
+		validate = true;
+		capture_frames = 0;
+		capture_path = "capture.vkcap";
+		export_path = nullptr;
+		export_frames = 0;
+		export_fps = 60;
+		extra_windows = 0;
+		msaa_samples = 1;
+		depth_sprites = false;
+		dynamic_resolution = false;
+		frame_budget_ms = 1000.0f / 60.0f;
+		min_resolution_scale = 0.5f;
+	}
+};
 
 typedef struct {
 	VkImage image;
 	VkImageView view;
-
-	VkCommandBuffer cmd;
 	VkFramebuffer framebuffer;
 } SwapchainImageResources;
 
+// One of these for every Square that is drawn, in the
+// instance buffer. The vertex shader moves and scales
+// the Square, and the fragment shader samples the
+// texture at "texture" in the TextureTable
+typedef struct {
+	float offset[2];
+	float scale;
+	uint32_t texture;
+} SquareInstance;
+
+// How long one prepare_* function took,
+// the first time that prepare() ran
+typedef struct {
+	const char* name;
+	double ms;
+} StartupStage;
+
 class Demo
 {
 public:
+	DemoSettings settings;
+
 	char name[APP_NAME_STR_LEN];  // Name to put on the window/icon
 	HWND window;                  // hWnd - window handle
 	POINT minsize;                // minimum window size
@@ -58,6 +196,14 @@ public:
 	bool prepared;
 	bool is_minimized;
 
+	// This boolean keeps track of how many times we have executed the
+	// "prepare()" function. If we have never used the function before
+	// then we know we are initializing the program for the first time,
+	// if the boolean is false, then we know the program has already
+	// been initialized. Each Demo has its own, so a program can make
+	// more than one Demo, one after another (Benchmark.cpp does)
+	bool firstInit;
+
 	bool syncd_with_actual_presents;
 	uint64_t refresh_duration;
 	uint64_t refresh_duration_multiplier;
@@ -68,13 +214,35 @@ public:
 	uint32_t last_late_id;   // 0 if no late images
 
 	VkInstance inst;
+
+	// the version of Vulkan that the instance was made with
+	uint32_t api_version;
+
 	VkPhysicalDevice gpu;
 	VkDevice device;
 	VkQueue queue;
-	VkSemaphore image_acquired_semaphores[FRAME_LAG];
-	VkSemaphore draw_complete_semaphores[FRAME_LAG];
+	uint32_t queue_family_index;
+	VkSemaphore image_acquired_semaphores[MAX_FRAME_LAG];
+	VkSemaphore draw_complete_semaphores[MAX_FRAME_LAG];
 	VkPhysicalDeviceMemoryProperties memory_properties;
 
+	// features that were turned on when the device was made
+	VkPhysicalDeviceFeatures enabled_features;
+
+	// true if VK_EXT_descriptor_indexing was turned on,
+	// and every texture is in one descriptor set
+	bool bindless;
+
+	// how bindings that change every frame are written,
+	// see DescriptorTemplate.h. With DESCRIPTOR_PATH_PUSH,
+	// VK_KHR_push_descriptor was turned on
+	DescriptorPath descriptor_path;
+
+	// true if VK_KHR_imageless_framebuffer was turned on,
+	// and the main window has one framebuffer, which is
+	// given its image views when the render pass begins
+	bool imageless;
+
 	uint32_t enabled_extension_count;
 	uint32_t enabled_layer_count;
 	char *extension_names[64];
@@ -107,30 +275,191 @@ public:
 	// current mode of the swapchain
 	VkPresentModeKHR currentPresentMode;
 
+	// the other windows, settings.extra_windows of them,
+	// minus any that could not use our format or queue
+	std::vector<OutputWindow*> outputs;
+
+	// true if the swapchain images can be copied
+	// from, which FrameReadback needs
+	bool swapchain_readable;
+
+	// true if shaders can read the swapchain images,
+	// so FrameReadback can convert them to YUV
+	bool swapchain_sampleable;
+
+	// true if the swapchain images can be blitted into,
+	// which dynamic resolution needs
+	bool swapchain_blittable;
+
 	// fences that are used for drawing
-	VkFence drawFences[FRAME_LAG];
+	VkFence drawFences[MAX_FRAME_LAG];
 	int frame_index;
 
-	BufferCPU* vertexDataCPU;
-	BufferCPU* indexDataCPU;
+	// settings.frame_lag, clamped to 1 to MAX_FRAME_LAG
+	uint32_t frame_lag;
+
+	// vertices and indices share one buffer,
+	// the indices start at index_offset
+	BufferCPU* meshDataCPU;
+	VkDeviceSize index_offset;
+	uint32_t index_count;
+	VkIndexType index_type;
+
+	// vertex layout, which comes from the mesh file
+	uint32_t vertex_stride;
+	uint32_t vertex_attribute_count;
+	VkVertexInputAttributeDescription vertex_attributes[MESH_FILE_MAX_ATTRIBUTES];
+
+	// how far the mesh goes from its center, in x and y
+	// (which the instance scale changes) and in z (which
+	// it does not), the culler uses these for its spheres
+	float mesh_radius_xy;
+	float mesh_radius_z;
 
 	VkCommandPool cmd_pool;
+
+	// recorded every frame, one per frame in flight
+	VkCommandBuffer draw_cmds[MAX_FRAME_LAG];
 	VkPipelineLayout pipeline_layout;
 	VkDescriptorSetLayout desc_layout;
 	VkPipelineCache pipelineCache;
 	VkRenderPass render_pass;
 	VkPipeline pipeline;
 
+	// the samples per pixel that the render pass and the
+	// pipelines use, from settings.msaa_samples
+	VkSampleCountFlagBits samples;
+
+	// the multisampled image that every framebuffer draws
+	// into, which is resolved into the swapchain image,
+	// nullptr if samples is VK_SAMPLE_COUNT_1_BIT
+	RenderTarget* msaa_target;
+
+	// the depth buffer, VK_FORMAT_UNDEFINED and nullptr
+	// unless settings.depth_sprites is true
+	VkFormat depth_format;
+	RenderTarget* depth_target;
+
+	// With dynamic resolution, the main window's scene is drawn
+	// into graph_offscreen, with offscreen_render_pass, and
+	// then blitted into the swapchain image. All of these are
+	// null without it
+	ResolutionController* resolution;
+	VkRenderPass offscreen_render_pass;
+	VkFramebuffer offscreen_framebuffer;
+
+	// With imageless framebuffers, the main window's one
+	// framebuffer, and the size that it and offscreen_framebuffer
+	// were made for. They are only made again when that changes,
+	// see prepare_framebuffers. swapchain_usage is the usage of
+	// the swapchain images, which the framebuffer has to know
+	VkFramebuffer imageless_framebuffer;
+	uint32_t imageless_width;
+	uint32_t imageless_height;
+	VkImageUsageFlags swapchain_usage;
+
+	// The passes of every frame, and the resources that they
+	// share, see prepare_frame_graph. It is made again when the
+	// window changes size. graph_offscreen is RENDER_GRAPH_NONE
+	// without dynamic resolution, and the culling buffers are
+	// RENDER_GRAPH_NONE without GPU culling
+	RenderGraph* frame_graph;
+	RenderGraphResource graph_swapchain;
+	RenderGraphResource graph_offscreen;
+	RenderGraphResource graph_visible;
+	RenderGraphResource graph_indirect;
+
 	glm::mat4x4 projection_matrix;
 	glm::mat4x4 view_matrix;
 	glm::mat4x4 model_matrix;
 
+	// the matrix that is in the uniform buffer, which
+	// the vertex shader multiplies every position by
+	glm::mat4x4 clip_matrix;
+
+	// loads textures in the background, every texture
+	// that finished loading is added to "textures"
+	TextureLoader* texture_loader;
+	MipGenerator* mip_generator;
+	std::vector<Texture*> textures;
+
+	// every sampler comes from here, texture_sampler
+	// is the one that is shared by all textures
+	SamplerCache* sampler_cache;
+	VkSampler texture_sampler;
+
+	// every texture in "textures" is also in the table,
+	// at the same index as it has in "textures"
+	TextureTable* texture_table;
+
+	// one SquareInstance per texture, it is written
+	// again when a texture is added
+	BufferCPU* instanceBufferCPU;
+	uint32_t instance_count;
+	bool instances_changed;
+
+	// hides Squares that are outside of the view, on the GPU,
+	// before the render pass. See InstanceCuller.h
+	InstanceCuller* instance_culler;
+
+	// how long each pass takes on the GPU, read a few
+	// frames late, without waiting. See GpuTimer.h
+	GpuTimer* gpu_timer;
+
+	// frames drawn since the program started
+	uint64_t frame_count;
+
+	// copies finished frames back to the CPU, only when
+	// something asks for them. See FrameReadback.h
+	FrameReadback* readback;
+
+	// null unless settings.export_path is set,
+	// it gets every frame from "readback"
+	FrameExporter* exporter;
+
+	// when this is open, every frame's GPU times and
+	// statistics are added to it, see toggle_gpu_log()
+	FILE* gpu_log;
+	bool gpu_log_needs_header;
+
+	// Times of the last frame, for Benchmark.cpp.
+	// cpu_frame_ms is the time that draw() took, without the
+	// time it spent waiting for a fence or for a swapchain image.
+	// present_interval_ms is the time between the last two presents
+	double cpu_frame_ms;
+	double present_interval_ms;
+	std::chrono::steady_clock::time_point last_present_time;
+
+	// sprites are submitted again every frame, in update_sprites(),
+	// sprite_pipeline draws them with alpha blending,
+	// opaque_sprite_pipeline (only with depth) writes
+	// depth and does not blend
+	SpriteBatch* sprite_batch;
+	VkPipeline sprite_pipeline;
+	uint32_t sprite_pipeline_id;
+	VkPipeline opaque_sprite_pipeline;
+	uint32_t opaque_sprite_pipeline_id;
+	float sprite_time;
+
 	BufferCPU* matrixBufferCPU;
 	VkDescriptorSet descriptor_set;
-	VkDescriptorPool desc_pool;
+
+	// where every descriptor set comes from, except the culling,
+	// readback and bindless texture sets, which make their own,
+	// see prepare_descriptor_pool
+	DescriptorAllocator* descriptor_allocator;
 
 	bool validate;
 
+	// null unless settings.capture_frames is more than zero,
+	// it is made before prepare(), so it can see every object
+	FrameCapture* frame_capture;
+
+	// every prepare_* stage of the first prepare(),
+	// in order, see report_startup_times()
+	std::vector<StartupStage> startup_stages;
+	double startup_ms;
+
 	VkShaderModule vert_shader_module;
 	VkShaderModule frag_shader_module;
 
@@ -151,11 +480,29 @@ public:
 	void prepare_descriptor_pool();
 	void prepare_descriptor_set();
 	void prepare_vb_ib();
+	void prepare_textures();
+	void update_instance_buffer();
+	void prepare_culling();
+	void prepare_gpu_timing();
+	void report_gpu_timing();
+	double overdraw();
+	void toggle_gpu_log();
+	void prepare_readback();
+	void prepare_sprites();
+	void update_sprites();
 	void prepare_render_pass();
 	void prepare_pipeline();
+	void prepare_frame_graph();
 	void prepare_framebuffers();
-	void build_swapchain_cmds();
+	void prepare_outputs();
+	void prepare_resolution();
+	VkFramebuffer create_imageless_framebuffer(VkRenderPass pass, VkImageUsageFlags targetUsage);
+	void record_scene(VkCommandBuffer cmd, VkRenderPass pass, VkFramebuffer framebuffer,
+		uint32_t w, uint32_t h, float scale, VkImageView target = VK_NULL_HANDLE);
+	void record_upscale(VkCommandBuffer cmd);
+	void record_draw_cmd(VkCommandBuffer cmd);
 	void prepare();
+	void report_startup_times();
 
 
 	void delete_resolution_dependencies();
@@ -164,7 +511,7 @@ public:
 	void draw();
 	void run();
 
-	Demo();
+	Demo(DemoSettings demoSettings = DemoSettings());
 	~Demo();
 };
 
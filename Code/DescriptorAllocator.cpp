@@ -0,0 +1,356 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "DescriptorAllocator.h"
+#include "FrameCapture.h"
+#include "Helper.h"
+#include <stdio.h>
+
+// How many descriptors of each type a pool has, for each set it
+// can hold. Sets in this program have one to three descriptors,
+// so this leaves room for the mix to change, and a pool that only
+// runs out of one type is still replaced by the next pool
+static const VkDescriptorPoolSize descriptors_per_set[] =
+{
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 },
+	{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+};
+
+#define DESCRIPTOR_POOL_TYPES (sizeof(descriptors_per_set) / sizeof(descriptors_per_set[0]))
+
+DescriptorBinding DescriptorBinding::Buffer(uint32_t binding, VkDescriptorType type,
+	VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	DescriptorBinding b = {};
+	b.binding = binding;
+	b.type = type;
+	b.buffer = buffer;
+	b.offset = offset;
+	b.range = range;
+	return b;
+}
+
+DescriptorBinding DescriptorBinding::Image(uint32_t binding, VkDescriptorType type,
+	VkSampler sampler, VkImageView view, VkImageLayout layout)
+{
+	DescriptorBinding b = {};
+	b.binding = binding;
+	b.type = type;
+	b.sampler = sampler;
+	b.view = view;
+	b.layout = layout;
+	return b;
+}
+
+DescriptorAllocator::DescriptorAllocator(VkDevice d, uint32_t frameCount, uint32_t firstPoolSets)
+{
+	device = d;
+	frame = 0;
+
+	poolsCreated = 0;
+	setsAllocated = 0;
+	cacheHits = 0;
+	cacheMisses = 0;
+
+	if (firstPoolSets < 1)
+		firstPoolSets = 1;
+
+	// no pool is made until the first set is needed
+	persistent.current = 0;
+	persistent.nextSets = firstPoolSets;
+	persistent.capacity = 0;
+
+	frames.resize(frameCount > 0 ? frameCount : 1);
+	for (PoolList& list : frames)
+		list = persistent;
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	// destroying a pool frees every set in it
+	DestroyPools(persistent);
+	for (PoolList& list : frames)
+		DestroyPools(list);
+}
+
+void DescriptorAllocator::DestroyPools(PoolList& list)
+{
+	for (VkDescriptorPool pool : list.pools)
+		vkDestroyDescriptorPool(device, pool, NULL);
+
+	list.pools.clear();
+	list.current = 0;
+	list.capacity = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::CreatePool(uint32_t maxSets)
+{
+	VkDescriptorPoolSize sizes[DESCRIPTOR_POOL_TYPES];
+	for (uint32_t i = 0; i < DESCRIPTOR_POOL_TYPES; i++)
+	{
+		sizes[i].type = descriptors_per_set[i].type;
+		sizes[i].descriptorCount = descriptors_per_set[i].descriptorCount * maxSets;
+	}
+
+	// No FREE_DESCRIPTOR_SET flag: sets are never freed one at
+	// a time, only all together, which lets the driver hand them
+	// out from the pool like a stack
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = maxSets;
+	poolInfo.poolSizeCount = DESCRIPTOR_POOL_TYPES;
+	poolInfo.pPoolSizes = sizes;
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	if (vkCreateDescriptorPool(device, &poolInfo, NULL, &pool) != VK_SUCCESS)
+	{
+		printf("Could not make a descriptor pool for %u sets\n", maxSets);
+		fflush(stdout);
+		return VK_NULL_HANDLE;
+	}
+
+	poolsCreated++;
+	return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::AllocateFrom(PoolList& list, VkDescriptorSetLayout layout)
+{
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	while (true)
+	{
+		// every pool is full, so we make a bigger one
+		bool fresh = list.current == list.pools.size();
+		if (fresh)
+		{
+			VkDescriptorPool pool = CreatePool(list.nextSets);
+			if (pool == VK_NULL_HANDLE)
+				return VK_NULL_HANDLE;
+
+			list.pools.push_back(pool);
+			list.capacity += list.nextSets;
+			list.nextSets *= 2;
+			if (list.nextSets > DESCRIPTOR_POOL_MAX_SETS)
+				list.nextSets = DESCRIPTOR_POOL_MAX_SETS;
+		}
+
+		allocInfo.descriptorPool = list.pools[list.current];
+
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+
+		if (result == VK_SUCCESS)
+		{
+			setsAllocated++;
+			return set;
+		}
+
+		// Anything but a full pool is a real error. A pool
+		// that was just made, and is already too small, would
+		// be too small the next time too
+		bool full = result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL;
+		if (!full || fresh)
+		{
+			printf("Could not allocate a descriptor set (VkResult %d)\n", (int)result);
+			fflush(stdout);
+			return VK_NULL_HANDLE;
+		}
+
+		list.current++;
+	}
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+	VkDescriptorSet set = AllocateFrom(persistent, layout);
+	if (set != VK_NULL_HANDLE)
+		FrameCapture::TrackDescriptorSet(set, layout);
+
+	return set;
+}
+
+uint64_t DescriptorAllocator::Hash(VkDescriptorSetLayout layout, const DescriptorBinding* bindings, uint32_t count)
+{
+	// each field by itself, because the
+	// padding between fields can hold anything
+	uint64_t hash = HELPER_HASH_SEED;
+	hash = Helper::hash_bytes(&layout, sizeof(layout), hash);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const DescriptorBinding& b = bindings[i];
+		hash = Helper::hash_bytes(&b.binding, sizeof(b.binding), hash);
+		hash = Helper::hash_bytes(&b.type, sizeof(b.type), hash);
+		hash = Helper::hash_bytes(&b.buffer, sizeof(b.buffer), hash);
+		hash = Helper::hash_bytes(&b.offset, sizeof(b.offset), hash);
+		hash = Helper::hash_bytes(&b.range, sizeof(b.range), hash);
+		hash = Helper::hash_bytes(&b.sampler, sizeof(b.sampler), hash);
+		hash = Helper::hash_bytes(&b.view, sizeof(b.view), hash);
+		hash = Helper::hash_bytes(&b.layout, sizeof(b.layout), hash);
+	}
+
+	return hash;
+}
+
+bool DescriptorAllocator::Equal(const CacheEntry& entry, VkDescriptorSetLayout layout,
+	const DescriptorBinding* bindings, uint32_t count)
+{
+	if (entry.layout != layout || entry.bindings.size() != count)
+		return false;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const DescriptorBinding& a = entry.bindings[i];
+		const DescriptorBinding& b = bindings[i];
+
+		if (a.binding != b.binding ||
+			a.type != b.type ||
+			a.buffer != b.buffer ||
+			a.offset != b.offset ||
+			a.range != b.range ||
+			a.sampler != b.sampler ||
+			a.view != b.view ||
+			a.layout != b.layout)
+			return false;
+	}
+
+	return true;
+}
+
+VkDescriptorSet DescriptorAllocator::Cached(VkDescriptorSetLayout layout, const DescriptorBinding* bindings, uint32_t count)
+{
+	std::vector<CacheEntry>& list = cache[Hash(layout, bindings, count)];
+
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		if (Equal(list[i], layout, bindings, count))
+		{
+			cacheHits++;
+			return list[i].set;
+		}
+	}
+
+	// not in the cache yet, so make it
+	cacheMisses++;
+
+	CacheEntry entry;
+	entry.layout = layout;
+	entry.bindings.assign(bindings, bindings + count);
+	entry.set = Allocate(layout);
+
+	if (entry.set == VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+
+	// one write per binding, each points at
+	// its own buffer info or image info
+	std::vector<VkWriteDescriptorSet> writes(count);
+	std::vector<VkDescriptorBufferInfo> bufferInfos(count);
+	std::vector<VkDescriptorImageInfo> imageInfos(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const DescriptorBinding& b = bindings[i];
+
+		writes[i] = {};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = entry.set;
+		writes[i].dstBinding = b.binding;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = b.type;
+
+		if (b.buffer != VK_NULL_HANDLE)
+		{
+			bufferInfos[i].buffer = b.buffer;
+			bufferInfos[i].offset = b.offset;
+			bufferInfos[i].range = b.range;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		else
+		{
+			imageInfos[i].sampler = b.sampler;
+			imageInfos[i].imageView = b.view;
+			imageInfos[i].imageLayout = b.layout;
+			writes[i].pImageInfo = &imageInfos[i];
+		}
+	}
+
+	FrameCapture::UpdateDescriptorSets(device, count, writes.data());
+
+	list.push_back(entry);
+	return entry.set;
+}
+
+void DescriptorAllocator::BeginFrame(uint32_t frameIndex)
+{
+	frame = frameIndex % (uint32_t)frames.size();
+	PoolList& list = frames[frame];
+
+	// If the last time needed more than one pool, they are
+	// replaced with one pool that holds all of them, so that
+	// a frame with the same sets allocates from one pool, and
+	// never runs into a full one. This only happens while
+	// the number of sets per frame is still growing. No pool is
+	// bigger than DESCRIPTOR_POOL_MAX_SETS, so pools that hold
+	// more than that together are kept, and reset below, instead
+	// of being merged (and made again) every frame
+	if (list.pools.size() > 1 && list.capacity <= DESCRIPTOR_POOL_MAX_SETS)
+	{
+		uint32_t capacity = list.capacity;
+		DestroyPools(list);
+
+		VkDescriptorPool pool = CreatePool(capacity);
+		if (pool != VK_NULL_HANDLE)
+		{
+			list.pools.push_back(pool);
+			list.capacity = capacity;
+		}
+
+		if (list.nextSets < capacity)
+			list.nextSets = capacity;
+		return;
+	}
+
+	// The GPU is done with every set of this frame, so they
+	// all go back to the pool with one call. The flags
+	// must be 0, there are none yet
+	for (VkDescriptorPool pool : list.pools)
+		vkResetDescriptorPool(device, pool, 0);
+
+	list.current = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::AllocateFrame(VkDescriptorSetLayout layout)
+{
+	return AllocateFrom(frames[frame], layout);
+}
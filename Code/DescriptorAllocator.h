@@ -0,0 +1,160 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <unordered_map>
+#include <vector>
+
+// the most sets that one pool is made for, pools grow
+// by doubling, until they are this big
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+
+// What one binding of a cached set points at: a buffer, or an
+// image and its sampler, at array element 0 of "binding".
+// Fields that the type does not use should be zero
+struct DescriptorBinding
+{
+	uint32_t binding;
+	VkDescriptorType type;
+
+	// UNIFORM_BUFFER, STORAGE_BUFFER, and their _DYNAMIC types
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	VkDeviceSize range;
+
+	// SAMPLER, SAMPLED_IMAGE, COMBINED_IMAGE_SAMPLER, STORAGE_IMAGE
+	VkSampler sampler;
+	VkImageView view;
+	VkImageLayout layout;
+
+	static DescriptorBinding Buffer(uint32_t binding, VkDescriptorType type,
+		VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	static DescriptorBinding Image(uint32_t binding, VkDescriptorType type,
+		VkSampler sampler, VkImageView view, VkImageLayout layout);
+};
+
+// Gives out descriptor sets, so that nothing else has to guess how
+// big a VkDescriptorPool has to be.
+//
+// Sets come from pools with room for a mix of the common descriptor
+// types (see the cpp). When a pool is full, vkAllocateDescriptorSets
+// returns VK_ERROR_OUT_OF_POOL_MEMORY (or VK_ERROR_FRAGMENTED_POOL),
+// and the next pool is used, or made, twice as big as the last one.
+//
+// There are two kinds of sets:
+//
+// Persistent sets (Allocate, Cached) live as long as the allocator.
+// Cached() looks the set up by its layout and what it points at,
+// so asking for the same bindings twice gives the same set, and it
+// is only allocated and written the first time.
+//
+// Frame sets (AllocateFrame) only live for one frame in flight. Each
+// frame in flight has its own pools, and BeginFrame, which is called
+// after the frame's fence was waited for, resets all of them at once
+// with vkResetDescriptorPool, instead of freeing sets one by one.
+// After the first few frames, the pools are big enough, so a frame
+// that makes the same sets as the last one never makes a pool, and
+// allocating a set is just taking the next piece of a pool.
+//
+// Only use it from one thread, like the rest of the render loop
+class DescriptorAllocator
+{
+private:
+	// pools that sets come from, the ones before
+	// "current" are full, the ones after it are empty
+	struct PoolList
+	{
+		std::vector<VkDescriptorPool> pools;
+		uint32_t current;
+		uint32_t nextSets;
+
+		// the sets that the pools were made for, in total
+		uint32_t capacity;
+	};
+
+	struct CacheEntry
+	{
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+		VkDescriptorSet set;
+	};
+
+	VkDevice device;
+
+	PoolList persistent;
+	std::vector<PoolList> frames;
+	uint32_t frame;
+
+	// Several sets can have the same hash, so each hash has
+	// a list, which is almost always one set long
+	std::unordered_map<uint64_t, std::vector<CacheEntry>> cache;
+
+	VkDescriptorPool CreatePool(uint32_t maxSets);
+	VkDescriptorSet AllocateFrom(PoolList& list, VkDescriptorSetLayout layout);
+	void DestroyPools(PoolList& list);
+
+	static uint64_t Hash(VkDescriptorSetLayout layout, const DescriptorBinding* bindings, uint32_t count);
+	static bool Equal(const CacheEntry& entry, VkDescriptorSetLayout layout,
+		const DescriptorBinding* bindings, uint32_t count);
+
+public:
+	// how many pools were made (including the ones that were
+	// merged away), sets allocated, and Cached() calls that
+	// found their set, and that had to make it
+	uint32_t poolsCreated;
+	uint64_t setsAllocated;
+	uint64_t cacheHits;
+	uint32_t cacheMisses;
+
+	// frameCount is the number of frames in flight,
+	// firstPoolSets is how many sets the first pools hold
+	DescriptorAllocator(VkDevice d, uint32_t frameCount, uint32_t firstPoolSets = 64);
+
+	// the caller waited for the GPU, this frees every set
+	~DescriptorAllocator();
+
+	// A set that lives as long as the allocator. Returns
+	// VK_NULL_HANDLE if the driver is out of memory, or if
+	// the layout needs more descriptors than a pool has
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+	// A persistent set with these bindings written into it, the
+	// same set every time for the same layout and bindings. The
+	// buffers, views and samplers have to live as long as the
+	// allocator, because the set stays in the cache
+	VkDescriptorSet Cached(VkDescriptorSetLayout layout, const DescriptorBinding* bindings, uint32_t count);
+
+	// Starts frame "frameIndex" (draw's frame_index), after its
+	// fence was waited for. Every set that AllocateFrame gave out
+	// the last time this frame index was used is freed
+	void BeginFrame(uint32_t frameIndex);
+
+	// A set that lives until the next BeginFrame with the same
+	// frame index. It is not written, and it is not tracked by
+	// FrameCapture, the caller writes it
+	VkDescriptorSet AllocateFrame(VkDescriptorSetLayout layout);
+};
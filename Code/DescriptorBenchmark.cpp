@@ -0,0 +1,373 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+// DescriptorBenchmark is a small console program that measures how
+// long the CPU takes to give every draw of a frame its own bindings
+// (a uniform buffer at a different offset, and a texture), the three
+// ways that DescriptorTemplate can do it:
+//
+// vkUpdateDescriptorSets: a set is allocated for every draw, one
+// VkWriteDescriptorSet per binding is filled in, the driver reads
+// the writes, and the set is bound.
+//
+// Update templates: a set is allocated for every draw, and the
+// driver reads the descriptors straight out of a struct, and the
+// set is bound.
+//
+// Push descriptors: the descriptors go into the command buffer,
+// with no set to allocate, write or bind.
+//
+// Commands are recorded into a real command buffer, but it is never
+// submitted, so it does not need a window, or even a queue that can
+// draw. Sets come from DescriptorAllocator, like they do in Demo,
+// and BeginFrame frees them every frame
+
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "DescriptorAllocator.h"
+#include "DescriptorTemplate.h"
+#include "Helper.h"
+
+#define BENCHMARK_DRAWS 10000
+#define BENCHMARK_WARMUP_FRAMES 10
+#define BENCHMARK_FRAMES 120
+#define BENCHMARK_FRAMES_IN_FLIGHT 2
+
+// each draw reads its own 256 bytes of the uniform
+// buffer, 256 is the largest minUniformBufferOffsetAlignment
+#define BENCHMARK_UNIFORM_SIZE 256
+#define BENCHMARK_UNIFORM_SLOTS 1024
+
+// same as ERR_EXIT, but for a console program
+#define BENCHMARK_FAIL(msg)   \
+	do {                      \
+		printf("%s\n", msg);  \
+		fflush(stdout);       \
+		exit(1);              \
+	} while (0)
+
+// what one draw binds, in the layout that
+// DescriptorTemplate reads it from
+struct DrawBindings
+{
+	VkDescriptorBufferInfo uniforms;
+	VkDescriptorImageInfo texture;
+};
+
+static VkDeviceMemory allocate_memory(VkDevice device,
+	VkPhysicalDeviceMemoryProperties memory_properties, VkMemoryRequirements requirements)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = requirements.size;
+
+	if (!Helper::memory_type_from_properties(memory_properties, requirements.memoryTypeBits,
+		0, &allocInfo.memoryTypeIndex))
+		BENCHMARK_FAIL("No memory type for the benchmark's buffer and image");
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, NULL, &memory) != VK_SUCCESS)
+		BENCHMARK_FAIL("Could not allocate memory");
+
+	return memory;
+}
+
+int main(int argc, char** argv)
+{
+	// How many draws, this can be changed from
+	// the command line: DescriptorBenchmark.exe 1000
+	uint32_t drawCount = BENCHMARK_DRAWS;
+	if (argc > 1)
+		drawCount = (uint32_t)atoi(argv[1]);
+
+	// Update templates are part of Vulkan 1.1, we ask for it,
+	// and BestPath checks if the GPU has it too
+	VkApplicationInfo app = {};
+	app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app.pApplicationName = "DescriptorBenchmark";
+	app.pEngineName = "DescriptorBenchmark";
+	app.apiVersion = VK_API_VERSION_1_1;
+
+	VkInstanceCreateInfo instInfo = {};
+	instInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instInfo.pApplicationInfo = &app;
+
+	// A Vulkan 1.0 loader refuses 1.1, so we try again with
+	// 1.0, which only has vkUpdateDescriptorSets
+	uint32_t apiVersion = VK_API_VERSION_1_1;
+
+	VkInstance inst;
+	if (vkCreateInstance(&instInfo, NULL, &inst) == VK_ERROR_INCOMPATIBLE_DRIVER)
+	{
+		apiVersion = VK_API_VERSION_1_0;
+		app.apiVersion = apiVersion;
+
+		if (vkCreateInstance(&instInfo, NULL, &inst) != VK_SUCCESS)
+			BENCHMARK_FAIL("Could not create a Vulkan instance");
+	}
+
+	// Use the first GPU
+	uint32_t gpuCount = 1;
+	VkPhysicalDevice gpu;
+	vkEnumeratePhysicalDevices(inst, &gpuCount, &gpu);
+	if (gpuCount == 0)
+		BENCHMARK_FAIL("No GPU with Vulkan support");
+
+	VkPhysicalDeviceProperties gpuProps;
+	vkGetPhysicalDeviceProperties(gpu, &gpuProps);
+
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+
+	DescriptorPath bestPath = DescriptorTemplate::BestPath(gpu, apiVersion);
+
+	// A device needs at least one queue, queue family 0
+	// is fine, because we never submit anything
+	float priority = 0.0f;
+	VkDeviceQueueCreateInfo queueInfo = {};
+	queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo.queueFamilyIndex = 0;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &priority;
+
+	const char* extensionNames[1] = { VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME };
+
+	VkDeviceCreateInfo deviceInfo = {};
+	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+
+	if (bestPath == DESCRIPTOR_PATH_PUSH)
+	{
+		deviceInfo.enabledExtensionCount = 1;
+		deviceInfo.ppEnabledExtensionNames = extensionNames;
+	}
+
+	VkDevice device;
+	if (vkCreateDevice(gpu, &deviceInfo, NULL, &device) != VK_SUCCESS)
+		BENCHMARK_FAIL("Could not create a Vulkan device");
+
+	printf("GPU: %s\n", gpuProps.deviceName);
+	printf("Draws per frame: %u\n", drawCount);
+
+	// Something real for the descriptors to point at, a
+	// uniform buffer with a slice for each draw, and a 1x1
+	// texture. Nothing reads them, so they are never filled in
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = BENCHMARK_UNIFORM_SIZE * BENCHMARK_UNIFORM_SLOTS;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+	VkBuffer buffer;
+	vkCreateBuffer(device, &bufferInfo, NULL, &buffer);
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+	VkDeviceMemory bufferMemory = allocate_memory(device, memory_properties, requirements);
+	vkBindBufferMemory(device, buffer, bufferMemory, 0);
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	imageInfo.extent = { 1, 1, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImage image;
+	vkCreateImage(device, &imageInfo, NULL, &image);
+
+	vkGetImageMemoryRequirements(device, image, &requirements);
+	VkDeviceMemory imageMemory = allocate_memory(device, memory_properties, requirements);
+	vkBindImageMemory(device, image, imageMemory, 0);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = imageInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView view;
+	vkCreateImageView(device, &viewInfo, NULL, &view);
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	VkSampler sampler;
+	vkCreateSampler(device, &samplerInfo, NULL, &sampler);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = 0;
+
+	VkCommandPool commandPool;
+	vkCreateCommandPool(device, &poolInfo, NULL, &commandPool);
+
+	VkCommandBufferAllocateInfo cmdInfo = {};
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmdInfo.commandPool = commandPool;
+	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdInfo.commandBufferCount = 1;
+
+	VkCommandBuffer cmd;
+	vkAllocateCommandBuffers(device, &cmdInfo, &cmd);
+
+	DescriptorTemplateEntry entries[2] = {
+		{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, offsetof(DrawBindings, uniforms) },
+		{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, offsetof(DrawBindings, texture) },
+	};
+
+	const char* pathNames[3] = { "vkUpdateDescriptorSets", "Update templates", "Push descriptors" };
+	double writesAvg = 0;
+
+	// every path that the device has, from the slowest to the fastest
+	for (int p = DESCRIPTOR_PATH_WRITES; p <= bestPath; p++)
+	{
+		DescriptorTemplate* bindings = new DescriptorTemplate(device, (DescriptorPath)p, entries, 2);
+
+		VkPipelineLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &bindings->layout;
+
+		VkPipelineLayout pipelineLayout;
+		vkCreatePipelineLayout(device, &layoutInfo, NULL, &pipelineLayout);
+
+		bindings->SetPipelineLayout(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0);
+
+		// a new allocator for each path, so they all
+		// start with pools that are too small
+		DescriptorAllocator* allocator = new DescriptorAllocator(device, BENCHMARK_FRAMES_IN_FLIGHT);
+
+		std::vector<double> times;
+
+		for (uint32_t f = 0; f < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; f++)
+		{
+			// Demo waits for the frame's fence here,
+			// this command buffer was never submitted
+			vkResetCommandPool(device, commandPool, 0);
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			allocator->BeginFrame(f % BENCHMARK_FRAMES_IN_FLIGHT);
+
+			VkCommandBufferBeginInfo beginInfo = {};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkBeginCommandBuffer(cmd, &beginInfo);
+
+			DrawBindings draw = {};
+			draw.uniforms.buffer = buffer;
+			draw.uniforms.range = BENCHMARK_UNIFORM_SIZE;
+			draw.texture.sampler = sampler;
+			draw.texture.imageView = view;
+			draw.texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			// A set that is bound in a command buffer can not be
+			// written again until the GPU is done, so without push
+			// descriptors, every draw needs a set of its own
+			for (uint32_t i = 0; i < drawCount; i++)
+			{
+				draw.uniforms.offset = (VkDeviceSize)(i % BENCHMARK_UNIFORM_SLOTS) * BENCHMARK_UNIFORM_SIZE;
+
+				VkDescriptorSet set = VK_NULL_HANDLE;
+				if (bindings->path != DESCRIPTOR_PATH_PUSH)
+					set = allocator->AllocateFrame(bindings->layout);
+
+				bindings->Bind(cmd, set, &draw);
+			}
+
+			vkEndCommandBuffer(cmd);
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			if (f >= BENCHMARK_WARMUP_FRAMES)
+				times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+
+		// sort the frame times, so we can find percentiles
+		std::sort(times.begin(), times.end());
+
+		double total = 0;
+		for (size_t i = 0; i < times.size(); i++)
+			total += times[i];
+
+		double avg = total / times.size();
+		double p50 = times[times.size() / 2];
+		double p99 = times[std::min(times.size() - 1, (size_t)ceil(times.size() * 0.99) - 1)];
+		double max = times.back();
+
+		if (p == DESCRIPTOR_PATH_WRITES)
+			writesAvg = avg;
+
+		// the path can be slower than asked for, if
+		// the driver could not make a template
+		printf("\n%s\n", pathNames[bindings->path]);
+		printf("  avg %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", avg, p50, p99, max);
+		printf("  %.0f ns per draw, %.2fx the speed of vkUpdateDescriptorSets\n",
+			avg * 1000000.0 / drawCount, writesAvg / avg);
+		printf("  %u descriptor pools made\n", allocator->poolsCreated);
+
+		delete allocator;
+		vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+		delete bindings;
+	}
+
+	if (bestPath != DESCRIPTOR_PATH_PUSH)
+	{
+		printf("\n%s can not be measured on this GPU\n",
+			bestPath == DESCRIPTOR_PATH_WRITES ? "Update templates and push descriptors" : "Push descriptors");
+	}
+
+	fflush(stdout);
+
+	vkDestroyCommandPool(device, commandPool, NULL);
+	vkDestroySampler(device, sampler, NULL);
+	vkDestroyImageView(device, view, NULL);
+	vkDestroyImage(device, image, NULL);
+	vkFreeMemory(device, imageMemory, NULL);
+	vkDestroyBuffer(device, buffer, NULL);
+	vkFreeMemory(device, bufferMemory, NULL);
+	vkDestroyDevice(device, NULL);
+	vkDestroyInstance(inst, NULL);
+	return 0;
+}
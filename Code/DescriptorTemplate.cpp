@@ -0,0 +1,226 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "DescriptorTemplate.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool is_buffer_type(VkDescriptorType type)
+{
+	return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+		type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+		type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+		type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+DescriptorPath DescriptorTemplate::BestPath(VkPhysicalDevice gpu, uint32_t apiVersion)
+{
+	// Templates are part of Vulkan 1.1, which the
+	// instance and the GPU both have to support
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu, &properties);
+
+	if (apiVersion < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1)
+		return DESCRIPTOR_PATH_WRITES;
+
+	uint32_t count = 0;
+	vkEnumerateDeviceExtensionProperties(gpu, NULL, &count, NULL);
+
+	std::vector<VkExtensionProperties> extensions(count);
+	vkEnumerateDeviceExtensionProperties(gpu, NULL, &count, extensions.data());
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!strcmp(extensions[i].extensionName, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME))
+			return DESCRIPTOR_PATH_PUSH;
+	}
+
+	return DESCRIPTOR_PATH_TEMPLATE;
+}
+
+DescriptorTemplate::DescriptorTemplate(VkDevice d, DescriptorPath usePath,
+	const DescriptorTemplateEntry* templateEntries, uint32_t count)
+{
+	device = d;
+	path = usePath;
+	entries.assign(templateEntries, templateEntries + count);
+
+	bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	pipeline_layout = VK_NULL_HANDLE;
+	set_index = 0;
+	update_template = VK_NULL_HANDLE;
+
+	fpCmdPushDescriptorSetWithTemplateKHR = nullptr;
+	if (path == DESCRIPTOR_PATH_PUSH)
+	{
+		fpCmdPushDescriptorSetWithTemplateKHR = (PFN_vkCmdPushDescriptorSetWithTemplateKHR)
+			vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+
+		// the extension was not turned on
+		if (fpCmdPushDescriptorSetWithTemplateKHR == nullptr)
+			path = DESCRIPTOR_PATH_TEMPLATE;
+	}
+
+	// one descriptor per binding
+	std::vector<VkDescriptorSetLayoutBinding> bindings(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		bindings[i] = {};
+		bindings[i].binding = entries[i].binding;
+		bindings[i].descriptorType = entries[i].type;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = entries[i].stages;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = count;
+	layoutInfo.pBindings = bindings.data();
+
+	if (path == DESCRIPTOR_PATH_PUSH)
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+
+	vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &layout);
+
+	// A template for sets only needs the set layout, so it
+	// is made now. A push template also needs the pipeline
+	// layout, so it waits for SetPipelineLayout
+	if (path == DESCRIPTOR_PATH_TEMPLATE)
+	{
+		std::vector<VkDescriptorUpdateTemplateEntry> templateInfo(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			templateInfo[i] = {};
+			templateInfo[i].dstBinding = entries[i].binding;
+			templateInfo[i].descriptorCount = 1;
+			templateInfo[i].descriptorType = entries[i].type;
+			templateInfo[i].offset = entries[i].offset;
+			templateInfo[i].stride = 0;
+		}
+
+		VkDescriptorUpdateTemplateCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		info.descriptorUpdateEntryCount = count;
+		info.pDescriptorUpdateEntries = templateInfo.data();
+		info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		info.descriptorSetLayout = layout;
+
+		if (vkCreateDescriptorUpdateTemplate(device, &info, NULL, &update_template) != VK_SUCCESS)
+		{
+			printf("Could not make a descriptor update template, using vkUpdateDescriptorSets\n");
+			fflush(stdout);
+			update_template = VK_NULL_HANDLE;
+			path = DESCRIPTOR_PATH_WRITES;
+		}
+	}
+
+	// The writes only change in dstSet and their info pointers
+	writes.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		writes[i] = {};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstBinding = entries[i].binding;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = entries[i].type;
+	}
+}
+
+DescriptorTemplate::~DescriptorTemplate()
+{
+	if (update_template != VK_NULL_HANDLE)
+		vkDestroyDescriptorUpdateTemplate(device, update_template, NULL);
+
+	vkDestroyDescriptorSetLayout(device, layout, NULL);
+}
+
+void DescriptorTemplate::SetPipelineLayout(VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t set)
+{
+	bind_point = bindPoint;
+	pipeline_layout = pipelineLayout;
+	set_index = set;
+
+	if (path != DESCRIPTOR_PATH_PUSH || update_template != VK_NULL_HANDLE)
+		return;
+
+	std::vector<VkDescriptorUpdateTemplateEntry> templateInfo(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		templateInfo[i] = {};
+		templateInfo[i].dstBinding = entries[i].binding;
+		templateInfo[i].descriptorCount = 1;
+		templateInfo[i].descriptorType = entries[i].type;
+		templateInfo[i].offset = entries[i].offset;
+		templateInfo[i].stride = 0;
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	info.descriptorUpdateEntryCount = (uint32_t)templateInfo.size();
+	info.pDescriptorUpdateEntries = templateInfo.data();
+	info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+	info.descriptorSetLayout = layout;
+	info.pipelineBindPoint = bindPoint;
+	info.pipelineLayout = pipelineLayout;
+	info.set = set;
+
+	vkCreateDescriptorUpdateTemplate(device, &info, NULL, &update_template);
+}
+
+void DescriptorTemplate::Write(VkDescriptorSet set, const void* data)
+{
+	if (path == DESCRIPTOR_PATH_TEMPLATE)
+	{
+		vkUpdateDescriptorSetWithTemplate(device, set, update_template, data);
+		return;
+	}
+
+	// Without a template, we do what the template would: find
+	// each descriptor in the struct, and point a write at it
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		writes[i].dstSet = set;
+
+		if (is_buffer_type(entries[i].type))
+			writes[i].pBufferInfo = (const VkDescriptorBufferInfo*)(bytes + entries[i].offset);
+		else
+			writes[i].pImageInfo = (const VkDescriptorImageInfo*)(bytes + entries[i].offset);
+	}
+
+	vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, NULL);
+}
+
+void DescriptorTemplate::Bind(VkCommandBuffer cmd, VkDescriptorSet set, const void* data)
+{
+	if (path == DESCRIPTOR_PATH_PUSH)
+	{
+		fpCmdPushDescriptorSetWithTemplateKHR(cmd, update_template, pipeline_layout, set_index, data);
+		return;
+	}
+
+	Write(set, data);
+	vkCmdBindDescriptorSets(cmd, bind_point, pipeline_layout, set_index, 1, &set, 0, NULL);
+}
@@ -0,0 +1,132 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <stddef.h>
+#include <vector>
+
+// How a DescriptorTemplate gets its descriptors to the GPU,
+// from the slowest to the fastest
+enum DescriptorPath
+{
+	// vkUpdateDescriptorSets, with one VkWriteDescriptorSet per
+	// binding, which works on every device
+	DESCRIPTOR_PATH_WRITES,
+
+	// vkUpdateDescriptorSetWithTemplate (Vulkan 1.1): the driver
+	// was told once where each descriptor is in the struct, so
+	// it reads them straight out of it, with no write structs
+	DESCRIPTOR_PATH_TEMPLATE,
+
+	// vkCmdPushDescriptorSetWithTemplateKHR (VK_KHR_push_descriptor):
+	// the descriptors go into the command buffer, like push
+	// constants, so there is no set to allocate, write or bind
+	DESCRIPTOR_PATH_PUSH
+};
+
+// One binding, and where its descriptor is in the struct. The
+// descriptor is a VkDescriptorBufferInfo for buffer types, and a
+// VkDescriptorImageInfo for image and sampler types, at "offset"
+// bytes from the start of the struct (use offsetof)
+struct DescriptorTemplateEntry
+{
+	uint32_t binding;
+	VkDescriptorType type;
+	VkShaderStageFlags stages;
+	size_t offset;
+};
+
+// A descriptor set layout, and the fastest way that the device has
+// to fill it in from a plain C++ struct, for bindings that change
+// every draw (or every frame). For example:
+//
+//   struct Bindings
+//   {
+//       VkDescriptorImageInfo image;
+//       VkDescriptorBufferInfo buffer;
+//   };
+//
+//   DescriptorTemplateEntry entries[] = {
+//       { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, offsetof(Bindings, image) },
+//       { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, offsetof(Bindings, buffer) },
+//   };
+//
+// The pipeline layout is made with "layout" at set "set", then
+// SetPipelineLayout is called, and then every draw fills in a
+// Bindings, and calls Bind. With DESCRIPTOR_PATH_PUSH, the layout
+// is a push descriptor layout, which can not be used to allocate
+// sets, so Bind ignores the set that it is given, and Write
+// can not be used.
+//
+// None of this goes through FrameCapture, so it is
+// only for commands that are not captured
+class DescriptorTemplate
+{
+private:
+	VkDevice device;
+	std::vector<DescriptorTemplateEntry> entries;
+
+	VkPipelineBindPoint bind_point;
+	VkPipelineLayout pipeline_layout;
+	uint32_t set_index;
+
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR fpCmdPushDescriptorSetWithTemplateKHR;
+
+	// DESCRIPTOR_PATH_WRITES, filled in
+	// by Write, kept so that it does not
+	// allocate every time
+	std::vector<VkWriteDescriptorSet> writes;
+
+public:
+	DescriptorPath path;
+	VkDescriptorSetLayout layout;
+
+	// VK_NULL_HANDLE with DESCRIPTOR_PATH_WRITES,
+	// and until SetPipelineLayout with DESCRIPTOR_PATH_PUSH
+	VkDescriptorUpdateTemplate update_template;
+
+	// The fastest path that the device can have. apiVersion is the
+	// instance's. If it is DESCRIPTOR_PATH_PUSH, the device has to
+	// be made with VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME
+	static DescriptorPath BestPath(VkPhysicalDevice gpu, uint32_t apiVersion);
+
+	// "usePath" can be slower than BestPath, but not faster
+	DescriptorTemplate(VkDevice d, DescriptorPath usePath, const DescriptorTemplateEntry* templateEntries, uint32_t count);
+	~DescriptorTemplate();
+
+	// the pipeline layout that has "layout" at set "set"
+	void SetPipelineLayout(VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t set);
+
+	// Fills in a set made with "layout" from the struct,
+	// not with DESCRIPTOR_PATH_PUSH
+	void Write(VkDescriptorSet set, const void* data);
+
+	// Gives the descriptors in the struct to the next draws
+	// or dispatches in cmd. Without push descriptors, "set" is
+	// written and bound, so the GPU must be done with it
+	void Bind(VkCommandBuffer cmd, VkDescriptorSet set, const void* data);
+};
@@ -0,0 +1,226 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#include "FileView.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Pages are 4kb on every system we run on, touching one
+// byte per page is enough to make the OS load the page
+#define FILE_VIEW_PAGE_SIZE 4096
+
+FileView::FileView()
+{
+	mapping = nullptr;
+	data = nullptr;
+	size = 0;
+	stopPrefetch = false;
+
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	fileMapping = NULL;
+#else
+	file = -1;
+#endif
+}
+
+FileView::~FileView()
+{
+	Close();
+}
+
+bool FileView::IsOpen() const
+{
+#ifdef _WIN32
+	return file != INVALID_HANDLE_VALUE;
+#else
+	return file >= 0;
+#endif
+}
+
+bool FileView::Open(const char* path, uint32_t hints)
+{
+	Close();
+
+#ifdef _WIN32
+	// Windows can only take hints when the file is opened
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (hints & FILE_VIEW_HINT_SEQUENTIAL) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	if (hints & FILE_VIEW_HINT_RANDOM) flags |= FILE_FLAG_RANDOM_ACCESS;
+
+	file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	size = (uint64_t)fileSize.QuadPart;
+
+	// Windows can not map an empty file,
+	// but an empty file is not an error
+	if (size == 0)
+		return true;
+
+	fileMapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (fileMapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapping == NULL)
+	{
+		Close();
+		return false;
+	}
+#else
+	file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(file, &st) != 0)
+	{
+		Close();
+		return false;
+	}
+	size = (uint64_t)st.st_size;
+
+	if (size == 0)
+		return true;
+
+	mapping = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (mapping == MAP_FAILED)
+	{
+		mapping = nullptr;
+		Close();
+		return false;
+	}
+#endif
+
+	data = (const uint8_t*)mapping;
+
+	// hints for the whole file
+	Advise(0, size, hints);
+
+	return true;
+}
+
+void FileView::Advise(uint64_t offset, uint64_t length, uint32_t hints)
+{
+	if (mapping == nullptr || offset >= size)
+		return;
+
+	if (length > size - offset)
+		length = size - offset;
+
+#ifdef _WIN32
+	// SEQUENTIAL and RANDOM were given to CreateFile,
+	// WILLNEED asks Windows to start reading right now
+	if (hints & FILE_VIEW_HINT_WILLNEED)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = (void*)(data + offset);
+		range.NumberOfBytes = (size_t)length;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+#else
+	// madvise needs an address that starts on a page
+	uint64_t pageStart = offset & ~(uint64_t)(FILE_VIEW_PAGE_SIZE - 1);
+	void* address = (void*)(data + pageStart);
+	size_t rangeLength = (size_t)(length + offset - pageStart);
+
+	if (hints & FILE_VIEW_HINT_SEQUENTIAL) madvise(address, rangeLength, MADV_SEQUENTIAL);
+	if (hints & FILE_VIEW_HINT_RANDOM) madvise(address, rangeLength, MADV_RANDOM);
+	if (hints & FILE_VIEW_HINT_WILLNEED) madvise(address, rangeLength, MADV_WILLNEED);
+#endif
+}
+
+void FileView::Prefetch()
+{
+	if (mapping == nullptr || prefetchThread.joinable())
+		return;
+
+	stopPrefetch = false;
+
+	// Touch one byte of every page. The thread does nothing with
+	// the bytes, it just makes the OS bring each page into memory,
+	// so that whoever reads the data later finds it already there
+	prefetchThread = std::thread([this]()
+	{
+		volatile uint8_t sink = 0;
+
+		for (uint64_t i = 0; i < size && !stopPrefetch; i += FILE_VIEW_PAGE_SIZE)
+			sink += data[i];
+
+		(void)sink;
+	});
+}
+
+void FileView::Close()
+{
+	// the prefetch thread reads from the mapping,
+	// so it has to stop before we unmap
+	if (prefetchThread.joinable())
+	{
+		stopPrefetch = true;
+		prefetchThread.join();
+	}
+
+#ifdef _WIN32
+	if (mapping != nullptr)
+		UnmapViewOfFile(mapping);
+
+	if (fileMapping != NULL)
+		CloseHandle(fileMapping);
+
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	fileMapping = NULL;
+#else
+	if (mapping != nullptr)
+		munmap(mapping, (size_t)size);
+
+	if (file >= 0)
+		close(file);
+
+	file = -1;
+#endif
+
+	mapping = nullptr;
+	data = nullptr;
+	size = 0;
+}
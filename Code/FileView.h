@@ -0,0 +1,102 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Hints that tell the operating system how we plan to
+// read the file, so that it can load pages from the disk
+// before we need them. These can be combined with |
+enum FileViewHint
+{
+	FILE_VIEW_HINT_NONE = 0,
+
+	// we read from the start to the end, one time
+	FILE_VIEW_HINT_SEQUENTIAL = 1,
+
+	// we jump around the file (like a texture cache)
+	FILE_VIEW_HINT_RANDOM = 2,
+
+	// we will need the whole file very soon,
+	// start loading it from the disk right away
+	FILE_VIEW_HINT_WILLNEED = 4,
+};
+
+// FileView makes a file look like an array of bytes in memory,
+// without reading the file into an array. It uses mmap on Linux,
+// and file mapping on Windows. The operating system loads each
+// page from the disk the first time it is touched, so nothing
+// is copied until we copy it ourselves (usually straight
+// into a Vulkan buffer). Sizes are 64-bit, so files larger
+// than 2 GB work fine
+class FileView
+{
+private:
+	void* mapping;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE fileMapping;
+#else
+	int file;
+#endif
+
+	// background thread that touches every page,
+	// started by Prefetch(), stopped by Close()
+	std::thread prefetchThread;
+	std::atomic<bool> stopPrefetch;
+
+	FileView(const FileView&);
+	FileView& operator=(const FileView&);
+
+public:
+	// the bytes of the file, valid until Close()
+	const uint8_t* data;
+	uint64_t size;
+
+	FileView();
+	~FileView();
+
+	// Returns false if the file could not be opened or mapped.
+	// An empty file opens successfully with data == nullptr
+	bool Open(const char* path, uint32_t hints = FILE_VIEW_HINT_SEQUENTIAL);
+	void Close();
+
+	// Apply hints to part of the file, for example
+	// FILE_VIEW_HINT_WILLNEED on the part we read next
+	void Advise(uint64_t offset, uint64_t length, uint32_t hints);
+
+	// Start loading the whole file from the disk on a
+	// background thread, so the thread that reads the data
+	// later does not have to wait on the disk
+	void Prefetch();
+
+	bool IsOpen() const;
+};
@@ -0,0 +1,945 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+#include "FrameCapture.h"
+#include "BufferCPU.h"
+#include <string.h>
+
+// EndFrame() compares host buffers in blocks of this many bytes,
+// and saves every block that changed (touching blocks are saved
+// together, as one update)
+#define CAPTURE_BLOCK_SIZE 256
+
+FrameCapture* FrameCapture::active = nullptr;
+std::mutex FrameCapture::mutex;
+
+// Vulkan handles are pointers on 64-bit, and uint64_t on 32-bit,
+// either way, they fit in 8 bytes, which is what the maps use
+template <typename T>
+static uint64_t Key(T handle)
+{
+	uint64_t key = 0;
+	memcpy(&key, &handle, sizeof(handle));
+	return key;
+}
+
+// Every field of the file is written with one of these,
+// they append to the end of "bytes"
+static void Put32(std::vector<uint8_t>& bytes, uint32_t value)
+{
+	uint8_t* p = (uint8_t*)&value;
+	bytes.insert(bytes.end(), p, p + 4);
+}
+
+static void Put64(std::vector<uint8_t>& bytes, uint64_t value)
+{
+	uint8_t* p = (uint8_t*)&value;
+	bytes.insert(bytes.end(), p, p + 8);
+}
+
+static void PutFloat(std::vector<uint8_t>& bytes, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	Put32(bytes, bits);
+}
+
+static void PutBytes(std::vector<uint8_t>& bytes, const void* data, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)data;
+	bytes.insert(bytes.end(), p, p + size);
+}
+
+FrameCapture::FrameCapture()
+{
+	file = nullptr;
+	flags = 0;
+	capturing = false;
+	inFrame = false;
+	framesCaptured = 0;
+	framesLeft = 0;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	active = this;
+}
+
+FrameCapture::~FrameCapture()
+{
+	Finish();
+
+	// After this, a worker that is about to track or forget
+	// a buffer sees that there is no capture, it can't
+	// get "active" while we are being freed
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == this)
+		active = nullptr;
+}
+
+void FrameCapture::Track(uint32_t type, uint64_t handle, const std::vector<uint8_t>& bytes)
+{
+	Object object;
+	object.type = type;
+	object.bytes = bytes;
+	object.alive = true;
+
+	uint32_t id = (uint32_t)objects.size();
+	objects.push_back(object);
+
+	if (handle != 0)
+		ids[handle] = id;
+
+	// objects that are made while capturing go
+	// straight into the file, after the frames
+	// that came before them
+	if (capturing)
+	{
+		std::vector<uint8_t> chunk = bytes;
+
+		// a new buffer has no contents yet (the
+		// replay fills it with zeros), EndFrame()
+		// saves whatever is written into it
+		if (type == CAPTURE_CHUNK_BUFFER)
+			Put64(chunk, 0);
+
+		WriteChunk(type, chunk);
+	}
+}
+
+uint32_t FrameCapture::Id(uint64_t handle) const
+{
+	auto it = ids.find(handle);
+	return it == ids.end() ? CAPTURE_NO_ID : it->second;
+}
+
+void FrameCapture::WriteChunk(uint32_t type, const std::vector<uint8_t>& bytes)
+{
+	CaptureChunkHeader header;
+	header.type = type;
+	header.size = (uint32_t)bytes.size();
+
+	fwrite(&header, sizeof(header), 1, file);
+	if (!bytes.empty())
+		fwrite(bytes.data(), 1, bytes.size(), file);
+}
+
+bool FrameCapture::Start(const char* path, uint32_t frameCount,
+	uint32_t width, uint32_t height, VkFormat colorFormat)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (file != nullptr || frameCount == 0)
+		return false;
+
+	file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		printf("Could not open %s to write a capture\n", path);
+		fflush(stdout);
+		return false;
+	}
+
+	CaptureFileHeader header = {};
+	header.magic = CAPTURE_FILE_MAGIC;
+	header.version = CAPTURE_FILE_VERSION;
+	header.headerSize = sizeof(CaptureFileHeader);
+	header.flags = flags;
+	header.width = width;
+	header.height = height;
+	header.colorFormat = (uint32_t)colorFormat;
+	header.frameCount = 0;
+	fwrite(&header, sizeof(header), 1, file);
+
+	// every object that was tracked so far, in order
+	for (uint32_t id = 0; id < (uint32_t)objects.size(); id++)
+	{
+		const Object& object = objects[id];
+
+		if (object.type != CAPTURE_CHUNK_BUFFER)
+		{
+			WriteChunk(object.type, object.bytes);
+			continue;
+		}
+
+		// A buffer is its size and usage, then its contents.
+		// Only host buffers have contents that we can read,
+		// the others are written by the GPU during the frame
+		std::vector<uint8_t> chunk;
+		HostBuffer* host = nullptr;
+
+		for (auto& it : hostBuffers)
+			if (it.second.id == id)
+				host = &it.second;
+
+		if (!object.alive)
+		{
+			// a buffer that is gone, size zero,
+			// the replay makes nothing for it
+			Put64(chunk, 0);
+			Put32(chunk, 0);
+			Put32(chunk, 0);
+			Put64(chunk, 0);
+		}
+		else if (host != nullptr)
+		{
+			const uint8_t* contents = (const uint8_t*)host->buffer->Map();
+			host->shadow.assign(contents, contents + host->buffer->size);
+			host->buffer->Unmap();
+
+			chunk = object.bytes;
+			Put64(chunk, host->shadow.size());
+			PutBytes(chunk, host->shadow.data(), host->shadow.size());
+		}
+		else
+		{
+			chunk = object.bytes;
+			Put64(chunk, 0);
+		}
+
+		WriteChunk(CAPTURE_CHUNK_BUFFER, chunk);
+	}
+
+	capturing = true;
+	framesCaptured = 0;
+	framesLeft = frameCount;
+
+	printf("Capturing %u frames to %s\n", frameCount, path);
+	fflush(stdout);
+	return true;
+}
+
+void FrameCapture::BeginFrame()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!capturing)
+		return;
+
+	commands.clear();
+	inFrame = true;
+}
+
+void FrameCapture::WriteBufferChanges(HostBuffer& host)
+{
+	const uint8_t* contents = (const uint8_t*)host.buffer->Map();
+	size_t size = host.shadow.size();
+
+	size_t offset = 0;
+	while (offset < size)
+	{
+		// skip blocks that did not change
+		size_t block = size - offset < CAPTURE_BLOCK_SIZE ? size - offset : CAPTURE_BLOCK_SIZE;
+		if (memcmp(contents + offset, host.shadow.data() + offset, block) == 0)
+		{
+			offset += block;
+			continue;
+		}
+
+		// then take every changed block after it
+		size_t start = offset;
+		while (offset < size)
+		{
+			block = size - offset < CAPTURE_BLOCK_SIZE ? size - offset : CAPTURE_BLOCK_SIZE;
+			if (memcmp(contents + offset, host.shadow.data() + offset, block) == 0)
+				break;
+			offset += block;
+		}
+
+		std::vector<uint8_t> chunk;
+		Put32(chunk, host.id);
+		Put64(chunk, start);
+		Put64(chunk, offset - start);
+		PutBytes(chunk, contents + start, offset - start);
+		WriteChunk(CAPTURE_CHUNK_BUFFER_UPDATE, chunk);
+
+		memcpy(host.shadow.data() + start, contents + start, offset - start);
+	}
+
+	host.buffer->Unmap();
+}
+
+void FrameCapture::EndFrame()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!inFrame)
+		return;
+
+	inFrame = false;
+
+	// The CPU wrote this frame's data before the
+	// commands were recorded, so the updates go
+	// before the frame, the replay copies them in
+	// at the start of the frame
+	for (auto& it : hostBuffers)
+		WriteBufferChanges(it.second);
+
+	WriteChunk(CAPTURE_CHUNK_FRAME, commands);
+	framesCaptured++;
+
+	if (framesCaptured == framesLeft)
+		Close();
+}
+
+void FrameCapture::Finish()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Close();
+}
+
+void FrameCapture::Close()
+{
+	if (file == nullptr)
+		return;
+
+	// now we know how many frames there are
+	long end = ftell(file);
+	fseek(file, offsetof(CaptureFileHeader, frameCount), SEEK_SET);
+	fwrite(&framesCaptured, sizeof(uint32_t), 1, file);
+	fclose(file);
+	file = nullptr;
+
+	capturing = false;
+	inFrame = false;
+
+	printf("Captured %u frames, %.2f MB\n", framesCaptured, end / (1024.0 * 1024.0));
+	fflush(stdout);
+}
+
+// Objects
+//=====================================
+
+void FrameCapture::TrackShader(VkShaderModule module, const uint32_t* code, size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	active->shaders[Key(module)].assign(code, code + size / 4);
+}
+
+void FrameCapture::TrackBuffer(VkBuffer buffer, const VkBufferCreateInfo& info, BufferCPU* host)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put64(bytes, info.size);
+	Put32(bytes, info.usage);
+	Put32(bytes, host != nullptr ? 1 : 0);
+
+	active->Track(CAPTURE_CHUNK_BUFFER, Key(buffer), bytes);
+
+	if (host != nullptr)
+	{
+		HostBuffer& entry = active->hostBuffers[Key(buffer)];
+		entry.id = active->Id(Key(buffer));
+		entry.buffer = host;
+		entry.shadow.clear();
+
+		// made during the capture, so the replay
+		// starts it at zero, and so do we
+		if (active->capturing)
+			entry.shadow.resize((size_t)info.size, 0);
+	}
+}
+
+void FrameCapture::ForgetBuffer(VkBuffer buffer)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	uint32_t id = active->Id(Key(buffer));
+	if (id != CAPTURE_NO_ID)
+		active->objects[id].alive = false;
+
+	active->hostBuffers.erase(Key(buffer));
+	active->ids.erase(Key(buffer));
+}
+
+void FrameCapture::TrackImage(VkImage image, const VkImageCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, info.imageType);
+	Put32(bytes, info.format);
+	Put32(bytes, info.extent.width);
+	Put32(bytes, info.extent.height);
+	Put32(bytes, info.extent.depth);
+	Put32(bytes, info.mipLevels);
+	Put32(bytes, info.arrayLayers);
+	Put32(bytes, info.usage);
+
+	active->Track(CAPTURE_CHUNK_IMAGE, Key(image), bytes);
+}
+
+void FrameCapture::TrackImageView(VkImageView view, const VkImageViewCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, active->Id(Key(info.image)));
+	Put32(bytes, info.viewType);
+	Put32(bytes, info.format);
+	Put32(bytes, info.subresourceRange.aspectMask);
+	Put32(bytes, info.subresourceRange.baseMipLevel);
+	Put32(bytes, info.subresourceRange.levelCount);
+	Put32(bytes, info.subresourceRange.baseArrayLayer);
+	Put32(bytes, info.subresourceRange.layerCount);
+
+	active->Track(CAPTURE_CHUNK_IMAGE_VIEW, Key(view), bytes);
+}
+
+void FrameCapture::TrackSampler(VkSampler sampler, const VkSamplerCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, info.magFilter);
+	Put32(bytes, info.minFilter);
+	Put32(bytes, info.mipmapMode);
+	Put32(bytes, info.addressModeU);
+	Put32(bytes, info.addressModeV);
+	Put32(bytes, info.addressModeW);
+	PutFloat(bytes, info.mipLodBias);
+	Put32(bytes, info.anisotropyEnable);
+	PutFloat(bytes, info.maxAnisotropy);
+	Put32(bytes, info.compareEnable);
+	Put32(bytes, info.compareOp);
+	PutFloat(bytes, info.minLod);
+	PutFloat(bytes, info.maxLod);
+	Put32(bytes, info.borderColor);
+	Put32(bytes, info.unnormalizedCoordinates);
+
+	active->Track(CAPTURE_CHUNK_SAMPLER, Key(sampler), bytes);
+}
+
+void FrameCapture::TrackSetLayout(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	// descriptor indexing puts the flags of each
+	// binding in a struct in the pNext chain
+	const VkDescriptorBindingFlagsEXT* bindingFlags = nullptr;
+	for (const VkBaseInStructure* next = (const VkBaseInStructure*)info.pNext; next != nullptr; next = next->pNext)
+	{
+		if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT)
+			bindingFlags = ((const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT*)next)->pBindingFlags;
+	}
+
+	if (bindingFlags != nullptr || info.flags != 0)
+		active->flags |= CAPTURE_FLAG_DESCRIPTOR_INDEXING;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, info.flags);
+	Put32(bytes, info.bindingCount);
+
+	for (uint32_t i = 0; i < info.bindingCount; i++)
+	{
+		const VkDescriptorSetLayoutBinding& binding = info.pBindings[i];
+		Put32(bytes, binding.binding);
+		Put32(bytes, binding.descriptorType);
+		Put32(bytes, binding.descriptorCount);
+		Put32(bytes, binding.stageFlags);
+		Put32(bytes, bindingFlags != nullptr ? bindingFlags[i] : 0);
+	}
+
+	active->Track(CAPTURE_CHUNK_SET_LAYOUT, Key(layout), bytes);
+}
+
+void FrameCapture::TrackPipelineLayout(VkPipelineLayout layout, const VkPipelineLayoutCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, info.setLayoutCount);
+	for (uint32_t i = 0; i < info.setLayoutCount; i++)
+		Put32(bytes, active->Id(Key(info.pSetLayouts[i])));
+
+	Put32(bytes, info.pushConstantRangeCount);
+	for (uint32_t i = 0; i < info.pushConstantRangeCount; i++)
+	{
+		Put32(bytes, info.pPushConstantRanges[i].stageFlags);
+		Put32(bytes, info.pPushConstantRanges[i].offset);
+		Put32(bytes, info.pPushConstantRanges[i].size);
+	}
+
+	active->Track(CAPTURE_CHUNK_PIPELINE_LAYOUT, Key(layout), bytes);
+}
+
+// One shader stage: which stage, the name of its entry point,
+// its specialization constants, and its SPIR-V
+static void PutStage(std::vector<uint8_t>& bytes, const VkPipelineShaderStageCreateInfo& stage,
+	const std::vector<uint32_t>* code)
+{
+	Put32(bytes, stage.stage);
+
+	uint32_t nameLength = (uint32_t)strlen(stage.pName);
+	Put32(bytes, nameLength);
+	PutBytes(bytes, stage.pName, nameLength);
+
+	const VkSpecializationInfo* spec = stage.pSpecializationInfo;
+	Put32(bytes, spec != nullptr ? spec->mapEntryCount : 0);
+	if (spec != nullptr)
+	{
+		for (uint32_t i = 0; i < spec->mapEntryCount; i++)
+		{
+			Put32(bytes, spec->pMapEntries[i].constantID);
+			Put32(bytes, spec->pMapEntries[i].offset);
+			Put32(bytes, (uint32_t)spec->pMapEntries[i].size);
+		}
+	}
+
+	Put32(bytes, spec != nullptr ? (uint32_t)spec->dataSize : 0);
+	if (spec != nullptr)
+		PutBytes(bytes, spec->pData, spec->dataSize);
+
+	uint32_t codeSize = code != nullptr ? (uint32_t)(code->size() * 4) : 0;
+	Put32(bytes, codeSize);
+	if (codeSize > 0)
+		PutBytes(bytes, code->data(), codeSize);
+}
+
+void FrameCapture::TrackGraphicsPipeline(VkPipeline pipeline, const VkGraphicsPipelineCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, active->Id(Key(info.layout)));
+
+	Put32(bytes, info.stageCount);
+	for (uint32_t i = 0; i < info.stageCount; i++)
+	{
+		auto it = active->shaders.find(Key(info.pStages[i].module));
+		PutStage(bytes, info.pStages[i], it != active->shaders.end() ? &it->second : nullptr);
+	}
+
+	// Vertex input
+	const VkPipelineVertexInputStateCreateInfo* vi = info.pVertexInputState;
+	Put32(bytes, vi->vertexBindingDescriptionCount);
+	for (uint32_t i = 0; i < vi->vertexBindingDescriptionCount; i++)
+	{
+		Put32(bytes, vi->pVertexBindingDescriptions[i].binding);
+		Put32(bytes, vi->pVertexBindingDescriptions[i].stride);
+		Put32(bytes, vi->pVertexBindingDescriptions[i].inputRate);
+	}
+
+	Put32(bytes, vi->vertexAttributeDescriptionCount);
+	for (uint32_t i = 0; i < vi->vertexAttributeDescriptionCount; i++)
+	{
+		Put32(bytes, vi->pVertexAttributeDescriptions[i].location);
+		Put32(bytes, vi->pVertexAttributeDescriptions[i].binding);
+		Put32(bytes, vi->pVertexAttributeDescriptions[i].format);
+		Put32(bytes, vi->pVertexAttributeDescriptions[i].offset);
+	}
+
+	// Input assembly
+	Put32(bytes, info.pInputAssemblyState->topology);
+	Put32(bytes, info.pInputAssemblyState->primitiveRestartEnable);
+
+	// Rasterization
+	const VkPipelineRasterizationStateCreateInfo* rs = info.pRasterizationState;
+	Put32(bytes, rs->depthClampEnable);
+	Put32(bytes, rs->rasterizerDiscardEnable);
+	Put32(bytes, rs->polygonMode);
+	Put32(bytes, rs->cullMode);
+	Put32(bytes, rs->frontFace);
+	PutFloat(bytes, rs->lineWidth);
+
+	// Multisample
+	Put32(bytes, info.pMultisampleState != nullptr ? info.pMultisampleState->rasterizationSamples : VK_SAMPLE_COUNT_1_BIT);
+
+	// Depth
+	const VkPipelineDepthStencilStateCreateInfo* ds = info.pDepthStencilState;
+	Put32(bytes, ds != nullptr ? ds->depthTestEnable : VK_FALSE);
+	Put32(bytes, ds != nullptr ? ds->depthWriteEnable : VK_FALSE);
+	Put32(bytes, ds != nullptr ? ds->depthCompareOp : VK_COMPARE_OP_NEVER);
+
+	// Blending, one per color attachment
+	const VkPipelineColorBlendStateCreateInfo* cb = info.pColorBlendState;
+	Put32(bytes, cb->attachmentCount);
+	for (uint32_t i = 0; i < cb->attachmentCount; i++)
+	{
+		const VkPipelineColorBlendAttachmentState& a = cb->pAttachments[i];
+		Put32(bytes, a.blendEnable);
+		Put32(bytes, a.srcColorBlendFactor);
+		Put32(bytes, a.dstColorBlendFactor);
+		Put32(bytes, a.colorBlendOp);
+		Put32(bytes, a.srcAlphaBlendFactor);
+		Put32(bytes, a.dstAlphaBlendFactor);
+		Put32(bytes, a.alphaBlendOp);
+		Put32(bytes, a.colorWriteMask);
+	}
+
+	// Dynamic state
+	uint32_t dynamicCount = info.pDynamicState != nullptr ? info.pDynamicState->dynamicStateCount : 0;
+	Put32(bytes, dynamicCount);
+	for (uint32_t i = 0; i < dynamicCount; i++)
+		Put32(bytes, info.pDynamicState->pDynamicStates[i]);
+
+	active->Track(CAPTURE_CHUNK_GRAPHICS_PIPELINE, Key(pipeline), bytes);
+}
+
+void FrameCapture::TrackComputePipeline(VkPipeline pipeline, const VkComputePipelineCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, active->Id(Key(info.layout)));
+
+	auto it = active->shaders.find(Key(info.stage.module));
+	PutStage(bytes, info.stage, it != active->shaders.end() ? &it->second : nullptr);
+
+	active->Track(CAPTURE_CHUNK_COMPUTE_PIPELINE, Key(pipeline), bytes);
+}
+
+void FrameCapture::TrackDescriptorSet(VkDescriptorSet set, VkDescriptorSetLayout layout, uint32_t variableCount)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	std::vector<uint8_t> bytes;
+	Put32(bytes, active->Id(Key(layout)));
+	Put32(bytes, variableCount);
+
+	active->Track(CAPTURE_CHUNK_DESCRIPTOR_SET, Key(set), bytes);
+}
+
+void FrameCapture::UpdateDescriptorSets(VkDevice device, uint32_t count, const VkWriteDescriptorSet* writes)
+{
+	vkUpdateDescriptorSets(device, count, writes, 0, NULL);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr)
+		return;
+
+	// one chunk per descriptor, so that the replay
+	// does not have to know which types use which info
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const VkWriteDescriptorSet& write = writes[i];
+
+		for (uint32_t j = 0; j < write.descriptorCount; j++)
+		{
+			std::vector<uint8_t> bytes;
+			Put32(bytes, active->Id(Key(write.dstSet)));
+			Put32(bytes, write.dstBinding);
+			Put32(bytes, write.dstArrayElement + j);
+			Put32(bytes, write.descriptorType);
+
+			if (write.pBufferInfo != nullptr)
+			{
+				Put32(bytes, active->Id(Key(write.pBufferInfo[j].buffer)));
+				Put32(bytes, CAPTURE_NO_ID);
+				Put32(bytes, 0);
+				Put64(bytes, write.pBufferInfo[j].offset);
+				Put64(bytes, write.pBufferInfo[j].range);
+			}
+			else if (write.pImageInfo != nullptr)
+			{
+				Put32(bytes, active->Id(Key(write.pImageInfo[j].imageView)));
+				Put32(bytes, active->Id(Key(write.pImageInfo[j].sampler)));
+				Put32(bytes, write.pImageInfo[j].imageLayout);
+				Put64(bytes, 0);
+				Put64(bytes, 0);
+			}
+			else
+			{
+				continue;
+			}
+
+			active->Track(CAPTURE_CHUNK_DESCRIPTOR_WRITE, 0, bytes);
+		}
+	}
+}
+
+// Commands
+//=====================================
+
+void FrameCapture::Command(uint32_t opcode, const std::vector<uint8_t>& args)
+{
+	Put32(commands, opcode);
+	Put32(commands, (uint32_t)args.size());
+	PutBytes(commands, args.data(), args.size());
+}
+
+void FrameCapture::CmdBindPipeline(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+{
+	vkCmdBindPipeline(cmd, bindPoint, pipeline);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, bindPoint);
+	Put32(args, active->Id(Key(pipeline)));
+	active->Command(CAPTURE_CMD_BIND_PIPELINE, args);
+}
+
+void FrameCapture::CmdBindDescriptorSets(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout layout,
+	uint32_t firstSet, uint32_t count, const VkDescriptorSet* sets)
+{
+	vkCmdBindDescriptorSets(cmd, bindPoint, layout, firstSet, count, sets, 0, NULL);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, bindPoint);
+	Put32(args, active->Id(Key(layout)));
+	Put32(args, firstSet);
+	Put32(args, count);
+	for (uint32_t i = 0; i < count; i++)
+		Put32(args, active->Id(Key(sets[i])));
+	active->Command(CAPTURE_CMD_BIND_DESCRIPTOR_SETS, args);
+}
+
+void FrameCapture::CmdBindVertexBuffers(VkCommandBuffer cmd, uint32_t firstBinding, uint32_t count,
+	const VkBuffer* buffers, const VkDeviceSize* offsets)
+{
+	vkCmdBindVertexBuffers(cmd, firstBinding, count, buffers, offsets);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, firstBinding);
+	Put32(args, count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Put32(args, active->Id(Key(buffers[i])));
+		Put64(args, offsets[i]);
+	}
+	active->Command(CAPTURE_CMD_BIND_VERTEX_BUFFERS, args);
+}
+
+void FrameCapture::CmdBindIndexBuffer(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkIndexType type)
+{
+	vkCmdBindIndexBuffer(cmd, buffer, offset, type);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, active->Id(Key(buffer)));
+	Put64(args, offset);
+	Put32(args, type);
+	active->Command(CAPTURE_CMD_BIND_INDEX_BUFFER, args);
+}
+
+void FrameCapture::CmdPushConstants(VkCommandBuffer cmd, VkPipelineLayout layout, VkShaderStageFlags stages,
+	uint32_t offset, uint32_t size, const void* data)
+{
+	vkCmdPushConstants(cmd, layout, stages, offset, size, data);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, active->Id(Key(layout)));
+	Put32(args, stages);
+	Put32(args, offset);
+	Put32(args, size);
+	PutBytes(args, data, size);
+	active->Command(CAPTURE_CMD_PUSH_CONSTANTS, args);
+}
+
+void FrameCapture::CmdSetViewport(VkCommandBuffer cmd, const VkViewport& viewport)
+{
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	PutFloat(args, viewport.x);
+	PutFloat(args, viewport.y);
+	PutFloat(args, viewport.width);
+	PutFloat(args, viewport.height);
+	PutFloat(args, viewport.minDepth);
+	PutFloat(args, viewport.maxDepth);
+	active->Command(CAPTURE_CMD_SET_VIEWPORT, args);
+}
+
+void FrameCapture::CmdSetScissor(VkCommandBuffer cmd, const VkRect2D& scissor)
+{
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, (uint32_t)scissor.offset.x);
+	Put32(args, (uint32_t)scissor.offset.y);
+	Put32(args, scissor.extent.width);
+	Put32(args, scissor.extent.height);
+	active->Command(CAPTURE_CMD_SET_SCISSOR, args);
+}
+
+void FrameCapture::CmdDrawIndexed(VkCommandBuffer cmd, uint32_t indexCount, uint32_t instanceCount,
+	uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+{
+	vkCmdDrawIndexed(cmd, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, indexCount);
+	Put32(args, instanceCount);
+	Put32(args, firstIndex);
+	Put32(args, (uint32_t)vertexOffset);
+	Put32(args, firstInstance);
+	active->Command(CAPTURE_CMD_DRAW_INDEXED, args);
+}
+
+void FrameCapture::CmdDrawIndexedIndirect(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+	uint32_t drawCount, uint32_t stride)
+{
+	vkCmdDrawIndexedIndirect(cmd, buffer, offset, drawCount, stride);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, active->Id(Key(buffer)));
+	Put64(args, offset);
+	Put32(args, drawCount);
+	Put32(args, stride);
+	active->Command(CAPTURE_CMD_DRAW_INDEXED_INDIRECT, args);
+}
+
+void FrameCapture::CmdDispatch(VkCommandBuffer cmd, uint32_t x, uint32_t y, uint32_t z)
+{
+	vkCmdDispatch(cmd, x, y, z);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, x);
+	Put32(args, y);
+	Put32(args, z);
+	active->Command(CAPTURE_CMD_DISPATCH, args);
+}
+
+void FrameCapture::CmdUpdateBuffer(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+	VkDeviceSize size, const void* data)
+{
+	vkCmdUpdateBuffer(cmd, buffer, offset, size, data);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, active->Id(Key(buffer)));
+	Put64(args, offset);
+	Put64(args, size);
+	PutBytes(args, data, (size_t)size);
+	active->Command(CAPTURE_CMD_UPDATE_BUFFER, args);
+}
+
+void FrameCapture::CmdMemoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+	uint32_t imageBarrierCount, const VkImageMemoryBarrier* imageBarriers)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+
+	// with only image barriers, an empty global barrier is left out
+	uint32_t memoryBarrierCount = (srcAccess | dstAccess) != 0 || imageBarrierCount == 0 ? 1 : 0;
+
+	vkCmdPipelineBarrier(cmd, srcStages, dstStages, 0,
+		memoryBarrierCount, &barrier, 0, NULL, imageBarrierCount, imageBarriers);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	Put32(args, srcStages);
+	Put32(args, dstStages);
+	Put32(args, srcAccess);
+	Put32(args, dstAccess);
+	active->Command(CAPTURE_CMD_BARRIER, args);
+}
+
+void FrameCapture::CmdBeginRenderPass(VkCommandBuffer cmd, const VkRenderPassBeginInfo& info)
+{
+	vkCmdBeginRenderPass(cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	std::vector<uint8_t> args;
+	for (uint32_t i = 0; i < 4; i++)
+		PutFloat(args, info.clearValueCount > 0 ? info.pClearValues[0].color.float32[i] : 0.0f);
+	Put32(args, info.renderArea.extent.width);
+	Put32(args, info.renderArea.extent.height);
+	active->Command(CAPTURE_CMD_BEGIN_RENDER_PASS, args);
+}
+
+void FrameCapture::CmdEndRenderPass(VkCommandBuffer cmd)
+{
+	vkCmdEndRenderPass(cmd);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active == nullptr || !active->inFrame)
+		return;
+
+	active->Command(CAPTURE_CMD_END_RENDER_PASS, std::vector<uint8_t>());
+}
@@ -0,0 +1,287 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+
+class BufferCPU;
+
+// A .vkcap file is a header, followed by chunks. Every chunk is
+// a CaptureChunkHeader (type and size), followed by "size" bytes.
+// The first chunks describe every object that the captured frames
+// use (buffers with their contents, images, samplers, layouts,
+// pipelines with their SPIR-V, descriptor sets and their writes),
+// in the order they were made, so an object only ever refers to
+// objects before it. Objects refer to each other by id, which is
+// the order they appear in the file, starting from 0.
+// After that, each captured frame is the bytes that the CPU wrote
+// into buffers for that frame (CAPTURE_CHUNK_BUFFER_UPDATE), and
+// then one CAPTURE_CHUNK_FRAME with every command of the frame.
+//
+// All numbers are little-endian, and every field is written
+// one at a time (never a whole Vulkan struct), so a capture made
+// on Windows replays on Linux
+
+// "VKCP" when read as bytes
+#define CAPTURE_FILE_MAGIC 0x50434B56
+
+// Increase this every time the format changes
+#define CAPTURE_FILE_VERSION 1
+
+// id of "no object"
+#define CAPTURE_NO_ID 0xFFFFFFFF
+
+// the header has this flag when a descriptor set layout uses
+// VK_EXT_descriptor_indexing, so the replay has to enable it
+#define CAPTURE_FLAG_DESCRIPTOR_INDEXING 1
+
+enum CaptureChunk
+{
+	CAPTURE_CHUNK_BUFFER = 1,
+	CAPTURE_CHUNK_IMAGE,
+	CAPTURE_CHUNK_IMAGE_VIEW,
+	CAPTURE_CHUNK_SAMPLER,
+	CAPTURE_CHUNK_SET_LAYOUT,
+	CAPTURE_CHUNK_PIPELINE_LAYOUT,
+	CAPTURE_CHUNK_GRAPHICS_PIPELINE,
+	CAPTURE_CHUNK_COMPUTE_PIPELINE,
+	CAPTURE_CHUNK_DESCRIPTOR_SET,
+	CAPTURE_CHUNK_DESCRIPTOR_WRITE,
+	CAPTURE_CHUNK_BUFFER_UPDATE,
+	CAPTURE_CHUNK_FRAME,
+};
+
+// The commands inside CAPTURE_CHUNK_FRAME. Each one is an opcode,
+// the size of what follows, and then the arguments of the vkCmd,
+// with handles turned into ids
+enum CaptureCommand
+{
+	CAPTURE_CMD_BIND_PIPELINE = 1,
+	CAPTURE_CMD_BIND_DESCRIPTOR_SETS,
+	CAPTURE_CMD_BIND_VERTEX_BUFFERS,
+	CAPTURE_CMD_BIND_INDEX_BUFFER,
+	CAPTURE_CMD_PUSH_CONSTANTS,
+	CAPTURE_CMD_SET_VIEWPORT,
+	CAPTURE_CMD_SET_SCISSOR,
+	CAPTURE_CMD_DRAW_INDEXED,
+	CAPTURE_CMD_DRAW_INDEXED_INDIRECT,
+	CAPTURE_CMD_DISPATCH,
+	CAPTURE_CMD_UPDATE_BUFFER,
+	CAPTURE_CMD_BARRIER,
+	CAPTURE_CMD_BEGIN_RENDER_PASS,
+	CAPTURE_CMD_END_RENDER_PASS,
+};
+
+struct CaptureFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t flags;
+
+	// size and format of the image that the frames draw into
+	uint32_t width;
+	uint32_t height;
+	uint32_t colorFormat;	// VkFormat
+
+	// written again when the capture is finished
+	uint32_t frameCount;
+};
+
+struct CaptureChunkHeader
+{
+	uint32_t type;	// CaptureChunk
+	uint32_t size;
+};
+
+// FrameCapture records the frames that Demo draws into a .vkcap
+// file, which Replay.exe can draw again, as fast as the GPU can,
+// without a window, and without the rest of the program.
+//
+// Capturing has two halves. From the moment a FrameCapture is made
+// (before Demo::prepare), every object that a frame can use is
+// tracked: BufferCPU, Texture, SamplerCache, and the layouts,
+// pipelines and descriptor sets of Demo, InstanceCuller and
+// TextureTable call the Track* functions below. Tracking saves a
+// small description of the object, in memory. Then, Start() writes
+// every tracked object into the file, and each frame between
+// BeginFrame() and EndFrame() is written as commands.
+//
+// Commands are recorded by calling FrameCapture::Cmd* instead of
+// vkCmd*, which calls the real vkCmd* and saves a copy while a
+// frame is being captured. Every function here does nothing but
+// forward to Vulkan when there is no FrameCapture, so the code
+// that calls them does not have to check.
+//
+// Host-visible buffers are not tracked write by write: EndFrame()
+// compares every BufferCPU with a copy of what it held after the
+// last frame, and saves only the blocks that changed
+class FrameCapture
+{
+private:
+	struct Object
+	{
+		uint32_t type;	// CaptureChunk
+		std::vector<uint8_t> bytes;
+
+		// false after a buffer is destroyed, it is still written,
+		// to keep the ids in order, but with a size of zero
+		bool alive;
+	};
+
+	struct HostBuffer
+	{
+		uint32_t id;
+		BufferCPU* buffer;
+		std::vector<uint8_t> shadow;
+	};
+
+	// every tracked object, in order, its id is its index
+	std::vector<Object> objects;
+
+	// the newest id of every handle (handles can be reused
+	// after an object is destroyed, the newest one wins)
+	std::unordered_map<uint64_t, uint32_t> ids;
+
+	// SPIR-V of every shader module, pipelines copy
+	// it, because modules are destroyed right away
+	std::unordered_map<uint64_t, std::vector<uint32_t>> shaders;
+
+	std::unordered_map<uint64_t, HostBuffer> hostBuffers;
+
+	FILE* file;
+	std::vector<uint8_t> commands;
+
+	uint32_t framesLeft;
+
+	// TextureLoader makes staging buffers on ThreadPool workers,
+	// and every BufferCPU tracks itself, so objects can be tracked
+	// (and forgotten) while the main thread records commands, or
+	// while it deletes the FrameCapture. This guards "active" as
+	// well as everything it points to, so it is static: the static
+	// functions hold it from before they look at "active" until
+	// they are done, and the destructor holds it while it clears
+	// "active". The private functions expect it to be held already
+	static std::mutex mutex;
+
+	void Track(uint32_t type, uint64_t handle, const std::vector<uint8_t>& bytes);
+	uint32_t Id(uint64_t handle) const;
+	void WriteChunk(uint32_t type, const std::vector<uint8_t>& bytes);
+	void WriteBufferChanges(HostBuffer& host);
+	void Command(uint32_t opcode, const std::vector<uint8_t>& args);
+
+	// Finish(), for when the mutex is held
+	void Close();
+
+public:
+	// the FrameCapture that the static functions use
+	static FrameCapture* active;
+
+	// CAPTURE_FLAG_*
+	uint32_t flags;
+
+	// true between Start() and the last frame
+	bool capturing;
+
+	// true between BeginFrame() and EndFrame()
+	bool inFrame;
+
+	uint32_t framesCaptured;
+
+	FrameCapture();
+	~FrameCapture();
+
+	// Opens the file and writes every tracked object. Each
+	// EndFrame() after this writes one frame, until "frameCount"
+	// frames are written, then the file is finished and closed
+	bool Start(const char* path, uint32_t frameCount,
+		uint32_t width, uint32_t height, VkFormat colorFormat);
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Closes the file early. Does nothing if it is closed
+	void Finish();
+
+	// Objects
+	//=====================================
+
+	static void TrackShader(VkShaderModule module, const uint32_t* code, size_t size);
+	static void TrackBuffer(VkBuffer buffer, const VkBufferCreateInfo& info, BufferCPU* host);
+	static void ForgetBuffer(VkBuffer buffer);
+	static void TrackImage(VkImage image, const VkImageCreateInfo& info);
+	static void TrackImageView(VkImageView view, const VkImageViewCreateInfo& info);
+	static void TrackSampler(VkSampler sampler, const VkSamplerCreateInfo& info);
+	static void TrackSetLayout(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutCreateInfo& info);
+	static void TrackPipelineLayout(VkPipelineLayout layout, const VkPipelineLayoutCreateInfo& info);
+	static void TrackGraphicsPipeline(VkPipeline pipeline, const VkGraphicsPipelineCreateInfo& info);
+	static void TrackComputePipeline(VkPipeline pipeline, const VkComputePipelineCreateInfo& info);
+	static void TrackDescriptorSet(VkDescriptorSet set, VkDescriptorSetLayout layout, uint32_t variableCount = 0);
+
+	// calls vkUpdateDescriptorSets, and saves the writes
+	// (copies are not supported, nothing here uses them)
+	static void UpdateDescriptorSets(VkDevice device, uint32_t count, const VkWriteDescriptorSet* writes);
+
+	// Commands
+	//=====================================
+
+	static void CmdBindPipeline(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+	static void CmdBindDescriptorSets(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout layout,
+		uint32_t firstSet, uint32_t count, const VkDescriptorSet* sets);
+	static void CmdBindVertexBuffers(VkCommandBuffer cmd, uint32_t firstBinding, uint32_t count,
+		const VkBuffer* buffers, const VkDeviceSize* offsets);
+	static void CmdBindIndexBuffer(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkIndexType type);
+	static void CmdPushConstants(VkCommandBuffer cmd, VkPipelineLayout layout, VkShaderStageFlags stages,
+		uint32_t offset, uint32_t size, const void* data);
+	static void CmdSetViewport(VkCommandBuffer cmd, const VkViewport& viewport);
+	static void CmdSetScissor(VkCommandBuffer cmd, const VkRect2D& scissor);
+	static void CmdDrawIndexed(VkCommandBuffer cmd, uint32_t indexCount, uint32_t instanceCount,
+		uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+	static void CmdDrawIndexedIndirect(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+		uint32_t drawCount, uint32_t stride);
+	static void CmdDispatch(VkCommandBuffer cmd, uint32_t x, uint32_t y, uint32_t z);
+	static void CmdUpdateBuffer(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+		VkDeviceSize size, const void* data);
+
+	// A global memory barrier, in the same vkCmdPipelineBarrier
+	// as any image barriers (RenderGraph batches them that way).
+	// Only the global part is saved, the replay has its own
+	// images, in the layouts that it needs
+	static void CmdMemoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+		VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+		uint32_t imageBarrierCount = 0, const VkImageMemoryBarrier* imageBarriers = NULL);
+
+	// the replay draws into its own render pass, with one color
+	// attachment, so only the clear color and size are saved
+	static void CmdBeginRenderPass(VkCommandBuffer cmd, const VkRenderPassBeginInfo& info);
+	static void CmdEndRenderPass(VkCommandBuffer cmd);
+};
@@ -0,0 +1,307 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "FrameExporter.h"
+#include "Profiler.h"
+#include <string.h>
+#include <chrono>
+
+FrameExporter::FrameExporter(
+	const char* path,
+	ExportFormat exportFormat,
+	uint32_t frameWidth,
+	uint32_t frameHeight,
+	uint32_t framesPerSecond)
+{
+	format = exportFormat;
+	width = frameWidth;
+	height = frameHeight;
+	framesPushed = 0;
+	framesSkipped = 0;
+	stallMs = 0.0;
+	writeFailed = false;
+	head = 0;
+	tail = 0;
+	stopping = false;
+
+	file = fopen(path, "wb");
+	ok = file != nullptr;
+	if (!ok)
+		return;
+
+	// Y4M has one line of text at the start, and then
+	// "FRAME" before each frame. Raw RGBA has nothing
+	if (format == EXPORT_FORMAT_Y4M)
+		fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, framesPerSecond);
+
+	// all the memory is allocated now, so
+	// Push never allocates while rendering
+	size_t frameSize = format == EXPORT_FORMAT_Y4M ?
+		(size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2) :
+		(size_t)width * height * 4;
+
+	ring.resize(EXPORT_QUEUE_FRAMES);
+	for (std::vector<uint8_t>& entry : ring)
+		entry.resize(frameSize);
+
+	writer = std::thread(&FrameExporter::WriterLoop, this);
+}
+
+FrameExporter::~FrameExporter()
+{
+	Finish();
+}
+
+void FrameExporter::Finish()
+{
+	if (!ok)
+		return;
+
+	// the writer thread finishes the ring before it stops
+	stopping = true;
+	writer.join();
+
+	// fclose writes whatever is still buffered, so it can fail too
+	if (fclose(file) != 0)
+		writeFailed = true;
+
+	file = nullptr;
+	ok = false;
+}
+
+ExportFormat FrameExporter::FormatForPath(const char* path)
+{
+	size_t length = strlen(path);
+	if (length >= 4 && strcmp(path + length - 4, ".y4m") == 0)
+		return EXPORT_FORMAT_Y4M;
+	return EXPORT_FORMAT_RAW_RGBA;
+}
+
+bool FrameExporter::SupportsFormat(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+void FrameExporter::Push(const ReadbackImage& image)
+{
+	PROFILE_FUNCTION();
+
+	if (!ok)
+		return;
+
+	if (image.width != width || image.height != height)
+	{
+		framesSkipped++;
+		return;
+	}
+
+	// Wait for a free entry, this is the back-pressure. It
+	// only happens when the writer is behind by a whole ring
+	uint32_t h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) == EXPORT_QUEUE_FRAMES)
+	{
+		PROFILE_SCOPE("export stall");
+		auto wait_start = std::chrono::steady_clock::now();
+
+		while (h - tail.load(std::memory_order_acquire) == EXPORT_QUEUE_FRAMES)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+		stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+	}
+
+	std::vector<uint8_t>& entry = ring[h % EXPORT_QUEUE_FRAMES];
+
+	if (format == EXPORT_FORMAT_Y4M)
+		PackYuv(image, entry.data());
+	else
+		PackRgba(image, entry.data());
+
+	// release: the writer thread sees the bytes
+	// of the entry before it sees the new head
+	head.store(h + 1, std::memory_order_release);
+	framesPushed++;
+}
+
+void FrameExporter::PackRgba(const ReadbackImage& image, uint8_t* dst)
+{
+	// swapchains are usually BGRA, the file is always RGBA
+	bool bgra = image.format == VK_FORMAT_B8G8R8A8_UNORM || image.format == VK_FORMAT_B8G8R8A8_SRGB;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* src = image.pixels + (size_t)y * image.rowPitch;
+		uint8_t* row = dst + (size_t)y * width * 4;
+
+		if (!bgra)
+		{
+			memcpy(row, src, (size_t)width * 4);
+			continue;
+		}
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			row[x * 4 + 0] = src[x * 4 + 2];
+			row[x * 4 + 1] = src[x * 4 + 1];
+			row[x * 4 + 2] = src[x * 4 + 0];
+			row[x * 4 + 3] = src[x * 4 + 3];
+		}
+	}
+}
+
+void FrameExporter::PackYuv(const ReadbackImage& image, uint8_t* dst)
+{
+	uint32_t chromaWidth = (width + 1) / 2;
+	uint32_t chromaHeight = (height + 1) / 2;
+	uint8_t* yPlane = dst;
+	uint8_t* uPlane = yPlane + (size_t)width * height;
+	uint8_t* vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+
+	// RgbToYuv.comp already did the work, the
+	// rows only lose the padding at their ends
+	if (image.layout == READBACK_LAYOUT_I420)
+	{
+		for (uint32_t y = 0; y < height; y++)
+			memcpy(yPlane + (size_t)y * width, image.pixels + (size_t)y * image.rowPitch, width);
+
+		for (uint32_t y = 0; y < chromaHeight; y++)
+		{
+			memcpy(uPlane + (size_t)y * chromaWidth, image.uPlane + (size_t)y * image.chromaPitch, chromaWidth);
+			memcpy(vPlane + (size_t)y * chromaWidth, image.vPlane + (size_t)y * image.chromaPitch, chromaWidth);
+		}
+		return;
+	}
+
+	// The swapchain could not be sampled, so the frame is
+	// RGBA, and the CPU converts it, with the same math
+	// as RgbToYuv.comp (the sRGB values, BT.601)
+	bool bgra = image.format == VK_FORMAT_B8G8R8A8_UNORM || image.format == VK_FORMAT_B8G8R8A8_SRGB;
+	int r = bgra ? 2 : 0;
+	int b = bgra ? 0 : 2;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* src = image.pixels + (size_t)y * image.rowPitch;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint8_t* p = src + x * 4;
+			yPlane[(size_t)y * width + x] = (uint8_t)((16 * 256 + 66 * p[r] + 129 * p[1] + 25 * p[b] + 128) >> 8);
+		}
+	}
+
+	for (uint32_t cy = 0; cy < chromaHeight; cy++)
+	{
+		for (uint32_t cx = 0; cx < chromaWidth; cx++)
+		{
+			// the average of the 2x2 square, the last
+			// row or column is repeated at the edges
+			int sum[3] = { 0, 0, 0 };
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				uint32_t px = cx * 2 + (i & 1);
+				uint32_t py = cy * 2 + (i >> 1);
+				if (px >= width) px = width - 1;
+				if (py >= height) py = height - 1;
+
+				const uint8_t* p = image.pixels + (size_t)py * image.rowPitch + px * 4;
+				sum[0] += p[r];
+				sum[1] += p[1];
+				sum[2] += p[b];
+			}
+
+			int R = sum[0] / 4;
+			int G = sum[1] / 4;
+			int B = sum[2] / 4;
+			uPlane[(size_t)cy * chromaWidth + cx] = (uint8_t)((128 * 256 - 38 * R - 74 * G + 112 * B + 128) >> 8);
+			vPlane[(size_t)cy * chromaWidth + cx] = (uint8_t)((128 * 256 + 112 * R - 94 * G - 18 * B + 128) >> 8);
+		}
+	}
+}
+
+void FrameExporter::WriterLoop()
+{
+	PROFILE_THREAD_NAME("FrameExporter writer");
+
+	while (true)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+
+		// acquire: if we see the new head, we
+		// also see the bytes that Push wrote
+		if (t == head.load(std::memory_order_acquire))
+		{
+			// Nothing to write. After stopping, Push is never
+			// called again, so an empty ring means we are done.
+			// head is read again, because a Push can happen
+			// between the first read and seeing "stopping"
+			if (stopping && t == head.load(std::memory_order_acquire))
+				break;
+
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+			continue;
+		}
+
+		std::vector<uint8_t>& entry = ring[t % EXPORT_QUEUE_FRAMES];
+
+		// After a failed write, the entry is only taken out
+		// of the ring. Writing more would leave a hole in the
+		// middle of the file, which is worse than a short file
+		if (!writeFailed)
+		{
+			PROFILE_SCOPE("fwrite frame");
+
+			bool written = true;
+			if (format == EXPORT_FORMAT_Y4M)
+				written = fputs("FRAME\n", file) >= 0;
+			if (written)
+				written = fwrite(entry.data(), 1, entry.size(), file) == entry.size();
+
+			if (!written)
+			{
+				// only this thread prints, once, and the
+				// render thread reads the flag at the end
+				printf("Writing a frame failed, the frames after it are not exported\n");
+				fflush(stdout);
+				writeFailed = true;
+			}
+		}
+
+		// release: Push can only reuse the
+		// entry after we are done reading it
+		tail.store(t + 1, std::memory_order_release);
+	}
+
+	if (fflush(file) != 0)
+		writeFailed = true;
+}
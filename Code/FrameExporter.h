@@ -0,0 +1,128 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "FrameReadback.h"
+
+// frames that can wait for the writer thread, a 1080p
+// Y4M frame is 3 MB, so this is 24 MB of memory
+#define EXPORT_QUEUE_FRAMES 8
+
+enum ExportFormat
+{
+	// every pixel as R, G, B, A bytes, with no header,
+	// "ffmpeg -f rawvideo -pix_fmt rgba -s WxH" reads it
+	EXPORT_FORMAT_RAW_RGBA,
+
+	// YUV4MPEG2 with 4:2:0 chroma, which most players and
+	// encoders open as it is. Half the size of RGBA
+	EXPORT_FORMAT_Y4M
+};
+
+// Writes every frame that FrameReadback gives it to one file.
+//
+// Push runs on the render thread, in the readback callback. It only
+// copies the frame into a free entry of a ring of EXPORT_QUEUE_FRAMES
+// frames, and a writer thread writes the entries to the file, so the
+// render thread never waits for the disk. The ring has one writer and
+// one reader, so it needs no lock: "head" is only changed by Push, and
+// "tail" is only changed by the writer thread. If the disk is slower
+// than the renderer, the ring fills up, and Push waits for the writer
+// thread to free an entry. That slows the render loop down to the
+// speed of the disk, instead of dropping frames.
+//
+// Every frame must have the size that the exporter was made with,
+// a frame of a different size (after a resize) is skipped
+class FrameExporter
+{
+private:
+	FILE* file;
+	ExportFormat format;
+
+	// the bytes of one frame, ready to write
+	std::vector<std::vector<uint8_t>> ring;
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	std::atomic<bool> stopping;
+	std::thread writer;
+
+	void WriterLoop();
+
+	// I420 planes, from either layout of ReadbackImage
+	void PackYuv(const ReadbackImage& image, uint8_t* dst);
+	void PackRgba(const ReadbackImage& image, uint8_t* dst);
+
+public:
+	// false if the file could not be made,
+	// then Push does nothing
+	bool ok;
+
+	uint32_t width;
+	uint32_t height;
+
+	// frames given to the writer thread, and frames
+	// that were skipped because their size was wrong
+	uint64_t framesPushed;
+	uint64_t framesSkipped;
+
+	// time that Push spent waiting for a free entry,
+	// more than zero means the disk is too slow
+	double stallMs;
+
+	// set by the writer thread when a write fails (the disk is
+	// full, for example). Frames after that are thrown away,
+	// so that Push never waits for a writer that is stuck
+	std::atomic<bool> writeFailed;
+
+	FrameExporter(
+		const char* path,
+		ExportFormat exportFormat,
+		uint32_t frameWidth,
+		uint32_t frameHeight,
+		uint32_t framesPerSecond);
+
+	// calls Finish
+	~FrameExporter();
+
+	// Writes every frame that is still in the ring, and
+	// closes the file. After this, writeFailed is final,
+	// and Push does nothing
+	void Finish();
+
+	void Push(const ReadbackImage& image);
+
+	// ".y4m" is Y4M, anything else is raw RGBA
+	static ExportFormat FormatForPath(const char* path);
+
+	// The file always has 8 bits per channel, and frames are
+	// packed as 8-bit RGBA or BGRA. 10-bit and 16-bit float
+	// swapchains would need a conversion, which we don't do
+	static bool SupportsFormat(VkFormat format);
+};
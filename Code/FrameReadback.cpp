@@ -0,0 +1,541 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "FrameReadback.h"
+#include "Helper.h"
+#include <stdio.h>
+#include <string.h>
+
+FrameReadback::FrameReadback(
+	VkDevice d,
+	VkPhysicalDeviceMemoryProperties mp,
+	uint32_t slotCount)
+{
+	device = d;
+	memory_properties = mp;
+	requested = 0;
+	delivered = 0;
+	layout = READBACK_LAYOUT_COPY;
+
+	sampler = VK_NULL_HANDLE;
+	yuv_bindings = nullptr;
+	pipeline_layout = VK_NULL_HANDLE;
+	yuv_pipeline = VK_NULL_HANDLE;
+	desc_pool = VK_NULL_HANDLE;
+
+	// buffers are made by the first Record that
+	// needs them, nothing is allocated until then
+	slots.resize(slotCount);
+	for (Slot& slot : slots)
+	{
+		slot = {};
+	}
+}
+
+FrameReadback::~FrameReadback()
+{
+	for (Slot& slot : slots)
+		Release(slot);
+
+	// destroying VK_NULL_HANDLE does nothing, so
+	// this is fine if PrepareYuv was never called.
+	// The pool frees the sets
+	vkDestroyDescriptorPool(device, desc_pool, NULL);
+	vkDestroyPipeline(device, yuv_pipeline, NULL);
+	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+	delete yuv_bindings;
+	vkDestroySampler(device, sampler, NULL);
+}
+
+// the push constants of RgbToYuv.comp
+struct YuvLayout
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t yStride;
+	uint32_t uOffset;
+	uint32_t vOffset;
+	uint32_t chromaStride;
+	uint32_t srgb;
+};
+
+// Where the planes go in the buffer. Each thread of RgbToYuv.comp
+// writes 8x2 pixels, so the rows of Y are rounded up to 8 bytes,
+// and there is an even number of rows. The rows of U and V are
+// half as long, so they are 4-byte aligned too
+static YuvLayout LayoutYuv(uint32_t width, uint32_t height)
+{
+	YuvLayout l;
+	l.width = width;
+	l.height = height;
+	l.yStride = (width + 7) & ~7u;
+	l.chromaStride = l.yStride / 2;
+
+	uint32_t rows = (height + 1) & ~1u;
+	l.uOffset = l.yStride * rows;
+	l.vOffset = l.uOffset + l.chromaStride * (rows / 2);
+	l.srgb = 0;
+	return l;
+}
+
+// the bindings of RgbToYuv.comp, as they are
+// given to DescriptorTemplate every frame
+struct YuvBindings
+{
+	VkDescriptorImageInfo image;
+	VkDescriptorBufferInfo buffer;
+};
+
+bool FrameReadback::PrepareYuv(const char* shaderPath, DescriptorPath descriptorPath)
+{
+	if (yuv_pipeline != VK_NULL_HANDLE)
+		return true;
+
+	VkShaderModule module;
+	if (!Helper::create_shader_module_from_file(device, shaderPath, &module))
+		return false;
+
+	// texelFetch reads exact pixels, the filter does not
+	// matter, but a sampler2D needs a sampler
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	vkCreateSampler(device, &samplerInfo, NULL, &sampler);
+
+	// binding 0 is the frame, binding 1 is the slot's buffer
+	DescriptorTemplateEntry entries[2] = {
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, offsetof(YuvBindings, image) },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, offsetof(YuvBindings, buffer) },
+	};
+	yuv_bindings = new DescriptorTemplate(device, descriptorPath, entries, 2);
+
+	VkPushConstantRange pushRange = {};
+	pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushRange.size = sizeof(YuvLayout);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &yuv_bindings->layout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+	vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipeline_layout);
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipeline_layout;
+	vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &yuv_pipeline);
+
+	vkDestroyShaderModule(device, module, NULL);
+
+	yuv_bindings->SetPipelineLayout(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0);
+
+	// push descriptors live in the command
+	// buffer, there are no sets to make
+	if (yuv_bindings->path == DESCRIPTOR_PATH_PUSH)
+	{
+		layout = READBACK_LAYOUT_I420;
+		return true;
+	}
+
+	// One set per slot. A set is only written by Record,
+	// after its slot was collected, so the GPU is not using it
+	VkDescriptorPoolSize poolSizes[2] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = (uint32_t)slots.size();
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = (uint32_t)slots.size();
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = (uint32_t)slots.size();
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+	vkCreateDescriptorPool(device, &poolInfo, NULL, &desc_pool);
+
+	std::vector<VkDescriptorSetLayout> layouts(slots.size(), yuv_bindings->layout);
+	sets.resize(slots.size());
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = desc_pool;
+	allocInfo.descriptorSetCount = (uint32_t)layouts.size();
+	allocInfo.pSetLayouts = layouts.data();
+	vkAllocateDescriptorSets(device, &allocInfo, sets.data());
+
+	layout = READBACK_LAYOUT_I420;
+	return true;
+}
+
+void FrameReadback::Release(Slot& slot)
+{
+	if (slot.buffer == VK_NULL_HANDLE)
+		return;
+
+	vkUnmapMemory(device, slot.memory);
+	vkDestroyBuffer(device, slot.buffer, NULL);
+	vkFreeMemory(device, slot.memory, NULL);
+
+	slot.buffer = VK_NULL_HANDLE;
+	slot.memory = VK_NULL_HANDLE;
+	slot.mapped = nullptr;
+	slot.size = 0;
+}
+
+void FrameReadback::Reserve(Slot& slot, VkDeviceSize size)
+{
+	if (slot.size >= size)
+		return;
+
+	// the window got bigger, the old buffer is not used by the
+	// GPU anymore (this slot was collected), so it can go
+	Release(slot);
+
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.size = size;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	vkCreateBuffer(device, &info, NULL, &slot.buffer);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(device, slot.buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo memAllocInfo = {};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.allocationSize = mem_reqs.size;
+
+	// HOST_CACHED memory goes through the CPU's cache, so reading
+	// it is as fast as reading any other memory. Memory that is only
+	// HOST_COHERENT is usually not cached, and reading a whole frame
+	// out of it can take longer than drawing the frame. Every GPU
+	// has HOST_VISIBLE | HOST_COHERENT, if it has no HOST_CACHED
+	if (!Helper::memory_type_from_properties(
+		memory_properties,
+		mem_reqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+		&memAllocInfo.memoryTypeIndex))
+	{
+		Helper::memory_type_from_properties(
+			memory_properties,
+			mem_reqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&memAllocInfo.memoryTypeIndex);
+	}
+
+	// cached memory is not always coherent, then
+	// Collect has to invalidate it before reading
+	VkMemoryPropertyFlags flags = memory_properties.memoryTypes[memAllocInfo.memoryTypeIndex].propertyFlags;
+	slot.coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	vkAllocateMemory(device, &memAllocInfo, NULL, &slot.memory);
+	vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+
+	// mapped for as long as the buffer lives
+	void* mapped = nullptr;
+	vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	slot.mapped = (uint8_t*)mapped;
+	slot.size = size;
+}
+
+bool FrameReadback::Wanted()
+{
+	return requested > 0 && callback;
+}
+
+uint32_t FrameReadback::BytesPerPixel(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+	case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+		return 4;
+
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return 8;
+
+	default:
+		return 0;
+	}
+}
+
+void FrameReadback::Record(VkCommandBuffer cmd, uint32_t slotIndex, VkImage image, VkImageView view,
+	uint32_t width, uint32_t height, VkFormat format, uint64_t frame)
+{
+	uint32_t bytesPerPixel = BytesPerPixel(format);
+	if (!Wanted() || bytesPerPixel == 0 || slotIndex >= slots.size())
+		return;
+
+	Slot& slot = slots[slotIndex];
+
+	slot.recorded = true;
+	slot.image = {};
+	slot.image.frame = frame;
+	slot.image.width = width;
+	slot.image.height = height;
+	slot.image.format = format;
+	slot.image.layout = layout;
+
+	if (requested != READBACK_EVERY_FRAME)
+		requested--;
+
+	if (layout == READBACK_LAYOUT_I420)
+	{
+		YuvLayout l = LayoutYuv(width, height);
+		Reserve(slot, l.vOffset + (VkDeviceSize)l.chromaStride * ((height + 1) / 2));
+
+		slot.image.bytesPerPixel = 1;
+		slot.image.rowPitch = l.yStride;
+		slot.image.pixels = slot.mapped;
+		slot.image.chromaPitch = l.chromaStride;
+		slot.image.uPlane = slot.mapped + l.uOffset;
+		slot.image.vPlane = slot.mapped + l.vOffset;
+
+		RecordYuv(cmd, slotIndex, image, view);
+		return;
+	}
+
+	Reserve(slot, (VkDeviceSize)width * height * bytesPerPixel);
+
+	// The render pass left the image ready to present,
+	// the copy needs it as a transfer source. The copy
+	// waits for the render pass to finish writing it
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, NULL, 0, NULL, 1, &barrier);
+
+	// bufferRowLength 0 means that the rows are
+	// packed together, with no space between them
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent.width = width;
+	region.imageExtent.height = height;
+	region.imageExtent.depth = 1;
+
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+	// Back to PRESENT_SRC_KHR for the present. The
+	// present waits for the semaphore of the submit,
+	// so nothing else has to wait for this
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	// and the CPU reads the buffer after the fence
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = slot.buffer;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, NULL, 1, &bufferBarrier, 1, &barrier);
+
+	slot.image.bytesPerPixel = bytesPerPixel;
+	slot.image.rowPitch = width * bytesPerPixel;
+	slot.image.pixels = slot.mapped;
+}
+
+void FrameReadback::RecordYuv(VkCommandBuffer cmd, uint32_t slotIndex, VkImage image, VkImageView view)
+{
+	Slot& slot = slots[slotIndex];
+	YuvLayout l = LayoutYuv(slot.image.width, slot.image.height);
+
+	// texelFetch gives linear colors from an SRGB view
+	l.srgb = slot.image.format == VK_FORMAT_B8G8R8A8_SRGB || slot.image.format == VK_FORMAT_R8G8B8A8_SRGB;
+
+	// the swapchain image is different every frame,
+	// and the buffer may have grown, so the bindings
+	// are given to the shader every time
+	YuvBindings bindings = {};
+	bindings.image.sampler = sampler;
+	bindings.image.imageView = view;
+	bindings.image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	bindings.buffer.buffer = slot.buffer;
+	bindings.buffer.range = VK_WHOLE_SIZE;
+
+	// the compute shader reads the image after
+	// the render pass is done writing it
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL, 1, &barrier);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, yuv_pipeline);
+
+	// With push descriptors there are no sets, otherwise
+	// the slot's set was collected, so the GPU is done with it
+	VkDescriptorSet set = sets.empty() ? VK_NULL_HANDLE : sets[slotIndex];
+	yuv_bindings->Bind(cmd, set, &bindings);
+
+	vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(l), &l);
+
+	// one thread per 8x2 block, 8x8 threads per group
+	uint32_t blocksX = l.yStride / 8;
+	uint32_t blocksY = (l.height + 1) / 2;
+	vkCmdDispatch(cmd, (blocksX + 7) / 8, (blocksY + 7) / 8, 1);
+
+	// back to PRESENT_SRC_KHR, and the buffer
+	// is read by the CPU after the fence
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = slot.buffer;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, NULL, 1, &bufferBarrier, 1, &barrier);
+}
+
+void FrameReadback::Collect(uint32_t slotIndex)
+{
+	if (slotIndex >= slots.size())
+		return;
+
+	Slot& slot = slots[slotIndex];
+	if (!slot.recorded)
+		return;
+
+	slot.recorded = false;
+
+	// without HOST_COHERENT, the CPU's cache may
+	// still have old bytes of this memory in it
+	if (!slot.coherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = slot.memory;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	if (callback)
+		callback(slot.image);
+
+	delivered++;
+}
+
+void FrameReadback::Flush()
+{
+	// Oldest first, so the callback sees the frames in order.
+	// The slot with the lowest frame number is the oldest
+	while (true)
+	{
+		int oldest = -1;
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			if (slots[i].recorded && (oldest < 0 || slots[i].image.frame < slots[oldest].image.frame))
+				oldest = (int)i;
+		}
+
+		if (oldest < 0)
+			break;
+
+		Collect((uint32_t)oldest);
+	}
+}
+
+bool FrameReadback::WritePpm(const ReadbackImage& image, const char* path)
+{
+	bool bgra = image.format == VK_FORMAT_B8G8R8A8_UNORM || image.format == VK_FORMAT_B8G8R8A8_SRGB;
+	bool rgba = image.format == VK_FORMAT_R8G8B8A8_UNORM || image.format == VK_FORMAT_R8G8B8A8_SRGB;
+	if ((!bgra && !rgba) || image.layout != READBACK_LAYOUT_COPY)
+		return false;
+
+	FILE* f = fopen(path, "wb");
+	if (f == nullptr)
+		return false;
+
+	fprintf(f, "P6\n%u %u\n255\n", image.width, image.height);
+
+	// one row at a time, RGB without alpha
+	std::vector<uint8_t> row(image.width * 3);
+	for (uint32_t y = 0; y < image.height; y++)
+	{
+		const uint8_t* src = image.pixels + (size_t)y * image.rowPitch;
+		for (uint32_t x = 0; x < image.width; x++)
+		{
+			row[x * 3 + 0] = src[x * 4 + (bgra ? 2 : 0)];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + (bgra ? 0 : 2)];
+		}
+		fwrite(row.data(), 1, row.size(), f);
+	}
+
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,183 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include "DescriptorTemplate.h"
+#include <functional>
+#include <vector>
+
+// requested = READBACK_EVERY_FRAME copies every frame
+// until requested is set to something else
+#define READBACK_EVERY_FRAME UINT32_MAX
+
+// What Record puts in the buffer
+enum ReadbackLayout
+{
+	// the pixels of the image, as they are
+	READBACK_LAYOUT_COPY,
+
+	// YUV 4:2:0, made by RgbToYuv.comp, see PrepareYuv
+	READBACK_LAYOUT_I420
+};
+
+// The pixels of one frame, they are only valid during the callback.
+//
+// With READBACK_LAYOUT_COPY, each row is rowPitch bytes, and the
+// pixels are in the order of "format" (usually B8G8R8A8, which is
+// the swapchain's format).
+//
+// With READBACK_LAYOUT_I420, "pixels" is the Y plane, one byte per
+// pixel, with rowPitch bytes per row. uPlane and vPlane have one
+// byte per 2x2 pixels, with chromaPitch bytes per row
+struct ReadbackImage
+{
+	uint64_t frame;
+	uint32_t width;
+	uint32_t height;
+	VkFormat format;
+	ReadbackLayout layout;
+	uint32_t bytesPerPixel;
+	uint32_t rowPitch;
+	const uint8_t* pixels;
+
+	uint32_t chromaPitch;
+	const uint8_t* uPlane;
+	const uint8_t* vPlane;
+};
+
+// Called on the render thread, a few frames after the frame was drawn
+typedef std::function<void(const ReadbackImage& image)> ReadbackCallback;
+
+// Gets the pixels of drawn frames back to the CPU, without waiting.
+//
+// At the end of a frame's command buffer, Record copies the swapchain
+// image into a buffer in HOST_CACHED memory (CPU reads from it are
+// fast, unlike from the write-combined memory that BufferCPU uses).
+// There is one buffer per frame in flight, like the command buffers.
+// draw() waits for a frame's fence before it records that frame
+// again, and right after that wait, Collect gives the finished copy
+// to the callback. So the CPU never waits for the copy, it gets it
+// frame_lag frames later, and the GPU never waits for the CPU.
+//
+// Usage:
+//	readback->callback = ...;
+//	readback->requested = 1;		or READBACK_EVERY_FRAME
+//	Record(cmd, slot, ...)			after the render pass
+//	Collect(slot)					after waiting for the slot's fence
+//	Flush()							after vkDeviceWaitIdle, at the end
+class FrameReadback
+{
+private:
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+
+	// one per frame in flight, "recorded" means that the
+	// copy is in a command buffer, and has not been collected
+	struct Slot
+	{
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint8_t* mapped;
+		bool coherent;
+		bool recorded;
+		ReadbackImage image;
+	};
+
+	std::vector<Slot> slots;
+
+	// READBACK_LAYOUT_I420, these are VK_NULL_HANDLE (and
+	// nullptr) until PrepareYuv works. The swapchain image and
+	// the slot's buffer are given to the shader by yuv_bindings,
+	// every frame. With push descriptors, that needs no sets,
+	// otherwise each slot has a descriptor set
+	VkSampler sampler;
+	DescriptorTemplate* yuv_bindings;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline yuv_pipeline;
+	VkDescriptorPool desc_pool;
+	std::vector<VkDescriptorSet> sets;
+
+	void RecordYuv(VkCommandBuffer cmd, uint32_t slot, VkImage image, VkImageView view);
+
+	// makes the slot's buffer at least "size" bytes
+	void Reserve(Slot& slot, VkDeviceSize size);
+	void Release(Slot& slot);
+
+public:
+	// how many more frames to copy, Record does
+	// nothing when this is zero, so a readback
+	// costs nothing when nobody asks for one
+	uint32_t requested;
+
+	ReadbackCallback callback;
+
+	// frames that reached the callback
+	uint64_t delivered;
+
+	// READBACK_LAYOUT_COPY, unless PrepareYuv
+	// was called, and it worked
+	ReadbackLayout layout;
+
+	FrameReadback(
+		VkDevice d,
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		uint32_t slotCount);
+
+	~FrameReadback();
+
+	// true if the next Record will copy something
+	bool Wanted();
+
+	// Makes every Record after this convert the image to YUV 4:2:0
+	// on the GPU. The image then needs VK_IMAGE_USAGE_SAMPLED_BIT,
+	// and Record needs a view of it. Returns false, and keeps
+	// copying the image as it is, if the shader can not be loaded.
+	// descriptorPath is how the bindings that change every frame
+	// are given to the shader, see DescriptorTemplate.h
+	bool PrepareYuv(const char* shaderPath, DescriptorPath descriptorPath);
+
+	// 0 for formats that Record can not copy
+	static uint32_t BytesPerPixel(VkFormat format);
+
+	// Copies "image", which is in PRESENT_SRC_KHR layout after
+	// the render pass, and puts it back in that layout. The image
+	// needs VK_IMAGE_USAGE_TRANSFER_SRC_BIT, "view" is only used
+	// by READBACK_LAYOUT_I420. Outside of a render pass
+	void Record(VkCommandBuffer cmd, uint32_t slot, VkImage image, VkImageView view,
+		uint32_t width, uint32_t height, VkFormat format, uint64_t frame);
+
+	// The GPU must be done with the slot's last command buffer
+	void Collect(uint32_t slot);
+
+	// Collects every slot, the GPU must be idle
+	void Flush();
+
+	// Writes an 8-bit RGBA or BGRA image as a binary PPM
+	// (which drops alpha), which almost anything can open
+	static bool WritePpm(const ReadbackImage& image, const char* path);
+};
@@ -0,0 +1,291 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "GpuTimer.h"
+#include <string.h>
+
+GpuTimer::GpuTimer(
+	VkDevice d,
+	VkPhysicalDevice gpu,
+	uint32_t queue_family_index,
+	uint32_t frameSlots,
+	bool pipelineStatistics)
+{
+	device = d;
+	pool = VK_NULL_HANDLE;
+	statisticsPool = VK_NULL_HANDLE;
+	slotCount = frameSlots;
+	current = 0;
+	frame = 0;
+	frameMs = 0.0;
+	enabled = false;
+	statisticsEnabled = false;
+	updated = false;
+	memset(&statistics, 0, sizeof(statistics));
+
+	// timestampValidBits is 0 if the queue family
+	// can not write timestamps at all. Otherwise, it is
+	// how many of the 64 bits actually count up
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, NULL);
+	std::vector<VkQueueFamilyProperties> families(queue_family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, families.data());
+
+	if (queue_family_index >= queue_family_count)
+		return;
+
+	uint32_t validBits = families[queue_family_index].timestampValidBits;
+	if (validBits == 0)
+		return;
+
+	timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	// timestampPeriod is how many nanoseconds
+	// pass every time the timestamp goes up by 1
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	timestampPeriod = props.limits.timestampPeriod;
+
+	// two queries (begin and end) for every pass, in every slot
+	VkQueryPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = slotCount * GPU_TIMER_MAX_PASSES * 2;
+	vkCreateQueryPool(device, &poolInfo, NULL, &pool);
+
+	// One statistics query per slot. The flags pick which counters
+	// the query has, and the results come back in the order of
+	// the flags' bits, which is the order of GpuStatistics.
+	// The device has to be made with pipelineStatisticsQuery
+	if (pipelineStatistics)
+	{
+		VkQueryPoolCreateInfo statsInfo = {};
+		statsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		statsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		statsInfo.queryCount = slotCount;
+		statsInfo.pipelineStatistics =
+			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+		if (vkCreateQueryPool(device, &statsInfo, NULL, &statisticsPool) == VK_SUCCESS)
+			statisticsEnabled = true;
+	}
+
+	slots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		slots[i].recorded = false;
+		slots[i].statisticsRecorded = false;
+		slots[i].passCount = 0;
+	}
+
+	enabled = true;
+}
+
+GpuTimer::~GpuTimer()
+{
+	vkDestroyQueryPool(device, pool, NULL);
+	vkDestroyQueryPool(device, statisticsPool, NULL);
+}
+
+bool GpuTimer::ReadSlot(uint32_t slot)
+{
+	Slot& s = slots[slot];
+
+	if (!s.recorded || s.passCount == 0)
+		return false;
+
+	// Each query gives two 64-bit numbers: the timestamp, and
+	// whether it is available. Without VK_QUERY_RESULT_WAIT_BIT
+	// this never waits, if the GPU is not done, "available" is 0,
+	// and we keep the results that we already had
+	uint64_t data[GPU_TIMER_MAX_PASSES * 2][2];
+	uint32_t queryCount = s.passCount * 2;
+
+	VkResult result = vkGetQueryPoolResults(device, pool,
+		slot * GPU_TIMER_MAX_PASSES * 2, queryCount,
+		sizeof(data), data, sizeof(data[0]),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	if (result != VK_SUCCESS && result != VK_NOT_READY)
+		return false;
+
+	for (uint32_t i = 0; i < queryCount; i++)
+	{
+		if (data[i][1] == 0)
+			return false;
+	}
+
+	// four counters and then the availability
+	uint64_t stats[5] = {};
+
+	if (s.statisticsRecorded)
+	{
+		result = vkGetQueryPoolResults(device, statisticsPool, slot, 1,
+			sizeof(stats), stats, sizeof(stats),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if ((result != VK_SUCCESS && result != VK_NOT_READY) || stats[4] == 0)
+			return false;
+
+		statistics.inputVertices = stats[0];
+		statistics.vertexInvocations = stats[1];
+		statistics.clippingPrimitives = stats[2];
+		statistics.fragmentInvocations = stats[3];
+	}
+
+	passes.resize(s.passCount);
+
+	uint64_t first = data[0][0] & timestampMask;
+	uint64_t last = first;
+
+	for (uint32_t i = 0; i < s.passCount; i++)
+	{
+		uint64_t begin = data[i * 2][0] & timestampMask;
+		uint64_t end = data[i * 2 + 1][0] & timestampMask;
+
+		// if the counter wrapped around between the two
+		// timestamps, this still gives the right difference
+		uint64_t ticks = (end - begin) & timestampMask;
+
+		passes[i].name = s.names[i];
+		passes[i].ms = ticks * timestampPeriod / 1000000.0;
+
+		if (((end - first) & timestampMask) > ((last - first) & timestampMask))
+			last = end;
+	}
+
+	frameMs = ((last - first) & timestampMask) * timestampPeriod / 1000000.0;
+	frame = s.frame;
+	return true;
+}
+
+void GpuTimer::BeginFrame(VkCommandBuffer cmd, uint64_t frameNumber)
+{
+	if (!enabled)
+		return;
+
+	current = (uint32_t)(frameNumber % slotCount);
+
+	// the last frame that used this slot
+	// is done, so get its results first
+	updated = ReadSlot(current);
+
+	// Queries have to be reset before they are written again.
+	// This is a command, so it happens on the GPU, in order,
+	// before the timestamps that come after it
+	vkCmdResetQueryPool(cmd, pool, current * GPU_TIMER_MAX_PASSES * 2, GPU_TIMER_MAX_PASSES * 2);
+
+	if (statisticsEnabled)
+		vkCmdResetQueryPool(cmd, statisticsPool, current, 1);
+
+	Slot& s = slots[current];
+	s.recorded = true;
+	s.statisticsRecorded = false;
+	s.frame = frameNumber;
+	s.passCount = 0;
+}
+
+uint32_t GpuTimer::BeginPass(VkCommandBuffer cmd, const char* name)
+{
+	if (!enabled)
+		return UINT32_MAX;
+
+	Slot& s = slots[current];
+	if (s.passCount == GPU_TIMER_MAX_PASSES)
+		return UINT32_MAX;
+
+	uint32_t pass = s.passCount++;
+	s.names[pass] = name;
+
+	// TOP_OF_PIPE: the timestamp is written as soon as every
+	// command before it has started, which is the start of the pass
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool,
+		(current * GPU_TIMER_MAX_PASSES + pass) * 2);
+
+	return pass;
+}
+
+void GpuTimer::EndPass(VkCommandBuffer cmd, uint32_t pass)
+{
+	if (!enabled || pass == UINT32_MAX)
+		return;
+
+	// BOTTOM_OF_PIPE: the timestamp is written when every
+	// command before it has completely finished
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool,
+		(current * GPU_TIMER_MAX_PASSES + pass) * 2 + 1);
+}
+
+void GpuTimer::BeginStatistics(VkCommandBuffer cmd)
+{
+	if (!enabled || !statisticsEnabled)
+		return;
+
+	// no flags, VK_QUERY_CONTROL_PRECISE_BIT is only
+	// for occlusion queries
+	vkCmdBeginQuery(cmd, statisticsPool, current, 0);
+}
+
+void GpuTimer::EndStatistics(VkCommandBuffer cmd)
+{
+	if (!enabled || !statisticsEnabled)
+		return;
+
+	vkCmdEndQuery(cmd, statisticsPool, current);
+	slots[current].statisticsRecorded = true;
+}
+
+void GpuTimer::WriteCsvHeader(FILE* f)
+{
+	fprintf(f, "frame,total_ms");
+	for (size_t i = 0; i < passes.size(); i++)
+		fprintf(f, ",%s_ms", passes[i].name);
+
+	if (statisticsEnabled)
+		fprintf(f, ",input_vertices,vertex_invocations,clipping_primitives,fragment_invocations");
+
+	fprintf(f, "\n");
+}
+
+void GpuTimer::WriteCsvRow(FILE* f)
+{
+	fprintf(f, "%llu,%.4f", (unsigned long long)frame, frameMs);
+	for (size_t i = 0; i < passes.size(); i++)
+		fprintf(f, ",%.4f", passes[i].ms);
+
+	if (statisticsEnabled)
+	{
+		fprintf(f, ",%llu,%llu,%llu,%llu",
+			(unsigned long long)statistics.inputVertices,
+			(unsigned long long)statistics.vertexInvocations,
+			(unsigned long long)statistics.clippingPrimitives,
+			(unsigned long long)statistics.fragmentInvocations);
+	}
+
+	fprintf(f, "\n");
+}
@@ -0,0 +1,167 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <stdio.h>
+#include <vector>
+
+// the most passes that can be timed in one frame
+#define GPU_TIMER_MAX_PASSES 16
+
+// How long one pass took on the GPU
+struct GpuPassTime
+{
+	const char* name;
+	double ms;
+};
+
+// What the GPU did between BeginStatistics and EndStatistics,
+// from a VK_QUERY_TYPE_PIPELINE_STATISTICS query. Comparing two
+// frames tells us why one is slower: more inputVertices means more
+// geometry, more fragmentInvocations with the same geometry means
+// more overdraw, and the same counts with a longer time means the
+// shaders themselves got slower
+struct GpuStatistics
+{
+	// vertices read by the input assembler
+	uint64_t inputVertices;
+
+	// times the vertex shader ran, this can be lower than
+	// inputVertices, because of the post-transform cache
+	uint64_t vertexInvocations;
+
+	// triangles that reached the clipping stage
+	uint64_t clippingPrimitives;
+
+	// times the fragment shader ran
+	uint64_t fragmentInvocations;
+};
+
+// Times passes on the GPU with timestamp queries.
+//
+// Each pass writes a timestamp before it starts and after it ends,
+// and the difference is how long the GPU spent on it. The results
+// are not ready until the GPU finishes the command buffer, which is
+// a few frames later, so the query pool is a ring of slots, one per
+// frame. The program waits for a frame's fence before it records that
+// frame again (FRAME_LAG frames later), so with one more slot than
+// FRAME_LAG, a slot's last frame is always done by the time the slot
+// comes around again. BeginFrame reads it without waiting, and
+// without ever stopping the CPU or the GPU.
+//
+// Usage, for every command buffer:
+//	BeginFrame(cmd, frameNumber);	right after vkBeginCommandBuffer
+//	p = BeginPass(cmd, "name");		outside of a render pass
+//	...
+//	EndPass(cmd, p);
+//
+// The results of the newest finished frame are in "passes".
+//
+// It can also count vertices and fragments with a pipeline
+// statistics query, between BeginStatistics and EndStatistics,
+// which uses the same slots, and is read at the same time
+class GpuTimer
+{
+private:
+	VkDevice device;
+	VkQueryPool pool;
+	VkQueryPool statisticsPool;
+	uint32_t slotCount;
+
+	// nanoseconds per tick, and the bits of the
+	// timestamp that are real, the rest are garbage
+	double timestampPeriod;
+	uint64_t timestampMask;
+
+	// what was recorded in each slot, so that we
+	// know what the results mean when we read them
+	struct Slot
+	{
+		bool recorded;
+		bool statisticsRecorded;
+		uint64_t frame;
+		uint32_t passCount;
+		const char* names[GPU_TIMER_MAX_PASSES];
+	};
+
+	std::vector<Slot> slots;
+	uint32_t current;
+
+	bool ReadSlot(uint32_t slot);
+
+public:
+	// false if this queue family can not write timestamps,
+	// then every function here does nothing
+	bool enabled;
+
+	// false if statistics were not asked for, or if the device
+	// was made without the pipelineStatisticsQuery feature
+	bool statisticsEnabled;
+
+	// the newest results, from frame "frame"
+	std::vector<GpuPassTime> passes;
+	GpuStatistics statistics;
+	uint64_t frame;
+
+	// true if the last BeginFrame read a new frame's results
+	bool updated;
+
+	// from the first timestamp of the frame to the
+	// last one, which includes gaps between passes
+	double frameMs;
+
+	GpuTimer(
+		VkDevice d,
+		VkPhysicalDevice gpu,
+		uint32_t queue_family_index,
+		uint32_t frameSlots,
+		bool pipelineStatistics);
+
+	~GpuTimer();
+
+	// Reads the results of the last frame that used this slot,
+	// and resets the slot's queries, so it must be outside of a
+	// render pass. frameNumber has to go up by one every frame
+	void BeginFrame(VkCommandBuffer cmd, uint64_t frameNumber);
+
+	// returns the number to give to EndPass, or
+	// UINT32_MAX if this frame has too many passes
+	uint32_t BeginPass(VkCommandBuffer cmd, const char* name);
+	void EndPass(VkCommandBuffer cmd, uint32_t pass);
+
+	// Counts what the GPU does in between, once per frame. Both have
+	// to be outside of a render pass, or in the same subpass
+	void BeginStatistics(VkCommandBuffer cmd);
+	void EndStatistics(VkCommandBuffer cmd);
+
+	// One line per frame, with a column per pass and per
+	// statistic, so a run can be compared to another run.
+	// The header uses the pass names of the newest results
+	void WriteCsvHeader(FILE* f);
+	void WriteCsvRow(FILE* f);
+};
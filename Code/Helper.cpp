@@ -23,17 +23,27 @@ that utilizes Vulkan, see more at http://cemu.info
 */
 
 #include "Helper.h"
+#include "FileView.h"
+#include "FrameCapture.h"
 
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <signal.h>
 #include <vector>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
 void Helper::DbgMsg(char *fmt, ...)
 {
 	va_list va;
@@ -103,34 +113,86 @@ bool Helper::memory_type_from_properties(VkPhysicalDeviceMemoryProperties memory
 	return false;
 }
 
-// This function simply reads a file,
-// records every byte into an array of bytes,
-// and records the size. This can be used
-// for textures and shaders
-void Helper::ReadFile(const char* path, char** data, int* size)
+// This creates a shader module from a compiled shader file
+// (.spv) at runtime. The file is mapped with FileView, and
+// the driver reads the SPIR-V straight out of the mapping,
+// so the shader is never copied into an array of our own
+bool Helper::create_shader_module_from_file(VkDevice device, const char* path, VkShaderModule* module)
 {
-	// open the file 
-	FILE *fp = fopen(path, "rb");
+	FileView spirv;
 
-	// Go to the end of the file
-	fseek(fp, 0L, SEEK_END);
+	// SPIR-V is made of 4-byte words, so a file with any
+	// other size is not a compiled shader
+	if (!spirv.Open(path, FILE_VIEW_HINT_SEQUENTIAL | FILE_VIEW_HINT_WILLNEED) ||
+		spirv.size == 0 || spirv.size % 4 != 0)
+	{
+		printf("Could not load shader %s\n", path);
+		fflush(stdout);
+		return false;
+	}
+
+	VkShaderModuleCreateInfo shaderInfo = {};
+	shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderInfo.pCode = (const uint32_t*)spirv.data;
+	shaderInfo.codeSize = (size_t)spirv.size;
+
+	// The mapping is closed when "spirv" goes out of scope,
+	// which is fine, the driver has its own copy by then
+	if (vkCreateShaderModule(device, &shaderInfo, NULL, module) != VK_SUCCESS)
+		return false;
+
+	// a frame capture keeps a copy of the SPIR-V,
+	// because the module is destroyed after the
+	// pipeline is made
+	FrameCapture::TrackShader(*module, shaderInfo.pCode, shaderInfo.codeSize);
+	return true;
+}
 
-	// see how far away the end of 
-	// the file was, from the beginning,
-	// and record that number as size
-	*size = ftell(fp);
+// FNV-1a, it mixes in one byte at a time. It is not a
+// secure hash, but it is fast and simple, and it is good
+// enough to tell files and settings apart
+uint64_t Helper::hash_bytes(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
 
-	// go back to the beginning
-	rewind(fp);
+	return hash;
+}
+
+bool Helper::create_directory(const char* path)
+{
+#ifdef _WIN32
+	if (CreateDirectoryA(path, NULL))
+		return true;
+
+	return GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	if (mkdir(path, 0755) == 0)
+		return true;
+
+	return errno == EEXIST;
+#endif
+}
+
+bool Helper::env_flag(const char* name, bool fallback)
+{
+	const char* value = getenv(name);
+	if (value == nullptr || value[0] == '\0')
+		return fallback;
 
-	// allocate memory that is big enough
-	// for all bytes in the file
-	*data = (char*)calloc(1, *size + 1);
+	// lower case, so that OFF and False work too
+	char lower[8] = {};
+	for (size_t i = 0; i < sizeof(lower) - 1 && value[i] != '\0'; i++)
+		lower[i] = (char)tolower((unsigned char)value[i]);
 
-	// dump every byte from the file
-	// into our array of bytes
-	fread(*data, *size, 1, fp);
+	if (!strcmp(lower, "0") || !strcmp(lower, "off") ||
+		!strcmp(lower, "false") || !strcmp(lower, "no"))
+		return false;
 
-	// close the file
-	fclose(fp);
+	return true;
 }
\ No newline at end of file
@@ -40,6 +40,9 @@ that utilizes Vulkan, see more at http://cemu.info
 #define UNUSED
 #endif
 
+// the starting value for Helper::hash_bytes
+#define HELPER_HASH_SEED 14695981039346656037ull
+
 #define ERR_EXIT(err_msg, err_class)                                             \
     do {                                                                         \
         MessageBox(NULL, err_msg, err_class, MB_OK); \
@@ -56,7 +59,26 @@ public:
 		uint32_t typeBits,
 		VkFlags requirements_mask,
 		uint32_t *typeIndex);
-	
-	static void ReadFile(const char* path, char** data, int* size);
+
+	static bool create_shader_module_from_file(
+		VkDevice device,
+		const char* path,
+		VkShaderModule* module);
+
+	// 64-bit FNV-1a. To hash several things together,
+	// pass the result of one call as "hash" to the next
+	static uint64_t hash_bytes(
+		const void* data,
+		size_t size,
+		uint64_t hash = HELPER_HASH_SEED);
+
+	// returns true if the folder exists when this returns,
+	// whether it was made now or it was already there
+	static bool create_directory(const char* path);
+
+	// reads an environment variable as a switch: "0", "off",
+	// "false" and "no" are false, anything else is true,
+	// and "fallback" is returned if the variable is not set
+	static bool env_flag(const char* name, bool fallback);
 };
 
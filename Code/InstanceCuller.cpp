@@ -0,0 +1,348 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "InstanceCuller.h"
+#include "Helper.h"
+#include "FrameCapture.h"
+#include <string.h>
+
+// threads per group, this has to match local_size_x in Cull.comp
+#define CULL_GROUP_SIZE 64
+
+// binding 0 is the instances, binding 1 is the visible
+// instances, binding 2 is the draw commands
+#define CULL_BINDING_COUNT 3
+
+InstanceCuller::InstanceCuller(
+	VkDevice d,
+	VkPhysicalDevice gpu,
+	VkPhysicalDeviceMemoryProperties memory_properties,
+	uint32_t queue_family_index,
+	const char* cullShaderPath,
+	VkBuffer instanceBuffer,
+	uint32_t maxInstanceCount,
+	uint32_t framesInFlight,
+	bool compactVisible)
+{
+	device = d;
+	compact = compactVisible;
+	maxInstances = maxInstanceCount;
+	enabled = false;
+
+	desc_layout = VK_NULL_HANDLE;
+	desc_pool = VK_NULL_HANDLE;
+	pipeline_layout = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+
+	// Just like MipGenerator, the compute shader runs on
+	// the same queue as the drawing, so that queue has to
+	// support compute. Without it, nothing gets culled
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, NULL);
+	std::vector<VkQueueFamilyProperties> families(queue_family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, families.data());
+
+	if (queue_family_index >= queue_family_count ||
+		(families[queue_family_index].queueFlags & VK_QUEUE_COMPUTE_BIT) == 0)
+		return;
+
+	VkShaderModule module;
+	if (!Helper::create_shader_module_from_file(device, cullShaderPath, &module))
+		return;
+
+	// Three storage buffers, only the compute shader sees them
+	VkDescriptorSetLayoutBinding bindings[CULL_BINDING_COUNT] = {};
+	for (uint32_t i = 0; i < CULL_BINDING_COUNT; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = CULL_BINDING_COUNT;
+	layoutInfo.pBindings = bindings;
+	vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &desc_layout);
+	FrameCapture::TrackSetLayout(desc_layout, layoutInfo);
+
+	// The planes change every frame, so they are push
+	// constants, which are recorded into the command buffer,
+	// instead of a uniform buffer that we would have to
+	// keep one copy of per frame. CullConstants is 112 bytes,
+	// every GPU has at least 128 bytes of push constants
+	VkPushConstantRange push_range = {};
+	push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_range.offset = 0;
+	push_range.size = sizeof(CullConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &desc_layout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &push_range;
+	vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipeline_layout);
+	FrameCapture::TrackPipelineLayout(pipeline_layout, pipelineLayoutInfo);
+
+	// Cull.comp has one shader for both ways of drawing,
+	// a specialization constant picks one when the pipeline
+	// is made, so the shader does not check it per thread
+	VkSpecializationMapEntry specEntry = {};
+	specEntry.constantID = 0;
+	specEntry.offset = 0;
+	specEntry.size = sizeof(VkBool32);
+
+	VkBool32 specCompact = compact ? VK_TRUE : VK_FALSE;
+
+	VkSpecializationInfo specInfo = {};
+	specInfo.mapEntryCount = 1;
+	specInfo.pMapEntries = &specEntry;
+	specInfo.dataSize = sizeof(VkBool32);
+	specInfo.pData = &specCompact;
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = &specInfo;
+	pipelineInfo.layout = pipeline_layout;
+	vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+	FrameCapture::TrackComputePipeline(pipeline, pipelineInfo);
+
+	vkDestroyShaderModule(device, module, NULL);
+
+	// One set per frame in flight, each set points at
+	// the same instance buffer, and that frame's outputs
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = CULL_BINDING_COUNT * framesInFlight;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = framesInFlight;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	vkCreateDescriptorPool(device, &poolInfo, NULL, &desc_pool);
+
+	// Only the GPU reads and writes these buffers, so they go in
+	// DEVICE_LOCAL memory, unlike every BufferCPU. The visible
+	// instances are read by the vertex shader as a vertex buffer,
+	// the commands are read by vkCmdDrawIndexedIndirect.
+	// TRANSFER_DST lets us reset the command with vkCmdUpdateBuffer
+	uint32_t commandCount = compact ? 1 : maxInstances;
+
+	frames.resize(framesInFlight);
+	for (uint32_t i = 0; i < framesInFlight; i++)
+	{
+		Frame& f = frames[i];
+
+		CreateBuffer(memory_properties,
+			(VkDeviceSize)maxInstances * 16,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			&f.visible, &f.visibleMemory);
+
+		CreateBuffer(memory_properties,
+			(VkDeviceSize)commandCount * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			&f.commands, &f.commandsMemory);
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = desc_pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &desc_layout;
+		vkAllocateDescriptorSets(device, &allocInfo, &f.set);
+		FrameCapture::TrackDescriptorSet(f.set, desc_layout);
+
+		VkDescriptorBufferInfo buffers[CULL_BINDING_COUNT] = {};
+		buffers[0].buffer = instanceBuffer;
+		buffers[0].range = VK_WHOLE_SIZE;
+		buffers[1].buffer = f.visible;
+		buffers[1].range = VK_WHOLE_SIZE;
+		buffers[2].buffer = f.commands;
+		buffers[2].range = VK_WHOLE_SIZE;
+
+		// the three bindings are next to each other,
+		// so one write with a count of 3 fills all of them
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = f.set;
+		write.dstBinding = 0;
+		write.descriptorCount = CULL_BINDING_COUNT;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = buffers;
+		FrameCapture::UpdateDescriptorSets(device, 1, &write);
+	}
+
+	enabled = true;
+}
+
+InstanceCuller::~InstanceCuller()
+{
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		FrameCapture::ForgetBuffer(frames[i].visible);
+		FrameCapture::ForgetBuffer(frames[i].commands);
+
+		vkDestroyBuffer(device, frames[i].visible, NULL);
+		vkFreeMemory(device, frames[i].visibleMemory, NULL);
+		vkDestroyBuffer(device, frames[i].commands, NULL);
+		vkFreeMemory(device, frames[i].commandsMemory, NULL);
+	}
+
+	// this frees the sets too
+	vkDestroyDescriptorPool(device, desc_pool, NULL);
+	vkDestroyPipeline(device, pipeline, NULL);
+	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(device, desc_layout, NULL);
+}
+
+void InstanceCuller::CreateBuffer(
+	VkPhysicalDeviceMemoryProperties memory_properties,
+	VkDeviceSize size,
+	VkBufferUsageFlags usage,
+	VkBuffer* buffer,
+	VkDeviceMemory* memory)
+{
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.usage = usage;
+	info.size = size;
+	vkCreateBuffer(device, &info, NULL, buffer);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(device, *buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo memAllocInfo = {};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.allocationSize = mem_reqs.size;
+
+	// every GPU has at least one DEVICE_LOCAL memory type
+	Helper::memory_type_from_properties(
+		memory_properties,
+		mem_reqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&memAllocInfo.memoryTypeIndex);
+
+	vkAllocateMemory(device, &memAllocInfo, NULL, memory);
+	vkBindBufferMemory(device, *buffer, *memory, 0);
+
+	// no contents to save, the GPU writes them every frame
+	FrameCapture::TrackBuffer(*buffer, info, nullptr);
+}
+
+void InstanceCuller::ExtractPlanes(const glm::mat4& clip, glm::vec4 planes[6])
+{
+	// A point is inside the view when its clip position (x, y, z, w)
+	// has -w <= x <= w, -w <= y <= w, and 0 <= z <= w (Vulkan's depth
+	// goes from 0 to 1, not -1 to 1). Each of those six tests is a
+	// plane: x + w >= 0 is the left plane, w - x >= 0 is the right
+	// plane, and so on. x is row 0 of the matrix times the point,
+	// w is row 3, so "x + w" is (row 0 + row 3) times the point.
+	// GLM stores columns, so row i is clip[0][i], clip[1][i], ...
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+
+	planes[0] = row[3] + row[0];	// left
+	planes[1] = row[3] - row[0];	// right
+	planes[2] = row[3] + row[1];	// bottom
+	planes[3] = row[3] - row[1];	// top
+	planes[4] = row[2];				// near
+	planes[5] = row[3] - row[2];	// far
+
+	// With normals of length 1, the plane test gives a distance,
+	// which can be compared to the radius of a sphere
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+	}
+}
+
+void InstanceCuller::Record(
+	VkCommandBuffer cmd,
+	uint32_t frameIndex,
+	uint32_t instanceCount,
+	uint32_t indexCount,
+	const glm::mat4& clip,
+	float radiusXY,
+	float radiusZ)
+{
+	if (!enabled || instanceCount == 0)
+		return;
+
+	if (instanceCount > maxInstances)
+		instanceCount = maxInstances;
+
+	Frame& f = frames[frameIndex % frames.size()];
+
+	// In compact mode, every thread that finds a visible instance
+	// adds 1 to the instanceCount of the one command, so it has to
+	// start at 0. vkCmdUpdateBuffer puts the data right into the
+	// command buffer, which is fine for 20 bytes. In the other
+	// mode, the shader writes every command, so nothing is reset
+	if (compact)
+	{
+		VkDrawIndexedIndirectCommand reset = {};
+		reset.indexCount = indexCount;
+		FrameCapture::CmdUpdateBuffer(cmd, f.commands, 0, sizeof(reset), &reset);
+
+		FrameCapture::CmdMemoryBarrier(cmd,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	}
+
+	CullConstants constants;
+	ExtractPlanes(clip, constants.planes);
+	constants.instanceCount = instanceCount;
+	constants.indexCount = indexCount;
+	constants.radiusXY = radiusXY;
+	constants.radiusZ = radiusZ;
+
+	FrameCapture::CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	FrameCapture::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+		pipeline_layout, 0, 1, &f.set);
+	FrameCapture::CmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(constants), &constants);
+
+	// one thread per instance, rounded up
+	FrameCapture::CmdDispatch(cmd, (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+VkBuffer InstanceCuller::VisibleBuffer(uint32_t frameIndex) const
+{
+	return frames[frameIndex % frames.size()].visible;
+}
+
+VkBuffer InstanceCuller::IndirectBuffer(uint32_t frameIndex) const
+{
+	return frames[frameIndex % frames.size()].commands;
+}
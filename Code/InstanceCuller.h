@@ -0,0 +1,154 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// Cull.comp reads this from push constants. The six planes
+// of the view, then what it needs to write draw commands
+struct CullConstants
+{
+	glm::vec4 planes[6];
+	uint32_t instanceCount;
+	uint32_t indexCount;
+
+	// every instance is a sphere around (offset.x, offset.y, 0),
+	// with a radius of radiusXY * scale + radiusZ
+	float radiusXY;
+	float radiusZ;
+};
+
+// Hides instances that are outside of the view, on the GPU.
+//
+// Every frame, Record() runs Cull.comp over the instance buffer,
+// before the render pass. Each thread tests one SquareInstance
+// against the six planes of the view, and the draw is then made
+// with vkCmdDrawIndexedIndirect, which reads its instance count
+// from a buffer that the compute shader wrote. The CPU never reads
+// the result back, and it never waits for it, so culling costs
+// one dispatch, no matter how many instances there are.
+//
+// There are two ways to draw the result:
+//
+// Compact (bindless textures): visible instances are copied
+// into VisibleBuffer(), with no gaps, and IndirectBuffer()
+// holds one command, whose instanceCount is the number of
+// visible instances. That is one draw for every instance.
+//
+// Per instance (one descriptor set per texture): the CPU still
+// binds each texture's set, so each instance keeps its own draw.
+// IndirectBuffer() holds one command per instance, with an
+// instanceCount of 1 if it is visible, and 0 if it is not, so
+// hidden instances do no vertex work at all.
+//
+// Both buffers have one copy per frame in flight, so a frame can
+// be culled while the GPU still draws the frame before it
+class InstanceCuller
+{
+private:
+	struct Frame
+	{
+		VkBuffer visible;
+		VkDeviceMemory visibleMemory;
+		VkBuffer commands;
+		VkDeviceMemory commandsMemory;
+		VkDescriptorSet set;
+	};
+
+	VkDevice device;
+	bool compact;
+	uint32_t maxInstances;
+
+	VkDescriptorSetLayout desc_layout;
+	VkDescriptorPool desc_pool;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline pipeline;
+
+	std::vector<Frame> frames;
+
+	void CreateBuffer(
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkBuffer* buffer,
+		VkDeviceMemory* memory);
+
+public:
+	// false if the queue can not run compute shaders, or if the
+	// shader could not be loaded. Then Record() does nothing,
+	// and the instances have to be drawn without culling
+	bool enabled;
+
+	// instanceBuffer is an array of maxInstances SquareInstances,
+	// made with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+	InstanceCuller(
+		VkDevice d,
+		VkPhysicalDevice gpu,
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		uint32_t queue_family_index,
+		const char* cullShaderPath,
+		VkBuffer instanceBuffer,
+		uint32_t maxInstanceCount,
+		uint32_t framesInFlight,
+		bool compactVisible);
+
+	~InstanceCuller();
+
+	// Six planes (left, right, bottom, top, near, far) from the
+	// matrix that the vertex shader multiplies positions by. Each
+	// plane is (normal, distance), with the normal facing into
+	// the view, and a length of 1, so that dot(normal, point) +
+	// distance is how far the point is inside of the plane
+	static void ExtractPlanes(const glm::mat4& clip, glm::vec4 planes[6]);
+
+	// Records the dispatch. Must be outside of a render pass. The
+	// draws that read the result need a barrier from the compute
+	// shader (and from the transfer that resets the command) to
+	// DRAW_INDIRECT and VERTEX_INPUT, which the frame graph makes,
+	// see Demo::prepare_frame_graph. "clip" is the matrix from the
+	// uniform buffer, the instances are spheres, see CullConstants
+	void Record(
+		VkCommandBuffer cmd,
+		uint32_t frameIndex,
+		uint32_t instanceCount,
+		uint32_t indexCount,
+		const glm::mat4& clip,
+		float radiusXY,
+		float radiusZ);
+
+	// SquareInstances that passed, only written when compact
+	VkBuffer VisibleBuffer(uint32_t frameIndex) const;
+
+	// VkDrawIndexedIndirectCommands, one when compact,
+	// one per instance when not
+	VkBuffer IndirectBuffer(uint32_t frameIndex) const;
+};
@@ -24,7 +24,11 @@ that utilizes Vulkan, see more at http://cemu.info
  
 #include "Demo.h"
 #include "Main.h"
+#include "Profiler.h"
+#include "Helper.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Make this global, so it can be initialized in WinMain
 // and used in WndProc
@@ -75,11 +79,106 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine, int nCmdShow) 
 {
+	// Validation is on, unless the environment variable
+	// VKCUBE_VALIDATION is 0, or the command line says
+	// --no-validate. The command line wins, so that
+	// "vkcube.exe --validate" always validates
+	DemoSettings settings;
+	settings.validate = Helper::env_flag("VKCUBE_VALIDATION", true);
+
+	if (pCmdLine != NULL && strstr(pCmdLine, "--no-validate") != NULL)
+		settings.validate = false;
+	else if (pCmdLine != NULL && strstr(pCmdLine, "--validate") != NULL)
+		settings.validate = true;
+
+	// "vkcube.exe --capture 60" writes 60 frames to
+	// capture.vkcap, which Replay.exe can draw again
+	const char* capture = pCmdLine != NULL ? strstr(pCmdLine, "--capture ") : NULL;
+	if (capture != NULL)
+		settings.capture_frames = (uint32_t)atoi(capture + strlen("--capture "));
+
+	// "vkcube.exe --export out.y4m --export-frames 600" writes
+	// 600 frames to out.y4m, and then quits. The path ends at
+	// the next space
+	static char export_path[260];
+	const char* export_arg = pCmdLine != NULL ? strstr(pCmdLine, "--export ") : NULL;
+	if (export_arg != NULL)
+	{
+		sscanf(export_arg + strlen("--export "), "%259s", export_path);
+		settings.export_path = export_path;
+	}
+
+	const char* export_frames = pCmdLine != NULL ? strstr(pCmdLine, "--export-frames ") : NULL;
+	if (export_frames != NULL)
+		settings.export_frames = (uint32_t)atoi(export_frames + strlen("--export-frames "));
+
+	// "vkcube.exe --windows 3" draws the scene
+	// into the main window and two more
+	const char* windows = pCmdLine != NULL ? strstr(pCmdLine, "--windows ") : NULL;
+	if (windows != NULL)
+	{
+		int count = atoi(windows + strlen("--windows "));
+		settings.extra_windows = count > 1 ? (uint32_t)(count - 1) : 0;
+	}
+
+	// "vkcube.exe --depth" draws the opaque sprites
+	// front to back, with a depth buffer
+	if (pCmdLine != NULL && strstr(pCmdLine, "--depth") != NULL)
+		settings.depth_sprites = true;
+
+	// "vkcube.exe --dynamic-resolution --budget 8" lowers the
+	// resolution when the GPU takes more than 8 ms per frame
+	if (pCmdLine != NULL && strstr(pCmdLine, "--dynamic-resolution") != NULL)
+		settings.dynamic_resolution = true;
+
+	const char* budget = pCmdLine != NULL ? strstr(pCmdLine, "--budget ") : NULL;
+	if (budget != NULL)
+		settings.frame_budget_ms = (float)atof(budget + strlen("--budget "));
+
+	// "vkcube.exe --no-imageless" makes one framebuffer per
+	// swapchain image, like GPUs without imageless framebuffers
+	if (pCmdLine != NULL && strstr(pCmdLine, "--no-imageless") != NULL)
+		settings.allow_imageless = false;
+
+	// "vkcube.exe --msaa 4" draws with 4 samples per pixel
+	const char* msaa = pCmdLine != NULL ? strstr(pCmdLine, "--msaa ") : NULL;
+	if (msaa != NULL)
+		settings.msaa_samples = (uint32_t)atoi(msaa + strlen("--msaa "));
+
 	// First we create demo, the demo's constructor will
 	// do all the initialization for the whole program.
 	// Go to Demo.cpp and look for Demo::Demo to learn
 	// about how this works
-	demo = new Demo();
+	demo = new Demo(settings);
+
+#ifdef ENABLE_PROFILER
+	printf("Press P to write the profiler's trace to trace.json\n");
+	fflush(stdout);
+#endif
+
+	printf("Press L to start or stop writing GPU times to gpu_frames.csv\n");
+	// When frames are exported, the exporter
+	// gets all of them, there are no screenshots
+	if (demo->exporter == nullptr)
+	{
+		printf("Press C to save the next frame to screenshot_<frame>.ppm\n");
+		fflush(stdout);
+
+		// The screenshot reaches us a few frames after C
+		// is pressed, once the GPU has finished copying it,
+		// the loop below never waits for it
+		demo->readback->callback = [](const ReadbackImage& image)
+		{
+			char path[64];
+			sprintf(path, "screenshot_%llu.ppm", (unsigned long long)image.frame);
+
+			if (FrameReadback::WritePpm(image, path))
+				printf("Saved %s\n", path);
+			else
+				printf("Could not save %s\n", path);
+			fflush(stdout);
+		};
+	}
 
 	// The main loop of our program.
 	// This will repeat infinitely until we tell it to stop
@@ -110,6 +209,36 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine,
 		// Go to Demo.cpp and look for Demo::run() to learn
 		// about how this works
 		demo->run();
+
+		// Press P to save everything the profiler recorded
+		// (the last few thousand scopes of every thread),
+		// open the file at chrome://tracing to see it.
+		// This does nothing if the profiler is turned off
+		if (keys['P'])
+		{
+			keys['P'] = false;
+			PROFILE_WRITE_TRACE("trace.json");
+		}
+
+		// Press L to start (or stop) writing every frame's
+		// GPU times and statistics to gpu_frames.csv
+		if (keys['L'])
+		{
+			keys['L'] = false;
+			demo->toggle_gpu_log();
+		}
+
+		// Press C to copy the next frame back to the CPU
+		if (keys['C'] && demo->exporter == nullptr)
+		{
+			keys['C'] = false;
+			demo->readback->requested = 1;
+		}
+
+		// After the last exported frame was recorded, we quit,
+		// deleting the Demo writes the frames that are left
+		if (demo->exporter != nullptr && demo->readback->requested == 0)
+			break;
 	}
 
 	// After the loop is finished, it is time to quit the demo.
@@ -0,0 +1,172 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#include "MeshFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// round a number up to the next multiple of MESH_FILE_ALIGNMENT
+static uint64_t align_up(uint64_t value)
+{
+	return (value + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+static uint32_t index_size(uint32_t indexType)
+{
+	if (indexType == VK_INDEX_TYPE_UINT16) return 2;
+	if (indexType == VK_INDEX_TYPE_UINT32) return 4;
+	return 0;
+}
+
+MeshFile::MeshFile()
+{
+	header = nullptr;
+	payload = nullptr;
+	payloadSize = 0;
+	indexOffsetInPayload = 0;
+}
+
+MeshFile::~MeshFile()
+{
+	Close();
+}
+
+bool MeshFile::Open(const char* path)
+{
+	Close();
+
+	// Rather than reading the file into an array (which would
+	// copy every byte once into the array, and then once more
+	// into the vertex buffer), we "map" the file with FileView.
+	// The file then looks like an array in memory, and the OS
+	// loads pages from the disk when we touch them. The only
+	// copy that happens is the one into the buffer. We read the
+	// file from start to end, and we need all of it right away
+	if (!view.Open(path, FILE_VIEW_HINT_SEQUENTIAL | FILE_VIEW_HINT_WILLNEED))
+		return false;
+
+	uint64_t fileSize = view.size;
+
+	if (fileSize < sizeof(MeshFileHeader))
+	{
+		Close();
+		return false;
+	}
+
+	// Now check that the header makes sense, we do not
+	// want a broken or old file to make us read past the
+	// end of the mapping
+	header = (const MeshFileHeader*)view.data;
+
+	uint32_t indexBytes = index_size(header->indexType);
+
+	bool valid =
+		header->magic == MESH_FILE_MAGIC &&
+		header->version == MESH_FILE_VERSION &&
+		header->headerSize == sizeof(MeshFileHeader) &&
+		header->attributeCount <= MESH_FILE_MAX_ATTRIBUTES &&
+		indexBytes != 0 &&
+		header->vertexSize == (uint64_t)header->vertexStride * header->vertexCount &&
+		header->indexSize == (uint64_t)indexBytes * header->indexCount &&
+		header->vertexOffset % MESH_FILE_ALIGNMENT == 0 &&
+		header->indexOffset % MESH_FILE_ALIGNMENT == 0 &&
+		header->vertexOffset >= sizeof(MeshFileHeader) &&
+		header->indexOffset >= header->vertexOffset + header->vertexSize &&
+		header->indexOffset + header->indexSize <= fileSize;
+
+	if (!valid)
+	{
+		printf("%s is not a valid version %d mesh file\n", path, MESH_FILE_VERSION);
+		fflush(stdout);
+		Close();
+		return false;
+	}
+
+	payload = view.data + header->vertexOffset;
+	payloadSize = header->indexOffset + header->indexSize - header->vertexOffset;
+	indexOffsetInPayload = header->indexOffset - header->vertexOffset;
+
+	return true;
+}
+
+void MeshFile::Close()
+{
+	view.Close();
+
+	header = nullptr;
+	payload = nullptr;
+	payloadSize = 0;
+	indexOffsetInPayload = 0;
+}
+
+bool MeshFile::Write(
+	const char* path,
+	const void* vertices, uint32_t vertexStride, uint32_t vertexCount,
+	const MeshFileAttribute* attributes, uint32_t attributeCount,
+	const void* indices, VkIndexType indexType, uint32_t indexCount)
+{
+	if (attributeCount > MESH_FILE_MAX_ATTRIBUTES || index_size(indexType) == 0)
+		return false;
+
+	MeshFileHeader h = {};
+	h.magic = MESH_FILE_MAGIC;
+	h.version = MESH_FILE_VERSION;
+	h.headerSize = sizeof(MeshFileHeader);
+	h.vertexStride = vertexStride;
+	h.vertexCount = vertexCount;
+	h.indexType = indexType;
+	h.indexCount = indexCount;
+	h.attributeCount = attributeCount;
+	memcpy(h.attributes, attributes, attributeCount * sizeof(MeshFileAttribute));
+
+	h.vertexOffset = align_up(sizeof(MeshFileHeader));
+	h.vertexSize = (uint64_t)vertexStride * vertexCount;
+	h.indexOffset = align_up(h.vertexOffset + h.vertexSize);
+	h.indexSize = (uint64_t)index_size(indexType) * indexCount;
+
+	FILE* fp = fopen(path, "wb");
+	if (fp == nullptr)
+		return false;
+
+	// zeros that we write in the gaps between sections
+	const uint8_t padding[MESH_FILE_ALIGNMENT] = {};
+
+	bool ok =
+		fwrite(&h, sizeof(h), 1, fp) == 1 &&
+		fwrite(padding, 1, (size_t)(h.vertexOffset - sizeof(h)), fp) == h.vertexOffset - sizeof(h) &&
+		fwrite(vertices, 1, (size_t)h.vertexSize, fp) == h.vertexSize &&
+		fwrite(padding, 1, (size_t)(h.indexOffset - h.vertexOffset - h.vertexSize), fp) == h.indexOffset - h.vertexOffset - h.vertexSize &&
+		fwrite(indices, 1, (size_t)h.indexSize, fp) == h.indexSize;
+
+	// fclose can fail too, if the last bytes
+	// could not be flushed to the disk
+	if (fclose(fp) != 0)
+		ok = false;
+
+	if (!ok)
+		remove(path);
+
+	return ok;
+}
@@ -0,0 +1,116 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#pragma once
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include "FileView.h"
+
+// A .mesh file is a small header, followed by vertices that
+// are already interleaved (exactly how the vertex buffer wants
+// them), followed by indices. Because the vertices and indices
+// are stored back-to-back, the whole payload can be copied into
+// one buffer with one memcpy, and then bound twice: once as a
+// vertex buffer (at offset 0) and once as an index buffer
+
+// "VKMH" when read as bytes
+#define MESH_FILE_MAGIC 0x484D4B56
+
+// Increase this every time the header changes,
+// old files will be rejected and rebuilt
+#define MESH_FILE_VERSION 1
+
+// vertex data and index data both start on
+// a multiple of this many bytes
+#define MESH_FILE_ALIGNMENT 16
+
+#define MESH_FILE_MAX_ATTRIBUTES 8
+
+// One of these for every "layout (location = x) in"
+// in the vertex shader. This is the same information
+// that goes into VkVertexInputAttributeDescription
+struct MeshFileAttribute
+{
+	uint32_t location;
+	uint32_t format;	// VkFormat
+	uint32_t offset;	// bytes from the start of one vertex
+};
+
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexType;	// VkIndexType
+	uint32_t indexCount;
+
+	uint32_t attributeCount;
+	MeshFileAttribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+
+	// All offsets are from the start of the file.
+	// indexOffset is always after vertexOffset, and
+	// the bytes in between are just padding
+	uint64_t vertexOffset;
+	uint64_t vertexSize;
+	uint64_t indexOffset;
+	uint64_t indexSize;
+};
+
+class MeshFile
+{
+private:
+	FileView view;
+
+public:
+	// points into the mapped file, valid until Close()
+	const MeshFileHeader* header;
+
+	// vertices, padding, and indices, in one block
+	const uint8_t* payload;
+	uint64_t payloadSize;
+
+	// where the index data starts, relative to payload
+	uint64_t indexOffsetInPayload;
+
+	MeshFile();
+	~MeshFile();
+
+	// Maps the file into memory (nothing is copied)
+	// and checks the header. Returns false if the
+	// file is missing, or if it is not a valid mesh
+	bool Open(const char* path);
+	void Close();
+
+	// Builds a mesh file out of vertices that are
+	// already interleaved, and indices
+	static bool Write(
+		const char* path,
+		const void* vertices, uint32_t vertexStride, uint32_t vertexCount,
+		const MeshFileAttribute* attributes, uint32_t attributeCount,
+		const void* indices, VkIndexType indexType, uint32_t indexCount);
+};
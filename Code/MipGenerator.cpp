@@ -0,0 +1,420 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "MipGenerator.h"
+#include "Helper.h"
+
+MipGenerator::MipGenerator(
+	VkDevice d,
+	VkPhysicalDevice physical_device,
+	uint32_t queue_family_index,
+	const char* downsampleShaderPath)
+{
+	device = d;
+	gpu = physical_device;
+	desc_layout = VK_NULL_HANDLE;
+	pipeline_layout = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+
+	// The compute path is only a fallback, so if the queue that
+	// records the uploads can not run compute shaders, or if the
+	// shader file is missing, we just make fewer mips
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, NULL);
+	std::vector<VkQueueFamilyProperties> families(queue_family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, families.data());
+
+	if (queue_family_index >= queue_family_count ||
+		(families[queue_family_index].queueFlags & VK_QUEUE_COMPUTE_BIT) == 0)
+		return;
+
+	VkShaderModule module;
+	if (!Helper::create_shader_module_from_file(device, downsampleShaderPath, &module))
+		return;
+
+	// binding 0 is the level we read from,
+	// binding 1 is the level we write to
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+	vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &desc_layout);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &desc_layout;
+	vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipeline_layout);
+
+	// A compute pipeline is much smaller than a graphics
+	// pipeline, it only has one shader stage and a layout
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipeline_layout;
+	vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+
+	// the pipeline keeps what it needs from the module
+	vkDestroyShaderModule(device, module, NULL);
+}
+
+MipGenerator::~MipGenerator()
+{
+	// destroying VK_NULL_HANDLE does nothing,
+	// so this is safe if compute was never set up
+	vkDestroyPipeline(device, pipeline, NULL);
+	vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(device, desc_layout, NULL);
+}
+
+uint32_t MipGenerator::MipCount(uint32_t width, uint32_t height)
+{
+	// each level is half the size of the level above
+	// it, so a 256x64 image has 256, 128, 64, 32, 16,
+	// 8, 4, 2, 1 across, which is 9 levels
+	uint32_t size = width > height ? width : height;
+	uint32_t count = 1;
+
+	while (size > 1)
+	{
+		size >>= 1;
+		count++;
+	}
+
+	return count;
+}
+
+MipMethod MipGenerator::MethodFor(VkFormat format)
+{
+	// The format properties tell us what the GPU can do with
+	// images of this format when they use OPTIMAL tiling.
+	// A blit needs to read (BLIT_SRC) and write (BLIT_DST) the
+	// format, and it needs FILTER_LINEAR, or the smaller
+	// levels would only take every second pixel
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(gpu, format, &props);
+
+	VkFormatFeatureFlags blit =
+		VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+		VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	if ((props.optimalTilingFeatures & blit) == blit)
+		return MIP_METHOD_BLIT;
+
+	// Downsample.comp declares its images as rgba8, so
+	// it can only be used for that one format
+	if (pipeline != VK_NULL_HANDLE &&
+		format == VK_FORMAT_R8G8B8A8_UNORM &&
+		(props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+		return MIP_METHOD_COMPUTE;
+
+	return MIP_METHOD_NONE;
+}
+
+VkImageUsageFlags MipGenerator::UsageFor(VkFormat format)
+{
+	switch (MethodFor(format))
+	{
+	case MIP_METHOD_BLIT:
+		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	case MIP_METHOD_COMPUTE:
+		return VK_IMAGE_USAGE_STORAGE_BIT;
+	default:
+		return 0;
+	}
+}
+
+void MipGenerator::Record(VkCommandBuffer cmd, Texture* texture, MipScratch* scratch)
+{
+	if (texture->mipLevels > 1)
+	{
+		MipMethod method = MethodFor(texture->format);
+
+		if (method == MIP_METHOD_BLIT)
+		{
+			RecordBlit(cmd, texture);
+			return;
+		}
+
+		if (method == MIP_METHOD_COMPUTE)
+		{
+			RecordCompute(cmd, texture, scratch);
+			return;
+		}
+	}
+
+	// Nothing to generate, just move every level from
+	// TRANSFER_DST to SHADER_READ_ONLY. If the texture has
+	// more than one level, the smaller ones stay empty
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = texture->image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = texture->mipLevels;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, NULL, 0, NULL, 1, &barrier);
+}
+
+void MipGenerator::RecordBlit(VkCommandBuffer cmd, Texture* texture)
+{
+	// We go down the chain one level at a time. Before level i
+	// can be made, level i-1 has to be finished, and moved from
+	// TRANSFER_DST (being written) to TRANSFER_SRC (being read)
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = texture->image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+
+	int32_t srcWidth = (int32_t)texture->width;
+	int32_t srcHeight = (int32_t)texture->height;
+
+	for (uint32_t i = 1; i < texture->mipLevels; i++)
+	{
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		vkCmdPipelineBarrier(cmd,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, NULL, 0, NULL, 1, &barrier);
+
+		int32_t dstWidth = srcWidth > 1 ? srcWidth / 2 : 1;
+		int32_t dstHeight = srcHeight > 1 ? srcHeight / 2 : 1;
+
+		// A blit copies one box of pixels into another box, and
+		// stretches the pixels if the boxes are not the same size.
+		// offsets[0] is one corner of the box, offsets[1] is the
+		// opposite corner
+		VkImageBlit blit = {};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[1].x = srcWidth;
+		blit.srcOffsets[1].y = srcHeight;
+		blit.srcOffsets[1].z = 1;
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.layerCount = 1;
+		blit.dstOffsets[1].x = dstWidth;
+		blit.dstOffsets[1].y = dstHeight;
+		blit.dstOffsets[1].z = 1;
+
+		vkCmdBlitImage(cmd,
+			texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+
+	// Now every level except the last one is in TRANSFER_SRC,
+	// and the last one is still in TRANSFER_DST. Both groups
+	// move to SHADER_READ_ONLY in one call
+	VkImageMemoryBarrier toShader[2] = { barrier, barrier };
+
+	toShader[0].subresourceRange.baseMipLevel = 0;
+	toShader[0].subresourceRange.levelCount = texture->mipLevels - 1;
+	toShader[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	toShader[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	toShader[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	toShader[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	toShader[1].subresourceRange.baseMipLevel = texture->mipLevels - 1;
+	toShader[1].subresourceRange.levelCount = 1;
+	toShader[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	toShader[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	toShader[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	toShader[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, NULL, 0, NULL, 2, toShader);
+}
+
+void MipGenerator::RecordCompute(VkCommandBuffer cmd, Texture* texture, MipScratch* scratch)
+{
+	uint32_t levels = texture->mipLevels;
+
+	// Storage images have to be in the GENERAL layout.
+	// Mip 0 was just written by a copy, so the compute
+	// shader has to wait for the transfer to finish
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = texture->image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = levels;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, NULL, 0, NULL, 1, &barrier);
+
+	// One view per level, because a storage image
+	// descriptor can only point at one level
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = texture->image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = texture->format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	size_t firstView = scratch->views.size();
+	for (uint32_t i = 0; i < levels; i++)
+	{
+		VkImageView view;
+		viewInfo.subresourceRange.baseMipLevel = i;
+		vkCreateImageView(device, &viewInfo, NULL, &view);
+		scratch->views.push_back(view);
+	}
+
+	// One descriptor set per level that we make, each with two
+	// storage images. The pool is only used for this texture,
+	// and it is destroyed in Release, which frees the sets too
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSize.descriptorCount = 2 * (levels - 1);
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = levels - 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	VkDescriptorPool pool;
+	vkCreateDescriptorPool(device, &poolInfo, NULL, &pool);
+	scratch->pools.push_back(pool);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	barrier.subresourceRange.levelCount = 1;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	for (uint32_t i = 1; i < levels; i++)
+	{
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &desc_layout;
+
+		VkDescriptorSet set;
+		vkAllocateDescriptorSets(device, &allocInfo, &set);
+
+		VkDescriptorImageInfo images[2] = {};
+		images[0].imageView = scratch->views[firstView + i - 1];
+		images[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		images[1].imageView = scratch->views[firstView + i];
+		images[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = 0;
+		write.descriptorCount = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write.pImageInfo = images;
+		vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipeline_layout, 0, 1, &set, 0, NULL);
+
+		// 8x8 threads per group, rounded up
+		uint32_t w = texture->width >> i;
+		uint32_t h = texture->height >> i;
+		if (w == 0) w = 1;
+		if (h == 0) h = 1;
+		vkCmdDispatch(cmd, (w + 7) / 8, (h + 7) / 8, 1);
+
+		// the next level reads what this level wrote
+		barrier.subresourceRange.baseMipLevel = i;
+		vkCmdPipelineBarrier(cmd,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, NULL, 0, NULL, 1, &barrier);
+	}
+
+	// every level goes to SHADER_READ_ONLY for the fragment shader
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = levels;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, NULL, 0, NULL, 1, &barrier);
+}
+
+void MipGenerator::Release(MipScratch* scratch)
+{
+	for (size_t i = 0; i < scratch->views.size(); i++)
+		vkDestroyImageView(device, scratch->views[i], NULL);
+
+	for (size_t i = 0; i < scratch->pools.size(); i++)
+		vkDestroyDescriptorPool(device, scratch->pools[i], NULL);
+
+	scratch->views.clear();
+	scratch->pools.clear();
+}
@@ -0,0 +1,106 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <vector>
+
+#include "Texture.h"
+
+// How the mip levels of a format are made
+enum MipMethod
+{
+	// only mip 0 exists, the format can not be
+	// blitted or written by a compute shader
+	MIP_METHOD_NONE,
+
+	// vkCmdBlitImage with linear filtering, each level is
+	// made by shrinking the level above it by half
+	MIP_METHOD_BLIT,
+
+	// Downsample.comp, for formats that can not be blitted
+	// with a linear filter, but can be storage images
+	MIP_METHOD_COMPUTE
+};
+
+// Image views and descriptor pools that the compute path made
+// while recording. The GPU uses them when the command buffer runs,
+// so they have to live until the command buffer's fence opens,
+// and then they are given back with MipGenerator::Release
+struct MipScratch
+{
+	std::vector<VkImageView> views;
+	std::vector<VkDescriptorPool> pools;
+};
+
+// Records the commands that fill in every mip level of a texture,
+// into a command buffer that someone else owns. It never submits
+// anything and never waits, so it can be used in the same command
+// buffer as the copy that filled mip 0 (see TextureLoader::Update)
+class MipGenerator
+{
+private:
+	VkDevice device;
+	VkPhysicalDevice gpu;
+
+	// compute path, these are VK_NULL_HANDLE if the
+	// shader could not be loaded, or if the queue
+	// can not run compute shaders
+	VkDescriptorSetLayout desc_layout;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline pipeline;
+
+	void RecordBlit(VkCommandBuffer cmd, Texture* texture);
+	void RecordCompute(VkCommandBuffer cmd, Texture* texture, MipScratch* scratch);
+
+public:
+	MipGenerator(
+		VkDevice d,
+		VkPhysicalDevice physical_device,
+		uint32_t queue_family_index,
+		const char* downsampleShaderPath);
+
+	~MipGenerator();
+
+	// number of levels in a full chain, down to 1x1
+	static uint32_t MipCount(uint32_t width, uint32_t height);
+
+	// which path Record will take for this format
+	MipMethod MethodFor(VkFormat format);
+
+	// image usage flags that a texture needs, on top of
+	// TRANSFER_DST and SAMPLED, for MethodFor(format)
+	VkImageUsageFlags UsageFor(VkFormat format);
+
+	// Every level of the texture must be in TRANSFER_DST_OPTIMAL,
+	// with mip 0 already written by a transfer command in "cmd".
+	// When the commands finish, every level is in
+	// SHADER_READ_ONLY_OPTIMAL, ready for the fragment shader
+	void Record(VkCommandBuffer cmd, Texture* texture, MipScratch* scratch);
+
+	// call after the command buffer that Record wrote into is finished
+	void Release(MipScratch* scratch);
+};
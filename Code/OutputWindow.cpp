@@ -0,0 +1,401 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "OutputWindow.h"
+#include <stdio.h>
+
+// every OutputWindow uses this window class,
+// it is registered by the first one that is made
+#define OUTPUT_WINDOW_CLASS "OutputWindow"
+static uint32_t output_window_count = 0;
+
+LRESULT CALLBACK OutputWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+	// The OutputWindow is not known until CreateWindowEx returns,
+	// so messages before that (like the first WM_SIZE) are ignored
+	OutputWindow* output = (OutputWindow*)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+
+	if (output != nullptr)
+	{
+		// Closing an extra window only hides it,
+		// the main window still decides when we quit
+		if (uMsg == WM_CLOSE)
+		{
+			output->closed = true;
+			ShowWindow(hWnd, SW_HIDE);
+			return 0;
+		}
+
+		// The swapchain is rebuilt by Demo::draw(), when the
+		// GPU is idle, not here in the middle of a frame
+		if (uMsg == WM_SIZE)
+		{
+			output->width = LOWORD(lParam);
+			output->height = HIWORD(lParam);
+			output->needs_rebuild = true;
+		}
+	}
+
+	return DefWindowProc(hWnd, uMsg, wParam, lParam);
+}
+
+OutputWindow::OutputWindow(
+	const char* title,
+	int x, int y,
+	uint32_t windowWidth, uint32_t windowHeight,
+	VkInstance instance,
+	VkPhysicalDevice physical_device,
+	VkDevice d,
+	VkPhysicalDeviceMemoryProperties memoryProperties,
+	uint32_t queue_family_index,
+	VkFormat swapchainFormat,
+	VkColorSpaceKHR swapchainColorSpace,
+	VkSampleCountFlagBits sampleCount,
+	VkFormat depthFormat,
+	VkRenderPass renderPass,
+	uint32_t frameLag)
+{
+	inst = instance;
+	gpu = physical_device;
+	device = d;
+	memory_properties = memoryProperties;
+	render_pass = renderPass;
+	samples = sampleCount;
+	depth_format = depthFormat;
+	frame_lag = frameLag;
+	format = swapchainFormat;
+	color_space = swapchainColorSpace;
+	width = windowWidth;
+	height = windowHeight;
+
+	ok = false;
+	window = NULL;
+	surface = VK_NULL_HANDLE;
+	swapchain = VK_NULL_HANDLE;
+	msaa_target = nullptr;
+	depth_target = nullptr;
+	current_buffer = 0;
+	acquired = false;
+	needs_rebuild = false;
+	closed = false;
+
+	for (uint32_t i = 0; i < OUTPUT_MAX_FRAME_LAG; i++)
+		image_acquired_semaphores[i] = VK_NULL_HANDLE;
+
+	// Same as Demo::prepare_window, with our own WndProc
+	if (output_window_count == 0)
+	{
+		WNDCLASSEX win_class = {};
+		win_class.cbSize = sizeof(WNDCLASSEX);
+		win_class.style = CS_HREDRAW | CS_VREDRAW;
+		win_class.lpfnWndProc = WndProc;
+		win_class.hIcon = LoadIcon(NULL, IDI_APPLICATION);
+		win_class.hCursor = LoadCursor(NULL, IDC_ARROW);
+		win_class.hbrBackground = (HBRUSH)GetStockObject(WHITE_BRUSH);
+		win_class.lpszClassName = OUTPUT_WINDOW_CLASS;
+		win_class.hIconSm = LoadIcon(NULL, IDI_WINLOGO);
+		RegisterClassEx(&win_class);
+	}
+	output_window_count++;
+
+	RECT wr = { 0, 0, (LONG)width, (LONG)height };
+	AdjustWindowRect(&wr, WS_OVERLAPPEDWINDOW, FALSE);
+
+	window = CreateWindowEx(0, OUTPUT_WINDOW_CLASS, title,
+		WS_OVERLAPPEDWINDOW | WS_VISIBLE | WS_SYSMENU,
+		x, y, wr.right - wr.left, wr.bottom - wr.top,
+		NULL, NULL, (HINSTANCE)0, NULL);
+
+	if (!window)
+	{
+		printf("Cannot create window %s\n", title);
+		fflush(stdout);
+		return;
+	}
+
+	SetWindowLongPtr(window, GWLP_USERDATA, (LONG_PTR)this);
+
+	VkWin32SurfaceCreateInfoKHR surfaceInfo = {};
+	surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+	surfaceInfo.hwnd = window;
+	vkCreateWin32SurfaceKHR(inst, &surfaceInfo, NULL, &surface);
+
+	// Demo picked its queue family for the main window's surface,
+	// this window may be on a monitor that another GPU drives
+	VkBool32 supported = VK_FALSE;
+	vkGetPhysicalDeviceSurfaceSupportKHR(gpu, queue_family_index, surface, &supported);
+	if (!supported)
+	{
+		printf("%s: the queue can not present to this window\n", title);
+		fflush(stdout);
+		return;
+	}
+
+	// The render pass only works with Demo's format
+	uint32_t formatCount = 0;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface, &formatCount, NULL);
+	std::vector<VkSurfaceFormatKHR> formats(formatCount);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface, &formatCount, formats.data());
+
+	bool formatSupported = formatCount == 1 && formats[0].format == VK_FORMAT_UNDEFINED;
+	for (uint32_t i = 0; i < formatCount; i++)
+	{
+		if (formats[i].format == format && formats[i].colorSpace == color_space)
+			formatSupported = true;
+	}
+
+	if (!formatSupported)
+	{
+		printf("%s: this window does not support the main window's format\n", title);
+		fflush(stdout);
+		return;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	for (uint32_t i = 0; i < frame_lag; i++)
+		vkCreateSemaphore(device, &semaphoreInfo, NULL, &image_acquired_semaphores[i]);
+
+	CreateSwapchain();
+	ok = true;
+}
+
+OutputWindow::~OutputWindow()
+{
+	// the caller waited for the GPU
+	DestroySwapchainResources();
+
+	if (swapchain != VK_NULL_HANDLE)
+		vkDestroySwapchainKHR(device, swapchain, NULL);
+
+	for (uint32_t i = 0; i < OUTPUT_MAX_FRAME_LAG; i++)
+		vkDestroySemaphore(device, image_acquired_semaphores[i], NULL);
+
+	if (surface != VK_NULL_HANDLE)
+		vkDestroySurfaceKHR(inst, surface, NULL);
+
+	if (window)
+		DestroyWindow(window);
+
+	output_window_count--;
+	if (output_window_count == 0)
+		UnregisterClass(OUTPUT_WINDOW_CLASS, NULL);
+}
+
+void OutputWindow::DestroySwapchainResources()
+{
+	for (size_t i = 0; i < framebuffers.size(); i++)
+	{
+		vkDestroyFramebuffer(device, framebuffers[i], NULL);
+		vkDestroyImageView(device, views[i], NULL);
+	}
+
+	framebuffers.clear();
+	views.clear();
+	images.clear();
+
+	delete msaa_target;
+	msaa_target = nullptr;
+	delete depth_target;
+	depth_target = nullptr;
+}
+
+void OutputWindow::CreateSwapchain()
+{
+	VkSurfaceCapabilitiesKHR caps;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpu, surface, &caps);
+
+	// A short version of Demo::prepare_swapchain. If the surface
+	// decides the size, we use that, if not, we use the window size
+	VkExtent2D extent;
+	if (caps.currentExtent.width == 0xFFFFFFFF)
+	{
+		extent.width = width;
+		extent.height = height;
+		if (extent.width < caps.minImageExtent.width) extent.width = caps.minImageExtent.width;
+		if (extent.width > caps.maxImageExtent.width) extent.width = caps.maxImageExtent.width;
+		if (extent.height < caps.minImageExtent.height) extent.height = caps.minImageExtent.height;
+		if (extent.height > caps.maxImageExtent.height) extent.height = caps.maxImageExtent.height;
+	}
+	else
+	{
+		extent = caps.currentExtent;
+	}
+
+	// minimized, there is nothing to draw into
+	// until the window gets a size again
+	if (extent.width == 0 || extent.height == 0)
+		return;
+
+	width = extent.width;
+	height = extent.height;
+
+	// one image more than the minimum, so that Acquire
+	// usually finds a free image, and does not skip
+	uint32_t imageCount = caps.minImageCount + 1;
+	if (caps.maxImageCount > 0 && imageCount > caps.maxImageCount)
+		imageCount = caps.maxImageCount;
+
+	VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	VkCompositeAlphaFlagBitsKHR alphaFlags[4] = {
+		VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+		VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
+		VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
+		VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+	};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (caps.supportedCompositeAlpha & alphaFlags[i])
+		{
+			compositeAlpha = alphaFlags[i];
+			break;
+		}
+	}
+
+	VkSwapchainKHR oldSwapchain = swapchain;
+
+	// FIFO is the only present mode that every surface supports
+	VkSwapchainCreateInfoKHR swapchain_ci = {};
+	swapchain_ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	swapchain_ci.surface = surface;
+	swapchain_ci.minImageCount = imageCount;
+	swapchain_ci.imageFormat = format;
+	swapchain_ci.imageColorSpace = color_space;
+	swapchain_ci.imageExtent = extent;
+	swapchain_ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	swapchain_ci.preTransform = (caps.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) ?
+		VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR : caps.currentTransform;
+	swapchain_ci.compositeAlpha = compositeAlpha;
+	swapchain_ci.imageArrayLayers = 1;
+	swapchain_ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	swapchain_ci.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	swapchain_ci.oldSwapchain = oldSwapchain;
+	swapchain_ci.clipped = true;
+
+	vkCreateSwapchainKHR(device, &swapchain_ci, NULL, &swapchain);
+
+	if (oldSwapchain != VK_NULL_HANDLE)
+		vkDestroySwapchainKHR(device, oldSwapchain, NULL);
+
+	uint32_t count = 0;
+	vkGetSwapchainImagesKHR(device, swapchain, &count, NULL);
+	images.resize(count);
+	vkGetSwapchainImagesKHR(device, swapchain, &count, images.data());
+
+	// a view and a framebuffer for each image,
+	// the same as Demo::prepare_framebuffers
+	views.resize(count);
+	framebuffers.resize(count);
+
+	if (samples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		msaa_target = new RenderTarget(device, memory_properties, width, height, format, samples,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+			VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	if (depth_format != VK_FORMAT_UNDEFINED)
+	{
+		depth_target = new RenderTarget(device, memory_properties, width, height, depth_format, samples,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+			VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = images[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.layerCount = 1;
+		vkCreateImageView(device, &viewInfo, NULL, &views[i]);
+
+		// with MSAA, the multisampled image comes first, and
+		// the depth image is last, the same as the render pass
+		VkImageView attachments[3] = { views[i], VK_NULL_HANDLE, VK_NULL_HANDLE };
+		uint32_t attachmentCount = 1;
+		if (msaa_target != nullptr)
+		{
+			attachments[0] = msaa_target->view;
+			attachments[1] = views[i];
+			attachmentCount = 2;
+		}
+
+		if (depth_target != nullptr)
+			attachments[attachmentCount++] = depth_target->view;
+
+		VkFramebufferCreateInfo fb_info = {};
+		fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		fb_info.renderPass = render_pass;
+		fb_info.attachmentCount = attachmentCount;
+		fb_info.pAttachments = attachments;
+		fb_info.width = width;
+		fb_info.height = height;
+		fb_info.layers = 1;
+		vkCreateFramebuffer(device, &fb_info, NULL, &framebuffers[i]);
+	}
+}
+
+void OutputWindow::Rebuild()
+{
+	needs_rebuild = false;
+	DestroySwapchainResources();
+
+	// a minimized window keeps its old swapchain
+	// handle, so that the next one can replace it
+	CreateSwapchain();
+}
+
+bool OutputWindow::Acquire(uint32_t frameIndex)
+{
+	acquired = false;
+
+	if (!ok || closed || swapchain == VK_NULL_HANDLE || images.empty())
+		return false;
+
+	// A timeout of zero returns VK_NOT_READY right away if no
+	// image is free, we skip this window for one frame then
+	VkResult result = vkAcquireNextImageKHR(device, swapchain, 0,
+		image_acquired_semaphores[frameIndex], VK_NULL_HANDLE, &current_buffer);
+
+	// SUBOPTIMAL still gave us an image, and
+	// signals the semaphore, so we draw it
+	if (result == VK_SUBOPTIMAL_KHR)
+		needs_rebuild = true;
+	else if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		needs_rebuild = true;
+
+	acquired = result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+	return acquired;
+}
+
+void OutputWindow::Presented(VkResult result)
+{
+	if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
+		needs_rebuild = true;
+}
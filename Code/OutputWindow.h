@@ -0,0 +1,138 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include "RenderTarget.h"
+#include <vector>
+
+// the most frames in flight, the same as MAX_FRAME_LAG in Demo.h
+#define OUTPUT_MAX_FRAME_LAG 3
+
+// One more window that Demo draws the same scene into.
+//
+// Everything that does not depend on the window is shared with the
+// main window: the device, the queue, the render pass, the pipelines,
+// the pipeline cache, the buffers, the textures and the descriptor
+// sets. The only things that belong to an OutputWindow are the things
+// that a swapchain needs: the window, its surface, the swapchain, its
+// image views and framebuffers, and the semaphores that tell us when
+// an image was acquired. Demo draws every window in the same command
+// buffer, and presents all of them with one vkQueuePresentKHR.
+//
+// The swapchain has the same format as the main window's swapchain,
+// because the render pass and the pipelines were made for that format.
+// With MSAA or depth, the window has its own multisampled image and depth
+// image too, because it has its own size.
+// If the surface does not support it, the window is not made ("ok" is
+// false).
+//
+// Acquire never waits: if the window has no free image, it skips the
+// frame, so a slow or hidden window can not slow down the others
+class OutputWindow
+{
+private:
+	VkPhysicalDevice gpu;
+	VkDevice device;
+	VkInstance inst;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkRenderPass render_pass;
+	VkSampleCountFlagBits samples;
+	VkFormat depth_format;
+	uint32_t frame_lag;
+
+	void CreateSwapchain();
+	void DestroySwapchainResources();
+
+	static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+public:
+	bool ok;
+
+	HWND window;
+	VkSurfaceKHR surface;
+	VkFormat format;
+	VkColorSpaceKHR color_space;
+
+	// VK_NULL_HANDLE while the window is minimized
+	VkSwapchainKHR swapchain;
+	uint32_t width;
+	uint32_t height;
+
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+	std::vector<VkFramebuffer> framebuffers;
+
+	// the multisampled image that is resolved into the
+	// swapchain image, nullptr without MSAA
+	RenderTarget* msaa_target;
+
+	// nullptr without depth
+	RenderTarget* depth_target;
+
+	// one per frame in flight, like Demo's
+	VkSemaphore image_acquired_semaphores[OUTPUT_MAX_FRAME_LAG];
+
+	// the image that Acquire got, and if it got one
+	uint32_t current_buffer;
+	bool acquired;
+
+	// set when the window changes size, or when the
+	// swapchain is out of date, then Rebuild has to
+	// be called while the GPU is idle
+	bool needs_rebuild;
+
+	// the window was closed, it is never drawn again
+	bool closed;
+
+	OutputWindow(
+		const char* title,
+		int x, int y,
+		uint32_t windowWidth, uint32_t windowHeight,
+		VkInstance instance,
+		VkPhysicalDevice physical_device,
+		VkDevice d,
+		VkPhysicalDeviceMemoryProperties memoryProperties,
+		uint32_t queue_family_index,
+		VkFormat swapchainFormat,
+		VkColorSpaceKHR swapchainColorSpace,
+		VkSampleCountFlagBits sampleCount,
+		VkFormat depthFormat,
+		VkRenderPass renderPass,
+		uint32_t frameLag);
+
+	~OutputWindow();
+
+	// Gets the next image for frame "frameIndex", without waiting.
+	// Returns false if there is nothing to draw into this frame
+	bool Acquire(uint32_t frameIndex);
+
+	// The GPU must not be using the old swapchain
+	void Rebuild();
+
+	// what vkQueuePresentKHR said about this swapchain
+	void Presented(VkResult result);
+};
@@ -0,0 +1,209 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "Profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileEvent
+{
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+};
+
+// One per thread that has recorded anything. "written" only goes
+// up, the event it points to is events[written % PROFILER_RING_SIZE]
+struct ProfileThread
+{
+	uint32_t id;
+	std::string name;
+	std::atomic<uint64_t> written;
+	ProfileEvent events[PROFILER_RING_SIZE];
+};
+
+// Every thread's ring, and the time when the program started,
+// in ticks and in steady_clock time. Comparing them again when
+// the trace is written tells us how long a tick is
+struct ProfileRegistry
+{
+	std::mutex mutex;
+	std::vector<ProfileThread*> threads;
+	uint64_t startTicks;
+	std::chrono::steady_clock::time_point startTime;
+
+	ProfileRegistry()
+	{
+		startTicks = Profiler::Now();
+		startTime = std::chrono::steady_clock::now();
+	}
+
+	// the rings live until the program ends, because
+	// a thread can end before the trace is written
+	~ProfileRegistry()
+	{
+		for (size_t i = 0; i < threads.size(); i++)
+			delete threads[i];
+	}
+};
+
+static ProfileRegistry registry;
+
+static thread_local ProfileThread* thisThread = nullptr;
+
+static ProfileThread* get_thread()
+{
+	if (thisThread == nullptr)
+	{
+		ProfileThread* t = new ProfileThread();
+		t->written.store(0);
+
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		t->id = (uint32_t)registry.threads.size();
+		t->name = "Thread " + std::to_string(t->id);
+		registry.threads.push_back(t);
+
+		thisThread = t;
+	}
+
+	return thisThread;
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+	ProfileThread* t = get_thread();
+
+	// Only this thread writes "written", so a relaxed load is
+	// enough. The release store makes sure that the event is
+	// written before WriteChromeTrace can see the new count
+	uint64_t i = t->written.load(std::memory_order_relaxed);
+
+	ProfileEvent& e = t->events[i & (PROFILER_RING_SIZE - 1)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+
+	t->written.store(i + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ProfileThread* t = get_thread();
+
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	t->name = name;
+}
+
+// Names are usually function names, but quotes and
+// backslashes would break the JSON, so they are escaped
+static void write_json_string(FILE* f, const char* s)
+{
+	fputc('"', f);
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+bool Profiler::WriteChromeTrace(const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if (f == nullptr)
+	{
+		printf("Could not write the trace to %s\n", path);
+		fflush(stdout);
+		return false;
+	}
+
+	// How many microseconds one tick is. With rdtsc, this is
+	// measured over the whole run, so it is very accurate, as long
+	// as the CPU's counter runs at a fixed rate (every x64 CPU from
+	// the last ten years does). With steady_clock, ticks are the
+	// clock's own unit
+	uint64_t nowTicks = Now();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.startTime).count();
+	double usPerTick = 1.0;
+
+	if (nowTicks > registry.startTicks)
+		usPerTick = seconds * 1000000.0 / (double)(nowTicks - registry.startTicks);
+
+	fprintf(f, "{\"traceEvents\":[\n");
+
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	bool first = true;
+	uint64_t eventCount = 0;
+
+	for (size_t t = 0; t < registry.threads.size(); t++)
+	{
+		ProfileThread* thread = registry.threads[t];
+
+		// "M" events name the rows of the timeline
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+			first ? "" : ",\n", thread->id);
+		write_json_string(f, thread->name.c_str());
+		fprintf(f, "}}");
+		first = false;
+
+		// only the newest PROFILER_RING_SIZE events are left
+		uint64_t written = thread->written.load(std::memory_order_acquire);
+		uint64_t count = written < PROFILER_RING_SIZE ? written : PROFILER_RING_SIZE;
+
+		for (uint64_t i = written - count; i < written; i++)
+		{
+			const ProfileEvent& e = thread->events[i & (PROFILER_RING_SIZE - 1)];
+
+			// "X" is a complete event, with a start and a
+			// duration, both in microseconds
+			double ts = (double)(int64_t)(e.start - registry.startTicks) * usPerTick;
+			double dur = (double)(int64_t)(e.end - e.start) * usPerTick;
+
+			fprintf(f, ",\n{\"name\":");
+			write_json_string(f, e.name);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", thread->id, ts, dur);
+		}
+
+		eventCount += count;
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	printf("Wrote %llu profiler events to %s\n", (unsigned long long)eventCount, path);
+	fflush(stdout);
+	return true;
+}
+
+#endif
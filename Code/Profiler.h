@@ -0,0 +1,130 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+#pragma once
+#include <stdint.h>
+
+// The profiler is only compiled in when ENABLE_PROFILER is
+// defined, which vkcube.vcxproj and Benchmark.vcxproj only do
+// in Debug. Without it (every Release build), every PROFILE_
+// macro below turns into nothing, so the markers in the code
+// cost nothing at all, and benchmark numbers do not include
+// the profiler's own overhead.
+//
+// Usage:
+//	PROFILE_FUNCTION();			times the rest of the function
+//	PROFILE_SCOPE("name");		times the rest of the { } block
+//	PROFILE_THREAD_NAME("name");	names this thread in the trace
+//	PROFILE_WRITE_TRACE("trace.json");
+//
+// Names must be string literals (or anything else that lives
+// until the program ends), because only the pointer is saved.
+//
+// The trace file is Chrome's trace-event JSON. Open it at
+// chrome://tracing (or https://ui.perfetto.dev) to see every
+// scope of every thread on a timeline
+#ifdef ENABLE_PROFILER
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROFILER_USE_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+// events kept per thread, older events are overwritten,
+// this has to be a power of two
+#define PROFILER_RING_SIZE 16384
+
+class Profiler
+{
+public:
+	// A timestamp in ticks. On x64 this is the CPU's time stamp
+	// counter (rdtsc), which takes a few cycles to read and does
+	// not call into the OS. Ticks are turned into microseconds
+	// only when the trace is written
+	static inline uint64_t Now()
+	{
+#ifdef PROFILER_USE_RDTSC
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	// Saves one event in this thread's ring. There are no locks,
+	// each thread only writes to its own ring (the first call on
+	// each thread takes a lock once, to make the ring)
+	static void Record(const char* name, uint64_t start, uint64_t end);
+
+	static void SetThreadName(const char* name);
+
+	// Writes every event that is still in the rings. Threads
+	// can keep recording while this runs, an event that is
+	// overwritten while it is being written may come out wrong,
+	// which is fine for a trace. Returns false if the file
+	// could not be made
+	static bool WriteChromeTrace(const char* path);
+};
+
+// Records the time between its constructor and its destructor
+struct ProfileScope
+{
+	const char* name;
+	uint64_t start;
+
+	ProfileScope(const char* n)
+	{
+		name = n;
+		start = Profiler::Now();
+	}
+
+	~ProfileScope()
+	{
+		Profiler::Record(name, start, Profiler::Now());
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) Profiler::SetThreadName(name)
+#define PROFILE_WRITE_TRACE(path) Profiler::WriteChromeTrace(path)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD_NAME(name)
+#define PROFILE_WRITE_TRACE(path) ((void)0)
+
+#endif
@@ -0,0 +1,844 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "RenderGraph.h"
+#include "FrameCapture.h"
+#include "Helper.h"
+#include <stdio.h>
+#include <algorithm>
+
+RenderGraph::RenderGraph(VkDevice d, VkPhysicalDeviceMemoryProperties memoryProperties)
+{
+	device = d;
+	memory_properties = memoryProperties;
+	compiled = false;
+
+	culledPasses = 0;
+	transientImages = 0;
+	memoryBytes = 0;
+	unaliasedBytes = 0;
+	barrierCount = 0;
+
+	final = BarrierBatch();
+}
+
+RenderGraph::~RenderGraph()
+{
+	// the caller waited for the GPU
+	for (Resource& r : resources)
+	{
+		if (r.imported || r.image == VK_NULL_HANDLE)
+			continue;
+
+		vkDestroyImageView(device, r.view, NULL);
+		vkDestroyImage(device, r.image, NULL);
+	}
+
+	for (VkDeviceMemory memory : blocks)
+		vkFreeMemory(device, memory, NULL);
+}
+
+RenderGraphResource RenderGraph::ImportImage(const char* name, VkImageAspectFlags aspect,
+	VkImageLayout initialLayout, VkPipelineStageFlags initialStages, VkImageLayout finalLayout)
+{
+	Resource r = {};
+	r.name = name;
+	r.isImage = true;
+	r.imported = true;
+	r.output = finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+	r.aspect = aspect;
+	r.initialLayout = initialLayout;
+	r.initialStages = initialStages;
+	r.finalLayout = finalLayout;
+	r.block = RENDER_GRAPH_NONE;
+	r.first = RENDER_GRAPH_NONE;
+	r.last = RENDER_GRAPH_NONE;
+
+	resources.push_back(r);
+	return (RenderGraphResource)resources.size() - 1;
+}
+
+RenderGraphResource RenderGraph::ImportBuffer(const char* name, bool output)
+{
+	Resource r = {};
+	r.name = name;
+	r.isImage = false;
+	r.imported = true;
+	r.output = output;
+	r.block = RENDER_GRAPH_NONE;
+	r.first = RENDER_GRAPH_NONE;
+	r.last = RENDER_GRAPH_NONE;
+
+	resources.push_back(r);
+	return (RenderGraphResource)resources.size() - 1;
+}
+
+RenderGraphResource RenderGraph::CreateImage(const char* name, uint32_t width, uint32_t height,
+	VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect)
+{
+	Resource r = {};
+	r.name = name;
+	r.isImage = true;
+	r.imported = false;
+	r.output = false;
+	r.aspect = aspect;
+	r.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	r.finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	r.block = RENDER_GRAPH_NONE;
+	r.first = RENDER_GRAPH_NONE;
+	r.last = RENDER_GRAPH_NONE;
+
+	// the image is made in Compile(), if a pass that runs uses it
+	r.info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	r.info.imageType = VK_IMAGE_TYPE_2D;
+	r.info.format = format;
+	r.info.extent.width = width;
+	r.info.extent.height = height;
+	r.info.extent.depth = 1;
+	r.info.mipLevels = 1;
+	r.info.arrayLayers = 1;
+	r.info.samples = VK_SAMPLE_COUNT_1_BIT;
+	r.info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	r.info.usage = usage;
+	r.info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	r.info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	resources.push_back(r);
+	return (RenderGraphResource)resources.size() - 1;
+}
+
+uint32_t RenderGraph::AddPass(const char* name, RenderGraphRecord record, bool sideEffect)
+{
+	Pass p;
+	p.name = name;
+	p.record = record;
+	p.sideEffect = sideEffect;
+	p.culled = false;
+
+	passes.push_back(p);
+	return (uint32_t)passes.size() - 1;
+}
+
+void RenderGraph::Read(uint32_t pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+	VkImageLayout layout, VkImageLayout finalLayout)
+{
+	RenderGraphAccess a = { resource, stages, access, layout, finalLayout };
+	passes[pass].reads.push_back(a);
+}
+
+void RenderGraph::Write(uint32_t pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+	VkImageLayout layout, VkImageLayout finalLayout)
+{
+	RenderGraphAccess a = { resource, stages, access, layout, finalLayout };
+	passes[pass].writes.push_back(a);
+}
+
+void RenderGraph::Cull()
+{
+	// Walk backwards from the end of the frame. "needed" is every
+	// resource that something after this point uses
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = 0; i < resources.size(); i++)
+		needed[i] = resources[i].output;
+
+	culledPasses = 0;
+
+	for (size_t i = passes.size(); i-- > 0;)
+	{
+		Pass& p = passes[i];
+
+		bool runs = p.sideEffect;
+		for (const RenderGraphAccess& a : p.writes)
+			runs = runs || needed[a.resource];
+
+		p.culled = !runs;
+		if (p.culled)
+		{
+			culledPasses++;
+			continue;
+		}
+
+		for (const RenderGraphAccess& a : p.reads)
+			needed[a.resource] = true;
+
+		// A write that wants the image in a layout keeps what was in
+		// it (like loadOp LOAD), and a buffer write might only write
+		// part of the buffer, so whatever wrote it before is needed
+		for (const RenderGraphAccess& a : p.writes)
+		{
+			if (!resources[a.resource].isImage || a.layout != VK_IMAGE_LAYOUT_UNDEFINED)
+				needed[a.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::Sort()
+{
+	// Which passes each pass has to wait for, from the order
+	// that they were added in: read after write, write after
+	// write, and write after read
+	std::vector<std::vector<uint32_t>> next(passes.size());
+	std::vector<uint32_t> waitingFor(passes.size(), 0);
+
+	std::vector<uint32_t> lastWriter(resources.size(), RENDER_GRAPH_NONE);
+	std::vector<std::vector<uint32_t>> readers(resources.size());
+
+	auto edge = [&](uint32_t from, uint32_t to)
+	{
+		if (from == to || from == RENDER_GRAPH_NONE)
+			return;
+		if (std::find(next[from].begin(), next[from].end(), to) != next[from].end())
+			return;
+		next[from].push_back(to);
+		waitingFor[to]++;
+	};
+
+	for (uint32_t i = 0; i < (uint32_t)passes.size(); i++)
+	{
+		const Pass& p = passes[i];
+		if (p.culled)
+			continue;
+
+		for (const RenderGraphAccess& a : p.reads)
+		{
+			edge(lastWriter[a.resource], i);
+			readers[a.resource].push_back(i);
+		}
+
+		for (const RenderGraphAccess& a : p.writes)
+		{
+			edge(lastWriter[a.resource], i);
+			for (uint32_t reader : readers[a.resource])
+				edge(reader, i);
+
+			lastWriter[a.resource] = i;
+			readers[a.resource].clear();
+		}
+	}
+
+	// Kahn's algorithm. "ready" is kept in the order the passes were
+	// added, so with no better choice, that order is kept
+	std::vector<uint32_t> ready;
+	for (uint32_t i = 0; i < (uint32_t)passes.size(); i++)
+	{
+		if (!passes[i].culled && waitingFor[i] == 0)
+			ready.push_back(i);
+	}
+
+	order.clear();
+	uint32_t previous = RENDER_GRAPH_NONE;
+
+	while (!ready.empty())
+	{
+		// the first ready pass that does not wait for the
+		// last one, or the first ready pass if they all do
+		size_t pick = 0;
+		if (previous != RENDER_GRAPH_NONE)
+		{
+			for (size_t r = 0; r < ready.size(); r++)
+			{
+				const std::vector<uint32_t>& n = next[previous];
+				if (std::find(n.begin(), n.end(), ready[r]) == n.end())
+				{
+					pick = r;
+					break;
+				}
+			}
+		}
+
+		uint32_t p = ready[pick];
+		ready.erase(ready.begin() + pick);
+		order.push_back(p);
+		previous = p;
+
+		for (uint32_t n : next[p])
+		{
+			if (--waitingFor[n] == 0)
+			{
+				ready.insert(std::upper_bound(ready.begin(), ready.end(), n), n);
+			}
+		}
+	}
+}
+
+bool RenderGraph::Allocate()
+{
+	// When each resource is first and last used, as a position
+	// in "order", and what its last pass did. Only the writes of
+	// the last pass count: an image that takes over the memory
+	// waits for its stages, and if the last pass only read, that
+	// is a write after read, which needs no access flags at all
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		const Pass& p = passes[order[i]];
+
+		for (int list = 0; list < 2; list++)
+		{
+			const std::vector<RenderGraphAccess>& accesses = list == 0 ? p.reads : p.writes;
+			for (const RenderGraphAccess& a : accesses)
+			{
+				Resource& r = resources[a.resource];
+				if (r.first == RENDER_GRAPH_NONE)
+					r.first = i;
+
+				if (r.last != i)
+				{
+					r.lastStages = 0;
+					r.lastWrites = 0;
+				}
+
+				r.last = i;
+				r.lastStages |= a.stages;
+				if (list == 1)
+					r.lastWrites |= a.access;
+			}
+		}
+	}
+
+	// make every transient image that is used
+	std::vector<RenderGraphResource> transient;
+	for (RenderGraphResource i = 0; i < (RenderGraphResource)resources.size(); i++)
+	{
+		Resource& r = resources[i];
+		if (r.imported || r.first == RENDER_GRAPH_NONE)
+			continue;
+
+		VkResult err = vkCreateImage(device, &r.info, NULL, &r.image);
+		if (err != VK_SUCCESS)
+		{
+			printf("Render graph: could not make %s (VkResult %d)\n", r.name, (int)err);
+			fflush(stdout);
+			r.image = VK_NULL_HANDLE;
+			return false;
+		}
+
+		vkGetImageMemoryRequirements(device, r.image, &r.requirements);
+		transient.push_back(i);
+	}
+
+	// The biggest images pick a block first, so that
+	// smaller ones fit into the blocks that they made
+	std::sort(transient.begin(), transient.end(), [&](RenderGraphResource a, RenderGraphResource b)
+	{
+		return resources[a].requirements.size > resources[b].requirements.size;
+	});
+
+	struct Block
+	{
+		uint32_t memoryType;
+		VkDeviceSize size;
+		std::vector<RenderGraphResource> images;
+	};
+	std::vector<Block> plan;
+
+	for (RenderGraphResource i : transient)
+	{
+		Resource& r = resources[i];
+		unaliasedBytes += r.requirements.size;
+
+		for (uint32_t b = 0; b < (uint32_t)plan.size() && r.block == RENDER_GRAPH_NONE; b++)
+		{
+			if ((r.requirements.memoryTypeBits & (1u << plan[b].memoryType)) == 0)
+				continue;
+
+			// every image in the block has to be
+			// dead before r starts, or start after r dies
+			bool overlaps = false;
+			for (RenderGraphResource other : plan[b].images)
+			{
+				const Resource& o = resources[other];
+				if (!(o.last < r.first || r.last < o.first))
+					overlaps = true;
+			}
+
+			if (!overlaps)
+				r.block = b;
+		}
+
+		if (r.block == RENDER_GRAPH_NONE)
+		{
+			Block block;
+			block.size = 0;
+			if (!Helper::memory_type_from_properties(memory_properties, r.requirements.memoryTypeBits,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &block.memoryType))
+			{
+				printf("Render graph: no device-local memory type can hold %s\n", r.name);
+				fflush(stdout);
+				return false;
+			}
+
+			plan.push_back(block);
+			r.block = (uint32_t)plan.size() - 1;
+		}
+
+		// every image starts at the start of its block,
+		// so the block is as big as the biggest one
+		Block& block = plan[r.block];
+		block.images.push_back(i);
+		block.size = std::max(block.size, r.requirements.size);
+	}
+
+	for (Block& block : plan)
+	{
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = block.size;
+		allocInfo.memoryTypeIndex = block.memoryType;
+
+		VkDeviceMemory memory;
+		VkResult err = vkAllocateMemory(device, &allocInfo, NULL, &memory);
+		if (err != VK_SUCCESS)
+		{
+			printf("Render graph: could not allocate %.1f MB for transient images (VkResult %d)\n",
+				block.size / (1024.0 * 1024.0), (int)err);
+			fflush(stdout);
+			return false;
+		}
+
+		blocks.push_back(memory);
+		memoryBytes += block.size;
+
+		for (RenderGraphResource i : block.images)
+		{
+			Resource& r = resources[i];
+			err = vkBindImageMemory(device, r.image, memory, 0);
+			if (err != VK_SUCCESS)
+			{
+				printf("Render graph: could not bind memory to %s (VkResult %d)\n", r.name, (int)err);
+				fflush(stdout);
+				return false;
+			}
+
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = r.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = r.info.format;
+			viewInfo.subresourceRange.aspectMask = r.aspect;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.layerCount = 1;
+			err = vkCreateImageView(device, &viewInfo, NULL, &r.view);
+			if (err != VK_SUCCESS)
+			{
+				printf("Render graph: could not make a view of %s (VkResult %d)\n", r.name, (int)err);
+				fflush(stdout);
+				r.view = VK_NULL_HANDLE;
+				return false;
+			}
+		}
+	}
+
+	transientImages = (uint32_t)transient.size();
+	return true;
+}
+
+void RenderGraph::AddAccess(State& state, const RenderGraphAccess& a, bool write, BarrierBatch& batch)
+{
+	const Resource& r = resources[a.resource];
+	bool transition = r.isImage && a.layout != VK_IMAGE_LAYOUT_UNDEFINED && a.layout != state.layout;
+
+	// A write, or a layout change (which writes the whole image),
+	// waits for everything before it. A read only waits for the
+	// last write, and not even that, if an earlier read at the
+	// same stages already waited for it
+	VkPipelineStageFlags srcStages = 0;
+	VkAccessFlags srcAccess = 0;
+
+	if (state.untouched && !transition && (a.stages & ~state.writeStages) == 0)
+	{
+		// the acquire semaphore already waits for it
+	}
+	else if (write || transition)
+	{
+		srcStages = state.writeStages | state.readStages;
+		srcAccess = state.writeAccess;
+	}
+	else if (a.access != 0 && ((a.stages & ~state.readStages) != 0 || (a.access & ~state.readAccess) != 0))
+	{
+		srcStages = state.writeStages;
+		srcAccess = state.writeAccess;
+	}
+
+	if (transition)
+	{
+		Barrier b;
+		b.resource = a.resource;
+		b.srcAccess = srcAccess;
+		b.dstAccess = a.access;
+		b.oldLayout = state.layout;
+		b.newLayout = a.layout;
+		batch.images.push_back(b);
+
+		batch.srcStages |= srcStages != 0 ? srcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		batch.dstStages |= a.stages;
+	}
+	else if (srcStages != 0)
+	{
+		batch.srcStages |= srcStages;
+		batch.dstStages |= a.stages;
+		batch.memorySrcAccess |= srcAccess;
+		batch.memoryDstAccess |= a.access;
+	}
+
+	// where the resource is after the pass
+	state.untouched = false;
+
+	if (write)
+	{
+		state.writeStages = a.stages;
+		state.writeAccess = a.access;
+		state.readStages = 0;
+		state.readAccess = 0;
+	}
+	else if (transition)
+	{
+		// the layout change happened before these stages, so later
+		// passes wait for them, and the last write is made visible
+		// again to whatever they read with. The barrier already made
+		// the last write available, so there is no write access left
+		// to wait for, and the old one may not even belong to these
+		// stages (a color write, and then a transfer read)
+		state.writeStages = a.stages;
+		state.writeAccess = 0;
+		state.readStages = a.stages;
+		state.readAccess = a.access;
+	}
+	else
+	{
+		state.readStages |= a.stages;
+		state.readAccess |= a.access;
+	}
+
+	if (a.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED)
+		state.layout = a.finalLayout;
+	else if (a.layout != VK_IMAGE_LAYOUT_UNDEFINED)
+		state.layout = a.layout;
+}
+
+void RenderGraph::PlanBarriers()
+{
+	std::vector<State> states(resources.size());
+
+	for (RenderGraphResource i = 0; i < (RenderGraphResource)resources.size(); i++)
+	{
+		const Resource& r = resources[i];
+		State& s = states[i];
+		s = State();
+		s.layout = r.initialLayout;
+		s.writeStages = r.initialStages;
+		s.untouched = r.imported && r.isImage;
+
+		if (r.imported || r.block == RENDER_GRAPH_NONE)
+			continue;
+
+		// A transient image takes over its memory from the image
+		// in its block that was alive last before it, which is
+		// the last one in the block if it is the first one (from
+		// the last frame, or itself, if it is alone in the block)
+		const Resource* previous = nullptr;
+		for (const Resource& o : resources)
+		{
+			if (o.imported || o.block != r.block)
+				continue;
+
+			if (o.last < r.first && (previous == nullptr || o.last > previous->last))
+				previous = &o;
+		}
+
+		if (previous == nullptr)
+		{
+			for (const Resource& o : resources)
+			{
+				if (!o.imported && o.block == r.block && (previous == nullptr || o.last > previous->last))
+					previous = &o;
+			}
+		}
+
+		s.writeStages = previous->lastStages;
+		s.writeAccess = previous->lastWrites;
+	}
+
+	batches.assign(order.size(), BarrierBatch());
+
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		const Pass& p = passes[order[i]];
+		for (const RenderGraphAccess& a : p.reads)
+			AddAccess(states[a.resource], a, false, batches[i]);
+		for (const RenderGraphAccess& a : p.writes)
+			AddAccess(states[a.resource], a, true, batches[i]);
+	}
+
+	// imported images that the frame has to leave in a layout
+	final = BarrierBatch();
+	for (RenderGraphResource i = 0; i < (RenderGraphResource)resources.size(); i++)
+	{
+		const Resource& r = resources[i];
+		const State& s = states[i];
+		if (!r.imported || !r.isImage || !r.output || s.layout == r.finalLayout)
+			continue;
+
+		Barrier b;
+		b.resource = i;
+		b.srcAccess = s.writeAccess;
+		b.dstAccess = 0;
+		b.oldLayout = s.layout;
+		b.newLayout = r.finalLayout;
+		final.images.push_back(b);
+
+		VkPipelineStageFlags srcStages = s.writeStages | s.readStages;
+		final.srcStages |= srcStages != 0 ? srcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		final.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	}
+
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+		CheckBatch(passes[order[i]].name, batches[i]);
+	CheckBatch("the end of the frame", final);
+
+	barrierCount = final.srcStages != 0 ? 1 : 0;
+	for (const BarrierBatch& b : batches)
+	{
+		if (b.srcStages != 0)
+			barrierCount++;
+	}
+}
+
+bool RenderGraph::Compile()
+{
+	Cull();
+	Sort();
+
+	// without memory the transient images can't be used,
+	// the images that were made are destroyed with the graph
+	if (!Allocate())
+		return false;
+
+	PlanBarriers();
+	compiled = true;
+	return true;
+}
+
+void RenderGraph::SetImage(RenderGraphResource resource, VkImage image)
+{
+	resources[resource].image = image;
+}
+
+void RenderGraph::SetBuffer(RenderGraphResource resource, VkBuffer buffer)
+{
+	resources[resource].buffer = buffer;
+}
+
+VkImage RenderGraph::Image(RenderGraphResource resource) const
+{
+	return resources[resource].image;
+}
+
+VkImageView RenderGraph::View(RenderGraphResource resource) const
+{
+	return resources[resource].view;
+}
+
+bool RenderGraph::Runs(uint32_t pass) const
+{
+	return !passes[pass].culled;
+}
+
+// Every stage that can do an access, from the table of
+// "Supported access types" in the Vulkan spec. The access
+// flags of a barrier have to be done by one of its stages
+static VkPipelineStageFlags StagesForAccess(VkAccessFlags access)
+{
+	const VkPipelineStageFlags shaders =
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+		VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+		VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	switch (access)
+	{
+	case VK_ACCESS_INDIRECT_COMMAND_READ_BIT:
+		return VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	case VK_ACCESS_INDEX_READ_BIT:
+	case VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT:
+		return VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	case VK_ACCESS_UNIFORM_READ_BIT:
+	case VK_ACCESS_SHADER_READ_BIT:
+	case VK_ACCESS_SHADER_WRITE_BIT:
+		return shaders;
+	case VK_ACCESS_INPUT_ATTACHMENT_READ_BIT:
+		return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	case VK_ACCESS_COLOR_ATTACHMENT_READ_BIT:
+	case VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT:
+		return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	case VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT:
+	case VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT:
+		return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	case VK_ACCESS_TRANSFER_READ_BIT:
+	case VK_ACCESS_TRANSFER_WRITE_BIT:
+		return VK_PIPELINE_STAGE_TRANSFER_BIT;
+	case VK_ACCESS_HOST_READ_BIT:
+	case VK_ACCESS_HOST_WRITE_BIT:
+		return VK_PIPELINE_STAGE_HOST_BIT;
+	default:
+		// MEMORY_READ, MEMORY_WRITE, and extensions
+		// that nothing here uses, any stage will do
+		return ~(VkPipelineStageFlags)0;
+	}
+}
+
+// true if every access flag is done by one of the stages
+static bool AccessFitsStages(VkAccessFlags access, VkPipelineStageFlags stages)
+{
+	if (stages & VK_PIPELINE_STAGE_ALL_COMMANDS_BIT)
+		return true;
+
+	if (stages & VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT)
+	{
+		stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+			VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+			VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	}
+
+	for (uint32_t bit = 0; bit < 32; bit++)
+	{
+		VkAccessFlags flag = access & (1u << bit);
+		if (flag != 0 && (StagesForAccess(flag) & stages) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+void RenderGraph::CheckBatch(const char* where, const BarrierBatch& batch) const
+{
+	// Validation would reject the barrier every frame, so we say
+	// it once, here. It means that a pass gave Read() or Write()
+	// access flags that its stages don't do, or that PlanBarriers
+	// paired the stages of one access with the flags of another
+	bool fits =
+		AccessFitsStages(batch.memorySrcAccess, batch.srcStages) &&
+		AccessFitsStages(batch.memoryDstAccess, batch.dstStages);
+
+	for (const Barrier& b : batch.images)
+	{
+		if (!AccessFitsStages(b.srcAccess, batch.srcStages) || !AccessFitsStages(b.dstAccess, batch.dstStages))
+			fits = false;
+	}
+
+	if (!fits)
+	{
+		printf("Render graph: the barrier before %s has access flags that its stages (0x%x -> 0x%x) don't do\n",
+			where, batch.srcStages, batch.dstStages);
+		fflush(stdout);
+	}
+}
+
+void RenderGraph::RecordBatch(VkCommandBuffer cmd, const BarrierBatch& batch)
+{
+	if (batch.srcStages == 0)
+		return;
+
+	image_barriers.resize(batch.images.size());
+
+	for (size_t i = 0; i < batch.images.size(); i++)
+	{
+		const Barrier& b = batch.images[i];
+		const Resource& r = resources[b.resource];
+
+		VkImageMemoryBarrier& barrier = image_barriers[i];
+		barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = b.srcAccess;
+		barrier.dstAccessMask = b.dstAccess;
+		barrier.oldLayout = b.oldLayout;
+		barrier.newLayout = b.newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = r.image;
+		barrier.subresourceRange.aspectMask = r.aspect;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+	}
+
+	// Everything goes in one vkCmdPipelineBarrier. It goes through
+	// FrameCapture, so that a capture has the same barriers between
+	// the culling and the draws (the image barriers are not saved)
+	FrameCapture::CmdMemoryBarrier(cmd, batch.srcStages, batch.dstStages,
+		batch.memorySrcAccess, batch.memoryDstAccess,
+		(uint32_t)image_barriers.size(), image_barriers.data());
+}
+
+void RenderGraph::Execute(VkCommandBuffer cmd)
+{
+	if (!compiled)
+		return;
+
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		RecordBatch(cmd, batches[i]);
+		passes[order[i]].record(cmd);
+	}
+
+	RecordBatch(cmd, final);
+}
+
+void RenderGraph::Print() const
+{
+	printf("Render graph: %u passes, %u culled, %u barrier calls per frame\n",
+		(uint32_t)order.size(), culledPasses, barrierCount);
+
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		const BarrierBatch& b = batches[i];
+		printf("    %s", passes[order[i]].name);
+		if (b.srcStages != 0)
+			printf(" (waits: stages 0x%x -> 0x%x, %u layout changes)", b.srcStages, b.dstStages, (uint32_t)b.images.size());
+		printf("\n");
+	}
+
+	for (const Pass& p : passes)
+	{
+		if (p.culled)
+			printf("    %s (culled, nothing uses what it writes)\n", p.name);
+	}
+
+	if (transientImages > 0)
+	{
+		printf("    %u transient images in %u blocks, %.1f MB (%.1f MB without aliasing)\n",
+			transientImages, (uint32_t)blocks.size(),
+			memoryBytes / (1024.0 * 1024.0), unaliasedBytes / (1024.0 * 1024.0));
+	}
+
+	fflush(stdout);
+}
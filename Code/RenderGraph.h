@@ -0,0 +1,274 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <functional>
+#include <vector>
+
+// a resource in a RenderGraph, an index into its resources
+typedef uint32_t RenderGraphResource;
+#define RENDER_GRAPH_NONE 0xFFFFFFFF
+
+// records the commands of one pass
+typedef std::function<void(VkCommandBuffer cmd)> RenderGraphRecord;
+
+// How a pass uses a resource: at which stages, with what kind of
+// access, and for images, in which layout. layout is what the image
+// has to be in when the pass starts, VK_IMAGE_LAYOUT_UNDEFINED if the
+// pass does not care, because it throws the old pixels away (like a
+// render pass with initialLayout UNDEFINED). finalLayout is what the
+// pass leaves it in, if the pass changes it itself (like a render
+// pass's finalLayout), VK_IMAGE_LAYOUT_UNDEFINED means "same as layout".
+// A read with no access only puts the pass after the writes, and the
+// image in its layout, for a pass that makes its own barriers (like
+// FrameReadback), which wait for "stages"
+struct RenderGraphAccess
+{
+	RenderGraphResource resource;
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	VkImageLayout layout;
+	VkImageLayout finalLayout;
+};
+
+// A frame, described as passes that say which resources they read and
+// write, instead of as commands with barriers written by hand.
+//
+// Every frame, the graph runs the same passes. The program builds it
+// once (and again when the window changes size): it adds resources and
+// passes, says what each pass reads and writes, and calls Compile().
+// Then every frame, it gives the graph this frame's imported handles
+// (SetImage, SetBuffer) and calls Execute(), which records every pass
+// into one command buffer.
+//
+// Compile() does four things:
+//
+// Culling. A pass only runs if it has a side effect (like presenting
+// to another window, or copying pixels back), or if it writes something
+// that a pass that runs reads, or an output (an imported image with a
+// final layout, like the swapchain image). A pass whose results nobody
+// uses is never recorded.
+//
+// Ordering. A pass that reads something has to come after the last
+// pass before it (in the order they were added) that writes it, and a
+// pass that writes something has to come after every pass before it
+// that uses it. Any order that keeps those rules gives the same
+// picture. Of the passes that are ready, we pick one that does not
+// depend on the pass that was just picked, if there is one, so that
+// passes that wait on each other are further apart, and the GPU can
+// work on something else while it waits.
+//
+// Barriers. The graph knows what every resource went through, so
+// before each pass, it makes one vkCmdPipelineBarrier with everything
+// the pass needs to wait for: writes that it reads (read after write),
+// uses of something that it writes (write after read, write after
+// write), and layout changes. Reads after reads need nothing. All of
+// this is worked out in Compile(), Execute() only fills in the handles.
+//
+// Aliasing. Images made with CreateImage are transient: the graph
+// makes them, and they only live from the first pass that uses them to
+// the last. Two transient images that are never alive at the same time
+// can share the same memory. Every transient image is put in the first
+// memory block that only has images whose lifetimes do not overlap with
+// it, and each block is as big as its biggest image. When one image
+// takes over a block from another, its first barrier waits for the
+// other one's last pass, and its old contents are UNDEFINED
+class RenderGraph
+{
+private:
+	struct Resource
+	{
+		const char* name;
+		bool isImage;
+		bool imported;
+
+		// an imported image with a final layout,
+		// or a buffer that was imported as an output
+		bool output;
+
+		VkImage image;
+		VkImageView view;
+		VkBuffer buffer;
+		VkImageAspectFlags aspect;
+
+		// imported images: the layout it has before the first pass,
+		// the stages that made it ready (for a swapchain image, the
+		// stage that the submit waits for the acquire at), and the
+		// layout it must have after the last pass
+		VkImageLayout initialLayout;
+		VkPipelineStageFlags initialStages;
+		VkImageLayout finalLayout;
+
+		// transient images
+		VkImageCreateInfo info;
+		VkMemoryRequirements requirements;
+		uint32_t block;
+
+		// the first and last pass that use it, in the
+		// order that they run, and what its last pass did
+		uint32_t first;
+		uint32_t last;
+		VkPipelineStageFlags lastStages;
+		VkAccessFlags lastWrites;
+	};
+
+	struct Pass
+	{
+		const char* name;
+		RenderGraphRecord record;
+		bool sideEffect;
+		bool culled;
+		std::vector<RenderGraphAccess> reads;
+		std::vector<RenderGraphAccess> writes;
+	};
+
+	// what one resource needs before a pass, worked out by Compile()
+	struct Barrier
+	{
+		RenderGraphResource resource;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	// every barrier before one pass, in one batch. Buffers (and
+	// images that change no layout) only need a global memory
+	// barrier, images that change layout need an image barrier
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags srcStages;
+		VkPipelineStageFlags dstStages;
+		VkAccessFlags memorySrcAccess;
+		VkAccessFlags memoryDstAccess;
+		std::vector<Barrier> images;
+	};
+
+	// where a resource is, while Compile() walks through the passes
+	struct State
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags writeStages;
+		VkAccessFlags writeAccess;
+		VkPipelineStageFlags readStages;
+		VkAccessFlags readAccess;
+
+		// An imported image that no pass used yet. The submit
+		// already waits for it at its initialStages (the acquire
+		// semaphore), so passes at those stages need no barrier,
+		// unless the layout changes
+		bool untouched;
+	};
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<VkDeviceMemory> blocks;
+
+	// the passes that run, in the order they run, and the
+	// barriers before each of them. "final" is after the last
+	// pass, for imported images that need their final layout
+	std::vector<uint32_t> order;
+	std::vector<BarrierBatch> batches;
+	BarrierBatch final;
+
+	// filled in by RecordBatch, kept so that it does
+	// not allocate every frame
+	std::vector<VkImageMemoryBarrier> image_barriers;
+
+	bool compiled;
+
+	void Cull();
+	void Sort();
+	bool Allocate();
+	void PlanBarriers();
+	void AddAccess(State& state, const RenderGraphAccess& a, bool write, BarrierBatch& batch);
+	void RecordBatch(VkCommandBuffer cmd, const BarrierBatch& batch);
+
+	// prints a warning if a barrier's access flags
+	// don't belong to its stages, see PlanBarriers
+	void CheckBatch(const char* where, const BarrierBatch& batch) const;
+
+public:
+	// After Compile(): how many passes were culled, how many
+	// transient images there are, how much memory they use, how
+	// much they would use without aliasing, and how many
+	// vkCmdPipelineBarrier calls Execute() makes
+	uint32_t culledPasses;
+	uint32_t transientImages;
+	VkDeviceSize memoryBytes;
+	VkDeviceSize unaliasedBytes;
+	uint32_t barrierCount;
+
+	RenderGraph(VkDevice d, VkPhysicalDeviceMemoryProperties memoryProperties);
+	~RenderGraph();
+
+	// An image that the program made (like a swapchain image). If
+	// finalLayout is not UNDEFINED, it is an output of the frame,
+	// and it is left in that layout after the last pass
+	RenderGraphResource ImportImage(const char* name, VkImageAspectFlags aspect,
+		VkImageLayout initialLayout, VkPipelineStageFlags initialStages, VkImageLayout finalLayout);
+
+	// A buffer that the program made. Previous frames are already
+	// done with it (the program waited for their fence). An output
+	// is always written, even if no pass reads it
+	RenderGraphResource ImportBuffer(const char* name, bool output = false);
+
+	// A transient image, which the graph makes in Compile()
+	RenderGraphResource CreateImage(const char* name, uint32_t width, uint32_t height,
+		VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+
+	// A side effect pass is never culled
+	uint32_t AddPass(const char* name, RenderGraphRecord record, bool sideEffect = false);
+
+	void Read(uint32_t pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+	void Write(uint32_t pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+	// After this, no more resources or passes can be added.
+	// False if the memory for the transient images could not
+	// be found or allocated, then the graph can't be executed
+	bool Compile();
+
+	// this frame's handles for imported resources
+	void SetImage(RenderGraphResource resource, VkImage image);
+	void SetBuffer(RenderGraphResource resource, VkBuffer buffer);
+
+	VkImage Image(RenderGraphResource resource) const;
+	VkImageView View(RenderGraphResource resource) const;
+
+	// true if the pass runs, after Compile()
+	bool Runs(uint32_t pass) const;
+
+	void Execute(VkCommandBuffer cmd);
+
+	// prints the passes in order, with their barriers
+	void Print() const;
+};
@@ -0,0 +1,119 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "RenderTarget.h"
+#include "Helper.h"
+
+RenderTarget::RenderTarget(
+	VkDevice d,
+	VkPhysicalDeviceMemoryProperties memory_properties,
+	uint32_t w,
+	uint32_t h,
+	VkFormat f,
+	VkSampleCountFlagBits sampleCount,
+	VkImageUsageFlags usage,
+	VkImageAspectFlags aspect)
+{
+	device = d;
+	width = w;
+	height = h;
+	format = f;
+	samples = sampleCount;
+	lazy = false;
+
+	// One mip level, one layer, OPTIMAL tiling, because
+	// only the GPU ever touches the pixels
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = samples;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	vkCreateImage(device, &imageInfo, NULL, &image);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(device, image, &mem_reqs);
+
+	VkMemoryAllocateInfo memAllocInfo = {};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.allocationSize = mem_reqs.size;
+
+	// Lazy memory is only allowed for transient images,
+	// and only some GPUs have it. If not, the image
+	// goes in the GPU's own memory, like a Texture
+	if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+	{
+		lazy = Helper::memory_type_from_properties(
+			memory_properties,
+			mem_reqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+			&memAllocInfo.memoryTypeIndex);
+	}
+
+	if (!lazy)
+	{
+		Helper::memory_type_from_properties(
+			memory_properties,
+			mem_reqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&memAllocInfo.memoryTypeIndex);
+	}
+
+	vkAllocateMemory(device, &memAllocInfo, NULL, &memory);
+	vkBindImageMemory(device, image, memory, 0);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+	viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+	viewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+	viewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+	viewInfo.subresourceRange.aspectMask = aspect;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	vkCreateImageView(device, &viewInfo, NULL, &view);
+}
+
+RenderTarget::~RenderTarget()
+{
+	vkDestroyImageView(device, view, NULL);
+	vkDestroyImage(device, image, NULL);
+	vkFreeMemory(device, memory, NULL);
+}
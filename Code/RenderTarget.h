@@ -0,0 +1,70 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+
+// A RenderTarget is an image that the GPU draws into, inside a render
+// pass, like a multisampled color image or a depth buffer. Unlike a
+// Texture, nothing is ever uploaded into it.
+//
+// If "usage" has VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, the image
+// only lives inside one render pass: it is cleared at the start and
+// thrown away at the end (storeOp DONT_CARE). Then we ask for
+// LAZILY_ALLOCATED memory. On a tile-based GPU (most phones and some
+// laptops), the image lives in the tile's on-chip memory, and real
+// memory is only given to it if the driver ever needs it, so it costs
+// no memory and no bandwidth. Desktop GPUs have no lazy memory, and
+// then we fall back to DEVICE_LOCAL memory, which always works.
+class RenderTarget
+{
+private:
+	VkDevice device;
+	VkDeviceMemory memory;
+
+public:
+	VkImage image;
+	VkImageView view;
+	VkFormat format;
+	VkSampleCountFlagBits samples;
+	uint32_t width;
+	uint32_t height;
+
+	// true if the memory is LAZILY_ALLOCATED
+	bool lazy;
+
+	RenderTarget(
+		VkDevice d,
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		uint32_t w,
+		uint32_t h,
+		VkFormat f,
+		VkSampleCountFlagBits sampleCount,
+		VkImageUsageFlags usage,
+		VkImageAspectFlags aspect);
+
+	~RenderTarget();
+};
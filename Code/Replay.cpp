@@ -0,0 +1,1695 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+
+// Replay draws the frames of a .vkcap file (see FrameCapture.h)
+// again, as fast as the GPU can, without a window. It makes every
+// object in the file, records every frame into its own command
+// buffer one time, and then submits those command buffers in a loop.
+// So the CPU does almost nothing, and the times it prints are the
+// GPU's work for those exact frames, which makes it good for
+// finding out if a change made the GPU slower:
+//
+//   vkcube.exe --capture 60
+//   Replay.exe capture.vkcap --loops 20 --out replay.csv
+//
+// Replay only uses Vulkan and FileView, not Win32, so it also
+// builds and runs on Linux.
+//
+// A few things are not the same as the real program:
+//  - textures have the right size, format and mips, but they
+//    are filled with grey (their pixels are not in the file)
+//  - each frame starts by copying what the CPU wrote into buffers
+//    for that frame, the real program wrote it with memcpy
+//  - descriptor writes from the middle of a capture are done
+//    before the first frame
+
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include "BufferCPU.h"
+#include "FileView.h"
+#include "FrameCapture.h"
+#include "Helper.h"
+#include "TextureTable.h"
+
+// same as ERR_EXIT, but for a console program
+#define REPLAY_FAIL(msg)      \
+	do {                      \
+		printf("%s\n", msg);  \
+		fflush(stdout);       \
+		exit(1);              \
+	} while (0)
+
+// Reads the fields of one chunk, in the same order that
+// FrameCapture.cpp wrote them. Reading past the end of
+// the chunk gives zeros, and sets "ok" to false
+struct CaptureReader
+{
+	const uint8_t* p;
+	const uint8_t* end;
+	bool ok;
+
+	CaptureReader(const uint8_t* data, size_t size)
+	{
+		p = data;
+		end = data + size;
+		ok = true;
+	}
+
+	const uint8_t* Bytes(size_t size)
+	{
+		if ((size_t)(end - p) < size)
+		{
+			ok = false;
+			p = end;
+			return nullptr;
+		}
+
+		const uint8_t* bytes = p;
+		p += size;
+		return bytes;
+	}
+
+	uint32_t U32()
+	{
+		uint32_t value = 0;
+		const uint8_t* bytes = Bytes(4);
+		if (bytes != nullptr)
+			memcpy(&value, bytes, 4);
+		return value;
+	}
+
+	uint64_t U64()
+	{
+		uint64_t value = 0;
+		const uint8_t* bytes = Bytes(8);
+		if (bytes != nullptr)
+			memcpy(&value, bytes, 8);
+		return value;
+	}
+
+	float F32()
+	{
+		uint32_t bits = U32();
+		float value;
+		memcpy(&value, &bits, 4);
+		return value;
+	}
+};
+
+struct Chunk
+{
+	uint32_t type;
+	const uint8_t* data;
+	uint32_t size;
+};
+
+// One of these per id in the file, only the
+// handles for the type of the object are used
+struct ReplayObject
+{
+	uint32_t type;
+
+	// buffers
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	BufferCPU* host;
+
+	// images
+	VkImage image;
+	VkFormat format;
+	uint32_t mipLevels;
+	uint32_t arrayLayers;
+
+	VkImageView view;
+	VkSampler sampler;
+
+	// set layouts, with what the pool needs to know
+	VkDescriptorSetLayout setLayout;
+	VkDescriptorSetLayoutCreateFlags setLayoutFlags;
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
+
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+	VkDescriptorSet set;
+};
+
+// Everything that one captured frame needs: the updates
+// to copy into buffers, and then the commands
+struct ReplayUpdate
+{
+	uint32_t buffer;
+	uint64_t offset;
+	uint64_t size;
+	const uint8_t* data;
+
+	// where the data is in the upload buffer
+	uint64_t uploadOffset;
+};
+
+struct ReplayFrame
+{
+	std::vector<ReplayUpdate> updates;
+	Chunk commands;
+	VkCommandBuffer cmd;
+};
+
+class Replay
+{
+public:
+	VkInstance inst;
+	VkPhysicalDevice gpu;
+	VkDevice device;
+	VkQueue queue;
+	uint32_t queue_family_index;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkPhysicalDeviceProperties gpu_properties;
+	bool timestamps;
+
+	CaptureFileHeader header;
+	std::vector<Chunk> chunks;
+	std::vector<ReplayObject> objects;
+	std::vector<ReplayFrame> frames;
+
+	VkCommandPool cmd_pool;
+	VkDescriptorPool desc_pool;
+	VkQueryPool query_pool;
+
+	// the image that every frame draws into
+	VkImage target;
+	VkDeviceMemory targetMemory;
+	VkImageView targetView;
+	VkRenderPass render_pass;
+	VkFramebuffer framebuffer;
+
+	// what the CPU wrote into buffers, for every frame
+	BufferCPU* upload;
+
+	// commands that refer to an object that is not in the file
+	uint32_t skipped;
+
+	bool Load(const FileView& file);
+	void CreateDevice(uint32_t gpuIndex);
+	void CreateTarget();
+	void CreateObjects();
+	void CreateDescriptorSets();
+	void RecordFrames();
+	void Run(uint32_t loops, uint32_t framesInFlight, const char* csvPath);
+	~Replay();
+
+private:
+	VkDeviceMemory Allocate(VkMemoryRequirements reqs, VkMemoryPropertyFlags flags);
+	VkShaderModule ReadStage(CaptureReader& r, VkPipelineShaderStageCreateInfo* stage,
+		std::string* name, VkSpecializationInfo* spec,
+		std::vector<VkSpecializationMapEntry>* entries, std::vector<uint8_t>* specData);
+	void CreateBuffer(ReplayObject& o, CaptureReader& r);
+	void CreateImage(ReplayObject& o, CaptureReader& r, VkCommandBuffer setup);
+	void CreateGraphicsPipeline(ReplayObject& o, CaptureReader& r);
+	void CreateComputePipeline(ReplayObject& o, CaptureReader& r);
+	void RecordCommands(VkCommandBuffer cmd, const Chunk& commands);
+
+	// the handle of an id, or VK_NULL_HANDLE
+	// if the id is not in the file
+	ReplayObject* Get(uint32_t id);
+};
+
+ReplayObject* Replay::Get(uint32_t id)
+{
+	if (id >= objects.size())
+		return nullptr;
+	return &objects[id];
+}
+
+bool Replay::Load(const FileView& file)
+{
+	if (file.size < sizeof(CaptureFileHeader))
+		return false;
+
+	memcpy(&header, file.data, sizeof(header));
+	if (header.magic != CAPTURE_FILE_MAGIC || header.version != CAPTURE_FILE_VERSION)
+		return false;
+
+	// Split the file into chunks. Every chunk that describes
+	// an object gets the next id, the same way FrameCapture
+	// gave them out
+	uint64_t offset = header.headerSize;
+	while (offset + sizeof(CaptureChunkHeader) <= file.size)
+	{
+		CaptureChunkHeader chunkHeader;
+		memcpy(&chunkHeader, file.data + offset, sizeof(chunkHeader));
+		offset += sizeof(chunkHeader);
+
+		if (offset + chunkHeader.size > file.size)
+			return false;
+
+		Chunk chunk;
+		chunk.type = chunkHeader.type;
+		chunk.data = file.data + offset;
+		chunk.size = chunkHeader.size;
+		chunks.push_back(chunk);
+
+		offset += chunkHeader.size;
+	}
+
+	// Put the buffer updates and commands together into frames
+	ReplayFrame frame;
+	for (const Chunk& chunk : chunks)
+	{
+		if (chunk.type >= CAPTURE_CHUNK_BUFFER && chunk.type <= CAPTURE_CHUNK_DESCRIPTOR_WRITE)
+		{
+			ReplayObject object = {};
+			object.type = chunk.type;
+			objects.push_back(object);
+		}
+		else if (chunk.type == CAPTURE_CHUNK_BUFFER_UPDATE)
+		{
+			CaptureReader r(chunk.data, chunk.size);
+			ReplayUpdate update;
+			update.buffer = r.U32();
+			update.offset = r.U64();
+			update.size = r.U64();
+			update.data = r.Bytes((size_t)update.size);
+			update.uploadOffset = 0;
+			if (r.ok)
+				frame.updates.push_back(update);
+		}
+		else if (chunk.type == CAPTURE_CHUNK_FRAME)
+		{
+			frame.commands = chunk;
+			frame.cmd = VK_NULL_HANDLE;
+			frames.push_back(frame);
+			frame.updates.clear();
+		}
+	}
+
+	return !frames.empty();
+}
+
+void Replay::CreateDevice(uint32_t gpuIndex)
+{
+	// Descriptor indexing needs Vulkan 1.1,
+	// the same as the real program
+	VkApplicationInfo app = {};
+	app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app.pApplicationName = "Replay";
+	app.pEngineName = "Replay";
+	app.apiVersion = VK_API_VERSION_1_1;
+
+	VkInstanceCreateInfo instInfo = {};
+	instInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instInfo.pApplicationInfo = &app;
+
+	if (vkCreateInstance(&instInfo, NULL, &inst) != VK_SUCCESS)
+		REPLAY_FAIL("vkCreateInstance failed");
+
+	uint32_t gpuCount = 0;
+	vkEnumeratePhysicalDevices(inst, &gpuCount, NULL);
+	if (gpuIndex >= gpuCount)
+		REPLAY_FAIL("There is no GPU with that index");
+
+	std::vector<VkPhysicalDevice> gpus(gpuCount);
+	vkEnumeratePhysicalDevices(inst, &gpuCount, gpus.data());
+	gpu = gpus[gpuIndex];
+
+	vkGetPhysicalDeviceProperties(gpu, &gpu_properties);
+	vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+
+	// one queue that can draw and run compute shaders,
+	// because the captured frames do both
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, NULL);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+
+	queue_family_index = UINT32_MAX;
+	for (uint32_t i = 0; i < familyCount; i++)
+	{
+		VkQueueFlags needed = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+		if ((families[i].queueFlags & needed) == needed)
+		{
+			queue_family_index = i;
+			break;
+		}
+	}
+
+	if (queue_family_index == UINT32_MAX)
+		REPLAY_FAIL("The GPU has no queue that does graphics and compute");
+
+	timestamps = families[queue_family_index].timestampValidBits > 0;
+
+	float priority = 0.0f;
+	VkDeviceQueueCreateInfo queueInfo = {};
+	queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo.queueFamilyIndex = queue_family_index;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &priority;
+
+	// Turn on every feature that the GPU has, the capture
+	// may use any of them (anisotropy, for example)
+	VkPhysicalDeviceFeatures features;
+	vkGetPhysicalDeviceFeatures(gpu, &features);
+
+	VkDeviceCreateInfo deviceInfo = {};
+	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+	deviceInfo.pEnabledFeatures = &features;
+
+	const char* extensions[] = { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME };
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+
+	if (header.flags & CAPTURE_FLAG_DESCRIPTOR_INDEXING)
+	{
+		if (!TextureTable::Supported(gpu, &indexing_features))
+			REPLAY_FAIL("This capture uses bindless textures, which this GPU does not support");
+
+		deviceInfo.enabledExtensionCount = 1;
+		deviceInfo.ppEnabledExtensionNames = extensions;
+		deviceInfo.pNext = &indexing_features;
+	}
+
+	if (vkCreateDevice(gpu, &deviceInfo, NULL, &device) != VK_SUCCESS)
+		REPLAY_FAIL("vkCreateDevice failed");
+
+	vkGetDeviceQueue(device, queue_family_index, 0, &queue);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queue_family_index;
+	vkCreateCommandPool(device, &poolInfo, NULL, &cmd_pool);
+
+	printf("Replaying on %s\n", gpu_properties.deviceName);
+	fflush(stdout);
+}
+
+VkDeviceMemory Replay::Allocate(VkMemoryRequirements reqs, VkMemoryPropertyFlags flags)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = reqs.size;
+
+	Helper::memory_type_from_properties(memory_properties, reqs.memoryTypeBits,
+		flags, &allocInfo.memoryTypeIndex);
+
+	VkDeviceMemory memory;
+	vkAllocateMemory(device, &allocInfo, NULL, &memory);
+	return memory;
+}
+
+void Replay::CreateTarget()
+{
+	// The swapchain image is replaced by an image of
+	// the same size and format, in the same layout
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = (VkFormat)header.colorFormat;
+	imageInfo.extent.width = header.width;
+	imageInfo.extent.height = header.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(device, &imageInfo, NULL, &target) != VK_SUCCESS)
+		REPLAY_FAIL("Could not make the image to draw into");
+
+	VkMemoryRequirements reqs;
+	vkGetImageMemoryRequirements(device, target, &reqs);
+	targetMemory = Allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	vkBindImageMemory(device, target, targetMemory, 0);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = target;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = imageInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.layerCount = 1;
+	vkCreateImageView(device, &viewInfo, NULL, &targetView);
+
+	// Same as Demo::prepare_render_pass, except that the
+	// image stays a color attachment, instead of being presented
+	VkAttachmentDescription attachment = {};
+	attachment.format = imageInfo.format;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorReference = {};
+	colorReference.attachment = 0;
+	colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorReference;
+
+	// the last frame may still be writing the
+	// image when the next one clears it
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo rpInfo = {};
+	rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	rpInfo.attachmentCount = 1;
+	rpInfo.pAttachments = &attachment;
+	rpInfo.subpassCount = 1;
+	rpInfo.pSubpasses = &subpass;
+	rpInfo.dependencyCount = 1;
+	rpInfo.pDependencies = &dependency;
+	vkCreateRenderPass(device, &rpInfo, NULL, &render_pass);
+
+	VkFramebufferCreateInfo fbInfo = {};
+	fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	fbInfo.renderPass = render_pass;
+	fbInfo.attachmentCount = 1;
+	fbInfo.pAttachments = &targetView;
+	fbInfo.width = header.width;
+	fbInfo.height = header.height;
+	fbInfo.layers = 1;
+	vkCreateFramebuffer(device, &fbInfo, NULL, &framebuffer);
+}
+
+void Replay::CreateBuffer(ReplayObject& o, CaptureReader& r)
+{
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.size = r.U64();
+	info.usage = r.U32();
+	bool hostVisible = r.U32() != 0;
+	uint64_t contentSize = r.U64();
+	const uint8_t* contents = r.Bytes((size_t)contentSize);
+
+	// a buffer that was destroyed before the capture
+	if (info.size == 0)
+		return;
+
+	// every frame copies its updates in
+	info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	if (hostVisible)
+	{
+		// BufferCPU, just like the real program,
+		// so the GPU reads it from the same kind of memory
+		o.host = new BufferCPU(device, memory_properties, info);
+		o.buffer = o.host->buffer;
+
+		uint8_t* mapped = (uint8_t*)o.host->Map();
+		memset(mapped, 0, (size_t)info.size);
+		if (contents != nullptr)
+			memcpy(mapped, contents, (size_t)std::min<uint64_t>(contentSize, info.size));
+		o.host->Unmap();
+	}
+	else
+	{
+		vkCreateBuffer(device, &info, NULL, &o.buffer);
+
+		VkMemoryRequirements reqs;
+		vkGetBufferMemoryRequirements(device, o.buffer, &reqs);
+		o.memory = Allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		vkBindBufferMemory(device, o.buffer, o.memory, 0);
+	}
+}
+
+void Replay::CreateImage(ReplayObject& o, CaptureReader& r, VkCommandBuffer setup)
+{
+	VkImageCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	info.imageType = (VkImageType)r.U32();
+	info.format = (VkFormat)r.U32();
+	info.extent.width = r.U32();
+	info.extent.height = r.U32();
+	info.extent.depth = r.U32();
+	info.mipLevels = r.U32();
+	info.arrayLayers = r.U32();
+	info.usage = r.U32() | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	info.samples = VK_SAMPLE_COUNT_1_BIT;
+	info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// A capture from a desktop GPU can have BC textures, which
+	// a phone GPU can't sample, so those become RGBA8, which
+	// every GPU has. The size and mips stay the same
+	VkImageFormatProperties formatProperties;
+	if (vkGetPhysicalDeviceImageFormatProperties(gpu, info.format, info.imageType, info.tiling,
+		info.usage, 0, &formatProperties) != VK_SUCCESS)
+	{
+		info.format = VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	vkCreateImage(device, &info, NULL, &o.image);
+	o.format = info.format;
+	o.mipLevels = info.mipLevels;
+	o.arrayLayers = info.arrayLayers;
+
+	VkMemoryRequirements reqs;
+	vkGetImageMemoryRequirements(device, o.image, &reqs);
+	o.memory = Allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	vkBindImageMemory(device, o.image, o.memory, 0);
+
+	// Fill it with grey, and leave it ready for
+	// shaders to read, which is what the descriptors
+	// in the capture expect. Block-compressed images
+	// can't be cleared, they stay undefined
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.levelCount = info.mipLevels;
+	range.layerCount = info.arrayLayers;
+
+	bool compressed = info.format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK &&
+		info.format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = o.image;
+	barrier.subresourceRange = range;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (!compressed)
+	{
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(setup, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, NULL, 0, NULL, 1, &barrier);
+
+		VkClearColorValue grey = {};
+		grey.float32[0] = 0.5f;
+		grey.float32[1] = 0.5f;
+		grey.float32[2] = 0.5f;
+		grey.float32[3] = 1.0f;
+		vkCmdClearColorImage(setup, o.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &grey, 1, &range);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(setup, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+VkShaderModule Replay::ReadStage(CaptureReader& r, VkPipelineShaderStageCreateInfo* stage,
+	std::string* name, VkSpecializationInfo* spec,
+	std::vector<VkSpecializationMapEntry>* entries, std::vector<uint8_t>* specData)
+{
+	*stage = {};
+	stage->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stage->stage = (VkShaderStageFlagBits)r.U32();
+
+	uint32_t nameLength = r.U32();
+	const uint8_t* nameBytes = r.Bytes(nameLength);
+	name->assign(nameBytes != nullptr ? (const char*)nameBytes : "", nameBytes != nullptr ? nameLength : 0);
+
+	uint32_t entryCount = r.U32();
+	entries->resize(entryCount);
+	for (uint32_t i = 0; i < entryCount; i++)
+	{
+		(*entries)[i].constantID = r.U32();
+		(*entries)[i].offset = r.U32();
+		(*entries)[i].size = r.U32();
+	}
+
+	uint32_t dataSize = r.U32();
+	const uint8_t* data = r.Bytes(dataSize);
+	specData->assign(data, data != nullptr ? data + dataSize : data);
+
+	if (entryCount > 0)
+	{
+		*spec = {};
+		spec->mapEntryCount = entryCount;
+		spec->pMapEntries = entries->data();
+		spec->dataSize = specData->size();
+		spec->pData = specData->data();
+		stage->pSpecializationInfo = spec;
+	}
+
+	// the SPIR-V is not 4-byte aligned inside the file
+	// (the entry point name can be any length)
+	uint32_t codeSize = r.U32();
+	const uint8_t* code = r.Bytes(codeSize);
+	std::vector<uint32_t> words(codeSize / 4);
+	if (code != nullptr && codeSize > 0)
+		memcpy(words.data(), code, codeSize);
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = words.size() * 4;
+	moduleInfo.pCode = words.data();
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	if (codeSize == 0 || vkCreateShaderModule(device, &moduleInfo, NULL, &module) != VK_SUCCESS)
+		printf("A shader in the capture has no SPIR-V\n");
+
+	stage->module = module;
+	stage->pName = name->c_str();
+	return module;
+}
+
+void Replay::CreateGraphicsPipeline(ReplayObject& o, CaptureReader& r)
+{
+	ReplayObject* layout = Get(r.U32());
+
+	uint32_t stageCount = r.U32();
+	std::vector<VkPipelineShaderStageCreateInfo> stages(stageCount);
+	std::vector<std::string> names(stageCount);
+	std::vector<VkSpecializationInfo> specs(stageCount);
+	std::vector<std::vector<VkSpecializationMapEntry>> entries(stageCount);
+	std::vector<std::vector<uint8_t>> specData(stageCount);
+	std::vector<VkShaderModule> modules(stageCount);
+
+	for (uint32_t i = 0; i < stageCount; i++)
+		modules[i] = ReadStage(r, &stages[i], &names[i], &specs[i], &entries[i], &specData[i]);
+
+	uint32_t bindingCount = r.U32();
+	std::vector<VkVertexInputBindingDescription> bindings(bindingCount);
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		bindings[i].binding = r.U32();
+		bindings[i].stride = r.U32();
+		bindings[i].inputRate = (VkVertexInputRate)r.U32();
+	}
+
+	uint32_t attributeCount = r.U32();
+	std::vector<VkVertexInputAttributeDescription> attributes(attributeCount);
+	for (uint32_t i = 0; i < attributeCount; i++)
+	{
+		attributes[i].location = r.U32();
+		attributes[i].binding = r.U32();
+		attributes[i].format = (VkFormat)r.U32();
+		attributes[i].offset = r.U32();
+	}
+
+	VkPipelineVertexInputStateCreateInfo vi = {};
+	vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vi.vertexBindingDescriptionCount = bindingCount;
+	vi.pVertexBindingDescriptions = bindings.data();
+	vi.vertexAttributeDescriptionCount = attributeCount;
+	vi.pVertexAttributeDescriptions = attributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo ia = {};
+	ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	ia.topology = (VkPrimitiveTopology)r.U32();
+	ia.primitiveRestartEnable = r.U32();
+
+	VkPipelineRasterizationStateCreateInfo rs = {};
+	rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rs.depthClampEnable = r.U32();
+	rs.rasterizerDiscardEnable = r.U32();
+	rs.polygonMode = (VkPolygonMode)r.U32();
+	rs.cullMode = r.U32();
+	rs.frontFace = (VkFrontFace)r.U32();
+	rs.lineWidth = r.F32();
+
+	// the replay's render pass has one sample, the
+	// sample count is read, so that the fields line up
+	VkPipelineMultisampleStateCreateInfo ms = {};
+	ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	r.U32();
+	ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// and it has no depth buffer
+	VkPipelineDepthStencilStateCreateInfo ds = {};
+	ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	r.U32();
+	r.U32();
+	r.U32();
+
+	uint32_t blendCount = r.U32();
+	std::vector<VkPipelineColorBlendAttachmentState> blends(blendCount);
+	for (uint32_t i = 0; i < blendCount; i++)
+	{
+		blends[i].blendEnable = r.U32();
+		blends[i].srcColorBlendFactor = (VkBlendFactor)r.U32();
+		blends[i].dstColorBlendFactor = (VkBlendFactor)r.U32();
+		blends[i].colorBlendOp = (VkBlendOp)r.U32();
+		blends[i].srcAlphaBlendFactor = (VkBlendFactor)r.U32();
+		blends[i].dstAlphaBlendFactor = (VkBlendFactor)r.U32();
+		blends[i].alphaBlendOp = (VkBlendOp)r.U32();
+		blends[i].colorWriteMask = r.U32();
+	}
+
+	VkPipelineColorBlendStateCreateInfo cb = {};
+	cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	cb.attachmentCount = blendCount;
+	cb.pAttachments = blends.data();
+
+	// Viewport and scissor are always dynamic here, the
+	// frames in the capture set them, if the pipeline had
+	// them as dynamic state (Demo's pipelines do)
+	uint32_t dynamicCount = r.U32();
+	std::vector<VkDynamicState> dynamicStates;
+	for (uint32_t i = 0; i < dynamicCount; i++)
+		dynamicStates.push_back((VkDynamicState)r.U32());
+
+	if (std::find(dynamicStates.begin(), dynamicStates.end(), VK_DYNAMIC_STATE_VIEWPORT) == dynamicStates.end())
+		dynamicStates.push_back(VK_DYNAMIC_STATE_VIEWPORT);
+	if (std::find(dynamicStates.begin(), dynamicStates.end(), VK_DYNAMIC_STATE_SCISSOR) == dynamicStates.end())
+		dynamicStates.push_back(VK_DYNAMIC_STATE_SCISSOR);
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = (uint32_t)dynamicStates.size();
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkPipelineViewportStateCreateInfo vp = {};
+	vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	vp.viewportCount = 1;
+	vp.scissorCount = 1;
+
+	if (!r.ok || layout == nullptr)
+	{
+		printf("A graphics pipeline in the capture is broken\n");
+		return;
+	}
+
+	VkGraphicsPipelineCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	info.stageCount = stageCount;
+	info.pStages = stages.data();
+	info.pVertexInputState = &vi;
+	info.pInputAssemblyState = &ia;
+	info.pViewportState = &vp;
+	info.pRasterizationState = &rs;
+	info.pMultisampleState = &ms;
+	info.pDepthStencilState = &ds;
+	info.pColorBlendState = &cb;
+	info.pDynamicState = &dynamicState;
+	info.layout = layout->pipelineLayout;
+	info.renderPass = render_pass;
+
+	vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &info, NULL, &o.pipeline);
+
+	for (VkShaderModule module : modules)
+		vkDestroyShaderModule(device, module, NULL);
+}
+
+void Replay::CreateComputePipeline(ReplayObject& o, CaptureReader& r)
+{
+	ReplayObject* layout = Get(r.U32());
+
+	std::string name;
+	VkSpecializationInfo spec;
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<uint8_t> specData;
+
+	VkComputePipelineCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	VkShaderModule module = ReadStage(r, &info.stage, &name, &spec, &entries, &specData);
+
+	if (!r.ok || layout == nullptr)
+	{
+		printf("A compute pipeline in the capture is broken\n");
+		return;
+	}
+
+	info.layout = layout->pipelineLayout;
+	vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &info, NULL, &o.pipeline);
+	vkDestroyShaderModule(device, module, NULL);
+}
+
+void Replay::CreateObjects()
+{
+	// Images are cleared with one command buffer,
+	// which is submitted after every object is made
+	VkCommandBufferAllocateInfo cmdInfo = {};
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmdInfo.commandPool = cmd_pool;
+	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdInfo.commandBufferCount = 1;
+
+	VkCommandBuffer setup;
+	vkAllocateCommandBuffers(device, &cmdInfo, &setup);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(setup, &beginInfo);
+
+	uint32_t id = 0;
+	for (const Chunk& chunk : chunks)
+	{
+		if (chunk.type < CAPTURE_CHUNK_BUFFER || chunk.type > CAPTURE_CHUNK_DESCRIPTOR_WRITE)
+			continue;
+
+		ReplayObject& o = objects[id++];
+		CaptureReader r(chunk.data, chunk.size);
+
+		switch (chunk.type)
+		{
+		case CAPTURE_CHUNK_BUFFER:
+			CreateBuffer(o, r);
+			break;
+
+		case CAPTURE_CHUNK_IMAGE:
+			CreateImage(o, r, setup);
+			break;
+
+		case CAPTURE_CHUNK_IMAGE_VIEW:
+		{
+			ReplayObject* image = Get(r.U32());
+
+			VkImageViewCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			info.viewType = (VkImageViewType)r.U32();
+			info.format = (VkFormat)r.U32();
+			info.subresourceRange.aspectMask = r.U32();
+			info.subresourceRange.baseMipLevel = r.U32();
+			info.subresourceRange.levelCount = r.U32();
+			info.subresourceRange.baseArrayLayer = r.U32();
+			info.subresourceRange.layerCount = r.U32();
+
+			if (image == nullptr || image->image == VK_NULL_HANDLE)
+				break;
+
+			// the image may have a different format
+			// than it had when it was captured
+			info.image = image->image;
+			info.format = image->format;
+			vkCreateImageView(device, &info, NULL, &o.view);
+			break;
+		}
+
+		case CAPTURE_CHUNK_SAMPLER:
+		{
+			VkSamplerCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			info.magFilter = (VkFilter)r.U32();
+			info.minFilter = (VkFilter)r.U32();
+			info.mipmapMode = (VkSamplerMipmapMode)r.U32();
+			info.addressModeU = (VkSamplerAddressMode)r.U32();
+			info.addressModeV = (VkSamplerAddressMode)r.U32();
+			info.addressModeW = (VkSamplerAddressMode)r.U32();
+			info.mipLodBias = r.F32();
+			info.anisotropyEnable = r.U32();
+			info.maxAnisotropy = r.F32();
+			info.compareEnable = r.U32();
+			info.compareOp = (VkCompareOp)r.U32();
+			info.minLod = r.F32();
+			info.maxLod = r.F32();
+			info.borderColor = (VkBorderColor)r.U32();
+			info.unnormalizedCoordinates = r.U32();
+
+			if (info.maxAnisotropy > gpu_properties.limits.maxSamplerAnisotropy)
+				info.maxAnisotropy = gpu_properties.limits.maxSamplerAnisotropy;
+
+			vkCreateSampler(device, &info, NULL, &o.sampler);
+			break;
+		}
+
+		case CAPTURE_CHUNK_SET_LAYOUT:
+		{
+			o.setLayoutFlags = r.U32();
+			uint32_t count = r.U32();
+			o.bindings.resize(count);
+			o.bindingFlags.resize(count);
+
+			bool anyFlags = false;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				o.bindings[i] = {};
+				o.bindings[i].binding = r.U32();
+				o.bindings[i].descriptorType = (VkDescriptorType)r.U32();
+				o.bindings[i].descriptorCount = r.U32();
+				o.bindings[i].stageFlags = r.U32();
+				o.bindingFlags[i] = r.U32();
+				anyFlags = anyFlags || o.bindingFlags[i] != 0;
+			}
+
+			VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+			flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+			flagsInfo.bindingCount = count;
+			flagsInfo.pBindingFlags = o.bindingFlags.data();
+
+			VkDescriptorSetLayoutCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			info.pNext = anyFlags ? &flagsInfo : NULL;
+			info.flags = o.setLayoutFlags;
+			info.bindingCount = count;
+			info.pBindings = o.bindings.data();
+			vkCreateDescriptorSetLayout(device, &info, NULL, &o.setLayout);
+			break;
+		}
+
+		case CAPTURE_CHUNK_PIPELINE_LAYOUT:
+		{
+			std::vector<VkDescriptorSetLayout> setLayouts(r.U32());
+			for (size_t i = 0; i < setLayouts.size(); i++)
+			{
+				ReplayObject* layout = Get(r.U32());
+				setLayouts[i] = layout != nullptr ? layout->setLayout : VK_NULL_HANDLE;
+			}
+
+			std::vector<VkPushConstantRange> ranges(r.U32());
+			for (size_t i = 0; i < ranges.size(); i++)
+			{
+				ranges[i].stageFlags = r.U32();
+				ranges[i].offset = r.U32();
+				ranges[i].size = r.U32();
+			}
+
+			VkPipelineLayoutCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			info.setLayoutCount = (uint32_t)setLayouts.size();
+			info.pSetLayouts = setLayouts.data();
+			info.pushConstantRangeCount = (uint32_t)ranges.size();
+			info.pPushConstantRanges = ranges.data();
+			vkCreatePipelineLayout(device, &info, NULL, &o.pipelineLayout);
+			break;
+		}
+
+		case CAPTURE_CHUNK_GRAPHICS_PIPELINE:
+			CreateGraphicsPipeline(o, r);
+			break;
+
+		case CAPTURE_CHUNK_COMPUTE_PIPELINE:
+			CreateComputePipeline(o, r);
+			break;
+
+		default:
+			// descriptor sets and writes come next,
+			// once we know how big the pool has to be
+			break;
+		}
+	}
+
+	vkEndCommandBuffer(setup);
+
+	VkSubmitInfo submit = {};
+	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit.commandBufferCount = 1;
+	submit.pCommandBuffers = &setup;
+	vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE);
+	vkQueueWaitIdle(queue);
+
+	vkFreeCommandBuffers(device, cmd_pool, 1, &setup);
+}
+
+void Replay::CreateDescriptorSets()
+{
+	// One pool for every set in the capture. Each set
+	// takes as many descriptors as its layout has
+	std::vector<VkDescriptorPoolSize> sizes;
+	uint32_t setCount = 0;
+	bool updateAfterBind = false;
+
+	for (const ReplayObject& o : objects)
+	{
+		if (o.type == CAPTURE_CHUNK_SET_LAYOUT && (o.setLayoutFlags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT))
+			updateAfterBind = true;
+	}
+
+	uint32_t id = 0;
+	for (const Chunk& chunk : chunks)
+	{
+		if (chunk.type < CAPTURE_CHUNK_BUFFER || chunk.type > CAPTURE_CHUNK_DESCRIPTOR_WRITE)
+			continue;
+
+		id++;
+		if (chunk.type != CAPTURE_CHUNK_DESCRIPTOR_SET)
+			continue;
+
+		CaptureReader r(chunk.data, chunk.size);
+		ReplayObject* layout = Get(r.U32());
+		if (layout == nullptr)
+			continue;
+
+		setCount++;
+		for (const VkDescriptorSetLayoutBinding& binding : layout->bindings)
+		{
+			bool found = false;
+			for (VkDescriptorPoolSize& size : sizes)
+			{
+				if (size.type == binding.descriptorType)
+				{
+					size.descriptorCount += binding.descriptorCount;
+					found = true;
+				}
+			}
+
+			if (!found)
+			{
+				VkDescriptorPoolSize size;
+				size.type = binding.descriptorType;
+				size.descriptorCount = binding.descriptorCount;
+				sizes.push_back(size);
+			}
+		}
+	}
+
+	if (setCount == 0)
+		return;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = updateAfterBind ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = (uint32_t)sizes.size();
+	poolInfo.pPoolSizes = sizes.data();
+	vkCreateDescriptorPool(device, &poolInfo, NULL, &desc_pool);
+
+	// Now the sets, and the writes, in the order they
+	// happened, so a later write wins over an earlier one
+	id = 0;
+	for (const Chunk& chunk : chunks)
+	{
+		if (chunk.type < CAPTURE_CHUNK_BUFFER || chunk.type > CAPTURE_CHUNK_DESCRIPTOR_WRITE)
+			continue;
+
+		ReplayObject& o = objects[id++];
+		CaptureReader r(chunk.data, chunk.size);
+
+		if (chunk.type == CAPTURE_CHUNK_DESCRIPTOR_SET)
+		{
+			ReplayObject* layout = Get(r.U32());
+			uint32_t variableCount = r.U32();
+			if (layout == nullptr || layout->setLayout == VK_NULL_HANDLE)
+				continue;
+
+			VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableInfo = {};
+			variableInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+			variableInfo.descriptorSetCount = 1;
+			variableInfo.pDescriptorCounts = &variableCount;
+
+			VkDescriptorSetAllocateInfo allocInfo = {};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.pNext = variableCount > 0 ? &variableInfo : NULL;
+			allocInfo.descriptorPool = desc_pool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &layout->setLayout;
+			vkAllocateDescriptorSets(device, &allocInfo, &o.set);
+		}
+		else if (chunk.type == CAPTURE_CHUNK_DESCRIPTOR_WRITE)
+		{
+			ReplayObject* set = Get(r.U32());
+			uint32_t binding = r.U32();
+			uint32_t element = r.U32();
+			VkDescriptorType type = (VkDescriptorType)r.U32();
+			ReplayObject* resource = Get(r.U32());
+			ReplayObject* sampler = Get(r.U32());
+			VkImageLayout imageLayout = (VkImageLayout)r.U32();
+			uint64_t offset = r.U64();
+			uint64_t range = r.U64();
+
+			if (set == nullptr || set->set == VK_NULL_HANDLE || resource == nullptr)
+				continue;
+
+			VkDescriptorBufferInfo bufferInfo = {};
+			bufferInfo.buffer = resource->buffer;
+			bufferInfo.offset = offset;
+			bufferInfo.range = range;
+
+			VkDescriptorImageInfo imageInfo = {};
+			imageInfo.imageView = resource->view;
+			imageInfo.sampler = sampler != nullptr ? sampler->sampler : VK_NULL_HANDLE;
+			imageInfo.imageLayout = imageLayout;
+
+			bool isBuffer = type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+				type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+			if (isBuffer ? bufferInfo.buffer == VK_NULL_HANDLE : imageInfo.imageView == VK_NULL_HANDLE)
+				continue;
+
+			VkWriteDescriptorSet write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = set->set;
+			write.dstBinding = binding;
+			write.dstArrayElement = element;
+			write.descriptorCount = 1;
+			write.descriptorType = type;
+			write.pBufferInfo = isBuffer ? &bufferInfo : NULL;
+			write.pImageInfo = isBuffer ? NULL : &imageInfo;
+			vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+		}
+	}
+}
+
+// Turns the commands of one frame back into vkCmd* calls.
+// A command that uses an object that is not in the
+// capture is skipped, and counted in "skipped"
+void Replay::RecordCommands(VkCommandBuffer cmd, const Chunk& commands)
+{
+	CaptureReader frame(commands.data, commands.size);
+
+	while (frame.p < frame.end)
+	{
+		uint32_t opcode = frame.U32();
+		uint32_t size = frame.U32();
+		const uint8_t* args = frame.Bytes(size);
+		if (!frame.ok)
+			break;
+
+		CaptureReader r(args, size);
+
+		switch (opcode)
+		{
+		case CAPTURE_CMD_BIND_PIPELINE:
+		{
+			VkPipelineBindPoint bindPoint = (VkPipelineBindPoint)r.U32();
+			ReplayObject* pipeline = Get(r.U32());
+			if (pipeline == nullptr || pipeline->pipeline == VK_NULL_HANDLE) { skipped++; break; }
+			vkCmdBindPipeline(cmd, bindPoint, pipeline->pipeline);
+			break;
+		}
+
+		case CAPTURE_CMD_BIND_DESCRIPTOR_SETS:
+		{
+			VkPipelineBindPoint bindPoint = (VkPipelineBindPoint)r.U32();
+			ReplayObject* layout = Get(r.U32());
+			uint32_t firstSet = r.U32();
+			uint32_t count = r.U32();
+
+			std::vector<VkDescriptorSet> sets(count);
+			bool ok = layout != nullptr;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				ReplayObject* set = Get(r.U32());
+				sets[i] = set != nullptr ? set->set : VK_NULL_HANDLE;
+				ok = ok && sets[i] != VK_NULL_HANDLE;
+			}
+
+			if (!ok) { skipped++; break; }
+			vkCmdBindDescriptorSets(cmd, bindPoint, layout->pipelineLayout, firstSet, count, sets.data(), 0, NULL);
+			break;
+		}
+
+		case CAPTURE_CMD_BIND_VERTEX_BUFFERS:
+		{
+			uint32_t first = r.U32();
+			uint32_t count = r.U32();
+
+			std::vector<VkBuffer> buffers(count);
+			std::vector<VkDeviceSize> offsets(count);
+			bool ok = true;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				ReplayObject* buffer = Get(r.U32());
+				buffers[i] = buffer != nullptr ? buffer->buffer : VK_NULL_HANDLE;
+				offsets[i] = r.U64();
+				ok = ok && buffers[i] != VK_NULL_HANDLE;
+			}
+
+			if (!ok) { skipped++; break; }
+			vkCmdBindVertexBuffers(cmd, first, count, buffers.data(), offsets.data());
+			break;
+		}
+
+		case CAPTURE_CMD_BIND_INDEX_BUFFER:
+		{
+			ReplayObject* buffer = Get(r.U32());
+			VkDeviceSize offset = r.U64();
+			VkIndexType type = (VkIndexType)r.U32();
+			if (buffer == nullptr || buffer->buffer == VK_NULL_HANDLE) { skipped++; break; }
+			vkCmdBindIndexBuffer(cmd, buffer->buffer, offset, type);
+			break;
+		}
+
+		case CAPTURE_CMD_PUSH_CONSTANTS:
+		{
+			ReplayObject* layout = Get(r.U32());
+			VkShaderStageFlags stages = r.U32();
+			uint32_t offset = r.U32();
+			uint32_t dataSize = r.U32();
+			const uint8_t* data = r.Bytes(dataSize);
+			if (layout == nullptr || data == nullptr) { skipped++; break; }
+			vkCmdPushConstants(cmd, layout->pipelineLayout, stages, offset, dataSize, data);
+			break;
+		}
+
+		case CAPTURE_CMD_SET_VIEWPORT:
+		{
+			VkViewport viewport;
+			viewport.x = r.F32();
+			viewport.y = r.F32();
+			viewport.width = r.F32();
+			viewport.height = r.F32();
+			viewport.minDepth = r.F32();
+			viewport.maxDepth = r.F32();
+			vkCmdSetViewport(cmd, 0, 1, &viewport);
+			break;
+		}
+
+		case CAPTURE_CMD_SET_SCISSOR:
+		{
+			VkRect2D scissor;
+			scissor.offset.x = (int32_t)r.U32();
+			scissor.offset.y = (int32_t)r.U32();
+			scissor.extent.width = r.U32();
+			scissor.extent.height = r.U32();
+			vkCmdSetScissor(cmd, 0, 1, &scissor);
+			break;
+		}
+
+		case CAPTURE_CMD_DRAW_INDEXED:
+		{
+			uint32_t indexCount = r.U32();
+			uint32_t instanceCount = r.U32();
+			uint32_t firstIndex = r.U32();
+			int32_t vertexOffset = (int32_t)r.U32();
+			uint32_t firstInstance = r.U32();
+			vkCmdDrawIndexed(cmd, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+			break;
+		}
+
+		case CAPTURE_CMD_DRAW_INDEXED_INDIRECT:
+		{
+			ReplayObject* buffer = Get(r.U32());
+			VkDeviceSize offset = r.U64();
+			uint32_t drawCount = r.U32();
+			uint32_t stride = r.U32();
+			if (buffer == nullptr || buffer->buffer == VK_NULL_HANDLE) { skipped++; break; }
+			vkCmdDrawIndexedIndirect(cmd, buffer->buffer, offset, drawCount, stride);
+			break;
+		}
+
+		case CAPTURE_CMD_DISPATCH:
+		{
+			uint32_t x = r.U32();
+			uint32_t y = r.U32();
+			uint32_t z = r.U32();
+			vkCmdDispatch(cmd, x, y, z);
+			break;
+		}
+
+		case CAPTURE_CMD_UPDATE_BUFFER:
+		{
+			ReplayObject* buffer = Get(r.U32());
+			VkDeviceSize offset = r.U64();
+			VkDeviceSize dataSize = r.U64();
+			const uint8_t* data = r.Bytes((size_t)dataSize);
+			if (buffer == nullptr || buffer->buffer == VK_NULL_HANDLE || data == nullptr) { skipped++; break; }
+			vkCmdUpdateBuffer(cmd, buffer->buffer, offset, dataSize, data);
+			break;
+		}
+
+		case CAPTURE_CMD_BARRIER:
+		{
+			VkPipelineStageFlags srcStages = r.U32();
+			VkPipelineStageFlags dstStages = r.U32();
+
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = r.U32();
+			barrier.dstAccessMask = r.U32();
+			vkCmdPipelineBarrier(cmd, srcStages, dstStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+			break;
+		}
+
+		case CAPTURE_CMD_BEGIN_RENDER_PASS:
+		{
+			VkClearValue clear = {};
+			for (uint32_t i = 0; i < 4; i++)
+				clear.color.float32[i] = r.F32();
+
+			VkRenderPassBeginInfo begin = {};
+			begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			begin.renderPass = render_pass;
+			begin.framebuffer = framebuffer;
+			begin.renderArea.extent.width = std::min(r.U32(), header.width);
+			begin.renderArea.extent.height = std::min(r.U32(), header.height);
+			begin.clearValueCount = 1;
+			begin.pClearValues = &clear;
+			vkCmdBeginRenderPass(cmd, &begin, VK_SUBPASS_CONTENTS_INLINE);
+			break;
+		}
+
+		case CAPTURE_CMD_END_RENDER_PASS:
+			vkCmdEndRenderPass(cmd);
+			break;
+
+		default:
+			skipped++;
+			break;
+		}
+	}
+}
+
+void Replay::RecordFrames()
+{
+	// Every update of every frame goes into one buffer,
+	// which never changes, so each frame can copy from it
+	// without waiting for the CPU
+	uint64_t uploadSize = 0;
+	for (ReplayFrame& frame : frames)
+	{
+		for (ReplayUpdate& update : frame.updates)
+		{
+			update.uploadOffset = uploadSize;
+			uploadSize += (update.size + 15) & ~15ull;
+		}
+	}
+
+	upload = nullptr;
+	if (uploadSize > 0)
+	{
+		VkBufferCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		info.size = uploadSize;
+		info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		upload = new BufferCPU(device, memory_properties, info);
+
+		uint8_t* mapped = (uint8_t*)upload->Map();
+		for (ReplayFrame& frame : frames)
+			for (ReplayUpdate& update : frame.updates)
+				memcpy(mapped + update.uploadOffset, update.data, (size_t)update.size);
+		upload->Unmap();
+	}
+
+	// two timestamps per frame, the start and the end
+	query_pool = VK_NULL_HANDLE;
+	if (timestamps)
+	{
+		VkQueryPoolCreateInfo queryInfo = {};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryInfo.queryCount = (uint32_t)frames.size() * 2;
+		vkCreateQueryPool(device, &queryInfo, NULL, &query_pool);
+	}
+
+	std::vector<VkCommandBuffer> cmds(frames.size());
+
+	VkCommandBufferAllocateInfo cmdInfo = {};
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmdInfo.commandPool = cmd_pool;
+	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdInfo.commandBufferCount = (uint32_t)cmds.size();
+	vkAllocateCommandBuffers(device, &cmdInfo, cmds.data());
+
+	skipped = 0;
+
+	for (uint32_t f = 0; f < (uint32_t)frames.size(); f++)
+	{
+		ReplayFrame& frame = frames[f];
+		VkCommandBuffer cmd = frame.cmd = cmds[f];
+
+		// recorded once, submitted many times
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		vkBeginCommandBuffer(cmd, &beginInfo);
+
+		if (timestamps)
+		{
+			vkCmdResetQueryPool(cmd, query_pool, f * 2, 2);
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, f * 2);
+		}
+
+		// what the CPU wrote for this frame
+		for (const ReplayUpdate& update : frame.updates)
+		{
+			ReplayObject* target = Get(update.buffer);
+			if (target == nullptr || target->buffer == VK_NULL_HANDLE)
+			{
+				skipped++;
+				continue;
+			}
+
+			VkBufferCopy region;
+			region.srcOffset = update.uploadOffset;
+			region.dstOffset = update.offset;
+			region.size = update.size;
+			vkCmdCopyBuffer(cmd, upload->buffer, target->buffer, 1, &region);
+		}
+
+		if (!frame.updates.empty())
+		{
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0, 1, &barrier, 0, NULL, 0, NULL);
+		}
+
+		RecordCommands(cmd, frame.commands);
+
+		if (timestamps)
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, f * 2 + 1);
+
+		vkEndCommandBuffer(cmd);
+	}
+
+	if (skipped > 0)
+	{
+		printf("%u commands use objects that are not in the capture, they were skipped\n", skipped);
+		fflush(stdout);
+	}
+}
+
+void Replay::Run(uint32_t loops, uint32_t framesInFlight, const char* csvPath)
+{
+	uint32_t frameCount = (uint32_t)frames.size();
+
+	// A command buffer can't be submitted again while it is
+	// still running, so there can't be more frames in flight
+	// than there are frames
+	if (framesInFlight > frameCount)
+		framesInFlight = frameCount;
+	if (framesInFlight < 1)
+		framesInFlight = 1;
+
+	std::vector<VkFence> fences(framesInFlight);
+	std::vector<uint32_t> fenceFrame(framesInFlight, UINT32_MAX);
+	std::vector<uint32_t> fenceLoop(framesInFlight, 0);
+	for (uint32_t i = 0; i < framesInFlight; i++)
+	{
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkCreateFence(device, &fenceInfo, NULL, &fences[i]);
+	}
+
+	FILE* csv = nullptr;
+	if (csvPath != nullptr)
+	{
+		csv = fopen(csvPath, "w");
+		if (csv != nullptr)
+			fprintf(csv, "loop,frame,gpu_ms\n");
+	}
+
+	std::vector<double> gpuMs;
+	gpuMs.reserve(loops * frameCount);
+
+	// Reads the timestamps of the frame that the
+	// fence "slot" waited for (it is finished)
+	auto collect = [&](uint32_t slot)
+	{
+		uint32_t f = fenceFrame[slot];
+		if (f == UINT32_MAX || !timestamps)
+			return;
+
+		uint64_t ticks[2] = {};
+		if (vkGetQueryPoolResults(device, query_pool, f * 2, 2, sizeof(ticks), ticks,
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+			return;
+
+		double ms = (double)(ticks[1] - ticks[0]) * gpu_properties.limits.timestampPeriod / 1000000.0;
+		gpuMs.push_back(ms);
+
+		if (csv != nullptr)
+			fprintf(csv, "%u,%u,%.6f\n", fenceLoop[slot], f, ms);
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	uint32_t submitted = 0;
+	for (uint32_t loop = 0; loop < loops; loop++)
+	{
+		for (uint32_t f = 0; f < frameCount; f++)
+		{
+			uint32_t slot = submitted % framesInFlight;
+
+			if (fenceFrame[slot] != UINT32_MAX)
+			{
+				vkWaitForFences(device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+				vkResetFences(device, 1, &fences[slot]);
+				collect(slot);
+			}
+
+			VkSubmitInfo submit = {};
+			submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit.commandBufferCount = 1;
+			submit.pCommandBuffers = &frames[f].cmd;
+			vkQueueSubmit(queue, 1, &submit, fences[slot]);
+
+			fenceFrame[slot] = f;
+			fenceLoop[slot] = loop;
+			submitted++;
+		}
+	}
+
+	// the last few frames
+	for (uint32_t i = 0; i < framesInFlight; i++)
+	{
+		uint32_t slot = (submitted + i) % framesInFlight;
+		if (fenceFrame[slot] == UINT32_MAX)
+			continue;
+
+		vkWaitForFences(device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+		collect(slot);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%u frames (%u captured frames, %u loops) in %.3f s, %.1f frames per second\n",
+		submitted, frameCount, loops, seconds, seconds > 0.0 ? submitted / seconds : 0.0);
+
+	if (!gpuMs.empty())
+	{
+		std::vector<double> sorted = gpuMs;
+		std::sort(sorted.begin(), sorted.end());
+
+		double sum = 0.0;
+		for (double ms : sorted)
+			sum += ms;
+
+		printf("GPU ms per frame: mean %.3f, p50 %.3f, p95 %.3f, max %.3f\n",
+			sum / sorted.size(),
+			sorted[sorted.size() / 2],
+			sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * 0.95))],
+			sorted.back());
+	}
+	fflush(stdout);
+
+	if (csv != nullptr)
+		fclose(csv);
+
+	for (VkFence fence : fences)
+		vkDestroyFence(device, fence, NULL);
+}
+
+Replay::~Replay()
+{
+	vkDeviceWaitIdle(device);
+
+	for (ReplayObject& o : objects)
+	{
+		if (o.pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, o.pipeline, NULL);
+		if (o.pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(device, o.pipelineLayout, NULL);
+		if (o.setLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(device, o.setLayout, NULL);
+		if (o.sampler != VK_NULL_HANDLE) vkDestroySampler(device, o.sampler, NULL);
+		if (o.view != VK_NULL_HANDLE) vkDestroyImageView(device, o.view, NULL);
+		if (o.image != VK_NULL_HANDLE) vkDestroyImage(device, o.image, NULL);
+
+		if (o.host != nullptr)
+			delete o.host;
+		else if (o.buffer != VK_NULL_HANDLE)
+			vkDestroyBuffer(device, o.buffer, NULL);
+
+		if (o.memory != VK_NULL_HANDLE)
+			vkFreeMemory(device, o.memory, NULL);
+	}
+
+	delete upload;
+
+	if (desc_pool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(device, desc_pool, NULL);
+	if (query_pool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(device, query_pool, NULL);
+
+	vkDestroyFramebuffer(device, framebuffer, NULL);
+	vkDestroyRenderPass(device, render_pass, NULL);
+	vkDestroyImageView(device, targetView, NULL);
+	vkDestroyImage(device, target, NULL);
+	vkFreeMemory(device, targetMemory, NULL);
+
+	vkDestroyCommandPool(device, cmd_pool, NULL);
+	vkDestroyDevice(device, NULL);
+	vkDestroyInstance(inst, NULL);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Replay.exe capture.vkcap [--loops N] [--frames-in-flight N] [--gpu N] [--out times.csv]\n");
+		return 1;
+	}
+
+	const char* path = argv[1];
+	uint32_t loops = 10;
+	uint32_t framesInFlight = 2;
+	uint32_t gpuIndex = 0;
+	const char* csvPath = nullptr;
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--loops"))
+			loops = (uint32_t)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--frames-in-flight"))
+			framesInFlight = (uint32_t)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--gpu"))
+			gpuIndex = (uint32_t)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--out"))
+			csvPath = argv[i + 1];
+	}
+
+	// The whole capture is mapped, the buffer contents and
+	// SPIR-V are read straight out of the mapping
+	FileView file;
+	if (!file.Open(path, FILE_VIEW_HINT_SEQUENTIAL | FILE_VIEW_HINT_WILLNEED))
+		REPLAY_FAIL("Could not open the capture");
+
+	Replay* replay = new Replay();
+	if (!replay->Load(file))
+		REPLAY_FAIL("This is not a capture, or it was made by a different version");
+
+	printf("%s: %ux%u, %u frames, %u objects\n", path, replay->header.width, replay->header.height,
+		(uint32_t)replay->frames.size(), (uint32_t)replay->objects.size());
+	fflush(stdout);
+
+	replay->CreateDevice(gpuIndex);
+	replay->CreateTarget();
+	replay->CreateObjects();
+	replay->CreateDescriptorSets();
+	replay->RecordFrames();
+	replay->Run(loops, framesInFlight, csvPath);
+
+	delete replay;
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "ResolutionController.h"
+#include <math.h>
+
+// The scale aims for this part of the budget, and only changes when
+// the time leaves the range between the low and the high mark
+#define RESOLUTION_TARGET 0.85
+#define RESOLUTION_HIGH_MARK 0.95
+#define RESOLUTION_LOW_MARK 0.70
+
+// the most that one change can grow the scale by
+#define RESOLUTION_MAX_GROWTH (4.0f * RESOLUTION_SCALE_STEP)
+
+ResolutionController::ResolutionController(float frameBudgetMs, float minimumScale)
+{
+	budgetMs = frameBudgetMs;
+	minScale = minimumScale;
+	maxScale = 1.0f;
+
+	if (minScale < RESOLUTION_SCALE_STEP) minScale = RESOLUTION_SCALE_STEP;
+	if (minScale > maxScale) minScale = maxScale;
+
+	// start at full size, and only go down if we have to
+	scale = maxScale;
+	smoothedMs = 0.0;
+	framesSinceChange = 0;
+	changes = 0;
+}
+
+bool ResolutionController::Update(double gpuMs)
+{
+	if (gpuMs <= 0.0 || budgetMs <= 0.0f)
+		return false;
+
+	// An exponential moving average, each frame counts for a tenth,
+	// so one slow frame does not change the scale on its own
+	if (smoothedMs == 0.0)
+		smoothedMs = gpuMs;
+	else
+		smoothedMs = smoothedMs * 0.9 + gpuMs * 0.1;
+
+	framesSinceChange++;
+	if (framesSinceChange < RESOLUTION_SETTLE_FRAMES)
+		return false;
+
+	bool over = smoothedMs > budgetMs * RESOLUTION_HIGH_MARK;
+	bool under = smoothedMs < budgetMs * RESOLUTION_LOW_MARK;
+
+	if (!over && !(under && scale < maxScale))
+		return false;
+
+	float wanted = scale * (float)sqrt(budgetMs * RESOLUTION_TARGET / smoothedMs);
+
+	if (wanted > scale + RESOLUTION_MAX_GROWTH)
+		wanted = scale + RESOLUTION_MAX_GROWTH;
+
+	// round to a whole step, down when shrinking,
+	// so that we surely get under the budget
+	float steps = wanted / RESOLUTION_SCALE_STEP;
+	wanted = (over ? floorf(steps) : floorf(steps + 0.5f)) * RESOLUTION_SCALE_STEP;
+
+	if (wanted < minScale) wanted = minScale;
+	if (wanted > maxScale) wanted = maxScale;
+
+	if (fabsf(wanted - scale) < RESOLUTION_SCALE_STEP * 0.5f)
+		return false;
+
+	// the times that were measured at the old
+	// size say nothing about the new one
+	scale = wanted;
+	smoothedMs = 0.0;
+	framesSinceChange = 0;
+	changes++;
+	return true;
+}
@@ -0,0 +1,77 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <stdint.h>
+
+// how many frames to wait after the scale changes, before it can
+// change again. GPU times arrive a few frames late (see GpuTimer),
+// and the smoothed time needs a while to forget the old size
+#define RESOLUTION_SETTLE_FRAMES 30
+
+// the scale moves in steps of 1/32, so tiny changes
+// in GPU time do not change the size every time
+#define RESOLUTION_SCALE_STEP (1.0f / 32.0f)
+
+// Picks how big the image that the scene is drawn into should be,
+// as a fraction of the window ("scale", the same for width and
+// height), so that the GPU finishes each frame inside a budget.
+//
+// Update() is given the GPU time of each frame. It smooths the times,
+// and when the smoothed time is over the budget, or far enough under
+// it that a bigger image would still fit, it picks a new scale. The
+// cost of drawing is mostly the number of pixels, which is scale
+// squared, so the new scale is the old one times the square root of
+// (wanted time / measured time). It aims a bit under the budget, so
+// that a small spike does not push the frame over it.
+//
+// Growing is limited to a few steps at a time, because a scale that
+// is too big drops frames, while one that is too small only looks a
+// little softer. After every change, it waits RESOLUTION_SETTLE_FRAMES
+// frames, so that it sees what the change did before changing again
+class ResolutionController
+{
+public:
+	float budgetMs;
+	float minScale;
+	float maxScale;
+
+	// what the scene should be drawn at, from minScale to maxScale
+	float scale;
+
+	// the GPU time that the scale is decided by
+	double smoothedMs;
+
+	uint32_t framesSinceChange;
+
+	// how many times the scale changed, to see if it is
+	// going back and forth more than it should
+	uint32_t changes;
+
+	ResolutionController(float frameBudgetMs, float minimumScale);
+
+	// gpuMs is one frame's GPU time, returns true if scale changed
+	bool Update(double gpuMs);
+};
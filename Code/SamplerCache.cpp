@@ -0,0 +1,117 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "SamplerCache.h"
+#include "Helper.h"
+#include "FrameCapture.h"
+
+SamplerCache::SamplerCache(VkDevice d)
+{
+	device = d;
+}
+
+SamplerCache::~SamplerCache()
+{
+	for (auto it = samplers.begin(); it != samplers.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); i++)
+			vkDestroySampler(device, it->second[i].sampler, NULL);
+}
+
+uint64_t SamplerCache::Hash(const VkSamplerCreateInfo& info)
+{
+	// We hash each field by itself, instead of hashing the
+	// whole struct, because the padding between fields
+	// can hold anything
+	uint64_t hash = HELPER_HASH_SEED;
+
+	hash = Helper::hash_bytes(&info.pNext, sizeof(info.pNext), hash);
+	hash = Helper::hash_bytes(&info.flags, sizeof(info.flags), hash);
+	hash = Helper::hash_bytes(&info.magFilter, sizeof(info.magFilter), hash);
+	hash = Helper::hash_bytes(&info.minFilter, sizeof(info.minFilter), hash);
+	hash = Helper::hash_bytes(&info.mipmapMode, sizeof(info.mipmapMode), hash);
+	hash = Helper::hash_bytes(&info.addressModeU, sizeof(info.addressModeU), hash);
+	hash = Helper::hash_bytes(&info.addressModeV, sizeof(info.addressModeV), hash);
+	hash = Helper::hash_bytes(&info.addressModeW, sizeof(info.addressModeW), hash);
+	hash = Helper::hash_bytes(&info.mipLodBias, sizeof(info.mipLodBias), hash);
+	hash = Helper::hash_bytes(&info.anisotropyEnable, sizeof(info.anisotropyEnable), hash);
+	hash = Helper::hash_bytes(&info.maxAnisotropy, sizeof(info.maxAnisotropy), hash);
+	hash = Helper::hash_bytes(&info.compareEnable, sizeof(info.compareEnable), hash);
+	hash = Helper::hash_bytes(&info.compareOp, sizeof(info.compareOp), hash);
+	hash = Helper::hash_bytes(&info.minLod, sizeof(info.minLod), hash);
+	hash = Helper::hash_bytes(&info.maxLod, sizeof(info.maxLod), hash);
+	hash = Helper::hash_bytes(&info.borderColor, sizeof(info.borderColor), hash);
+	hash = Helper::hash_bytes(&info.unnormalizedCoordinates, sizeof(info.unnormalizedCoordinates), hash);
+
+	return hash;
+}
+
+bool SamplerCache::Equal(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b)
+{
+	return a.pNext == b.pNext &&
+		a.flags == b.flags &&
+		a.magFilter == b.magFilter &&
+		a.minFilter == b.minFilter &&
+		a.mipmapMode == b.mipmapMode &&
+		a.addressModeU == b.addressModeU &&
+		a.addressModeV == b.addressModeV &&
+		a.addressModeW == b.addressModeW &&
+		a.mipLodBias == b.mipLodBias &&
+		a.anisotropyEnable == b.anisotropyEnable &&
+		a.maxAnisotropy == b.maxAnisotropy &&
+		a.compareEnable == b.compareEnable &&
+		a.compareOp == b.compareOp &&
+		a.minLod == b.minLod &&
+		a.maxLod == b.maxLod &&
+		a.borderColor == b.borderColor &&
+		a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+VkSampler SamplerCache::Get(const VkSamplerCreateInfo& info)
+{
+	std::vector<Entry>& list = samplers[Hash(info)];
+
+	for (size_t i = 0; i < list.size(); i++)
+		if (Equal(list[i].info, info))
+			return list[i].sampler;
+
+	// not in the cache yet, so make it
+	Entry entry;
+	entry.info = info;
+	vkCreateSampler(device, &info, NULL, &entry.sampler);
+	FrameCapture::TrackSampler(entry.sampler, info);
+
+	list.push_back(entry);
+	return entry.sampler;
+}
+
+uint32_t SamplerCache::Count() const
+{
+	uint32_t count = 0;
+
+	for (auto it = samplers.begin(); it != samplers.end(); ++it)
+		count += (uint32_t)it->second.size();
+
+	return count;
+}
@@ -0,0 +1,69 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <unordered_map>
+#include <vector>
+
+// Most textures are sampled the same way (linear filtering,
+// repeat, every mip level), and a GPU only allows a limited number
+// of samplers (maxSamplerAllocationCount), so textures should share
+// samplers instead of making their own. Get() gives back the same
+// VkSampler every time it is called with the same settings.
+// Samplers are owned by the cache, and destroyed with it.
+// Only use it from one thread, like the rest of the render loop
+class SamplerCache
+{
+private:
+	struct Entry
+	{
+		VkSamplerCreateInfo info;
+		VkSampler sampler;
+	};
+
+	VkDevice device;
+
+	// Several create infos can have the same hash,
+	// so each hash has a list, which is almost
+	// always one sampler long
+	std::unordered_map<uint64_t, std::vector<Entry>> samplers;
+
+	static uint64_t Hash(const VkSamplerCreateInfo& info);
+	static bool Equal(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b);
+
+public:
+	SamplerCache(VkDevice d);
+	~SamplerCache();
+
+	// pNext is compared by pointer, so samplers with an
+	// extension struct are only shared when they use the
+	// exact same struct
+	VkSampler Get(const VkSamplerCreateInfo& info);
+
+	// number of different samplers that were made
+	uint32_t Count() const;
+};
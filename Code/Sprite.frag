@@ -0,0 +1,49 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#version 450
+
+// compileShaders.cmd builds this file twice, just like
+// Square.frag, with and without BINDLESS
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+#else
+layout (set = 1, binding = 0) uniform sampler2D textures[1];
+#endif
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 inColor;
+layout (location = 2) flat in uint inTexture;
+layout (location = 0) out vec4 outColor;
+
+void main() 
+{
+#ifdef BINDLESS
+	outColor = inColor * texture(textures[nonuniformEXT(inTexture)], inUV);
+#else
+	outColor = inColor * texture(textures[0], inUV);
+#endif
+}
\ No newline at end of file
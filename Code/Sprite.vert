@@ -0,0 +1,59 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#version 450
+
+// one corner of a sprite, see SpriteVertex in SpriteBatch.h
+layout (location = 0) in vec2 inPos;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec4 inColor;
+layout (location = 3) in uint inTexture;
+
+// Sprite positions are in pixels. This turns them into
+// -1 to 1, where (-1, -1) is the top-left of the window
+layout (push_constant) uniform pushConstants {
+    vec2 scale;
+    vec2 offset;
+} screen;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
+layout (location = 2) flat out uint outTexture;
+
+void main() 
+{
+	// The texture is in the low 24 bits, and the layer is in the
+	// high 8 bits (SPRITE_LAYER_SHIFT). Each layer gets its own
+	// depth, higher layers are closer (smaller depth), so that
+	// the depth test keeps them in front. Without a depth
+	// attachment, the depth is not used
+	uint layer = inTexture >> 24;
+	float depth = (256.0 - float(layer)) / 257.0;
+
+	outUV = inUV;
+	outColor = inColor;
+	outTexture = inTexture & 0xFFFFFFu;
+	gl_Position = vec4(inPos * screen.scale + screen.offset, depth, 1);
+}
\ No newline at end of file
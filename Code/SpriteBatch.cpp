@@ -0,0 +1,404 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "SpriteBatch.h"
+#include "FrameCapture.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+// SSE2 is on every x64 CPU
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SPRITE_BATCH_STREAM_STORES
+#endif
+
+SpriteBatch::SpriteBatch(
+	VkDevice d,
+	VkPhysicalDeviceMemoryProperties memory_properties,
+	bool useBindless,
+	uint32_t maxSpritesPerFrame,
+	uint32_t framesInFlight)
+{
+	bindless = useBindless;
+	maxSprites = maxSpritesPerFrame;
+	frameCount = framesInFlight;
+	frame = 0;
+	count = 0;
+	dropped = 0;
+
+	// These are allocated once, and never resized, so
+	// Submit() never allocates
+	keys.resize(maxSprites);
+	sortScratch.resize(maxSprites);
+	histogram.resize(2 * 65536);
+
+	// Both rings stay mapped, mapping and unmapping
+	// every frame would only waste time
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	info.size = (VkDeviceSize)frameCount * maxSprites * 4 * sizeof(SpriteVertex);
+
+	vertexRing = new BufferCPU(d, memory_properties, info);
+	vertices = (SpriteVertex*)vertexRing->Map();
+
+	// There can be more than 65536 vertices,
+	// so the indices are 32-bit
+	info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	info.size = (VkDeviceSize)frameCount * maxSprites * 6 * sizeof(uint32_t);
+
+	indexRing = new BufferCPU(d, memory_properties, info);
+	indices = (uint32_t*)indexRing->Map();
+}
+
+SpriteBatch::~SpriteBatch()
+{
+	vertexRing->Unmap();
+	indexRing->Unmap();
+	delete vertexRing;
+	delete indexRing;
+}
+
+void SpriteBatch::VertexInput(VkVertexInputBindingDescription* binding, VkVertexInputAttributeDescription attributes[4])
+{
+	binding->binding = 0;
+	binding->stride = sizeof(SpriteVertex);
+	binding->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	attributes[0].location = 0;
+	attributes[0].binding = 0;
+	attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[0].offset = offsetof(SpriteVertex, position);
+
+	attributes[1].location = 1;
+	attributes[1].binding = 0;
+	attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[1].offset = offsetof(SpriteVertex, uv);
+
+	// UNORM turns each byte into a float from 0 to 1
+	attributes[2].location = 2;
+	attributes[2].binding = 0;
+	attributes[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+	attributes[2].offset = offsetof(SpriteVertex, color);
+
+	attributes[3].location = 3;
+	attributes[3].binding = 0;
+	attributes[3].format = VK_FORMAT_R32_UINT;
+	attributes[3].offset = offsetof(SpriteVertex, texture);
+}
+
+uint32_t SpriteBatch::AddPipeline(VkPipeline pipeline, bool opaque)
+{
+	if (pipelines.size() == SPRITE_BATCH_MAX_PIPELINES)
+		return UINT32_MAX;
+
+	pipelines.push_back(pipeline);
+	opaquePipelines.push_back(opaque ? 1 : 0);
+	return (uint32_t)pipelines.size() - 1;
+}
+
+void SpriteBatch::Begin(uint32_t frameIndex)
+{
+	frame = frameIndex % frameCount;
+	count = 0;
+	dropped = 0;
+	batches.clear();
+}
+
+bool SpriteBatch::Submit(
+	glm::vec2 position,
+	float rotation,
+	glm::vec2 scale,
+	glm::vec4 uvRect,
+	uint32_t color,
+	uint32_t texture,
+	uint8_t layer,
+	uint32_t pipeline)
+{
+	if (count == maxSprites)
+	{
+		dropped++;
+		return false;
+	}
+
+	// 1 bit that is 0 for opaque sprites, 8 bits of layer, 7 bits
+	// of pipeline, 16 bits of texture. Sorting by this key puts
+	// opaque sprites first, then layers in order, and inside each
+	// layer, sprites that can share a draw are next to each other.
+	// Opaque sprites go front to back, so their layer is flipped
+	uint32_t pipelineBits = pipeline & (SPRITE_BATCH_MAX_PIPELINES - 1);
+	bool opaque = pipelineBits < opaquePipelines.size() && opaquePipelines[pipelineBits] != 0;
+	uint32_t order = opaque ? 255u - layer : 0x100u | layer;
+
+	uint64_t key =
+		((uint64_t)order << 23) |
+		((uint64_t)pipelineBits << 16) |
+		((uint64_t)(texture & 0xFFFF));
+
+	keys[count] = (key << 32) | count;
+
+	// Rotate the corners around the center. The corners go
+	// clockwise on the screen, starting at the top-left.
+	// Most sprites are not rotated, so we skip sin and cos
+	float c = 1.0f;
+	float s = 0.0f;
+
+	if (rotation != 0.0f)
+	{
+		c = cosf(rotation);
+		s = sinf(rotation);
+	}
+
+	// the shaders get the layer with the texture
+	texture = (texture & SPRITE_TEXTURE_MASK) | ((uint32_t)layer << SPRITE_LAYER_SHIFT);
+
+	float hx = scale.x * 0.5f;
+	float hy = scale.y * 0.5f;
+
+	// (hx, 0) and (0, hy) rotated
+	float ax = hx * c, ay = hx * s;
+	float bx = -hy * s, by = hy * c;
+
+	float x = position.x;
+	float y = position.y;
+
+	float x0 = x - ax - bx, y0 = y - ay - by;
+	float x1 = x + ax - bx, y1 = y + ay - by;
+	float x2 = x + ax + bx, y2 = y + ay + by;
+	float x3 = x - ax + bx, y3 = y - ay + by;
+
+	SpriteVertex* out = vertices + ((size_t)frame * maxSprites + count) * 4;
+
+#ifdef SPRITE_BATCH_STREAM_STORES
+	// The CPU never reads the ring, so we write around the cache.
+	// A normal store would first read the cache line from memory,
+	// and then push a line that the CPU will not use again out of
+	// the cache. The four vertices are 96 bytes, which is six
+	// 16-byte stores, and the mapped memory is aligned, so every
+	// store is aligned. The stores are built in registers, because
+	// writing the vertices to the stack first, and then reading
+	// them back 16 bytes at a time, is slower than the math
+	float colorBits, textureBits;
+	memcpy(&colorBits, &color, 4);
+	memcpy(&textureBits, &texture, 4);
+
+	float* dst = (float*)out;
+	_mm_stream_ps(dst + 0, _mm_setr_ps(x0, y0, uvRect.x, uvRect.y));
+	_mm_stream_ps(dst + 4, _mm_setr_ps(colorBits, textureBits, x1, y1));
+	_mm_stream_ps(dst + 8, _mm_setr_ps(uvRect.z, uvRect.y, colorBits, textureBits));
+	_mm_stream_ps(dst + 12, _mm_setr_ps(x2, y2, uvRect.z, uvRect.w));
+	_mm_stream_ps(dst + 16, _mm_setr_ps(colorBits, textureBits, x3, y3));
+	_mm_stream_ps(dst + 20, _mm_setr_ps(uvRect.x, uvRect.w, colorBits, textureBits));
+#else
+	SpriteVertex v[4];
+
+	v[0].position[0] = x0;	v[0].position[1] = y0;
+	v[1].position[0] = x1;	v[1].position[1] = y1;
+	v[2].position[0] = x2;	v[2].position[1] = y2;
+	v[3].position[0] = x3;	v[3].position[1] = y3;
+
+	v[0].uv[0] = uvRect.x;	v[0].uv[1] = uvRect.y;
+	v[1].uv[0] = uvRect.z;	v[1].uv[1] = uvRect.y;
+	v[2].uv[0] = uvRect.z;	v[2].uv[1] = uvRect.w;
+	v[3].uv[0] = uvRect.x;	v[3].uv[1] = uvRect.w;
+
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		v[i].color = color;
+		v[i].texture = texture;
+	}
+
+	memcpy(out, v, sizeof(v));
+#endif
+
+	count++;
+	return true;
+}
+
+void SpriteBatch::Sort()
+{
+	// LSD radix sort, 16 bits of the key at a time, starting
+	// with the low half (texture), then the high half (opaque, layer and
+	// pipeline). Each pass is stable, so after the second pass,
+	// the keys are sorted by all 32 bits, and sprites with equal
+	// keys stay in the order they were submitted. The counts for
+	// both passes are made in one loop over the keys
+	uint32_t* low = histogram.data();
+	uint32_t* high = low + 65536;
+	memset(low, 0, histogram.size() * sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t key = (uint32_t)(keys[i] >> 32);
+		low[key & 0xFFFF]++;
+		high[key >> 16]++;
+	}
+
+	uint64_t* src = keys.data();
+	uint64_t* dst = sortScratch.data();
+
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		uint32_t shift = 32 + pass * 16;
+		uint32_t* counts = pass == 0 ? low : high;
+
+		// if every key has the same half here, this
+		// pass would not move anything, so skip it
+		if (counts[(src[0] >> shift) & 0xFFFF] == count)
+			continue;
+
+		// turn the counts into the index where each value
+		// starts, in place, the counts are not needed after
+		uint32_t sum = 0;
+
+		for (uint32_t b = 0; b < 65536; b++)
+		{
+			uint32_t n = counts[b];
+			counts[b] = sum;
+			sum += n;
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t k = src[i];
+			dst[counts[(k >> shift) & 0xFFFF]++] = k;
+		}
+
+		uint64_t* swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	// if only one pass ran, the sorted
+	// keys are in the scratch array
+	if (src != keys.data())
+		keys.swap(sortScratch);
+}
+
+void SpriteBatch::WriteIndices()
+{
+	uint32_t* out = indices + (size_t)frame * maxSprites * 6;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t key = (uint32_t)(keys[i] >> 32);
+		uint32_t sprite = (uint32_t)keys[i];
+
+		// Start a new batch if this sprite can not be in the
+		// same draw as the last one
+		uint32_t pipeline = (key >> 16) & (SPRITE_BATCH_MAX_PIPELINES - 1);
+		uint32_t texture = key & 0xFFFF;
+
+		if (batches.empty() ||
+			batches.back().pipeline != pipeline ||
+			(!bindless && batches.back().texture != texture))
+		{
+			Batch batch;
+			batch.pipeline = pipeline;
+			batch.texture = texture;
+			batch.first = i;
+			batch.count = 0;
+			batches.push_back(batch);
+		}
+
+		batches.back().count++;
+
+		// two triangles, made from the four corners
+		uint32_t v = sprite * 4;
+		int* dst = (int*)(out + (size_t)i * 6);
+
+#ifdef SPRITE_BATCH_STREAM_STORES
+		// 24 bytes is not a whole number of 16-byte stores,
+		// so these are 4-byte streaming stores, which still
+		// do not read the cache line first
+		_mm_stream_si32(dst + 0, (int)v);
+		_mm_stream_si32(dst + 1, (int)(v + 1));
+		_mm_stream_si32(dst + 2, (int)(v + 2));
+		_mm_stream_si32(dst + 3, (int)(v + 2));
+		_mm_stream_si32(dst + 4, (int)(v + 3));
+		_mm_stream_si32(dst + 5, (int)v);
+#else
+		uint32_t quad[6] = { v, v + 1, v + 2, v + 2, v + 3, v };
+		memcpy(dst, quad, sizeof(quad));
+#endif
+	}
+}
+
+void SpriteBatch::End()
+{
+	if (count == 0)
+		return;
+
+	Sort();
+	WriteIndices();
+
+#ifdef SPRITE_BATCH_STREAM_STORES
+	// streaming stores are not in order with other stores,
+	// this makes sure they are all in memory before the
+	// command buffer is submitted
+	_mm_sfence();
+#endif
+}
+
+void SpriteBatch::Record(VkCommandBuffer cmd, VkPipelineLayout layout, const TextureTable* table)
+{
+	if (batches.empty())
+		return;
+
+	// this frame's part of the ring
+	VkDeviceSize offset = (VkDeviceSize)frame * maxSprites * 4 * sizeof(SpriteVertex);
+	FrameCapture::CmdBindVertexBuffers(cmd, 0, 1, &vertexRing->buffer, &offset);
+
+	offset = (VkDeviceSize)frame * maxSprites * 6 * sizeof(uint32_t);
+	FrameCapture::CmdBindIndexBuffer(cmd, indexRing->buffer, offset, VK_INDEX_TYPE_UINT32);
+
+	VkPipeline bound = VK_NULL_HANDLE;
+
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		const Batch& batch = batches[i];
+
+		if (pipelines[batch.pipeline] != bound)
+		{
+			bound = pipelines[batch.pipeline];
+			FrameCapture::CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, bound);
+		}
+
+		if (!bindless)
+		{
+			VkDescriptorSet set = table->SetFor(batch.texture);
+			FrameCapture::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &set);
+		}
+
+		// the indices of the Nth sorted sprite start at N * 6
+		FrameCapture::CmdDrawIndexed(cmd, batch.count * 6, 1, batch.first * 6, 0, 0);
+	}
+}
+
+uint32_t SpriteBatch::DrawCount() const
+{
+	return (uint32_t)batches.size();
+}
@@ -0,0 +1,195 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "BufferCPU.h"
+#include "TextureTable.h"
+
+// the most pipelines that a SpriteBatch can sort by,
+// each one gets 7 bits of the sort key
+#define SPRITE_BATCH_MAX_PIPELINES 128
+
+// SpriteVertex::texture has the texture in the low 24 bits,
+// and the layer in the high 8 bits, see Sprite.vert
+#define SPRITE_TEXTURE_MASK 0xFFFFFF
+#define SPRITE_LAYER_SHIFT 24
+
+// One corner of a sprite, this is what Sprite.vert reads.
+// Positions are in pixels, (0, 0) is the top-left of the window
+struct SpriteVertex
+{
+	float position[2];
+	float uv[2];
+
+	// red, green, blue, alpha, 8 bits each,
+	// red in the lowest byte (R8G8B8A8_UNORM)
+	uint32_t color;
+
+	// index in the TextureTable (SPRITE_TEXTURE_MASK), and
+	// the layer above it, which Sprite.vert turns into depth
+	uint32_t texture;
+};
+
+// Draws 2D sprites that change every frame. Every frame, the program
+// calls Begin(), then Submit() once per sprite, in any order, then
+// End(), and then Record() inside the render pass.
+//
+// Submit() writes the four corners of the sprite (SpriteVertex)
+// straight into a mapped vertex buffer, in the order they come in,
+// and saves a 32-bit key: opaque or not, then layer, then pipeline,
+// then texture.
+// End() sorts the keys with a radix sort, which is two passes over
+// the keys no matter how many sprites there are, and it skips a pass
+// if every key has the same half there (one layer and one pipeline,
+// or one texture). Then it writes the indices of each sprite in
+// sorted order, and splits the sprites into batches. The vertices
+// themselves never move, so End() never reads them back.
+//
+// A new batch starts when the pipeline changes. Without bindless
+// textures, it also starts when the texture changes, because each
+// texture has its own descriptor set. Record() draws each batch
+// with one vkCmdDrawIndexed.
+//
+// A pipeline can be added as opaque (AddPipeline), which means that
+// it writes depth, and does not blend. Sprites with an opaque pipeline
+// are all drawn before any other sprite, from the top layer down to
+// the bottom one (front to back). Each layer has its own depth (see
+// Sprite.vert), so when an opaque sprite covers a pixel, the GPU tests
+// the depth of every sprite under it before its fragment shader runs
+// (early-Z), and skips it. The other sprites are drawn after that,
+// from the bottom layer up (back to front), and they are blended over
+// what is behind them, but they are still skipped where an opaque
+// sprite is in front. Inside one layer, the order is not defined, the
+// same as without depth.
+//
+// The vertex and index buffers are rings with one part per frame in
+// flight, so the CPU can write the next frame while the GPU reads the
+// last one. Begin() must not be called for a frame until the GPU is
+// done with the last command buffer that used that frame (wait for
+// its fence)
+class SpriteBatch
+{
+private:
+	struct Batch
+	{
+		uint32_t pipeline;
+		uint32_t texture;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// one per pipeline, 1 if it was added as opaque
+	std::vector<uint8_t> opaquePipelines;
+
+	bool bindless;
+	uint32_t frameCount;
+	uint32_t frame;
+
+	// big buffers with frameCount parts each, they are
+	// mapped until the SpriteBatch is deleted.
+	// 4 vertices and 6 indices per sprite
+	BufferCPU* vertexRing;
+	BufferCPU* indexRing;
+	SpriteVertex* vertices;
+	uint32_t* indices;
+
+	// the high 32 bits of each key are the sort key, and
+	// the low 32 bits are the order the sprite came in
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> sortScratch;
+
+	// one count per value of a 16-bit half of the key
+	std::vector<uint32_t> histogram;
+
+	std::vector<Batch> batches;
+	std::vector<VkPipeline> pipelines;
+
+	void Sort();
+	void WriteIndices();
+
+public:
+	uint32_t maxSprites;
+
+	// sprites in the frame, after End()
+	uint32_t count;
+
+	// Submit() calls that did not fit
+	uint32_t dropped;
+
+	SpriteBatch(
+		VkDevice d,
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		bool useBindless,
+		uint32_t maxSpritesPerFrame,
+		uint32_t framesInFlight);
+
+	~SpriteBatch();
+
+	// What a pipeline needs in its VkPipelineVertexInputStateCreateInfo
+	// to read SpriteVertex, at binding 0, locations 0 to 3
+	static void VertexInput(VkVertexInputBindingDescription* binding, VkVertexInputAttributeDescription attributes[4]);
+
+	// returns the number to give to Submit() for this pipeline.
+	// An opaque pipeline has to test and write depth, and the
+	// render pass needs a depth attachment
+	uint32_t AddPipeline(VkPipeline pipeline, bool opaque = false);
+
+	void Begin(uint32_t frameIndex);
+
+	// position is the center of the sprite, scale is its width and height
+	// in pixels, rotation is in radians, uvRect is (u0, v0, u1, v1).
+	// Lower layers are drawn first (or behind, when opaque). Textures
+	// past 65535 still draw, but without bindless, they have to be
+	// below 65536, because only 16 bits of the texture fit in the key,
+	// and no texture can be past SPRITE_TEXTURE_MASK. Returns false if
+	// the frame is full
+	bool Submit(
+		glm::vec2 position,
+		float rotation,
+		glm::vec2 scale,
+		glm::vec4 uvRect,
+		uint32_t color,
+		uint32_t texture,
+		uint8_t layer,
+		uint32_t pipeline = 0);
+
+	void End();
+
+	// Binds the vertex and index buffers, and draws every batch.
+	// In bindless mode, the texture table's set has to be bound at
+	// set 1 already, otherwise this binds one set per batch
+	void Record(VkCommandBuffer cmd, VkPipelineLayout layout, const TextureTable* table);
+
+	// number of vkCmdDrawIndexed calls that Record() makes
+	uint32_t DrawCount() const;
+};
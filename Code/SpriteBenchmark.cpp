@@ -0,0 +1,204 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+// SpriteBenchmark is a small console program that measures how long
+// SpriteBatch takes on the CPU to take in 500,000 sprites and get them
+// ready to draw (Begin, Submit, End), which is all of the CPU work of
+// a sprite frame except vkCmdDrawIndexed. It does not need a window:
+// it makes a Vulkan device only so that the sprite batch has real
+// mapped memory to write into, which matters, because writing into
+// mapped memory is slower than writing into normal memory.
+//
+// To hit 60 frames per second, a whole frame has 16.6 milliseconds,
+// so this prints PASS if 99% of frames are faster than that
+
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "SpriteBatch.h"
+
+#define BENCHMARK_SPRITES 500000
+#define BENCHMARK_WARMUP_FRAMES 10
+#define BENCHMARK_FRAMES 120
+#define BENCHMARK_FRAMES_IN_FLIGHT 2
+#define BENCHMARK_TEXTURES 64
+#define BENCHMARK_LAYERS 4
+#define BENCHMARK_BUDGET_MS 16.6
+
+// same as ERR_EXIT, but for a console program
+#define BENCHMARK_FAIL(msg)   \
+	do {                      \
+		printf("%s\n", msg);  \
+		fflush(stdout);       \
+		exit(1);              \
+	} while (0)
+
+int main(int argc, char** argv)
+{
+	// How many sprites, this can be changed
+	// from the command line: SpriteBenchmark.exe 100000
+	uint32_t spriteCount = BENCHMARK_SPRITES;
+	if (argc > 1)
+		spriteCount = (uint32_t)atoi(argv[1]);
+
+	// Make a Vulkan instance with no extensions, because
+	// we do not need a window or a swapchain
+	VkApplicationInfo app = {};
+	app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app.pApplicationName = "SpriteBenchmark";
+	app.pEngineName = "SpriteBenchmark";
+	app.apiVersion = VK_API_VERSION_1_0;
+
+	VkInstanceCreateInfo instInfo = {};
+	instInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instInfo.pApplicationInfo = &app;
+
+	VkInstance inst;
+	if (vkCreateInstance(&instInfo, NULL, &inst) != VK_SUCCESS)
+		BENCHMARK_FAIL("Could not create a Vulkan instance");
+
+	// Use the first GPU
+	uint32_t gpuCount = 1;
+	VkPhysicalDevice gpu;
+	vkEnumeratePhysicalDevices(inst, &gpuCount, &gpu);
+	if (gpuCount == 0)
+		BENCHMARK_FAIL("No GPU with Vulkan support");
+
+	VkPhysicalDeviceProperties gpuProps;
+	vkGetPhysicalDeviceProperties(gpu, &gpuProps);
+
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+
+	// A device needs at least one queue, queue family 0
+	// is fine, because we never submit anything
+	float priority = 0.0f;
+	VkDeviceQueueCreateInfo queueInfo = {};
+	queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo.queueFamilyIndex = 0;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &priority;
+
+	VkDeviceCreateInfo deviceInfo = {};
+	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+
+	VkDevice device;
+	if (vkCreateDevice(gpu, &deviceInfo, NULL, &device) != VK_SUCCESS)
+		BENCHMARK_FAIL("Could not create a Vulkan device");
+
+	printf("GPU: %s\n", gpuProps.deviceName);
+	printf("Sprites per frame: %u\n", spriteCount);
+
+	// We measure both ways that Demo can run: with bindless
+	// textures, where only a pipeline change starts a new draw,
+	// and without, where every texture change does
+	for (int mode = 0; mode < 2; mode++)
+	{
+		bool bindless = (mode == 1);
+
+		SpriteBatch* batch = new SpriteBatch(device, memory_properties, bindless, spriteCount, BENCHMARK_FRAMES_IN_FLIGHT);
+
+		// Two pipelines, like an opaque one and a blended one,
+		// the handles are never used, so they can be anything
+		uint32_t pipelineA = batch->AddPipeline(VK_NULL_HANDLE);
+		uint32_t pipelineB = batch->AddPipeline(VK_NULL_HANDLE);
+
+		std::vector<double> times;
+		uint32_t draws = 0;
+
+		for (uint32_t f = 0; f < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; f++)
+		{
+			float time = f / 60.0f;
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			batch->Begin(f % BENCHMARK_FRAMES_IN_FLIGHT);
+
+			// Sprites come in a mixed-up order, like a game that
+			// submits them object by object, so the sort has
+			// real work to do. Every sprite spins, so that we
+			// measure the slow path of Submit, with sin and cos
+			for (uint32_t i = 0; i < spriteCount; i++)
+			{
+				glm::vec2 position((float)(i % 1000) * 2.0f, (float)(i / 1000) * 2.0f);
+
+				batch->Submit(
+					position,
+					time + i * 0.01f,
+					glm::vec2(8.0f, 8.0f),
+					glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+					0xFFFFFFFF,
+					(i * 7) % BENCHMARK_TEXTURES,
+					(uint8_t)(i % BENCHMARK_LAYERS),
+					(i & 8) ? pipelineB : pipelineA);
+			}
+
+			batch->End();
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			if (f >= BENCHMARK_WARMUP_FRAMES)
+				times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+			draws = batch->DrawCount();
+		}
+
+		// sort the frame times, so we can find percentiles
+		std::sort(times.begin(), times.end());
+
+		double total = 0;
+		for (size_t i = 0; i < times.size(); i++)
+			total += times[i];
+
+		double avg = total / times.size();
+		double p50 = times[times.size() / 2];
+		double p99 = times[std::min(times.size() - 1, (size_t)ceil(times.size() * 0.99) - 1)];
+		double max = times.back();
+
+		printf("\n%s textures\n", bindless ? "Bindless" : "Classic");
+		printf("  avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", avg, p50, p99, max);
+		printf("  %.1f million sprites per second\n", spriteCount / (avg * 1000.0));
+		printf("  %u draws per frame, %u sprites dropped\n", draws, batch->dropped);
+		printf("  %s (p99 %s %.1f ms)\n",
+			p99 < BENCHMARK_BUDGET_MS ? "PASS" : "FAIL",
+			p99 < BENCHMARK_BUDGET_MS ? "under" : "over",
+			BENCHMARK_BUDGET_MS);
+
+		delete batch;
+	}
+
+	fflush(stdout);
+
+	vkDestroyDevice(device, NULL);
+	vkDestroyInstance(inst, NULL);
+	return 0;
+}
@@ -22,12 +22,32 @@ graphics, he is working on a Wii U emulator
 that utilizes Vulkan, see more at http://cemu.info
 */
 
+
 #version 450
 
-layout (location = 0) in vec2 inColor;
+// compileShaders.cmd builds this file twice. With BINDLESS,
+// every texture is in one array, and each Square picks its own
+// with the index from the instance buffer. Without it, the
+// array only has one texture, and a different descriptor set
+// is bound for each Square (see TextureTable.h)
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+#else
+layout (set = 1, binding = 0) uniform sampler2D textures[1];
+#endif
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) flat in uint inTexture;
 layout (location = 0) out vec4 outColor;
 
 void main() 
 {
-   outColor = vec4(inColor, 0, 0);
+#ifdef BINDLESS
+	// nonuniformEXT tells the GPU that pixels in the
+	// same draw can use different textures
+	outColor = texture(textures[nonuniformEXT(inTexture)], inUV);
+#else
+	outColor = texture(textures[0], inUV);
+#endif
 }
\ No newline at end of file
@@ -22,19 +22,29 @@ graphics, he is working on a Wii U emulator
 that utilizes Vulkan, see more at http://cemu.info
 */
 
+
 #version 450
 
 layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec2 inColor;
+layout (location = 1) in vec2 inUV;
+
+// these come from the instance buffer, they
+// change once per Square, not once per vertex
+layout (location = 2) in vec3 inOffsetScale;
+layout (location = 3) in uint inTexture;
 
 layout (std140, binding = 0) uniform bufferVals {
     mat4 mvp;
 } myBufferVals;
 
-layout (location = 0) out vec2 outColor;
+layout (location = 0) out vec2 outUV;
+layout (location = 1) flat out uint outTexture;
 
 void main() 
 {	
-	outColor = inColor;
-	gl_Position = myBufferVals.mvp * vec4(inPos, 1);
+	outUV = inUV;
+	outTexture = inTexture;
+
+	vec3 pos = vec3(inPos.xy * inOffsetScale.z + inOffsetScale.xy, inPos.z);
+	gl_Position = myBufferVals.mvp * vec4(pos, 1);
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#include "Texture.h"
+#include "Helper.h"
+#include "FrameCapture.h"
+
+Texture::Texture(
+	VkDevice d,
+	VkPhysicalDeviceMemoryProperties memory_properties,
+	uint32_t w,
+	uint32_t h,
+	uint32_t mips,
+	VkFormat f,
+	VkImageUsageFlags usage)
+{
+	device = d;
+	width = w;
+	height = h;
+	mipLevels = mips;
+	format = f;
+
+	// The image starts in an UNDEFINED layout, the
+	// loader will move it to TRANSFER_DST, copy the
+	// pixels in, and then move it to SHADER_READ_ONLY
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	vkCreateImage(device, &imageInfo, NULL, &image);
+	FrameCapture::TrackImage(image, imageInfo);
+
+	// This is the same as BufferCPU, except that we
+	// want DEVICE_LOCAL memory (the GPU's own memory),
+	// instead of HOST_VISIBLE memory
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(device, image, &mem_reqs);
+
+	VkMemoryAllocateInfo memAllocInfo = {};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.allocationSize = mem_reqs.size;
+
+	Helper::memory_type_from_properties(
+		memory_properties,
+		mem_reqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&memAllocInfo.memoryTypeIndex);
+
+	vkAllocateMemory(device, &memAllocInfo, NULL, &memory);
+	vkBindImageMemory(device, image, memory, 0);
+
+	// The view covers every mip level, so
+	// that the shader can sample all of them
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+	viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+	viewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+	viewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	vkCreateImageView(device, &viewInfo, NULL, &view);
+	FrameCapture::TrackImageView(view, viewInfo);
+}
+
+Texture::~Texture()
+{
+	vkDestroyImageView(device, view, NULL);
+	vkDestroyImage(device, image, NULL);
+	vkFreeMemory(device, memory, NULL);
+}
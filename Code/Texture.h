@@ -0,0 +1,60 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+
+// A Texture is an image that lives in the GPU's own memory
+// (DEVICE_LOCAL), with OPTIMAL tiling, which means the GPU
+// arranges the pixels however it wants for fast sampling.
+// The CPU can not write into it directly, so pixels are put
+// into a BufferCPU first (a "staging" buffer), and then
+// copied into the image with a command buffer.
+// See TextureLoader.cpp for how that is done
+class Texture
+{
+private:
+	VkDevice device;
+	VkDeviceMemory memory;
+
+public:
+	VkImage image;
+	VkImageView view;
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+
+	Texture(
+		VkDevice d,
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		uint32_t w,
+		uint32_t h,
+		uint32_t mips,
+		VkFormat f,
+		VkImageUsageFlags usage);
+
+	~Texture();
+};
@@ -0,0 +1,223 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "TextureFile.h"
+#include "BlockCompression.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// round a number up to the next multiple of TEXTURE_FILE_ALIGNMENT
+static uint64_t align_up(uint64_t value)
+{
+	return (value + TEXTURE_FILE_ALIGNMENT - 1) & ~(uint64_t)(TEXTURE_FILE_ALIGNMENT - 1);
+}
+
+// bytes per pixel of the uncompressed formats that a texture
+// file can hold, 0 for every other format (block-compressed
+// formats are measured by BlockCompression::LevelSize)
+static uint32_t texel_size(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+// The header is copied straight into VkBufferImageCopy regions,
+// so a stale or broken file must not be able to describe a level
+// that is bigger than its bytes, or bigger than its mip level of
+// the image, or more mip levels than the image can have
+static bool levels_are_valid(const TextureFileLevel* levels, uint32_t mipLevels, uint64_t payloadSize,
+	VkFormat format, uint32_t width, uint32_t height)
+{
+	if (width == 0 || height == 0)
+		return false;
+
+	// a 1x1 image has one level, every level
+	// halves the biggest side, down to 1
+	uint32_t maxLevels = 1;
+	for (uint32_t side = width > height ? width : height; side > 1; side >>= 1)
+		maxLevels++;
+
+	if (mipLevels == 0 || mipLevels > TEXTURE_FILE_MAX_LEVELS || mipLevels > maxLevels)
+		return false;
+
+	// a format that we can not measure could have any size,
+	// so it can not be checked, and it is not loaded
+	uint32_t bytesPerTexel = texel_size(format);
+	const BlockFormat* block = BlockCompression::Find(format);
+
+	if (bytesPerTexel == 0 && block == nullptr)
+		return false;
+
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		uint32_t levelWidth = width >> i;
+		uint32_t levelHeight = height >> i;
+		if (levelWidth == 0) levelWidth = 1;
+		if (levelHeight == 0) levelHeight = 1;
+
+		if (levels[i].offset % TEXTURE_FILE_ALIGNMENT != 0 ||
+			levels[i].size == 0 ||
+			levels[i].offset > payloadSize ||
+			levels[i].size > payloadSize - levels[i].offset ||
+			levels[i].width != levelWidth ||
+			levels[i].height != levelHeight)
+			return false;
+
+		// every pixel (or block) of the level has to be in the file
+		uint64_t needed = block != nullptr ?
+			BlockCompression::LevelSize(block, levelWidth, levelHeight) :
+			(uint64_t)levelWidth * levelHeight * bytesPerTexel;
+
+		if (levels[i].size < needed)
+			return false;
+	}
+
+	return true;
+}
+
+TextureFile::TextureFile()
+{
+	header = nullptr;
+	payload = nullptr;
+	payloadSize = 0;
+}
+
+TextureFile::~TextureFile()
+{
+	Close();
+}
+
+bool TextureFile::Open(const char* path)
+{
+	Close();
+
+	// Same as MeshFile, the file is mapped instead of read,
+	// so the only copy is the one into the staging buffer
+	if (!view.Open(path, FILE_VIEW_HINT_SEQUENTIAL | FILE_VIEW_HINT_WILLNEED))
+		return false;
+
+	uint64_t fileSize = view.size;
+
+	if (fileSize < sizeof(TextureFileHeader))
+	{
+		Close();
+		return false;
+	}
+
+	header = (const TextureFileHeader*)view.data;
+
+	// A cache file that was only half written (the program
+	// closed while it was writing) fails the size checks,
+	// so it gets rebuilt instead of crashing us
+	bool valid =
+		header->magic == TEXTURE_FILE_MAGIC &&
+		header->version == TEXTURE_FILE_VERSION &&
+		header->headerSize == sizeof(TextureFileHeader) &&
+		header->payloadOffset % TEXTURE_FILE_ALIGNMENT == 0 &&
+		header->payloadOffset >= sizeof(TextureFileHeader) &&
+		header->payloadOffset <= fileSize &&
+		header->payloadSize <= fileSize - header->payloadOffset &&
+		levels_are_valid(header->levels, header->mipLevels, header->payloadSize,
+			(VkFormat)header->format, header->width, header->height);
+
+	if (!valid)
+	{
+		printf("%s is not a valid version %d texture file\n", path, TEXTURE_FILE_VERSION);
+		fflush(stdout);
+		Close();
+		return false;
+	}
+
+	payload = view.data + header->payloadOffset;
+	payloadSize = header->payloadSize;
+
+	return true;
+}
+
+void TextureFile::Close()
+{
+	view.Close();
+
+	header = nullptr;
+	payload = nullptr;
+	payloadSize = 0;
+}
+
+bool TextureFile::Write(
+	const char* path,
+	VkFormat format, uint32_t width, uint32_t height,
+	const TextureFileLevel* levels, uint32_t mipLevels,
+	const void* payload, uint64_t payloadSize,
+	uint64_t sourceHash, uint64_t sourceSize)
+{
+	if (!levels_are_valid(levels, mipLevels, payloadSize, format, width, height))
+		return false;
+
+	TextureFileHeader h = {};
+	h.magic = TEXTURE_FILE_MAGIC;
+	h.version = TEXTURE_FILE_VERSION;
+	h.headerSize = sizeof(TextureFileHeader);
+	h.format = format;
+	h.width = width;
+	h.height = height;
+	h.mipLevels = mipLevels;
+	h.sourceHash = sourceHash;
+	h.sourceSize = sourceSize;
+	memcpy(h.levels, levels, mipLevels * sizeof(TextureFileLevel));
+
+	h.payloadOffset = align_up(sizeof(TextureFileHeader));
+	h.payloadSize = payloadSize;
+
+	FILE* fp = fopen(path, "wb");
+	if (fp == nullptr)
+		return false;
+
+	// zeros between the header and the payload
+	const uint8_t padding[TEXTURE_FILE_ALIGNMENT] = {};
+
+	bool ok =
+		fwrite(&h, sizeof(h), 1, fp) == 1 &&
+		fwrite(padding, 1, (size_t)(h.payloadOffset - sizeof(h)), fp) == h.payloadOffset - sizeof(h) &&
+		fwrite(payload, 1, (size_t)payloadSize, fp) == payloadSize;
+
+	// fclose can fail too, if the last bytes
+	// could not be flushed to the disk
+	if (fclose(fp) != 0)
+		ok = false;
+
+	if (!ok)
+		remove(path);
+
+	return ok;
+}
@@ -0,0 +1,122 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include "FileView.h"
+
+// A .tex file holds a texture that is ready for the GPU, in the
+// same spirit as KTX2: a header that says the VkFormat and the
+// size, a table with one entry per mip level, and then every
+// mip level, already decoded, back-to-back. The payload can be
+// copied into a staging buffer with one memcpy, and each level
+// is copied into the image with one VkBufferImageCopy, so
+// loading a .tex file never decodes anything.
+// The TextureLoader writes these files the first time it loads
+// a PNG, and reads them every time after that (see TextureLoader.cpp)
+
+// "VKTX" when read as bytes
+#define TEXTURE_FILE_MAGIC 0x58544B56
+
+// Increase this every time the header changes,
+// old files will be rejected and rebuilt
+#define TEXTURE_FILE_VERSION 1
+
+// every mip level starts on a multiple of this many bytes,
+// which is more than vkCmdCopyBufferToImage needs
+#define TEXTURE_FILE_ALIGNMENT 16
+
+// enough for a 32768x32768 texture
+#define TEXTURE_FILE_MAX_LEVELS 16
+
+struct TextureFileLevel
+{
+	// from the start of the payload
+	uint64_t offset;
+	uint64_t size;
+
+	uint32_t width;
+	uint32_t height;
+};
+
+struct TextureFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+
+	uint32_t format;	// VkFormat
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+	uint32_t reserved;
+
+	// The file that this texture was made from, if there
+	// was one. A hash of its bytes, and how many bytes
+	// it had, so that the cache can tell if it changed
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+
+	TextureFileLevel levels[TEXTURE_FILE_MAX_LEVELS];
+
+	// from the start of the file
+	uint64_t payloadOffset;
+	uint64_t payloadSize;
+};
+
+class TextureFile
+{
+private:
+	FileView view;
+
+public:
+	// points into the mapped file, valid until Close()
+	const TextureFileHeader* header;
+
+	// every mip level, in one block
+	const uint8_t* payload;
+	uint64_t payloadSize;
+
+	TextureFile();
+	~TextureFile();
+
+	// Maps the file into memory (nothing is copied)
+	// and checks the header. Returns false if the
+	// file is missing, or if it is not a valid texture
+	bool Open(const char* path);
+	void Close();
+
+	// levels[i].offset must already be aligned to
+	// TEXTURE_FILE_ALIGNMENT, and every level must be
+	// inside of the payload
+	static bool Write(
+		const char* path,
+		VkFormat format, uint32_t width, uint32_t height,
+		const TextureFileLevel* levels, uint32_t mipLevels,
+		const void* payload, uint64_t payloadSize,
+		uint64_t sourceHash, uint64_t sourceSize);
+};
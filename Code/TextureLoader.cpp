@@ -0,0 +1,800 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#include "TextureLoader.h"
+#include "BlockCompression.h"
+#include "FileView.h"
+#include "Helper.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+
+// stb_image is compiled in Demo.cpp,
+// here we only need the declarations
+#include "stb_image.h"
+
+TextureLoader::TextureLoader(
+	VkDevice d,
+	VkPhysicalDevice physical_device,
+	VkPhysicalDeviceMemoryProperties mem_props,
+	VkQueue q,
+	uint32_t queue_family_index,
+	MipGenerator* mips,
+	uint32_t threadCount)
+{
+	device = d;
+	gpu = physical_device;
+	memory_properties = mem_props;
+	queue = q;
+	mip_generator = mips;
+	cacheWrites = 0;
+
+	// The loader has its own command pool, so that it never
+	// touches the pool that the render loop uses. Command
+	// buffers from this pool are short-lived, and they are
+	// only ever used on the render thread
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	cmd_pool_info.queueFamilyIndex = queue_family_index;
+	vkCreateCommandPool(device, &cmd_pool_info, NULL, &cmd_pool);
+
+	workers = new ThreadPool(threadCount);
+}
+
+TextureLoader::~TextureLoader()
+{
+	// Stop the workers first, so that nothing
+	// is added to "ready" while we clean up
+	delete workers;
+
+	// The GPU may still be copying, so this is
+	// the one place where the loader waits
+	for (size_t i = 0; i < inFlight.size(); i++)
+	{
+		vkWaitForFences(device, 1, &inFlight[i].fence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(device, inFlight[i].fence, NULL);
+		mip_generator->Release(&inFlight[i].scratch);
+	}
+	inFlight.clear();
+	ready.clear();
+
+	// these never reached their callbacks,
+	// so nobody else owns the textures
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		delete requests[i]->texture;
+		delete requests[i]->staging;
+		delete requests[i]->readback;
+		delete requests[i];
+	}
+	requests.clear();
+
+	// this also frees every command buffer from the pool
+	vkDestroyCommandPool(device, cmd_pool, NULL);
+}
+
+bool TextureLoader::EnableCache(const char* directory)
+{
+	if (!Helper::create_directory(directory))
+	{
+		printf("Could not create texture cache %s\n", directory);
+		fflush(stdout);
+		return false;
+	}
+
+	cacheDirectory = directory;
+	return true;
+}
+
+uint32_t TextureLoader::Pending() const
+{
+	return (uint32_t)requests.size();
+}
+
+void TextureLoader::Load(const char* path, TextureCallback callback)
+{
+	Request* request = new Request();
+	request->path = path;
+	request->callback = callback;
+	request->staging = nullptr;
+	request->stagingSize = 0;
+	request->format = VK_FORMAT_R8G8B8A8_UNORM;
+	request->width = 0;
+	request->height = 0;
+	request->mipLevels = 1;
+	request->sourceHash = 0;
+	request->sourceSize = 0;
+	request->complete = false;
+	request->texture = nullptr;
+	request->readback = nullptr;
+	request->readbackSize = 0;
+
+	requests.push_back(request);
+
+	workers->Enqueue([this, request]() { Decode(request); });
+}
+
+void TextureLoader::Decode(Request* request)
+{
+	PROFILE_FUNCTION();
+
+	// This runs on a worker thread. Creating buffers and
+	// allocating memory is allowed on any thread in Vulkan,
+	// as long as no two threads use the same buffer at once
+
+	// Map the PNG file, stb_image reads it straight out
+	// of the mapping, we never copy the compressed bytes
+	FileView file;
+
+	if (file.Open(request->path.c_str(), FILE_VIEW_HINT_SEQUENTIAL | FILE_VIEW_HINT_WILLNEED) &&
+		file.size >= sizeof(uint32_t) && *(const uint32_t*)file.data == TEXTURE_FILE_MAGIC)
+	{
+		// A .tex file is already decoded, so it does not
+		// go through stb_image, or through the cache
+		file.Close();
+		DecodeTextureFile(request);
+	}
+	else if (file.IsOpen() && file.size > 0 && file.size <= INT_MAX)
+	{
+		// The cache file is named after the bytes in the PNG,
+		// not after its path, so if the PNG is changed, the
+		// old cache file is never used again. Hashing the PNG
+		// is much faster than decoding it
+		if (!cacheDirectory.empty())
+		{
+			request->sourceHash = Helper::hash_bytes(file.data, (size_t)file.size);
+			request->sourceSize = file.size;
+
+			char name[32];
+			snprintf(name, sizeof(name), "/%016llx.tex", (unsigned long long)request->sourceHash);
+			request->cachePath = cacheDirectory + name;
+		}
+
+		if (!request->cachePath.empty() && DecodeFromCache(request))
+		{
+			// nothing else to do, the staging
+			// buffer already has every mip level
+		}
+		else
+		{
+			// we always ask for 4 channels (RGBA), because
+			// GPUs rarely support 3-channel images
+			int w = 0, h = 0, channels = 0;
+			stbi_uc* pixels = stbi_load_from_memory(file.data, (int)file.size, &w, &h, &channels, 4);
+
+			if (pixels != nullptr)
+			{
+				VkDeviceSize size = (VkDeviceSize)w * h * 4;
+
+				// The staging buffer is on the CPU side (HOST_VISIBLE),
+				// and the GPU copies from it (TRANSFER_SRC)
+				VkBufferCreateInfo info = {};
+				info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+				info.size = size;
+
+				// stb_image decodes into its own heap buffer (it can
+				// not decode into memory that we give it), so the
+				// pixels are copied once, into the staging buffer.
+				// That happens on this thread, so the render thread
+				// never touches a single pixel
+				request->staging = new BufferCPU(device, memory_properties, info);
+				request->staging->Store(pixels, size);
+				request->stagingSize = size;
+				request->width = (uint32_t)w;
+				request->height = (uint32_t)h;
+
+				// the pixels are tightly packed in the staging
+				// buffer, so bufferRowLength and bufferImageHeight
+				// are zero, which means "same as the image"
+				VkBufferImageCopy region = {};
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = 0;
+				region.imageSubresource.layerCount = 1;
+				region.imageExtent.width = request->width;
+				region.imageExtent.height = request->height;
+				region.imageExtent.depth = 1;
+				request->regions.push_back(region);
+
+				stbi_image_free(pixels);
+			}
+		}
+	}
+
+	// Whether it worked or not, hand it back to the
+	// render thread. staging == nullptr means it failed
+	std::lock_guard<std::mutex> lock(readyMutex);
+	ready.push_back(request);
+}
+
+bool TextureLoader::DecodeFromCache(Request* request)
+{
+	TextureFile cached;
+
+	if (!cached.Open(request->cachePath.c_str()))
+		return false;
+
+	const TextureFileHeader* header = cached.header;
+
+	// the file name is only part of the hash, so
+	// check that it really came from this PNG
+	if (header->sourceHash != request->sourceHash ||
+		header->sourceSize != request->sourceSize)
+		return false;
+
+	StageTextureFile(request, cached);
+	return true;
+}
+
+bool TextureLoader::FormatSupported(VkFormat format)
+{
+	// vkGetPhysicalDeviceFormatProperties can be called from any
+	// thread. If the GPU does not support a compressed format at
+	// all, none of the feature bits are set
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(gpu, format, &props);
+	return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+void TextureLoader::StageTextureFile(Request* request, const TextureFile& file)
+{
+	const TextureFileHeader* header = file.header;
+
+	// The payload already looks exactly like the staging
+	// buffer should look, every mip level is there, so
+	// this one memcpy is all the work we have to do
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	info.size = file.payloadSize;
+
+	request->staging = new BufferCPU(device, memory_properties, info);
+	request->staging->Store(file.payload, file.payloadSize);
+	request->stagingSize = file.payloadSize;
+	request->format = (VkFormat)header->format;
+	request->width = header->width;
+	request->height = header->height;
+	request->mipLevels = header->mipLevels;
+	request->complete = true;
+
+	// For block-compressed formats, the copy still gives the size
+	// in pixels, and Vulkan works out how many blocks that is
+	for (uint32_t i = 0; i < header->mipLevels; i++)
+	{
+		VkBufferImageCopy region = {};
+		region.bufferOffset = header->levels[i].offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = i;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent.width = header->levels[i].width;
+		region.imageExtent.height = header->levels[i].height;
+		region.imageExtent.depth = 1;
+		request->regions.push_back(region);
+	}
+}
+
+bool TextureLoader::DecodeTextureFile(Request* request)
+{
+	TextureFile file;
+
+	if (!file.Open(request->path.c_str()))
+		return false;
+
+	const TextureFileHeader* header = file.header;
+	VkFormat format = (VkFormat)header->format;
+	const BlockFormat* block = BlockCompression::Find(format);
+
+	// TextureFile::Open already checked, for every format, that
+	// each level has the extent of its mip level, and is as big
+	// as the format says it should be, so a broken file can not
+	// make us read past the end of a level while transcoding or
+	// copying, or write past the end of a mip level
+
+	// The best case: the GPU can sample this format, so the
+	// blocks go to the GPU exactly as they are in the file
+	if (block == nullptr || FormatSupported(format))
+	{
+		StageTextureFile(request, file);
+		return true;
+	}
+
+	return Transcode(request, file);
+}
+
+bool TextureLoader::Transcode(Request* request, const TextureFile& file)
+{
+	const TextureFileHeader* header = file.header;
+	const BlockFormat* block = BlockCompression::Find((VkFormat)header->format);
+
+	if (block->family == BLOCK_FAMILY_ASTC)
+	{
+		printf("%s is ASTC, which this GPU can not sample\n", request->path.c_str());
+		fflush(stdout);
+		return false;
+	}
+
+	// Decode every level to RGBA8 on this thread
+	uint32_t levelCount = header->mipLevels;
+	std::vector<std::vector<uint8_t>> pixels(levelCount);
+	bool opaque = true;
+
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		const TextureFileLevel& level = header->levels[i];
+		pixels[i].resize((size_t)level.width * level.height * 4);
+
+		BlockCompression::Decode(block, file.payload + level.offset,
+			level.width, level.height, pixels[i].data());
+
+		if (block->hasAlpha)
+			for (size_t p = 3; p < pixels[i].size() && opaque; p += 4)
+				opaque = pixels[i][p] == 255;
+	}
+
+	// Then pick what to give the GPU. BC1 and BC3 are supported by
+	// almost every desktop GPU, and they are 1/8 and 1/4 the size of
+	// RGBA8, so we would rather re-compress the pixels into one of
+	// those than make the texture four to eight times bigger.
+	// BC1 has no (smooth) alpha, so it is only used for opaque images
+	VkFormat target;
+	const BlockFormat* targetBlock;
+
+	if (opaque)
+		target = block->srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	else
+		target = block->srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+
+	targetBlock = BlockCompression::Find(target);
+
+	// RGBA8 is the last resort, every GPU can sample it
+	if (!FormatSupported(target))
+	{
+		target = block->srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+		targetBlock = nullptr;
+	}
+
+	// Lay the levels out like a .tex file does
+	std::vector<TextureFileLevel> levels(levelCount);
+	VkDeviceSize size = 0;
+
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		levels[i] = header->levels[i];
+		levels[i].offset = size;
+		levels[i].size = targetBlock != nullptr ?
+			BlockCompression::LevelSize(targetBlock, levels[i].width, levels[i].height) :
+			pixels[i].size();
+
+		size += (levels[i].size + TEXTURE_FILE_ALIGNMENT - 1) & ~(VkDeviceSize)(TEXTURE_FILE_ALIGNMENT - 1);
+	}
+
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	info.size = size;
+
+	request->staging = new BufferCPU(device, memory_properties, info);
+
+	// the encoders write straight into the staging buffer
+	uint8_t* staging = (uint8_t*)request->staging->Map();
+
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		uint8_t* dst = staging + levels[i].offset;
+
+		if (target == VK_FORMAT_BC1_RGB_UNORM_BLOCK || target == VK_FORMAT_BC1_RGB_SRGB_BLOCK)
+			BlockCompression::EncodeBC1(pixels[i].data(), levels[i].width, levels[i].height, dst);
+		else if (target == VK_FORMAT_BC3_UNORM_BLOCK || target == VK_FORMAT_BC3_SRGB_BLOCK)
+			BlockCompression::EncodeBC3(pixels[i].data(), levels[i].width, levels[i].height, dst);
+		else
+			memcpy(dst, pixels[i].data(), pixels[i].size());
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = levels[i].offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = i;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent.width = levels[i].width;
+		region.imageExtent.height = levels[i].height;
+		region.imageExtent.depth = 1;
+		request->regions.push_back(region);
+	}
+
+	request->staging->Unmap();
+	request->stagingSize = size;
+	request->format = target;
+	request->width = header->width;
+	request->height = header->height;
+	request->mipLevels = levelCount;
+	request->complete = true;
+
+	return true;
+}
+
+// Runs on a worker thread, after the GPU has copied every mip
+// level into the readback buffer. The file is written under a
+// temporary name first, and renamed when it is complete, so
+// that another copy of the program never sees half of a file
+static void write_cache_file(
+	std::shared_ptr<BufferCPU> readback,
+	std::string path, std::string tempPath,
+	VkFormat format, uint32_t width, uint32_t height,
+	std::vector<TextureFileLevel> levels, uint64_t size,
+	uint64_t sourceHash, uint64_t sourceSize)
+{
+	void* pixels = readback->Map();
+
+	bool ok = TextureFile::Write(tempPath.c_str(),
+		format, width, height,
+		levels.data(), (uint32_t)levels.size(),
+		pixels, size, sourceHash, sourceSize);
+
+	readback->Unmap();
+
+	// rename fails on Windows if the file is already there,
+	// which happens if the same PNG was loaded twice. The
+	// other file has the same pixels, so we can just drop ours
+	if (ok && rename(tempPath.c_str(), path.c_str()) != 0)
+		remove(tempPath.c_str());
+}
+
+void TextureLoader::Finish(Request* request)
+{
+	requests.erase(std::find(requests.begin(), requests.end(), request));
+
+	if (request->callback)
+		request->callback(request->path.c_str(), request->texture);
+	else
+		delete request->texture;
+
+	delete request->staging;
+
+	// Writing the cache file is slow (it goes to the disk),
+	// so it is given to a worker. The readback buffer is
+	// owned by a shared_ptr, so that it is freed when the
+	// job is done, or when the job is thrown away because
+	// the loader is being deleted
+	if (request->readback != nullptr)
+	{
+		std::shared_ptr<BufferCPU> readback(request->readback);
+		std::vector<TextureFileLevel> levels(request->readbackLevels,
+			request->readbackLevels + request->mipLevels);
+
+		std::string path = request->cachePath;
+		std::string tempPath = path + ".tmp" + std::to_string(cacheWrites++);
+		VkFormat format = request->format;
+		uint32_t width = request->width;
+		uint32_t height = request->height;
+		uint64_t size = request->readbackSize;
+		uint64_t sourceHash = request->sourceHash;
+		uint64_t sourceSize = request->sourceSize;
+
+		workers->Enqueue([=]()
+		{
+			write_cache_file(readback, path, tempPath, format, width, height,
+				levels, size, sourceHash, sourceSize);
+		});
+	}
+
+	delete request;
+}
+
+void TextureLoader::Update()
+{
+	PROFILE_FUNCTION();
+
+	// Part 1: Finish uploads that the GPU is done with
+	// =======================================
+
+	// vkGetFenceStatus does not wait, it just tells us
+	// if the fence is open (VK_SUCCESS) or not yet
+	for (size_t i = 0; i < inFlight.size();)
+	{
+		Upload& upload = inFlight[i];
+
+		if (vkGetFenceStatus(device, upload.fence) != VK_SUCCESS)
+		{
+			i++;
+			continue;
+		}
+
+		for (size_t j = 0; j < upload.requests.size(); j++)
+			Finish(upload.requests[j]);
+
+		vkDestroyFence(device, upload.fence, NULL);
+		vkFreeCommandBuffers(device, cmd_pool, 1, &upload.cmd);
+		mip_generator->Release(&upload.scratch);
+
+		inFlight.erase(inFlight.begin() + i);
+	}
+
+	// Part 2: Take textures that workers have decoded
+	// =======================================
+
+	std::vector<Request*> batch;
+	{
+		std::lock_guard<std::mutex> lock(readyMutex);
+
+		VkDeviceSize bytes = 0;
+		size_t taken = 0;
+
+		// always take at least one, so a texture that is
+		// larger than the budget can still be uploaded
+		while (taken < ready.size() && (taken == 0 || bytes < TEXTURE_UPLOAD_BUDGET))
+		{
+			Request* request = ready[taken++];
+			bytes += request->stagingSize;
+			batch.push_back(request);
+		}
+
+		ready.erase(ready.begin(), ready.begin() + taken);
+	}
+
+	// Textures that failed to decode go
+	// straight to their callback with nullptr
+	Upload upload = {};
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		if (batch[i]->staging == nullptr)
+			Finish(batch[i]);
+		else
+			upload.requests.push_back(batch[i]);
+	}
+
+	if (upload.requests.empty())
+		return;
+
+	// Part 3: Record the copies, all of them in one command buffer
+	// =======================================
+
+	VkCommandBufferAllocateInfo cmdInfo = {};
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdInfo.commandPool = cmd_pool;
+	cmdInfo.commandBufferCount = 1;
+	vkAllocateCommandBuffers(device, &cmdInfo, &upload.cmd);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(upload.cmd, &beginInfo);
+
+	// Before the copy, every image has to be moved from UNDEFINED
+	// (we do not care what is in it) to TRANSFER_DST_OPTIMAL
+	// (ready to be copied into). We put every image into one
+	// barrier, rather than one barrier per image, so the GPU
+	// only has to stop once
+	std::vector<VkImageMemoryBarrier> toTransfer(upload.requests.size());
+
+	for (size_t i = 0; i < upload.requests.size(); i++)
+	{
+		Request* request = upload.requests[i];
+
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+		// A texture from a .tex file or from the cache
+		// already has all of its mip levels. Otherwise, the MipGenerator makes as many
+		// levels as it can, and if there is a cache, the GPU
+		// copies them back out (TRANSFER_SRC) to be saved
+		if (!request->complete)
+		{
+			if (mip_generator->MethodFor(request->format) != MIP_METHOD_NONE)
+				request->mipLevels = MipGenerator::MipCount(request->width, request->height);
+
+			usage |= mip_generator->UsageFor(request->format);
+
+			if (!request->cachePath.empty())
+				usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+
+		request->texture = new Texture(device, memory_properties,
+			request->width, request->height, request->mipLevels, request->format, usage);
+
+		// every level goes to TRANSFER_DST, the smaller levels
+		// are written by the copy or by the MipGenerator
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = request->texture->image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = request->mipLevels;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		toTransfer[i] = barrier;
+	}
+
+	vkCmdPipelineBarrier(upload.cmd,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, NULL, 0, NULL, (uint32_t)toTransfer.size(), toTransfer.data());
+
+	// one region per mip level that is in the staging buffer,
+	// which is every level for a complete texture, or just mip 0
+	for (size_t i = 0; i < upload.requests.size(); i++)
+	{
+		Request* request = upload.requests[i];
+
+		vkCmdCopyBufferToImage(upload.cmd, request->staging->buffer, request->texture->image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			(uint32_t)request->regions.size(), request->regions.data());
+	}
+
+	// Complete textures are finished, they only have to move to
+	// SHADER_READ_ONLY_OPTIMAL, so that shaders can sample them
+	std::vector<VkImageMemoryBarrier> toShader;
+
+	for (size_t i = 0; i < upload.requests.size(); i++)
+	{
+		Request* request = upload.requests[i];
+
+		if (!request->complete)
+			continue;
+
+		VkImageMemoryBarrier barrier = toTransfer[i];
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		toShader.push_back(barrier);
+	}
+
+	if (!toShader.empty())
+	{
+		vkCmdPipelineBarrier(upload.cmd,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, NULL, 0, NULL, (uint32_t)toShader.size(), toShader.data());
+	}
+
+	// The others make their mip levels from mip 0, in the same
+	// command buffer. This also moves every level to
+	// SHADER_READ_ONLY_OPTIMAL. Then, if there is a cache, the
+	// levels are copied out, so that next time they can be
+	// loaded from the cache instead
+	for (size_t i = 0; i < upload.requests.size(); i++)
+	{
+		Request* request = upload.requests[i];
+
+		if (request->complete)
+			continue;
+
+		mip_generator->Record(upload.cmd, request->texture, &upload.scratch);
+
+		if (!request->cachePath.empty())
+			RecordReadback(upload.cmd, request);
+	}
+
+	vkEndCommandBuffer(upload.cmd);
+
+	// Part 4: Submit, with a fence that we check in Part 1 next time
+	// =======================================
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkCreateFence(device, &fenceInfo, NULL, &upload.fence);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &upload.cmd;
+	vkQueueSubmit(queue, 1, &submit_info, upload.fence);
+
+	inFlight.push_back(upload);
+}
+
+void TextureLoader::RecordReadback(VkCommandBuffer cmd, Request* request)
+{
+	Texture* texture = request->texture;
+
+	// Lay out the levels the same way that the .tex file
+	// does: back-to-back, each one starting on a multiple
+	// of TEXTURE_FILE_ALIGNMENT. Every texture that is not
+	// cached yet is RGBA8, 4 bytes per pixel
+	std::vector<VkBufferImageCopy> regions(texture->mipLevels);
+	VkDeviceSize size = 0;
+
+	for (uint32_t i = 0; i < texture->mipLevels; i++)
+	{
+		uint32_t w = texture->width >> i;
+		uint32_t h = texture->height >> i;
+		if (w == 0) w = 1;
+		if (h == 0) h = 1;
+
+		TextureFileLevel& level = request->readbackLevels[i];
+		level.offset = size;
+		level.size = (uint64_t)w * h * 4;
+		level.width = w;
+		level.height = h;
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = level.offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = i;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent.width = w;
+		region.imageExtent.height = h;
+		region.imageExtent.depth = 1;
+		regions[i] = region;
+
+		size += (level.size + TEXTURE_FILE_ALIGNMENT - 1) & ~(VkDeviceSize)(TEXTURE_FILE_ALIGNMENT - 1);
+	}
+
+	// the CPU reads this buffer, the GPU only writes to it
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	info.size = size;
+
+	request->readback = new BufferCPU(device, memory_properties, info);
+	request->readbackSize = size;
+
+	// The MipGenerator left every level in SHADER_READ_ONLY, after
+	// a barrier that waits for all of its writes, so we only need
+	// to wait for that barrier, and change the layout for the copy
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = texture->image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = texture->mipLevels;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, NULL, 0, NULL, 1, &barrier);
+
+	vkCmdCopyImageToBuffer(cmd, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		request->readback->buffer, (uint32_t)regions.size(), regions.data());
+
+	// the image goes back to SHADER_READ_ONLY, and the
+	// copy has to be visible to the CPU (HOST) when
+	// the fence opens
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkMemoryBarrier toHost = {};
+	toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &toHost, 0, NULL, 1, &barrier);
+}
@@ -0,0 +1,176 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#pragma once
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BufferCPU.h"
+#include "MipGenerator.h"
+#include "TextureFile.h"
+#include "Texture.h"
+#include "ThreadPool.h"
+
+// How many bytes of pixels Update() will copy to
+// the GPU per call. Anything more waits for the next
+// frame, so a big batch of textures can not make one
+// frame take much longer than the others
+#define TEXTURE_UPLOAD_BUDGET (32 * 1024 * 1024)
+
+// Called on the render thread when a texture is ready to use.
+// If the file could not be loaded, texture is nullptr.
+// The callback owns the texture, and must delete it
+typedef std::function<void(const char* path, Texture* texture)> TextureCallback;
+
+// Loads PNG files and .tex files (see TextureFile.h) in the
+// background. PNG files are decoded by stb_image on a pool of
+// worker threads. A .tex file can be block-compressed (BC1, BC3,
+// BC7, ETC2, ASTC), and if the GPU can not sample its format,
+// it is transcoded on a worker (see BlockCompression.h). The
+// pixels are written into staging buffers on those threads.
+// The render thread only records the copies into the GPU
+// images, and the commands that make their mip levels (see
+// MipGenerator). It checks fences to find out when the copies
+// are done, it never waits for a decode, a copy, or a fence
+class TextureLoader
+{
+private:
+	// one texture, from Load() to the callback
+	struct Request
+	{
+		std::string path;
+		TextureCallback callback;
+
+		// filled in by a worker thread. "regions" has one
+		// copy for each mip level that is in the staging buffer
+		BufferCPU* staging;
+		VkDeviceSize stagingSize;
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		std::vector<VkBufferImageCopy> regions;
+
+		// complete is true if the staging buffer already has
+		// every mip level, which is the case for .tex files and
+		// for the cache, so the MipGenerator is not needed
+		bool complete;
+
+		// The cache file for this texture, which is named
+		// after a hash of the PNG file
+		std::string cachePath;
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+
+		// filled in by Update(), on the render thread
+		Texture* texture;
+
+		// If the texture was not in the cache, the GPU copies
+		// every mip level into this buffer after making them,
+		// and Finish() writes the buffer into the cache file
+		BufferCPU* readback;
+		VkDeviceSize readbackSize;
+		TextureFileLevel readbackLevels[TEXTURE_FILE_MAX_LEVELS];
+	};
+
+	// one batch of copies that was submitted to the GPU
+	struct Upload
+	{
+		VkCommandBuffer cmd;
+		VkFence fence;
+		std::vector<Request*> requests;
+		MipScratch scratch;
+	};
+
+	VkDevice device;
+	VkPhysicalDevice gpu;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkQueue queue;
+	VkCommandPool cmd_pool;
+
+	ThreadPool* workers;
+	MipGenerator* mip_generator;
+
+	// decoded by workers, waiting for Update() to upload them.
+	// This is the only thing that workers and the render
+	// thread both touch, so it is the only thing with a lock
+	std::mutex readyMutex;
+	std::vector<Request*> ready;
+
+	// render thread only. "requests" holds every request
+	// that has not reached its callback, wherever it is,
+	// so that the destructor can free the ones that were
+	// still waiting in the thread pool
+	std::vector<Upload> inFlight;
+	std::vector<Request*> requests;
+	uint32_t cacheWrites;
+
+	// set once, before the first Load, and
+	// only read by the workers after that
+	std::string cacheDirectory;
+
+	void Decode(Request* request);
+	bool DecodeFromCache(Request* request);
+	bool DecodeTextureFile(Request* request);
+	bool Transcode(Request* request, const TextureFile& file);
+	void StageTextureFile(Request* request, const TextureFile& file);
+	bool FormatSupported(VkFormat format);
+	void RecordReadback(VkCommandBuffer cmd, Request* request);
+	void Finish(Request* request);
+
+public:
+	TextureLoader(
+		VkDevice d,
+		VkPhysicalDevice physical_device,
+		VkPhysicalDeviceMemoryProperties memory_properties,
+		VkQueue q,
+		uint32_t queue_family_index,
+		MipGenerator* mips,
+		uint32_t threadCount = 0);
+
+	~TextureLoader();
+
+	// Keep every texture that is loaded in "directory", already
+	// decoded, with all of its mip levels (see TextureFile.h).
+	// The next time the same PNG is loaded, even after the
+	// program restarts, it comes out of the cache, and
+	// stb_image and the MipGenerator are skipped.
+	// Call this before the first Load
+	bool EnableCache(const char* directory);
+
+	// Starts loading a texture, and returns right away.
+	// Call this from the render thread
+	void Load(const char* path, TextureCallback callback);
+
+	// Call this once per frame from the render thread.
+	// Uploads textures that finished decoding, and runs
+	// the callbacks of uploads that the GPU has finished
+	void Update();
+
+	// textures that were requested, and have
+	// not reached their callback yet
+	uint32_t Pending() const;
+};
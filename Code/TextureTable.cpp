@@ -0,0 +1,257 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#include "TextureTable.h"
+#include "FrameCapture.h"
+#include <string.h>
+
+bool TextureTable::Supported(VkPhysicalDevice gpu, VkPhysicalDeviceDescriptorIndexingFeaturesEXT* enable)
+{
+	// Descriptor indexing needs VK_KHR_maintenance3, which
+	// is part of Vulkan 1.1, so we do not ask GPUs that
+	// only have Vulkan 1.0
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu, &properties);
+
+	if (properties.apiVersion < VK_API_VERSION_1_1)
+		return false;
+
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(gpu, NULL, &extensionCount, NULL);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(gpu, NULL, &extensionCount, extensions.data());
+
+	bool found = false;
+	for (uint32_t i = 0; i < extensionCount; i++)
+		if (!strcmp(extensions[i].extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+			found = true;
+
+	if (!found)
+		return false;
+
+	// The extension is split into many small features, and
+	// a GPU can have the extension without having all of them.
+	// vkGetPhysicalDeviceFeatures2 fills in every structure
+	// that is in the pNext chain
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing = {};
+	indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &indexing;
+	vkGetPhysicalDeviceFeatures2(gpu, &features);
+
+	// runtimeDescriptorArray: the shader can declare textures[]
+	// without a size. PartiallyBound: empty slots are allowed.
+	// UpdateAfterBind: slots can be written while the set is in
+	// use. NonUniformIndexing: every pixel in one draw can pick
+	// a different texture, because each instance has its own
+	if (!indexing.runtimeDescriptorArray ||
+		!indexing.descriptorBindingPartiallyBound ||
+		!indexing.descriptorBindingSampledImageUpdateAfterBind ||
+		!indexing.shaderSampledImageArrayNonUniformIndexing)
+		return false;
+
+	// only turn on what we use
+	memset(enable, 0, sizeof(*enable));
+	enable->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	enable->runtimeDescriptorArray = VK_TRUE;
+	enable->descriptorBindingPartiallyBound = VK_TRUE;
+	enable->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	enable->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	return true;
+}
+
+TextureTable::TextureTable(VkDevice d, VkPhysicalDevice gpu, DescriptorAllocator* descriptors, bool useBindless,
+	uint32_t maxTextures)
+{
+	device = d;
+	allocator = descriptors;
+	pool = VK_NULL_HANDLE;
+	bindless = useBindless;
+	capacity = maxTextures;
+	count = 0;
+
+	if (bindless)
+	{
+		// Update-after-bind sets have their own limits, which
+		// are much higher than the normal ones on most GPUs.
+		// Each slot is a combined image sampler, so it counts
+		// as a sampled image, and as a sampler
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing = {};
+		indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexing;
+		vkGetPhysicalDeviceProperties2(gpu, &properties);
+
+		uint32_t limits[] = {
+			indexing.maxDescriptorSetUpdateAfterBindSampledImages,
+			indexing.maxDescriptorSetUpdateAfterBindSamplers,
+			indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			indexing.maxPerStageDescriptorUpdateAfterBindSamplers
+		};
+
+		for (uint32_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++)
+			if (limits[i] < capacity)
+				capacity = limits[i];
+	}
+
+	// Layout
+	//=====================================
+
+	// Binding 0 of set 1 is an array of textures. In bindless
+	// mode, the array holds the whole table, otherwise it
+	// holds one texture, and there is one set per texture
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = bindless ? capacity : 1;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorBindingFlagsEXT bindingFlags =
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+	flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flagsInfo.bindingCount = 1;
+	flagsInfo.pBindingFlags = &bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	if (bindless)
+	{
+		layoutInfo.pNext = &flagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	}
+
+	vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &layout);
+	FrameCapture::TrackSetLayout(layout, layoutInfo);
+
+	// Pool
+	//=====================================
+
+	// In bindless mode, the pool needs room for "capacity"
+	// textures in one set. A set with update-after-bind bindings
+	// can only come from a pool that was made with the same flag,
+	// so it can not come from the DescriptorAllocator. The one
+	// set is made right away, it starts empty, which is fine,
+	// because it is partially bound. Without bindless, the sets
+	// are made by Add
+	if (bindless)
+	{
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSize.descriptorCount = capacity;
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		vkCreateDescriptorPool(device, &poolInfo, NULL, &pool);
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet set;
+		vkAllocateDescriptorSets(device, &allocInfo, &set);
+		FrameCapture::TrackDescriptorSet(set, layout);
+		sets.push_back(set);
+	}
+}
+
+TextureTable::~TextureTable()
+{
+	// Destroying the pool frees every set in it. Without
+	// bindless, the pool is VK_NULL_HANDLE, which does
+	// nothing, and the allocator owns the sets
+	vkDestroyDescriptorPool(device, pool, NULL);
+	vkDestroyDescriptorSetLayout(device, layout, NULL);
+}
+
+uint32_t TextureTable::Add(Texture* texture, VkSampler sampler)
+{
+	if (count == capacity)
+		return UINT32_MAX;
+
+	// MipGenerator leaves every level of the
+	// texture in SHADER_READ_ONLY_OPTIMAL
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = texture->view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	// Without bindless, the set with this one texture comes from
+	// the cache, which allocates and writes it, the first time
+	// this texture and sampler are added
+	if (!bindless)
+	{
+		DescriptorBinding binding = DescriptorBinding::Image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			imageInfo.sampler, imageInfo.imageView, imageInfo.imageLayout);
+
+		VkDescriptorSet set = allocator->Cached(layout, &binding, 1);
+		if (set == VK_NULL_HANDLE)
+			return UINT32_MAX;
+
+		sets.push_back(set);
+		return count++;
+	}
+
+	uint32_t index = count++;
+
+	// In bindless mode, the texture goes into its own slot
+	// of the big array. Because of UPDATE_AFTER_BIND, this is
+	// allowed even if the set is bound in a command buffer that
+	// the GPU has not finished yet, as long as that command
+	// buffer does not use this slot
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = sets[0];
+	write.dstBinding = 0;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+
+	FrameCapture::UpdateDescriptorSets(device, 1, &write);
+	return index;
+}
+
+VkDescriptorSet TextureTable::SetFor(uint32_t index) const
+{
+	return bindless ? sets[0] : sets[index];
+}
@@ -0,0 +1,100 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_sdk_platform.h>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "Texture.h"
+
+// The most textures the table will ever hold. The GPU can
+// lower this, see maxDescriptorSetUpdateAfterBindSampledImages
+#define TEXTURE_TABLE_CAPACITY 4096
+
+// Holds every texture that the shaders can sample, at descriptor
+// set 1, binding 0, and gives each texture an index.
+//
+// In bindless mode (VK_EXT_descriptor_indexing), there is only one
+// descriptor set, with one big array of textures in it. The shader
+// picks a texture from the array with an index that comes with
+// each instance, so one vkCmdBindDescriptorSets is enough for the
+// whole frame, no matter how many textures are drawn. The array is
+// "partially bound", so the slots that nothing was put into yet
+// are allowed to be empty, and "update after bind", so a texture
+// can be added while command buffers that use the set are still
+// waiting to run.
+//
+// Without the extension, every texture gets its own descriptor set,
+// with an array that is one texture long, and that set has to be
+// bound before every draw that uses the texture. Those sets come
+// from the DescriptorAllocator's cache, so a texture that is added
+// twice with the same sampler shares one set
+class TextureTable
+{
+private:
+	VkDevice device;
+	DescriptorAllocator* allocator;
+
+	// bindless mode only, update-after-bind sets
+	// need a pool that was made for them
+	VkDescriptorPool pool;
+
+public:
+	bool bindless;
+	uint32_t capacity;
+	uint32_t count;
+
+	VkDescriptorSetLayout layout;
+
+	// in bindless mode, sets[0] holds every texture,
+	// otherwise there is one set for each texture
+	std::vector<VkDescriptorSet> sets;
+
+	// Checks if the GPU can do everything that bindless mode needs.
+	// If it can, "enable" is filled with the features to turn on,
+	// it should be put in the pNext chain of VkDeviceCreateInfo, and
+	// VK_EXT_descriptor_indexing has to be one of the device's
+	// extensions. The GPU has to support Vulkan 1.1, and so does
+	// the instance, because this uses vkGetPhysicalDeviceFeatures2
+	static bool Supported(VkPhysicalDevice gpu, VkPhysicalDeviceDescriptorIndexingFeaturesEXT* enable);
+
+	// "bindless" should only be true if Supported() returned true,
+	// and the device was made with those features turned on.
+	// Without bindless, the sets come from "descriptors", which
+	// has to live longer than the table
+	TextureTable(VkDevice d, VkPhysicalDevice gpu, DescriptorAllocator* descriptors, bool useBindless,
+		uint32_t maxTextures = TEXTURE_TABLE_CAPACITY);
+	~TextureTable();
+
+	// Puts a texture in the table, and returns its index, or
+	// UINT32_MAX if the table is full. The table does not own
+	// the texture, it has to stay alive as long as the table
+	uint32_t Add(Texture* texture, VkSampler sampler);
+
+	// the descriptor set that has the texture at "index"
+	VkDescriptorSet SetFor(uint32_t index) const;
+};
@@ -0,0 +1,98 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	stopping = false;
+
+	if (threadCount == 0)
+	{
+		// hardware_concurrency can return 0 if
+		// it does not know, so always keep one
+		uint32_t cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++)
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+
+	// wake up one sleeping thread to take the job
+	wake.notify_one();
+}
+
+uint32_t ThreadPool::ThreadCount() const
+{
+	return (uint32_t)workers.size();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	PROFILE_THREAD_NAME("ThreadPool worker");
+
+	while (true)
+	{
+		std::function<void()> job;
+
+		{
+			// sleep until there is a job, or until we are told to stop
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+			if (stopping)
+				return;
+
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		// run the job without holding the lock,
+		// so other threads can take jobs too
+		job();
+	}
+}
@@ -0,0 +1,62 @@
+/*
+Copyright 2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+<http://www.gnu.org/licenses/>.
+
+Special Thanks to Exzap from Team Cemu,
+he gave me advice on how to optimize Vulkan
+graphics, he is working on a Wii U emulator
+that utilizes Vulkan, see more at http://cemu.info
+*/
+
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A very small thread pool. A few threads are created when
+// the pool is created, and they sleep until a job is given
+// to them with Enqueue. Each job runs on whichever thread
+// is free first. Jobs must not touch the VkQueue or any
+// command buffer that the render loop is using
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void WorkerLoop();
+
+public:
+	// threadCount of 0 picks one thread per CPU core,
+	// minus one for the render loop
+	ThreadPool(uint32_t threadCount = 0);
+
+	// waits for the jobs that are running to finish,
+	// jobs that never started are thrown away
+	~ThreadPool();
+
+	void Enqueue(std::function<void()> job);
+
+	uint32_t ThreadCount() const;
+};
@@ -1,11 +1,27 @@
-..\Bin\glslangValidator.exe -V Square.vert -o Square.vert.spv
-..\Bin\glslangValidator.exe -V Square.frag -o Square.frag.spv
-..\Bin\spirv-opt --strip-debug Square.vert.spv -o Square2.vert.spv
-..\Bin\spirv-opt --strip-debug Square.frag.spv -o Square2.frag.spv
-bin2hex --i Square2.vert.spv --o Square.vert.inc
-bin2hex --i Square2.frag.spv --o Square.frag.inc
-del Square.vert.spv
-del Square.frag.spv
-del Square2.vert.spv
-del Square2.frag.spv
-pause
\ No newline at end of file
+@echo off
+rem Compiles every shader into ..\Assets\Shaders, where the programs
+rem load them from. vkcube and Benchmark run this before they build,
+rem with "nopause". glslangValidator comes from ..\Bin if it is there,
+rem and from the Vulkan SDK (VULKAN_SDK) if it is not
+setlocal
+cd /d "%~dp0"
+
+set GLSLANG=..\Bin\glslangValidator.exe
+if not exist "%GLSLANG%" set GLSLANG=%VULKAN_SDK%\Bin\glslangValidator.exe
+if not exist "%GLSLANG%" (
+	echo compileShaders.cmd: glslangValidator.exe is not in ..\Bin, install the Vulkan SDK or set VULKAN_SDK
+	exit /b 1
+)
+
+if not exist ..\Assets\Shaders mkdir ..\Assets\Shaders
+"%GLSLANG%" -V Square.vert -o ..\Assets\Shaders\Square.vert.spv || exit /b 1
+"%GLSLANG%" -V Square.frag -o ..\Assets\Shaders\Square.frag.spv || exit /b 1
+"%GLSLANG%" -V -DBINDLESS Square.frag -o ..\Assets\Shaders\SquareBindless.frag.spv || exit /b 1
+"%GLSLANG%" -V Sprite.vert -o ..\Assets\Shaders\Sprite.vert.spv || exit /b 1
+"%GLSLANG%" -V Sprite.frag -o ..\Assets\Shaders\Sprite.frag.spv || exit /b 1
+"%GLSLANG%" -V -DBINDLESS Sprite.frag -o ..\Assets\Shaders\SpriteBindless.frag.spv || exit /b 1
+"%GLSLANG%" -V Downsample.comp -o ..\Assets\Shaders\Downsample.comp.spv || exit /b 1
+"%GLSLANG%" -V Cull.comp -o ..\Assets\Shaders\Cull.comp.spv || exit /b 1
+"%GLSLANG%" -V RgbToYuv.comp -o ..\Assets\Shaders\RgbToYuv.comp.spv || exit /b 1
+
+if /i not "%1"=="nopause" pause